@@ -0,0 +1,1628 @@
+#include "json.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/**
+ * 性能测试
+ * 用法：./bench [测试名] [数据规模]
+ * 不带参数时依次运行所有测试
+ */
+
+/**
+ * @brief 获取单调时钟的当前时间，单位：秒
+ */
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/**
+ * @brief 获取当前线程占用的 CPU 时间，单位：秒
+ */
+static double thread_cpu(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * @brief 读取整个文件
+ * @param fname 文件名
+ * @param len 输出文件长度
+ * @return 堆分配的文件内容，失败返回 NULL
+ */
+static char *read_all(const char *fname, size_t *len)
+{
+    FILE *fp = fopen(fname, "rb");
+    char *buf;
+    long n;
+
+    if (!fp)
+    {
+        fprintf(stderr, "open file [%s] failed\n", fname);
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    n = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    buf = (char *)malloc(n + 1);
+    if (!buf || fread(buf, 1, n, fp) != (size_t)n)
+    {
+        fprintf(stderr, "read file [%s] failed\n", fname);
+        free(buf);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+    buf[n] = '\0';
+    *len = n;
+    return buf;
+}
+
+/**
+ * @brief 把 json-test.json 重复多次，拼成一个大小约为 mb 兆字节的 JSON 数组
+ * @param mb 目标大小
+ * @param len 输出文本长度
+ * @return 堆分配的 JSON 文本，失败返回 NULL
+ */
+static char *make_corpus(size_t mb, size_t *len)
+{
+    size_t unit_len, cap = mb << 20, n = 0;
+    char *unit = read_all("json-test.json", &unit_len);
+    char *buf;
+
+    if (!unit)
+        return NULL;
+    buf = (char *)malloc(cap + unit_len + 2);
+    if (!buf)
+    {
+        free(unit);
+        return NULL;
+    }
+    buf[n++] = '[';
+    while (n < cap)
+    {
+        if (n > 1)
+            buf[n++] = ',';
+        memcpy(buf + n, unit, unit_len);
+        n += unit_len;
+    }
+    buf[n++] = ']';
+    free(unit);
+    *len = n;
+    return buf;
+}
+
+/**
+ * @brief 测试 json_parse 的吞吐量，以及在同一个文档中反复“重置-解析”的吞吐量
+ * @details 第一阶段（json_scan）单独计时，与完整解析的差就是第二阶段构建树的耗时
+ * @param mb 输入文本的大小，单位：MB
+ */
+static int bench_parse(size_t mb)
+{
+    size_t len, structurals = 0;
+    char *text = make_corpus(mb, &len);
+    json_doc *doc = json_doc_new();
+    double scan = 0, heap = 0, arena = 0, heap_free = 0;
+
+    if (!text || !doc)
+    {
+        free(text);
+        json_doc_free(doc);
+        return -1;
+    }
+    for (int round = 0; round < 5; round++)
+    {
+        double start = now();
+        if (json_scan(text, len, &structurals) < 0)
+            goto failed_;
+        double cost = now() - start;
+        if (scan == 0 || cost < scan)
+            scan = cost;
+    }
+    for (int round = 0; round < 5; round++)
+    {
+        double start = now();
+        JSON *json = json_parse(text, len);
+        double cost = now() - start;
+        if (!json)
+            goto failed_;
+        start = now();
+        json_free(json);
+        double release = now() - start;
+        if (heap == 0 || cost < heap)
+        {
+            heap = cost;
+            heap_free = release;
+        }
+
+        json_doc_reset(doc);
+        start = now();
+        json = json_doc_parse(doc, text, len);
+        cost = now() - start;
+        if (!json)
+            goto failed_;
+        if (arena == 0 || cost < arena)
+            arena = cost;
+    }
+    printf("parse: %lu bytes, %lu structurals\n", (unsigned long)len, (unsigned long)structurals);
+    printf("  scan:  best %.3f s, %.1f MB/s (stage 1 only, json_scan)\n", scan, len / scan / (1 << 20));
+    printf("  tree:  %.3f s on top of the scan (heap json_parse - json_scan)\n", heap - scan);
+    printf("  heap:  best %.3f s, %.1f MB/s, json_free %.3f s\n", heap, len / heap / (1 << 20), heap_free);
+    printf("  arena: best %.3f s, %.1f MB/s (json_doc_reset + json_doc_parse)\n", arena, len / arena / (1 << 20));
+    free(text);
+    json_doc_free(doc);
+    return 0;
+
+failed_:
+    free(text);
+    json_doc_free(doc);
+    return -1;
+}
+
+/**
+ * @brief 测试大对象的构建和按键名查找
+ * @param n 对象的成员个数
+ */
+static int bench_object(size_t n)
+{
+    char key[32];
+    double sum = 0;
+    JSON *json = json_new(JSON_OBJ);
+    if (!json)
+        return -1;
+
+    double start = now();
+    for (size_t i = 0; i < n; i++)
+    {
+        sprintf(key, "member_%lu", (unsigned long)i);
+        if (!json_add_member(json, key, json_new_num(i)))
+        {
+            json_free(json);
+            return -1;
+        }
+    }
+    double build = now() - start;
+
+    start = now();
+    for (size_t i = 0; i < n; i++)
+    {
+        sprintf(key, "member_%lu", (unsigned long)(i * 7919 % n));
+        sum += json_obj_get_num(json, key, 0);
+    }
+    double lookup = now() - start;
+
+    printf("object: %lu members, build %.3f s (%.0f ns/member), lookup %.0f ns/key, checksum %.0f\n",
+           (unsigned long)n, build, build / n * 1e9, lookup / n * 1e9, sum);
+    json_free(json);
+    return 0;
+}
+
+/**
+ * @brief 测试节点反复创建和释放的开销：单个节点，以及运行时状态树中不断被替换的小对象
+ * @param n 循环次数
+ */
+static int bench_churn(size_t n)
+{
+    JSON *state = json_new(JSON_OBJ);
+    char key[32];
+    if (!state)
+        return -1;
+
+    double start = now();
+    for (size_t i = 0; i < n; i++)
+        json_free(json_new_num(i));
+    double scalar = now() - start;
+
+    // 1024 个会话，每次请求用新对象替换其中一个，旧对象随之释放
+    start = now();
+    for (size_t i = 0; i < n; i++)
+    {
+        JSON *session = json_new(JSON_OBJ);
+        JSON *tags = json_new(JSON_ARR);
+        if (!session || !tags || !json_add_member(session, "id", json_new_int(i)) ||
+            !json_add_member(session, "user", json_new_str("200.200.0.1")) ||
+            !json_add_member(session, "active", json_new_bool(TRUE)) || !json_add_element(tags, json_new_str("vip")) ||
+            !json_add_element(tags, json_new_str("cn")) || !json_add_member(session, "tags", tags))
+        {
+            json_free(session);
+            json_free(state);
+            return -1;
+        }
+        sprintf(key, "session_%lu", (unsigned long)(i % 1024));
+        if (!json_add_member(state, key, session))
+        {
+            json_free(state);
+            return -1;
+        }
+    }
+    double update = now() - start;
+
+    printf("churn: %lu rounds, json_new_num + json_free %.1f ns, replace a session (7 nodes) %.0f ns\n",
+           (unsigned long)n, scalar / n * 1e9, update / n * 1e9);
+    json_free(state);
+    return 0;
+}
+
+/**
+ * @brief 新建一条记录：{"id": i, "name": "...", "tags": ["vip", "cn"]}
+ */
+static JSON *make_record(size_t i)
+{
+    JSON *rec = json_new(JSON_OBJ);
+    JSON *tags = json_new(JSON_ARR);
+    if (!rec || !tags || !json_add_member(rec, "id", json_new_int(i)) ||
+        !json_add_member(rec, "name", json_new_str("record name longer than sso")) ||
+        !json_add_element(tags, json_new_str("vip")) || !json_add_element(tags, json_new_str("cn")) ||
+        !json_add_member(rec, "tags", tags))
+    {
+        json_free(rec);
+        json_free(tags);
+        return NULL;
+    }
+    return rec;
+}
+/**
+ * @brief 逐条读取记录的成员，返回读到的数值之和
+ */
+static long walk_records(const JSON *root)
+{
+    long sum = 0;
+    int n = json_arr_count(root);
+    for (int i = 0; i < n; i++)
+    {
+        const JSON *rec = json_get_element(root, i);
+        sum += json_obj_get_int(rec, "id", 0) + json_arr_count(json_get_member(rec, "tags"));
+        sum += strlen(json_obj_get_str(rec, "name", ""));
+    }
+    return sum;
+}
+/**
+ * @brief 测试 json_compact 前后的遍历和输出速度
+ * @param n 记录条数，构建时与另一棵树交替分配，之后释放另一棵树，使节点在堆中分散
+ */
+static int bench_compact(size_t n)
+{
+    JSON *root = json_new(JSON_ARR);
+    JSON *decoy = json_new(JSON_ARR);
+    if (!root || !decoy)
+        return -1;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (!json_add_element(root, make_record(i)) || !json_add_element(decoy, make_record(i)))
+        {
+            json_free(root);
+            json_free(decoy);
+            return -1;
+        }
+    }
+    json_free(decoy);
+
+    double start = now();
+    JSON *copy = json_compact(root);
+    double cost = now() - start;
+    if (!copy)
+    {
+        json_free(root);
+        return -1;
+    }
+    printf("compact: %lu records, %lu -> %lu bytes, json_compact %.3f s\n", (unsigned long)n,
+           (unsigned long)json_memory_usage(root), (unsigned long)json_memory_usage(copy), cost);
+
+    const JSON *trees[2] = {root, copy};
+    const char *names[2] = {"scattered", "compact"};
+    for (int t = 0; t < 2; t++)
+    {
+        double walk = 0, save = 0;
+        long sum = 0;
+        for (int round = 0; round < 3; round++)
+        {
+            start = now();
+            sum += walk_records(trees[t]);
+            cost = now() - start;
+            if (walk == 0 || cost < walk)
+                walk = cost;
+            start = now();
+            if (json_save(trees[t], "bench.yml") != 0)
+                sum = -1;
+            cost = now() - start;
+            if (save == 0 || cost < save)
+                save = cost;
+        }
+        printf("compact: %-9s walk %.1f ns/record, save %.3f s (%ld)\n", names[t], walk / n * 1e9, save, sum);
+    }
+    remove("bench.yml");
+    json_free(copy);
+    json_free(root);
+    return 0;
+}
+
+/**
+ * @brief 测试每次修改配置时整树复制与 json_snapshot 路径复制的开销
+ * @param n 记录条数，按每组 512 条分组，树的形状为 {"gN": [record, ...], ...}
+ */
+static int bench_cow(size_t n)
+{
+    enum { GROUP = 512, ROUNDS = 1000 };
+    JSON *root = json_new(JSON_OBJ);
+    JSON *group = NULL;
+    char expr[64];
+    if (!root)
+        return -1;
+    for (size_t i = 0; i < n; i++)
+    {
+        if (i % GROUP == 0)
+        {
+            snprintf(expr, sizeof(expr), "g%lu", (unsigned long)(i / GROUP));
+            group = json_add_member(root, expr, json_new(JSON_ARR));
+        }
+        if (!group || !json_add_element(group, make_record(i)))
+        {
+            json_free(root);
+            return -1;
+        }
+    }
+
+    // 整树复制：每次修改都得到一份独立的副本
+    JSON *version = json_compact(root);
+    double start = now();
+    for (int r = 0; r < ROUNDS / 100 && version; r++)
+    {
+        json_free(version);
+        version = json_compact(root);
+    }
+    double copy = (now() - start) / (ROUNDS / 100);
+    json_free(version);
+
+    // 路径复制：快照共享未修改的子树，修改只复制根到叶子的路径
+    version = json_snapshot(root);
+    int ret = version ? 0 : -1;
+    start = now();
+    for (int r = 0; r < ROUNDS && version; r++)
+    {
+        size_t i = (size_t)r * 7919 % n;
+        snprintf(expr, sizeof(expr), "g%lu[%lu].id", (unsigned long)(i / GROUP), (unsigned long)(i % GROUP));
+        json_path *path = json_path_compile(expr);
+        JSON *next = json_snapshot(version);
+        if (!path || !next || json_set_compiled(next, path, json_new_int(-r)) != 0)
+            ret = -1;
+        json_path_free(path);
+        json_free(version);
+        version = next;
+    }
+    double cow = (now() - start) / ROUNDS;
+    printf("cow: %lu records, %lu bytes, full copy %.3f ms/op, snapshot+set %.3f us/op\n",
+           (unsigned long)n, (unsigned long)json_memory_usage(root), copy * 1e3, cow * 1e6);
+    json_free(version);
+    json_free(root);
+    return ret;
+}
+
+typedef struct publish_ctx
+{
+    json_slot *slot;       // use_rcu 时读者从这里取当前版本
+    pthread_rwlock_t lock; // 否则用读写锁保护 cur
+    JSON *cur;
+    int use_rcu;
+    int stop; // 读者都结束后通知发布线程退出
+    size_t reloads;
+} publish_ctx;
+
+typedef struct publish_worker
+{
+    publish_ctx *ctx;
+    size_t reads;
+    unsigned seed;
+    double cost;  // 全部读取占用的 CPU 时间
+    double worst; // 最慢的一批读取的平均耗时，按墙上时间计，包括等锁和被调度出去的时间
+    long sum;
+} publish_worker;
+
+enum { PUBLISH_KEYS = 1024, PUBLISH_BATCH = 64, PUBLISH_READERS = 4 };
+
+/**
+ * @brief 读者线程：每次读取查找一条记录的两个成员
+ */
+static void *publish_read(void *arg)
+{
+    publish_worker *w = (publish_worker *)arg;
+    publish_ctx *ctx = w->ctx;
+    char key[16];
+    double start = thread_cpu(), batch = now();
+
+    for (size_t i = 0; i < w->reads; i++)
+    {
+        snprintf(key, sizeof(key), "k%u", (w->seed = w->seed * 1103515245 + 12345) % PUBLISH_KEYS);
+        const JSON *cur;
+        if (ctx->use_rcu)
+            cur = json_acquire(ctx->slot);
+        else
+        {
+            pthread_rwlock_rdlock(&ctx->lock);
+            cur = ctx->cur;
+        }
+        const JSON *rec = json_get_member(cur, key);
+        w->sum += json_obj_get_int(rec, "id", 0) + json_arr_count(json_get_member(rec, "tags"));
+        if (ctx->use_rcu)
+            json_release();
+        else
+            pthread_rwlock_unlock(&ctx->lock);
+        if ((i + 1) % PUBLISH_BATCH == 0)
+        {
+            double t = now();
+            if ((t - batch) / PUBLISH_BATCH > w->worst)
+                w->worst = (t - batch) / PUBLISH_BATCH;
+            batch = t;
+        }
+    }
+    w->cost = thread_cpu() - start;
+    return NULL;
+}
+/**
+ * @brief 发布线程：每隔 100 微秒修改一条记录并换入新版本
+ */
+static void *publish_reload(void *arg)
+{
+    publish_ctx *ctx = (publish_ctx *)arg;
+    JSON *cur = ctx->cur;
+    char expr[32];
+
+    while (!__atomic_load_n(&ctx->stop, __ATOMIC_ACQUIRE))
+    {
+        // 只有发布线程修改版本，读者并发读取 cur 不受影响
+        JSON *next = json_snapshot(cur);
+        snprintf(expr, sizeof(expr), "k%lu.id", (unsigned long)(ctx->reloads % PUBLISH_KEYS));
+        json_path *path = json_path_compile(expr);
+        if (!next || !path || json_set_compiled(next, path, json_new_int(ctx->reloads)) != 0)
+        {
+            json_path_free(path);
+            json_free(next);
+            break;
+        }
+        json_path_free(path);
+        if (ctx->use_rcu)
+            json_publish(ctx->slot, next);
+        else
+        {
+            pthread_rwlock_wrlock(&ctx->lock);
+            ctx->cur = next;
+            pthread_rwlock_unlock(&ctx->lock);
+            json_free(cur);
+        }
+        cur = next;
+        ctx->reloads++;
+        usleep(100);
+    }
+    return NULL;
+}
+/**
+ * @brief 测试配置重载期间多个读者线程的读取延迟，对比 json_publish/json_acquire 与读写锁
+ * @param n 每个读者线程的读取次数
+ */
+static int bench_publish(size_t n)
+{
+    const char *names[2] = {"rwlock", "json_acquire"};
+    char key[16];
+
+    for (int use_rcu = 0; use_rcu < 2; use_rcu++)
+    {
+        publish_ctx ctx = {.use_rcu = use_rcu};
+        pthread_t reload, tids[PUBLISH_READERS];
+        publish_worker workers[PUBLISH_READERS];
+
+        ctx.cur = json_new(JSON_OBJ);
+        for (size_t i = 0; ctx.cur && i < PUBLISH_KEYS; i++)
+        {
+            snprintf(key, sizeof(key), "k%lu", (unsigned long)i);
+            if (!json_add_member(ctx.cur, key, make_record(i)))
+                return -1;
+        }
+        if (!ctx.cur)
+            return -1;
+        pthread_rwlock_init(&ctx.lock, NULL);
+        if (use_rcu && !(ctx.slot = json_slot_new(ctx.cur)))
+            return -1;
+        for (int t = 0; t < PUBLISH_READERS; t++)
+        {
+            workers[t] = (publish_worker){.ctx = &ctx, .reads = n, .seed = t + 1};
+            pthread_create(&tids[t], NULL, publish_read, &workers[t]);
+        }
+        pthread_create(&reload, NULL, publish_reload, &ctx);
+
+        double cost = 0, worst = 0;
+        long sum = 0;
+        for (int t = 0; t < PUBLISH_READERS; t++)
+        {
+            pthread_join(tids[t], NULL);
+            cost += workers[t].cost;
+            sum += workers[t].sum;
+            if (workers[t].worst > worst)
+                worst = workers[t].worst;
+        }
+        __atomic_store_n(&ctx.stop, 1, __ATOMIC_RELEASE);
+        pthread_join(reload, NULL);
+        printf("publish: %-12s %d readers, %.1f ns cpu/read, worst batch %.1f ns/read, %lu reloads (%ld)\n",
+               names[use_rcu], PUBLISH_READERS, cost / PUBLISH_READERS / n * 1e9, worst * 1e9,
+               (unsigned long)ctx.reloads, sum);
+        if (use_rcu)
+            json_slot_free(ctx.slot);
+        else
+            json_free(ctx.cur);
+        pthread_rwlock_destroy(&ctx.lock);
+    }
+    return 0;
+}
+
+/**
+ * @brief 新建 n 条记录组成的数组，每条记录 6 个节点
+ */
+static JSON *make_records(size_t n)
+{
+    JSON *root = json_new(JSON_ARR);
+    for (size_t i = 0; root && i < n; i++)
+    {
+        if (!json_add_element(root, make_record(i)))
+        {
+            json_free(root);
+            return NULL;
+        }
+    }
+    return root;
+}
+/**
+ * @brief 测试调用者释放大树时被阻塞的时间，对比 json_free 与 json_free_async
+ * @param n 节点个数
+ */
+static int bench_free(size_t n)
+{
+    const char *names[2] = {"json_free", "json_free_async"};
+
+    for (int async = 0; async < 2; async++)
+    {
+        double worst = 0, total = 0;
+        for (int round = 0; round < 5; round++)
+        {
+            JSON *root = make_records(n / 6);
+            if (!root)
+                return -1;
+            double start = now();
+            if (async)
+                json_free_async(root);
+            else
+                json_free(root);
+            double cost = now() - start;
+            total += cost;
+            if (cost > worst)
+                worst = cost;
+            json_free_drain();
+        }
+        printf("free: %-15s %lu nodes, caller blocked %.3f ms avg, %.3f ms worst\n", names[async],
+               (unsigned long)n, total / 5 * 1e3, worst * 1e3);
+    }
+    return 0;
+}
+
+/**
+ * @brief 新建 depth 层嵌套的数组，每层放一个数字和下一层
+ */
+static JSON *make_deep(size_t depth)
+{
+    JSON *root = json_new(JSON_ARR), *cur = root;
+    for (size_t i = 0; cur && i < depth; i++)
+    {
+        JSON *next = json_new(JSON_ARR);
+        if (json_arr_add_num(cur, i) != 1 || !json_add_element(cur, next))
+        {
+            json_free(next);
+            cur = NULL;
+            break;
+        }
+        cur = next;
+    }
+    if (!cur)
+    {
+        json_free(root);
+        return NULL;
+    }
+    return root;
+}
+/**
+ * @brief 新建 n 条记录，记录在堆中的位置打乱：先建 n 条记录再按随机顺序释放，新的记录依次取用释放的内存
+ */
+static JSON *make_scattered(size_t n)
+{
+    JSON **recs = (JSON **)malloc(n * sizeof(JSON *));
+    if (!recs)
+        return NULL;
+    for (size_t i = 0; i < n; i++)
+        recs[i] = make_record(i);
+    srand(1);
+    for (size_t i = n; i > 1; i--)
+    {
+        size_t j = (size_t)rand() % i;
+        JSON *tmp = recs[i - 1];
+        recs[i - 1] = recs[j];
+        recs[j] = tmp;
+    }
+    for (size_t i = 0; i < n; i++)
+        json_free(recs[i]);
+    free(recs);
+    return make_records(n);
+}
+/**
+ * @brief 测试整棵树的遍历：释放、统计、紧凑拷贝，宽树另外测试保存
+ * @param n 宽树的记录条数，深树的层数为 n / 10
+ * @details 宽树按顺序构建时节点在堆中基本连续，打乱的宽树模拟长期修改后节点分散的情况
+ */
+static int bench_walk(size_t n)
+{
+    const char *shapes[3] = {"wide", "scattered", "deep"};
+
+    for (int shape = 0; shape < 3; shape++)
+    {
+        BOOL deep = shape == 2;
+        double stats = 0, compact = 0, save = 0, release = 0;
+        size_t nodes = 0;
+        for (int round = 0; round < 3; round++)
+        {
+            JSON *json;
+            json_mem_stats st;
+            if (shape == 1)
+                json = make_scattered(n);
+            else
+            {
+                // 与 bench_compact 相同，交替构建两棵树使节点在堆中分散
+                json = deep ? make_deep(n / 10) : make_records(n);
+                JSON *decoy = deep ? make_deep(n / 10) : make_records(n);
+                if (!decoy)
+                    return -1;
+                json_free(decoy);
+            }
+            if (!json)
+                return -1;
+
+            double start = now();
+            if (json_stats(json, &st) != 0)
+                return -1;
+            double cost = now() - start;
+            stats = round == 0 || cost < stats ? cost : stats;
+            nodes = st.nodes;
+
+            start = now();
+            JSON *copy = json_compact(json);
+            cost = now() - start;
+            compact = round == 0 || cost < compact ? cost : compact;
+            json_free(copy);
+
+            if (!deep)
+            {
+                start = now();
+                if (json_save(json, "bench.yml") != 0)
+                    return -1;
+                cost = now() - start;
+                save = round == 0 || cost < save ? cost : save;
+            }
+
+            start = now();
+            json_free(json);
+            cost = now() - start;
+            release = round == 0 || cost < release ? cost : release;
+        }
+        printf("walk: %-9s %lu nodes, json_stats %.1f ms, json_compact %.1f ms, json_save %.1f ms, json_free %.1f ms\n",
+               shapes[shape], (unsigned long)nodes, stats * 1e3, compact * 1e3, save * 1e3, release * 1e3);
+    }
+    remove("bench.yml");
+    return 0;
+}
+
+/**
+ * @brief 测试 json_save 的输出速度
+ * @param mb 被保存的 JSON 值解析前的文本大小，单位：MB
+ */
+static int bench_save(size_t mb)
+{
+    size_t len;
+    char *text = make_corpus(mb, &len);
+    JSON *json;
+
+    if (!text)
+        return -1;
+    json = json_parse(text, len);
+    free(text);
+    if (!json)
+        return -1;
+
+    double best = 0;
+    for (int round = 0; round < 3; round++)
+    {
+        double start = now();
+        if (json_save(json, "bench.yml") != 0)
+        {
+            json_free(json);
+            return -1;
+        }
+        double cost = now() - start;
+        if (best == 0 || cost < best)
+            best = cost;
+    }
+    FILE *fp = fopen("bench.yml", "rb");
+    fseek(fp, 0, SEEK_END);
+    long out = ftell(fp);
+    fclose(fp);
+    remove("bench.yml");
+    printf("save: %ld bytes of YAML, best %.3f s, %.1f MB/s\n", out, best, out / best / (1 << 20));
+    json_free(json);
+    return 0;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+/**
+ * @brief 测试增量保存时单步的耗时分布，以及与一次性 json_save 的总耗时对比
+ * @param mb 被保存的 JSON 值解析前的文本大小，单位：MB
+ */
+static int bench_save_step(size_t mb)
+{
+    size_t len, budget = 4096;
+    char *text = make_corpus(mb, &len);
+    JSON *json;
+
+    if (!text)
+        return -1;
+    json = json_parse(text, len);
+    free(text);
+    if (!json)
+        return -1;
+
+    double start = now();
+    if (json_save(json, "bench.yml") != 0)
+    {
+        json_free(json);
+        return -1;
+    }
+    double whole = now() - start;
+
+    size_t cap = 1024, steps = 0;
+    double *costs = (double *)malloc(cap * sizeof(double));
+    json_saver *saver = json_save_begin(json, "bench.yml");
+    int ret = saver && costs ? 1 : -1;
+    double total = 0;
+    while (ret == 1)
+    {
+        start = now();
+        ret = json_save_step(saver, budget);
+        double cost = now() - start;
+        total += cost;
+        if (steps == cap)
+        {
+            double *tmp = (double *)realloc(costs, (cap *= 2) * sizeof(double));
+            if (!tmp)
+            {
+                ret = -1;
+                break;
+            }
+            costs = tmp;
+        }
+        costs[steps++] = cost;
+    }
+    if (json_save_end(saver) != 0)
+        ret = -1;
+    if (ret == 0)
+    {
+        qsort(costs, steps, sizeof(double), cmp_double);
+        printf("save_step: json_save blocks %.1f ms; %lu steps of %lu values, total %.1f ms, "
+               "p50 %.1f us, p99 %.1f us, max %.1f us\n",
+               whole * 1e3, (unsigned long)steps, (unsigned long)budget, total * 1e3, costs[steps / 2] * 1e6,
+               costs[steps * 99 / 100] * 1e6, costs[steps - 1] * 1e6);
+    }
+    free(costs);
+    remove("bench.yml");
+    json_free(json);
+    return ret;
+}
+
+
+/**
+ * @brief 旧的数字输出方式：sprintf("%f") 后去掉多余的 0
+ */
+static int sprintf_trim(double num, char *buf)
+{
+    int len = sprintf(buf, "%f", num);
+    while (len > 0 && buf[len - 1] == '0')
+        len--;
+    if (len > 0 && buf[len - 1] == '.')
+        len--;
+    return len;
+}
+
+/**
+ * @brief 测试数字格式化的速度，与 sprintf 比较
+ * @param n 格式化的数字个数
+ */
+static int bench_dtoa(size_t n)
+{
+    double *nums = (double *)malloc(n * sizeof(double));
+    char buf[512];
+    size_t total;
+
+    if (!nums)
+        return -1;
+    // 整数、短小数和随机小数各占三分之一
+    unsigned long long seed = 88172645463325252ULL;
+    for (size_t i = 0; i < n; i++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        if (i % 3 == 0)
+            nums[i] = (double)(seed % 100000);
+        else if (i % 3 == 1)
+            nums[i] = (double)(seed % 100000) / 100;
+        else
+            nums[i] = (double)(seed >> 11) / (1ULL << 53) * 1000;
+    }
+
+    printf("dtoa: %lu numbers\n", (unsigned long)n);
+    struct
+    {
+        const char *name;
+        int (*format)(double num, char *buf);
+    } impls[] = {
+        {"json_num_to_str", json_num_to_str},
+        {"sprintf %f+trim", sprintf_trim},
+    };
+    for (size_t k = 0; k < sizeof(impls) / sizeof(impls[0]); k++)
+    {
+        total = 0;
+        double start = now();
+        for (size_t i = 0; i < n; i++)
+            total += impls[k].format(nums[i], buf);
+        double cost = now() - start;
+        printf("  %-16s %.3f s, %.1f M numbers/s, %lu bytes\n", impls[k].name, cost, n / cost / 1e6,
+               (unsigned long)total);
+    }
+    free(nums);
+    return 0;
+}
+
+/**
+ * @brief 测试按路径读取配置项：每次编译路径，与编译一次反复使用比较
+ * @param n 查询次数
+ */
+static int bench_path(size_t n)
+{
+    const char *text = "{\"basic\": {\"enable\": true, \"port\": 389, \"dns\": [\"200.200.3.254\", \"200.200.1.1\"]},"
+                       " \"advance\": {\"dns\": [\"192.168.1.1\"], \"timeout\": 30}}";
+    const char *expr = "basic.dns[1]";
+    JSON *json = json_parse(text, strlen(text));
+    json_path *path = json_path_compile(expr);
+    size_t hits = 0;
+
+    if (!json || !path)
+    {
+        json_free(json);
+        json_path_free(path);
+        return -1;
+    }
+
+    double start = now();
+    for (size_t i = 0; i < n; i++)
+    {
+        json_path *tmp = json_path_compile(expr);
+        hits += json_get_compiled(json, tmp) != NULL;
+        json_path_free(tmp);
+    }
+    double each = now() - start;
+
+    start = now();
+    for (size_t i = 0; i < n; i++)
+        hits += json_get_compiled(json, path) != NULL;
+    double compiled = now() - start;
+
+    printf("path: %lu queries of \"%s\", compile each time %.1f ns/query, compiled %.1f ns/query (%lu hits)\n",
+           (unsigned long)n, expr, each / n * 1e9, compiled / n * 1e9, (unsigned long)hits);
+    json_path_free(path);
+    json_free(json);
+    return 0;
+}
+
+static int count_event(void *ctx)
+{
+    (*(size_t *)ctx)++;
+    return 0;
+}
+static int count_str(void *ctx, const char *str, size_t len)
+{
+    (*(size_t *)ctx)++;
+    return 0;
+}
+static int count_num(void *ctx, double num)
+{
+    (*(size_t *)ctx)++;
+    return 0;
+}
+static int count_bool(void *ctx, BOOL val)
+{
+    (*(size_t *)ctx)++;
+    return 0;
+}
+
+/**
+ * @brief 测试流式解析的吞吐量：按 64KB 分块输入，只统计事件，以及边解析边构建 JSON 树
+ * @param mb 输入文本的大小，单位：MB
+ */
+static int bench_stream(size_t mb)
+{
+    const json_handler handler = {count_event, count_event, count_event, count_event,
+                                  count_str, count_str, count_num, count_bool, count_event};
+    const size_t chunk = 64 * 1024;
+    size_t len, events = 0;
+    char *text = make_corpus(mb, &len);
+    json_doc *doc = json_doc_new();
+    json_parser *p = json_parser_new(&handler, &events);
+    json_parser *tree = json_parser_new_tree(doc);
+    int ret = -1;
+
+    if (!text || !doc || !p || !tree)
+        goto out_;
+
+    double start = now();
+    for (size_t off = 0; off < len; off += chunk)
+    {
+        if (json_parser_feed(p, text + off, off + chunk > len ? len - off : chunk) < 0)
+            goto out_;
+    }
+    if (json_parser_finish(p) < 0)
+        goto out_;
+    double events_cost = now() - start;
+
+    start = now();
+    for (size_t off = 0; off < len; off += chunk)
+    {
+        if (json_parser_feed(tree, text + off, off + chunk > len ? len - off : chunk) < 0)
+            goto out_;
+    }
+    if (json_parser_finish(tree) < 0 || !json_parser_root(tree))
+        goto out_;
+    double tree_cost = now() - start;
+
+    printf("stream: %lu bytes in %lu-byte chunks, %lu events\n", (unsigned long)len, (unsigned long)chunk,
+           (unsigned long)events);
+    printf("  events only: %.3f s, %.1f MB/s\n", events_cost, len / events_cost / (1 << 20));
+    printf("  build tree:  %.3f s, %.1f MB/s (in a json_doc)\n", tree_cost, len / tree_cost / (1 << 20));
+    ret = 0;
+
+out_:
+    json_parser_free(p);
+    json_parser_free(tree);
+    json_doc_free(doc);
+    free(text);
+    return ret;
+}
+
+/**
+ * @brief 在子进程中加载文件并读取中间一个元素的 basic.port，报告耗时和子进程的峰值 RSS
+ * @param how 0 使用 json_load，1 使用 json_doc_load，2 使用 json_load_mmap，3 使用 json_load_lazy，
+ *            4 使用 json_open_frozen（fname 是冻结映像）
+ */
+static int load_in_child(const char *fname, int how)
+{
+    static const char *names[] = {"json_load", "json_doc_load", "json_load_mmap", "json_load_lazy", "json_open_frozen"};
+    struct rusage usage;
+    int status;
+    int fds[2];
+    double cost = 0;
+
+    if (pipe(fds) != 0)
+        return -1;
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0)
+    {
+        json_doc *doc = NULL;
+        JSON *json;
+        double start = now();
+        if (how == 1)
+        {
+            doc = json_doc_new();
+            json = json_doc_load(doc, fname);
+        }
+        else
+        {
+            json = how == 0   ? json_load(fname)
+                   : how == 2 ? json_load_mmap(fname)
+                   : how == 3 ? json_load_lazy(fname)
+                              : json_open_frozen(fname);
+        }
+        const JSON *elem = json ? json_get_element(json, json_arr_count(json) / 2) : NULL;
+        double port = elem ? json_obj_get_num(json_get_member(elem, "basic"), "port", 0) : 0;
+        cost = now() - start;
+        if (write(fds[1], &cost, sizeof(cost)) != sizeof(cost))
+            _exit(1);
+        _exit(port == 389 ? 0 : 1);
+    }
+    close(fds[1]);
+    if (read(fds[0], &cost, sizeof(cost)) != sizeof(cost))
+        cost = 0;
+    close(fds[0]);
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1;
+    printf("  %-16s %.3f s, peak RSS %ld MB\n", names[how], cost, usage.ru_maxrss / 1024);
+    return 0;
+}
+
+/**
+ * @brief 把大小约为 mb 兆字节的测试数据写入文件 fname
+ * @return 成功返回文件长度，失败返回 0
+ */
+static size_t write_corpus(const char *fname, size_t mb)
+{
+    size_t len;
+    char *text = make_corpus(mb, &len);
+    FILE *fp;
+
+    if (!text)
+        return 0;
+    fp = fopen(fname, "wb");
+    if (!fp || fwrite(text, 1, len, fp) != len)
+    {
+        if (fp)
+            fclose(fp);
+        free(text);
+        return 0;
+    }
+    fclose(fp);
+    free(text);
+    return len;
+}
+
+/**
+ * @brief 比较普通加载和映射加载大文件的耗时与峰值内存
+ * @param mb 文件大小，单位：MB
+ */
+static int bench_mmap(size_t mb)
+{
+    const char *fname = "bench.json";
+    size_t len = write_corpus(fname, mb);
+    int ret = 0;
+
+    if (!len)
+        return -1;
+    printf("mmap: %lu bytes file, page cache warm\n", (unsigned long)len);
+    for (int how = 0; how < 3 && ret == 0; how++)
+        ret = load_in_child(fname, how);
+    remove(fname);
+    return ret;
+}
+
+/**
+ * @brief 只读取大文件中的一个键时，比较完整加载和延迟加载的耗时与峰值内存
+ * @param mb 文件大小，单位：MB
+ */
+static int bench_lazy(size_t mb)
+{
+    const char *fname = "bench.json";
+    size_t len = write_corpus(fname, mb);
+    int ret;
+
+    if (!len)
+        return -1;
+    printf("lazy: %lu bytes file, page cache warm\n", (unsigned long)len);
+    ret = load_in_child(fname, 2);
+    if (ret == 0)
+        ret = load_in_child(fname, 3);
+    remove(fname);
+    return ret;
+}
+
+/**
+ * @brief 比较解析文本和打开冻结映像的耗时与峰值内存
+ * @param mb 文本大小，单位：MB
+ */
+static int bench_frozen(size_t mb)
+{
+    const char *fname = "bench.json", *image = "bench.frz";
+    size_t len = write_corpus(fname, mb);
+    int ret = -1;
+
+    if (!len)
+        return -1;
+    // 在子进程中生成映像，slab 留下的内存不会被之后的子进程继承，计入它们的峰值内存
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        JSON *json = json_load(fname);
+        _exit(json && json_freeze(json, image) == 0 ? 0 : 1);
+    }
+    int status;
+    if (pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    {
+        struct stat st;
+        stat(image, &st);
+        printf("frozen: %lu bytes text, %ld bytes image, page cache warm\n", (unsigned long)len, (long)st.st_size);
+        ret = load_in_child(fname, 0);
+        if (ret == 0)
+            ret = load_in_child(fname, 2);
+        if (ret == 0)
+            ret = load_in_child(image, 4);
+    }
+    remove(fname);
+    remove(image);
+    return ret;
+}
+
+static int count_record(void *ctx, JSON *record, size_t offset)
+{
+    (*(size_t *)ctx)++;
+    return 0;
+}
+
+/**
+ * @brief 测试 json_load_lines 的吞吐量随线程数的变化
+ * @param mb 文件大小，单位：MB，每行是压成一行的 json-test.json
+ */
+static int bench_lines(size_t mb)
+{
+    const char *fname = "bench.json";
+    size_t unit_len, len = 0;
+    char *unit = read_all("json-test.json", &unit_len);
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    FILE *fp;
+    double base = 0;
+
+    if (!unit)
+        return -1;
+    for (size_t i = 0; i < unit_len; i++)
+    {
+        if (unit[i] == '\n' || unit[i] == '\r')
+            unit[i] = ' ';
+    }
+    fp = fopen(fname, "wb");
+    if (!fp)
+    {
+        free(unit);
+        return -1;
+    }
+    for (; len < (mb << 20); len += unit_len + 1)
+    {
+        fwrite(unit, 1, unit_len, fp);
+        fputc('\n', fp);
+    }
+    fclose(fp);
+    free(unit);
+
+    printf("lines: %lu bytes, %d cpus\n", (unsigned long)len, cpus);
+    for (int threads = 1; threads <= (cpus > 4 ? cpus : 4); threads *= 2)
+    {
+        for (int ordered = 0; ordered < 2; ordered++)
+        {
+            size_t count = 0;
+            double start = now();
+            if (json_load_lines(fname, threads, count_record, &count, ordered) < 0)
+            {
+                remove(fname);
+                return -1;
+            }
+            double cost = now() - start;
+            if (threads == 1 && !ordered)
+                base = cost;
+            printf("  %2d threads %-9s %8.1f MB/s, speedup %.2f, %lu records\n", threads,
+                   ordered ? "ordered" : "unordered", len / cost / (1 << 20), base / cost, (unsigned long)count);
+        }
+    }
+    remove(fname);
+    return 0;
+}
+
+/**
+ * @brief 在子进程中新建 n 个短字符串节点并解析含大量短字符串的文本，报告速度和峰值 RSS
+ * @param n 节点个数
+ */
+static int bench_strings(size_t n)
+{
+    struct rusage usage;
+    int status;
+    int fds[2];
+    double cost[2] = {0, 0};
+
+    if (pipe(fds) != 0)
+        return -1;
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0)
+    {
+        char ip[32];
+        size_t len;
+        JSON *arr = json_new(JSON_ARR);
+        double start = now();
+        for (size_t i = 0; i < n && arr; i++)
+        {
+            snprintf(ip, sizeof(ip), "200.200.%u.%u", (unsigned)(i >> 8) & 0xFF, (unsigned)i & 0xFF);
+            if (!json_add_element(arr, json_new_str(ip)))
+                _exit(1);
+        }
+        cost[0] = now() - start;
+        json_free(arr);
+
+        // 形如 ["200.200.0.1","200.200.0.2",...] 的文本
+        char *text = (char *)malloc(n * 20 + 2);
+        if (!text)
+            _exit(1);
+        len = 0;
+        text[len++] = '[';
+        for (size_t i = 0; i < n; i++)
+            len += sprintf(text + len, "%s\"200.200.%u.%u\"", i ? "," : "", (unsigned)(i >> 8) & 0xFF,
+                           (unsigned)i & 0xFF);
+        text[len++] = ']';
+        start = now();
+        arr = json_parse(text, len);
+        cost[1] = now() - start;
+        if (write(fds[1], cost, sizeof(cost)) != sizeof(cost))
+            _exit(1);
+        _exit(arr ? 0 : 1);
+    }
+    close(fds[1]);
+    if (read(fds[0], cost, sizeof(cost)) != sizeof(cost))
+        cost[0] = cost[1] = 0;
+    close(fds[0]);
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1;
+    printf("strings: %lu short strings, peak RSS %ld MB\n", (unsigned long)n, usage.ru_maxrss / 1024);
+    printf("  json_new_str  %.1f M nodes/s\n", n / cost[0] / 1e6);
+    printf("  json_parse    %.1f M nodes/s\n", n / cost[1] / 1e6);
+    return 0;
+}
+
+/**
+ * @brief 在子进程中构建和解析 n 个键名相同的小对象，报告速度和峰值 RSS
+ * @param n 对象个数，每个对象有 3 个成员
+ */
+static int bench_keys(size_t n)
+{
+    struct rusage usage;
+    int status;
+    int fds[2];
+    double cost[3] = {0, 0, 0};
+
+    if (pipe(fds) != 0)
+        return -1;
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0)
+    {
+        static json_key k_hostname = JSON_KEY_INIT("hostname");
+        static json_key k_address = JSON_KEY_INIT("address");
+        static json_key k_port = JSON_KEY_INIT("port");
+        JSON *arr = json_new(JSON_ARR);
+        double start = now();
+        for (size_t i = 0; i < n && arr; i++)
+        {
+            JSON *obj = json_add_element(arr, json_new(JSON_OBJ));
+            if (!obj || !json_add_member(obj, "hostname", json_new_num(i)) ||
+                !json_add_member(obj, "address", json_new_bool(TRUE)) || !json_add_member(obj, "port", json_new_num(53)))
+                _exit(1);
+        }
+        cost[0] = now() - start;
+        json_free(arr);
+
+        arr = json_new(JSON_ARR);
+        start = now();
+        for (size_t i = 0; i < n && arr; i++)
+        {
+            JSON *obj = json_add_element(arr, json_new(JSON_OBJ));
+            if (!obj || !json_add_member_key(obj, &k_hostname, json_new_num(i)) ||
+                !json_add_member_key(obj, &k_address, json_new_bool(TRUE)) ||
+                !json_add_member_key(obj, &k_port, json_new_num(53)))
+                _exit(1);
+        }
+        cost[2] = now() - start;
+        json_free(arr);
+
+        // 形如 [{"hostname":0,"address":true,"port":53},...] 的文本
+        char *text = (char *)malloc(n * 64 + 2);
+        size_t len = 0;
+        if (!text)
+            _exit(1);
+        text[len++] = '[';
+        for (size_t i = 0; i < n; i++)
+            len += sprintf(text + len, "%s{\"hostname\":%lu,\"address\":true,\"port\":53}", i ? "," : "",
+                           (unsigned long)i);
+        text[len++] = ']';
+        start = now();
+        arr = json_parse(text, len);
+        cost[1] = now() - start;
+        if (write(fds[1], cost, sizeof(cost)) != sizeof(cost))
+            _exit(1);
+        _exit(arr ? 0 : 1);
+    }
+    close(fds[1]);
+    if (read(fds[0], cost, sizeof(cost)) != sizeof(cost))
+        cost[0] = cost[1] = cost[2] = 0;
+    close(fds[0]);
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1;
+    printf("keys: %lu objects x 3 members, peak RSS %ld MB\n", (unsigned long)n, usage.ru_maxrss / 1024);
+    printf("  json_add_member      %.1f M members/s\n", n * 3 / cost[0] / 1e6);
+    printf("  json_add_member_key  %.1f M members/s\n", n * 3 / cost[2] / 1e6);
+    printf("  json_parse           %.1f M members/s\n", n * 3 / cost[1] / 1e6);
+    return 0;
+}
+
+static int count_node(void *ctx)
+{
+    (*(size_t *)ctx)++;
+    return 0;
+}
+static int count_node_str(void *ctx, const char *str, size_t len)
+{
+    (*(size_t *)ctx)++;
+    return 0;
+}
+static int count_node_num(void *ctx, double num)
+{
+    (*(size_t *)ctx)++;
+    return 0;
+}
+static int count_node_bool(void *ctx, BOOL val)
+{
+    (*(size_t *)ctx)++;
+    return 0;
+}
+
+/**
+ * @brief 获取当前进程的常驻内存，单位：字节
+ */
+static size_t current_rss(void)
+{
+    long pages = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp)
+    {
+        if (fscanf(fp, "%*s %ld", &pages) != 1)
+            pages = 0;
+        fclose(fp);
+    }
+    return (size_t)pages * sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * @brief 在子进程中解析文本，报告 JSON 树占用的内存、解析耗时和逐个元素查找 advance.dns[2][2].name 的耗时
+ * @param use_doc 为 0 时用 json_parse 在堆中解析，否则用 json_doc_parse 在文档中解析
+ */
+static int nodes_in_child(const char *text, size_t len, size_t nodes, int use_doc)
+{
+    struct rusage usage;
+    int status;
+    int fds[2];
+    double result[3] = {0, 0, 0};
+
+    if (pipe(fds) != 0)
+        return -1;
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0)
+    {
+        json_doc *doc = use_doc ? json_doc_new() : NULL;
+        size_t rss = current_rss();
+        double start = now();
+        JSON *json = use_doc ? json_doc_parse(doc, text, len) : json_parse(text, len);
+        result[1] = now() - start;
+        if (!json)
+            _exit(1);
+        result[0] = (double)(current_rss() - rss);
+
+        size_t hits = 0;
+        int count = json_arr_count(json);
+        start = now();
+        for (int i = 0; i < count; i++)
+        {
+            const JSON *dns = json_get_member(json_get_member(json_get_element(json, i), "advance"), "dns");
+            const char *name = json_obj_get_str(json_get_element(json_get_element(dns, 2), 2), "name", NULL);
+            hits += name != NULL;
+        }
+        result[2] = (now() - start) / count;
+        if (write(fds[1], result, sizeof(result)) != sizeof(result))
+            _exit(1);
+        _exit(hits == (size_t)count ? 0 : 1);
+    }
+    close(fds[1]);
+    if (read(fds[0], result, sizeof(result)) != sizeof(result))
+        result[0] = result[1] = result[2] = 0;
+    close(fds[0]);
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1;
+    printf("  %-14s %.1f bytes/node (%.0f MB), parse %.3f s, lookup %.1f ns/element\n",
+           use_doc ? "json_doc_parse" : "json_parse", result[0] / nodes, result[0] / (1 << 20), result[1],
+           result[2] * 1e9);
+    return 0;
+}
+
+/**
+ * @brief 测试 JSON 树每个节点平均占用的内存，数据由 json-test.json 重复拼接而成
+ * @param m 节点个数，单位：百万
+ */
+static int bench_nodes(size_t m)
+{
+    const json_handler handler = {count_node, NULL, count_node, NULL, NULL,
+                                  count_node_str, count_node_num, count_node_bool, count_node};
+    size_t unit_len, unit_nodes = 0, len, nodes = 0;
+    char *unit = read_all("json-test.json", &unit_len);
+    json_parser *p = json_parser_new(&handler, &unit_nodes);
+    char *text = NULL;
+    int ret = -1;
+
+    if (!unit || !p || json_parser_feed(p, unit, unit_len) < 0 || json_parser_finish(p) < 0 || !unit_nodes)
+        goto out_;
+    text = make_corpus((m * 1000000 / unit_nodes * (unit_len + 1) >> 20) + 1, &len);
+    if (!text)
+        goto out_;
+    nodes = (len - 1) / (unit_len + 1) * unit_nodes + 1;
+    printf("nodes: %lu nodes (%lu per copy of json-test.json), %lu bytes of text\n", (unsigned long)nodes,
+           (unsigned long)unit_nodes, (unsigned long)len);
+    if (nodes_in_child(text, len, nodes, 0) < 0 || nodes_in_child(text, len, nodes, 1) < 0)
+        goto out_;
+    ret = 0;
+
+out_:
+    json_parser_free(p);
+    free(unit);
+    free(text);
+    return ret;
+}
+
+/**
+ * @brief 在子进程中测试 n 个整数组成的数组：解析后占用的内存、逐个读取、逐个追加和输出为 YAML 的耗时
+ * @param n 数组元素个数
+ */
+static int bench_numbers(size_t n)
+{
+    struct rusage usage;
+    int status;
+    int fds[2];
+    double result[7] = {0, 0, 0, 0, 0, 0, 0};
+
+    if (pipe(fds) != 0)
+        return -1;
+    pid_t pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0)
+    {
+        // 形如 [130,131,132,...] 的文本
+        char *text = (char *)malloc(n * 12 + 2);
+        size_t len = 0;
+        if (!text)
+            _exit(1);
+        text[len++] = '[';
+        for (size_t i = 0; i < n; i++)
+            len += sprintf(text + len, "%s%lu", i ? "," : "", (unsigned long)(i % 65536));
+        text[len++] = ']';
+
+        size_t rss = current_rss();
+        double start = now();
+        JSON *json = json_parse(text, len);
+        result[1] = now() - start;
+        if (!json)
+            _exit(1);
+        result[0] = (double)(current_rss() - rss) / n;
+
+        double sum = 0;
+        start = now();
+        for (size_t i = 0; i < n; i++)
+            sum += json_arr_get_num(json, (int)i, 0);
+        result[2] = (now() - start) / n;
+
+        int64_t isum = 0;
+        start = now();
+        for (size_t i = 0; i < n; i++)
+            isum += json_arr_get_int(json, (int)i, 0);
+        result[5] = (now() - start) / n;
+
+        start = now();
+        if (json_save(json, "/dev/null") != 0)
+            _exit(1);
+        result[4] = now() - start;
+        json_free(json);
+
+        json = json_new(JSON_ARR);
+        start = now();
+        for (size_t i = 0; i < n && json; i++)
+        {
+            if (json_arr_add_num(json, (double)i) < 0)
+                _exit(1);
+        }
+        result[3] = (now() - start) / n;
+        json_free(json);
+
+        json = json_new(JSON_ARR);
+        start = now();
+        for (size_t i = 0; i < n && json; i++)
+        {
+            if (json_arr_add_int(json, (int64_t)i) < 0)
+                _exit(1);
+        }
+        result[6] = (now() - start) / n;
+        json_free(json);
+        if (write(fds[1], result, sizeof(result)) != sizeof(result))
+            _exit(1);
+        _exit(sum > 0 && isum > 0 ? 0 : 1);
+    }
+    close(fds[1]);
+    if (read(fds[0], result, sizeof(result)) != sizeof(result))
+        memset(result, 0, sizeof(result));
+    close(fds[0]);
+    if (wait4(pid, &status, 0, &usage) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        return -1;
+    printf("numbers: array of %lu numbers, peak RSS %ld MB\n", (unsigned long)n, usage.ru_maxrss / 1024);
+    printf("  json_parse        %.1f bytes/element, %.3f s\n", result[0], result[1]);
+    printf("  json_arr_get_num  %.1f ns/element\n", result[2] * 1e9);
+    printf("  json_arr_add_num  %.1f ns/element\n", result[3] * 1e9);
+    printf("  json_arr_get_int  %.1f ns/element\n", result[5] * 1e9);
+    printf("  json_arr_add_int  %.1f ns/element\n", result[6] * 1e9);
+    printf("  json_save         %.3f s\n", result[4]);
+    return 0;
+}
+
+typedef struct bench_case
+{
+    const char *name;
+    int (*run)(size_t scale);
+    size_t scale; // 缺省的数据规模，含义由各测试自行解释
+} bench_case;
+
+static const bench_case cases[] = {
+    {"parse", bench_parse, 256},
+    {"object", bench_object, 200000},
+    {"save", bench_save, 64},
+    {"save_step", bench_save_step, 64},
+    {"dtoa", bench_dtoa, 3000000},
+    {"path", bench_path, 10000000},
+    {"stream", bench_stream, 256},
+    {"mmap", bench_mmap, 512},
+    {"lazy", bench_lazy, 512},
+    {"lines", bench_lines, 256},
+    {"strings", bench_strings, 5000000},
+    {"keys", bench_keys, 2000000},
+    {"nodes", bench_nodes, 10},
+    {"numbers", bench_numbers, 10000000},
+    {"churn", bench_churn, 5000000},
+    {"compact", bench_compact, 1000000},
+    {"cow", bench_cow, 200000},
+    {"publish", bench_publish, 2000000},
+    {"free", bench_free, 2000000},
+    {"walk", bench_walk, 1000000},
+    {"frozen", bench_frozen, 256},
+};
+
+int main(int argc, char **argv)
+{
+    int ret = 0;
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        if (argc > 1 && strcmp(argv[1], cases[i].name) != 0)
+            continue;
+        size_t scale = argc > 2 ? strtoul(argv[2], NULL, 10) : cases[i].scale;
+        if (cases[i].run(scale) < 0)
+        {
+            fprintf(stderr, "bench %s failed\n", cases[i].name);
+            ret = 1;
+        }
+    }
+    return ret;
+}
@@ -3,6 +3,22 @@
 #include <assert.h>
 #include <malloc.h>
 #include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+// 没有用 -mavx2 编译时，结构扫描另外编译一份 AVX2 的版本，运行时按 CPU 选择
+#define JSON_SCAN_DISPATCH
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "json.h"
 
 typedef struct array array;
@@ -11,719 +27,7661 @@ typedef struct value value;
 typedef struct keyvalue keyvalue;
 
 /**
- *  想想：这些结构体定义在.c是为什么？
+ * @brief 内存分配器，见 json_set_allocator
  */
+typedef struct allocator
+{
+    json_alloc_fn alloc;
+    json_realloc_fn realloc;
+    json_free_fn free;
+    void *user;
+} allocator;
+
+static void *std_alloc(void *user, size_t size, size_t align)
+{
+    (void)user;
+    if (align <= JSON_ALLOC_ALIGN)
+        return malloc(size);
+    // aligned_alloc 要求 size 是 align 的整数倍
+    return aligned_alloc(align, (size + align - 1) & ~(align - 1));
+}
+static void *std_realloc(void *user, void *ptr, size_t old_size, size_t new_size)
+{
+    (void)user;
+    (void)old_size;
+    return realloc(ptr, new_size);
+}
+static void std_free(void *user, void *ptr)
+{
+    (void)user;
+    free(ptr);
+}
+
+static const allocator std_allocator = {std_alloc, std_realloc, std_free, NULL};
+static allocator heap = {std_alloc, std_realloc, std_free, NULL}; // 堆中的节点和临时缓冲区使用的分配器
+
 /**
- *  想想：如果要提升内存分配效率，这个结构体该作什么变化？
+ * @brief 通过全局分配器分配 bytes 字节
  */
-struct array
+static void *heap_alloc(size_t bytes)
 {
-    value **elems; /* 想想: 这里如果定义为'value *elems'会怎样？ 会导致数组中无法添加新元素*/
-    U32 count;     //elems中有多少个value*
-    U32 size;      // 数组 array 的容量
-};
-
+    return heap.alloc(heap.user, bytes, JSON_ALLOC_ALIGN);
+}
 /**
- * @brief 对象的键值对
+ * @brief 通过全局分配器分配 bytes 字节并清零
  */
-struct keyvalue
+static void *heap_calloc(size_t bytes)
 {
-    char *key;  //键名
-    value *val; //值
-};
+    void *ptr = heap_alloc(bytes);
+    if (ptr)
+        memset(ptr, 0, bytes);
+    return ptr;
+}
+/**
+ * @brief 把 ptr 从 old_bytes 字节调整为 new_bytes 字节，ptr 为 NULL 时新分配
+ */
+static void *heap_realloc(void *ptr, size_t old_bytes, size_t new_bytes)
+{
+    if (!ptr)
+        return heap_alloc(new_bytes);
+    return heap.realloc(heap.user, ptr, old_bytes, new_bytes);
+}
+/**
+ * @brief 释放 heap_alloc 分配的内存，可以接受 NULL
+ */
+static void heap_free(void *ptr)
+{
+    if (ptr)
+        heap.free(heap.user, ptr);
+}
+
+#ifndef JSON_NO_SLAB
+#define SLAB_SIZE (64 * 1024) // 每次向全局分配器申请的大块，也是它的对齐值，对象据此找到所属的大块
+#define SLAB_MAX 512          // 超过该大小的请求直接交给全局分配器
+#define SLAB_CLASSES 16
+#define SLAB_BATCH 32 // 线程缓存与全局仓库之间每次搬运的对象个数
+
+// 各尺寸等级的对象大小：标量节点 16 字节，容器节点连同头部 32 字节，
+// 成员数组、键值对数组和打包数组扩容时按倍数增长，解析器按元素个数精确分配
+static const U32 slab_sizes[SLAB_CLASSES] = {16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512};
+
+typedef struct slab_obj slab_obj;
 
 /**
- *  想想：如果要提升内存分配效率，这个结构体该作什么变化？
+ * @brief 空闲对象，链表指针占用对象的前 8 个字节
  */
-struct object
+struct slab_obj
 {
-    keyvalue *kvs; //这是一个keyvalue的数组，可以通过realloc的方式扩充的动态数组
-    U32 count;     //数组kvs中有几个键值对
-    U32 size;      // 数组 kvs 的容量
+    slab_obj *next;
 };
 
+typedef struct slab_chunk slab_chunk;
+
 /**
- * @brief JSON值
+ * @brief 大块的头部，对象从 SLAB_HEAD 字节之后开始切分
  */
-struct value
+struct slab_chunk
 {
-    json_e type;    //JSON值的具体类型
-    union {         //匿名 union，其中的属性可以当作 value 的属相直接访问
-        double num; //数值，当type==JSON_NUM时有效
-        BOOL bol;   //布尔值，当type==JSON_BOL时有效
-        char *str;  //字符串值，堆中分配的一个字符串，当type==JSON_STR时有效
-        array arr;  //值数组，当type==JSON_ARR时有效
-        object obj; //对象，当type==JSON_OBJ时有效
-    };
+    slab_chunk *next;
+    allocator alloc; // 申请大块时的全局分配器，归还时使用
+    U32 gen;         // 申请大块时的 slab_gen
+    U32 carved;      // 已经切分出的对象个数
+    U32 free;        // json_slab_trim 统计出的空闲对象个数
 };
+#define SLAB_HEAD ((sizeof(slab_chunk) + 15) & ~(size_t)15) // 对象仍按 16 字节对齐
 
 /**
- *  @brief 新建一个type类型的JSON值，采用缺省值初始化
- *  
- *  @param [in] type JSON值的类型，见json_e的定义
- *  @return 堆分配的JSON值
- *  
- *  @details 
- *  1. 对于数值，初始化为0
- *  2. 对于BOOL，初始化为FALSE
- *  3. 对于字符串，初始化为NULL
- *  4. 对于OBJ，初始化为空对象
- *  5. 对于ARR，初始化为空数组
+ * @brief 一个尺寸等级的全局仓库，由 slab_lock 保护
  */
-JSON *json_new(json_e type)
+typedef struct slab_depot
 {
-    JSON *json = (JSON *)calloc(1, sizeof(JSON));
-    if (!json)
-    {
-        //想想：为什么输出到stderr，不用printf输出到stdout？
-        fprintf(stderr, "json_new: calloc(%lu) failed\n", sizeof(JSON));
-        return NULL;
-    }
-    json->type = type;
-    switch (type)
-    {
-    case JSON_STR:
-        json->str = NULL;
-        break;
-    case JSON_ARR:
-
-        json->arr.elems = (value **)calloc(1, sizeof(value *));
-        if (!json->arr.elems)
-        {
-            free(json);
-            fprintf(stderr, "json_new: calloc(%lu) failed\n", sizeof(value *));
-            return NULL;
-        }
-        json->arr.count = 0;
-        json->arr.size = 1;
-        break;
-    case JSON_OBJ:
+    slab_obj *free;  // 线程缓存归还的对象
+    slab_obj *stale; // 换过全局分配器之后，旧分配器的大块中的空闲对象，不再分出去，只等整理时归还
+    char *bump;      // 当前大块中尚未切分的部分
+    char *end;
+} slab_depot;
 
-        json->obj.kvs = (keyvalue *)calloc(1, sizeof(keyvalue));
-        if (!json->obj.kvs)
-        {
-            free(json);
-            fprintf(stderr, "json_new: calloc(%lu) failed\n", sizeof(keyvalue));
-            return NULL;
-        }
-        json->obj.count = 0;
-        json->obj.size = 1;
-        break;
-    default:
-        break;
-    }
-    return json;
-}
 /**
- * @brief 释放一个JSON值
- * @param json json值
- * @details
- * 该JSON值可能含子成员，也要一起释放
- * 可以接受 json 为 NULL
+ * @brief 线程缓存，分配和释放通常只访问这里，不加锁
  */
-void json_free(JSON *json)
+typedef struct slab_cache
 {
-    if (!json)
-    {
-        return;
-    }
+    slab_obj *free[SLAB_CLASSES];
+    U32 count[SLAB_CLASSES];
+    BOOL registered; // 是否已登记线程退出时的清理函数
+} slab_cache;
+
+static pthread_mutex_t slab_lock = PTHREAD_MUTEX_INITIALIZER;
+static slab_depot slab_depots[SLAB_CLASSES];
+static slab_chunk *slab_chunks; // 申请过、尚未归还的所有大块
+static U32 slab_gen;            // 每换一次全局分配器加一
+static __thread slab_cache slab_tls;
+static pthread_key_t slab_key;
+static pthread_once_t slab_once = PTHREAD_ONCE_INIT;
 
-    switch (json->type)
-    {
-    case JSON_STR:
-        free(json->str);
-        free(json);
-        break;
-    case JSON_ARR:
-        for (int i = 0; i < json->arr.count; i++)
-        {
-            json_free(json->arr.elems[i]);
-        }
-        free(json->arr.elems);
-        free(json);
-        break;
-    case JSON_OBJ:
-        for (int i = 0; i < json->obj.count; i++)
-        {
-            free(json->obj.kvs[i].key);
-            json_free(json->obj.kvs[i].val);
-        }
-        free(json->obj.kvs);
-        free(json);
-        break;
-    default:
-        free(json);
-        break;
-    }
-}
 /**
- * @brief 获取JSON值json的类型
- * @param json json值
- * @return json的实际类型
+ * @brief bytes 字节所属的尺寸等级，调用者保证 bytes 不超过 SLAB_MAX
  */
-json_e json_type(const JSON *json)
+static U32 slab_class(size_t bytes)
 {
-    assert(json);
-    return json ? json->type : JSON_NONE;
+    if (bytes <= 128)
+        return bytes ? (U32)((bytes - 1) >> 4) : 0;
+    if (bytes <= 256)
+        return 8 + (U32)((bytes - 129) >> 5);
+    return 12 + (U32)((bytes - 257) >> 6);
 }
 /**
- * @brief 新建一个BOOL类型的JSON值
- * @param val 新建JSON的初值
- * @return JSON* JSON值，失败返回NULL
+ * @brief 对象所在的大块
  */
-JSON *json_new_bool(BOOL val)
+static slab_chunk *slab_of(const void *ptr)
 {
-    JSON *json = json_new(JSON_BOL);
-    if (!json)
-        return NULL;
-    json->bol = val;
-    return json;
+    return (slab_chunk *)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
 }
 /**
- * @brief 新建一个数字类型的JSON值
- * @param val 新建JSON的初值
- * @return JSON* JSON值，失败返回NULL
+ * @brief 把线程缓存中 cls 等级的前 n 个对象还给全局仓库
+ * @details 不内联，免得 slab_put 的快速路径为它保存寄存器
  */
-JSON *json_new_num(double val)
+__attribute__((noinline)) static void slab_flush(slab_cache *c, U32 cls, U32 n)
 {
+    slab_obj *head = c->free[cls], *tail = head;
 
-    JSON *json = json_new(JSON_NUM);
-    if (!json)
-        return NULL;
-    json->num = val;
-    return json;
+    if (n == 0 || !head)
+        return;
+    for (U32 i = 1; i < n; i++)
+        tail = tail->next;
+    c->free[cls] = tail->next;
+    c->count[cls] -= n;
+    pthread_mutex_lock(&slab_lock);
+    tail->next = slab_depots[cls].free;
+    slab_depots[cls].free = head;
+    pthread_mutex_unlock(&slab_lock);
 }
 /**
- * @brief 新建一个字符串类型的JSON值
- * @param str 新建JSON的初值
- * @return JSON* JSON值，失败返回NULL
+ * @brief 线程退出时把它缓存的对象全部还给全局仓库
  */
-JSON *json_new_str(const char *str)
+static void slab_thread_exit(void *arg)
 {
-    JSON *json;
-    assert(str);
-
-    json = json_new(JSON_STR);
-    if (!json)
-        return json;
-    json->str = strdup(str);
-    if (!json->str)
-    {
-        fprintf(stderr, "json_new_str: strdup(%s) failed", str);
-        json_free(json);
-        return NULL;
-    }
-    return json;
+    slab_cache *c = (slab_cache *)arg;
+    for (U32 cls = 0; cls < SLAB_CLASSES; cls++)
+        slab_flush(c, cls, c->count[cls]);
+    c->registered = FALSE; // 之后的其他清理函数还可能释放 JSON，届时重新登记
 }
-//想想：json_num和json_str为什么带一个def参数？ 方便用户自定义函数执行失败时的返回值，同时防止固定的错误返回值与 JSON_NUM 的内容一致导致误判
-/**
- * @brief 获取JSON_NUM类型JSON值的数值
- * 
- * @param json 数值类型的JSON值
- * @param def   类型不匹配时返回的缺省值
- * @return double 如果json是合法的JSON_NUM类型，返回其数值，否则返回缺省值def
- */
-double json_num(const JSON *json, double def)
+static void slab_key_init(void)
 {
-    //想想：为什么这里不assert(json)? 在 return 中会判断
-    return json && json->type == JSON_NUM ? json->num : def;
+    pthread_key_create(&slab_key, slab_thread_exit);
 }
 /**
- * @brief 获取JSON_BOOL类型JSON值的布尔值
- * 
- * @param json 布尔值类型的JSON值
- * @return BOOL 如果json是合法的JSON_BOL类型，返回其数值，否则返回FALSE
+ * @brief 线程缓存中 cls 等级的对象用完时，从全局仓库取一批，仓库也空了则切分大块
+ * @return 取到的第一个对象，内存不足返回 NULL
  */
-BOOL json_bool(const JSON *json)
+__attribute__((noinline)) static slab_obj *slab_refill(slab_cache *c, U32 cls)
 {
-    //想想：为什么这里不assert(json)? 在 return 中会判断
-    return json && json->type == JSON_BOL ? json->bol : FALSE;
+    size_t size = slab_sizes[cls];
+    slab_depot *d = &slab_depots[cls];
+    U32 n = 0;
+
+    if (!c->registered)
+    {
+        pthread_once(&slab_once, slab_key_init);
+        pthread_setspecific(slab_key, c);
+        c->registered = TRUE;
+    }
+    pthread_mutex_lock(&slab_lock);
+    while (n < SLAB_BATCH && d->free)
+    {
+        slab_obj *obj = d->free;
+        d->free = obj->next;
+        if (slab_of(obj)->gen != slab_gen)
+        {
+            obj->next = d->stale;
+            d->stale = obj;
+            continue;
+        }
+        obj->next = c->free[cls];
+        c->free[cls] = obj;
+        n++;
+    }
+    for (; n < SLAB_BATCH; n++)
+    {
+        if ((size_t)(d->end - d->bump) < size)
+        {
+            slab_chunk *chunk = (slab_chunk *)heap.alloc(heap.user, SLAB_SIZE, SLAB_SIZE);
+            if (!chunk)
+                break;
+            chunk->next = slab_chunks;
+            chunk->alloc = heap;
+            chunk->gen = slab_gen;
+            chunk->carved = 0;
+            slab_chunks = chunk;
+            d->bump = (char *)chunk + SLAB_HEAD;
+            d->end = (char *)chunk + SLAB_SIZE;
+        }
+        slab_obj *obj = (slab_obj *)d->bump;
+        d->bump += size;
+        slab_of(obj)->carved++;
+        obj->next = c->free[cls];
+        c->free[cls] = obj;
+    }
+    pthread_mutex_unlock(&slab_lock);
+    c->count[cls] += n;
+    return c->free[cls];
 }
 /**
- * @brief 获取JSON_STR类型JSON值的字符串值
- * 
- * @param json 字符串类型的JSON值
- * @param def   类型不匹配时返回的缺省值
- * @return const char* 如果json是合法的JSON_STR类型，返回其字符串值，否则返回def
+ * @brief 从 slab 中分配 bytes 字节，超过 SLAB_MAX 时交给全局分配器
  */
-const char *json_str(const JSON *json, const char *def)
+static void *slab_get(size_t bytes)
 {
-    //想想：为什么这里不assert(json)? 在 return 中会判断
-    return json && json->type == JSON_STR ? json->str : def;
+    if (bytes > SLAB_MAX)
+        return heap_alloc(bytes);
+    U32 cls = slab_class(bytes);
+    slab_cache *c = &slab_tls;
+    slab_obj *obj = c->free[cls];
+    if (!obj && !(obj = slab_refill(c, cls)))
+        return NULL;
+    c->free[cls] = obj->next;
+    c->count[cls]--;
+    return obj;
 }
 /**
- * @brief 从对象类型的JSON值中获取名字为key的成员(JSON值)
- * @param json 对象类型的JSON值
- * @param key  成员的键名
- * @return 找到的成员
- * @details 要求json是个对象类型
+ * @brief 把 slab_get 得到的 bytes 字节放回当前线程的缓存，缓存过多时还一批给全局仓库
  */
-const JSON *json_get_member(const JSON *json, const char *key)
+static void slab_put(void *ptr, size_t bytes)
 {
-    U32 i;
-    assert(json);
-    assert(json->type == JSON_OBJ);
-    assert(!(json->obj.count > 0 && json->obj.kvs == NULL));
-    assert(key);
-    assert(key[0]);
-
-    for (i = 0; i < json->obj.count; ++i)
+    if (!ptr)
+        return;
+    if (bytes > SLAB_MAX)
     {
-        if (strcmp(json->obj.kvs[i].key, key) == 0)
-            return json->obj.kvs[i].val;
+        heap_free(ptr);
+        return;
     }
-    return NULL;
+    U32 cls = slab_class(bytes);
+    slab_cache *c = &slab_tls;
+    slab_obj *obj = (slab_obj *)ptr;
+    obj->next = c->free[cls];
+    c->free[cls] = obj;
+    if (++c->count[cls] > 2 * SLAB_BATCH)
+        slab_flush(c, cls, SLAB_BATCH);
 }
 /**
- * 从数组类型的JSON值中获取第idx个元素(子JSON值)
- * @param json 数组类型的JSON值
- * @param idx  元素的索引值
- * @return 找到的元素(JSON值的指针)
- * @details 要求json是个数组
+ * @brief 两个大小是否落在同一个尺寸等级，此时调整大小不用搬动
  */
-const JSON *json_get_element(const JSON *json, U32 idx)
+static BOOL slab_same(size_t a, size_t b)
 {
-    assert(json);
-    assert(json->type == JSON_ARR);
-    assert(!(json->arr.count > 0 && json->arr.elems == NULL));
-
-    if (idx >= json->arr.count) // idx 为无符号整数，因此一定大于等于零
-        return NULL;
-    return json->arr.elems[idx];
+    return a <= SLAB_MAX && b <= SLAB_MAX && slab_class(a) == slab_class(b);
 }
 /**
- * @brief 将 str 中的特殊字符全部转意，并在末尾添加换行符
- * @param str 要处理的字符串
- * @return 处理好的字符串
+ * @brief 把链表 list 中的对象计入所在大块的空闲个数
  */
-static char *transfer_str(const char *str)
+static void slab_count(const slab_obj *list)
 {
-    char *ret = (char *)malloc((strlen(str) * 2 + 2) * sizeof(char));
-    if (!ret)
-    {
-        fprintf(stderr, "transfer_str: malloc failed!\n");
-        return NULL;
-    }
-    int i = 0, len = strlen(str), j = 0;
-    while (i < len)
-    {
-        switch (str[i])
-        {
-        case '\n':
-            ret[j++] = '\\';
-            ret[j++] = 'n';
-            i++;
-            break;
-        case '\a':
-            ret[j++] = '\\';
-            ret[j++] = 'a';
-            i++;
-            break;
-        case '\b':
-            ret[j++] = '\\';
-            ret[j++] = 'b';
-            i++;
-            break;
-        case '\f':
-            ret[j++] = '\\';
-            ret[j++] = 'f';
-            i++;
-            break;
-        case '\r':
-            ret[j++] = '\\';
-            ret[j++] = 'r';
-            i++;
-            break;
-        case '\t':
-            ret[j++] = '\\';
-            ret[j++] = 't';
-            i++;
-            break;
-        case '\v':
-            ret[j++] = '\\';
-            ret[j++] = 'v';
-            i++;
-            break;
-        default:
-            ret[j++] = str[i++];
-            break;
-        }
-    }
-    ret[j++] = '\n';
-    ret[j] = '\0';
-    return ret;
+    for (; list; list = list->next)
+        slab_of(list)->free++;
 }
 /**
- * @brief 将双精度浮点数转换为字符串，并去除多余的 0
- * @param num 要转换的数字
- * @param buf 存放字符串的缓冲区
- * @return 返回值为空
+ * @brief 从链表中摘除所在大块已经完全空闲的对象
  */
-void JSON_NUM_to_string(double num, char *const buf)
+static void slab_unlink(slab_obj **link)
 {
-    sprintf(buf, "%f", num);
-    for (int i = strlen(buf) - 1; i >= 0; i--)
+    while (*link)
     {
-        if (buf[i] == '.')
-        {
-            buf[i] = '\n';
-            buf[i + 1] = '\0';
-            break;
-        }
-        else if (buf[i] != '0')
-        {
-            buf[i + 1] = '\n';
-            buf[i + 2] = '\0';
-            break;
-        }
+        slab_chunk *chunk = slab_of(*link);
+        if (chunk->free == chunk->carved)
+            *link = (*link)->next;
+        else
+            link = &(*link)->next;
     }
 }
 /**
- * @brief 将 JSON 对象转换为 YAML 格式并存储在 fp 打开的文件中
- * @param space_num 当前 json 对象转换为 YAML 格式时需要缩进的空格数
- * @param falg 记录了上一层 JSON 对象的类型
- * @param fp 指向存放 YAML 格式内容的文件的指针
- * @param json 要转换的 JSON 对象
- * @param error 常指针，用于记录函数执行过程中是否出错，*error=0 时未出错，非 0 时表示出错了
- * @return 转换成功时返回 0，失败时返回非 0 整数
+ * @brief 把完全空闲的大块还给申请它时的分配器
+ * @details
+ *  先把当前线程缓存的对象全部还给全局仓库，再统计仓库中每个大块的空闲对象个数，
+ *  空闲个数等于切分出的个数的大块没有任何对象在使用。其他线程缓存的对象在线程退出时才回到仓库，
+ *  它们所在的大块要等下次整理
  */
-static int json_to_yaml(const JSON *json, FILE *fp, int space_num, json_e flag, int *const error)
+void json_slab_trim(void)
 {
-    if (*error != 0)
+    slab_cache *c = &slab_tls;
+    slab_chunk **link = &slab_chunks, *chunk;
+
+    for (U32 cls = 0; cls < SLAB_CLASSES; cls++)
+        slab_flush(c, cls, c->count[cls]);
+    pthread_mutex_lock(&slab_lock);
+    for (chunk = slab_chunks; chunk; chunk = chunk->next)
+        chunk->free = 0;
+    for (U32 cls = 0; cls < SLAB_CLASSES; cls++)
     {
-        return *error;
+        slab_count(slab_depots[cls].free);
+        slab_count(slab_depots[cls].stale);
     }
-    switch (json->type)
-    {
-    case JSON_NUM:
+    for (U32 cls = 0; cls < SLAB_CLASSES; cls++)
     {
-        char *buf = malloc(320 * sizeof(char));
-        if (!buf)
-        {
-            fprintf(stderr, "json_to_yaml: JSON_NUM malloc failed\n");
-            *error = -1;
-            return -1;
-        }
-        JSON_NUM_to_string(json->num, buf); // 添加了换行符
-        int num_sucess = fwrite(buf, sizeof(char), strlen(buf), fp);
-        if (num_sucess != strlen(buf))
-        {
-            fprintf(stderr, "json_to_yaml: write JSON_NUM into file failed!\n");
-            *error = -1;
-            free(buf);
-            return -1;
-        }
-        free(buf);
-        return 0;
+        slab_depot *d = &slab_depots[cls];
+        slab_unlink(&d->free);
+        slab_unlink(&d->stale);
+        if (d->end && slab_of(d->end - 1)->free == slab_of(d->end - 1)->carved)
+            d->bump = d->end = NULL;
     }
-
-    case JSON_BOL:
+    while ((chunk = *link))
     {
-        char buf[7];
-        if (json->bol != 0)
+        if (chunk->free == chunk->carved)
         {
-            strcpy(buf, "true");
+            *link = chunk->next;
+            chunk->alloc.free(chunk->alloc.user, chunk);
         }
         else
-        {
-            strcpy(buf, "false");
-        }
-        strcat(buf, "\n");
-        int num_sucess = fwrite(buf, sizeof(char), strlen(buf), fp);
-        if (num_sucess != strlen(buf))
-        {
-            fprintf(stderr, "json_to_yaml: write JSON_BOL into file failed!\n");
-            *error = -1;
-            return -1;
+            link = &chunk->next;
+    }
+    pthread_mutex_unlock(&slab_lock);
+}
+/**
+ * @brief 更换全局分配器之前调用：归还空闲的大块，旧分配器的大块中剩下的对象不再分出去
+ */
+static void slab_retire(void)
+{
+    json_slab_trim();
+    pthread_mutex_lock(&slab_lock);
+    slab_gen++;
+    for (U32 cls = 0; cls < SLAB_CLASSES; cls++)
+        slab_depots[cls].bump = slab_depots[cls].end = NULL;
+    pthread_mutex_unlock(&slab_lock);
+}
+#else
+// 定义 JSON_NO_SLAB 时节点和成员数组直接使用全局分配器
+#define slab_get(bytes) heap_alloc(bytes)
+#define slab_put(ptr, bytes) heap_free(ptr)
+#define slab_same(a, b) FALSE
+#define slab_retire()
+#define SLAB_MAX 0
+
+void json_slab_trim(void)
+{
+}
+#endif // JSON_NO_SLAB
+
+/**
+ *  想想：这些结构体定义在.c是为什么？
+ */
+/**
+ *  想想：如果要提升内存分配效率，这个结构体该作什么变化？
+ */
+typedef struct packed packed;
+
+struct array
+{
+    union {
+        value **elems; /* 想想: 这里如果定义为'value *elems'会怎样？ 会导致数组中无法添加新元素*/
+        packed *pk;    // 打包的数组，当数组节点的flags含JSON_F_PACKED时有效
+    };
+    U32 count;     //elems中有多少个value*
+    U32 size;      // 数组 array 的容量
+};
+
+/**
+ * @brief 打包的数组：元素都是数值或都是布尔值时，按原始值紧凑存放，不再为每个元素分配节点
+ * @details
+ *  数值存放为 double 数组，整数存放为 int64_t 数组，布尔值存放为 BOOL 数组。json_arr_get_num 等接口直接读取原始值；
+ *  json_get_element 等需要元素节点时一次生成全部节点，记录在 boxed 中，数组本身保持打包，
+ *  所以多个线程可以同时读取；修改数组（json_add_element、按路径替换元素等）时才永久转为普通数组
+ */
+struct packed
+{
+    value **boxed;   // 按需生成的元素节点，NULL 表示还没有生成
+    uint64_t data[]; // 原始值：按 etype 是 double、int64_t 或 BOOL 数组
+};
+
+/**
+ * @brief 对象的键值对
+ */
+struct keyvalue
+{
+    json_key *key; //键名，指向共享的键名原子
+    value *val;    //值
+};
+
+/**
+ *  想想：如果要提升内存分配效率，这个结构体该作什么变化？
+ */
+struct object
+{
+    keyvalue *kvs; //这是一个keyvalue的数组，可以通过realloc的方式扩充的动态数组，容量较大时后面紧跟着哈希索引
+    U32 count;     //数组kvs中有几个键值对
+    U32 size;      // 数组 kvs 的容量
+};
+
+#define OBJ_INDEX_MIN 16 // kvs 的容量达到该值时，在 kvs 后面为对象建立哈希索引
+
+/**
+ * @brief 对象哈希索引的槽位，采用开放定址（线性探测）
+ * @details 键值对本身仍然按插入顺序存放在 kvs 中，索引只记录下标，所以不影响输出顺序
+ */
+typedef struct obj_slot
+{
+    U32 pos;  // 键值对在 kvs 中的下标 + 1，0 表示空槽
+    U32 hash; // 键名的哈希值，探测时先比较哈希值，相同再比较字符串
+} obj_slot;
+
+typedef struct lazy_src lazy_src;
+
+/**
+ * @brief 延迟解析的对象或数组：只记录它在结构索引中的位置，第一次访问时才展开
+ */
+typedef struct lazy_ref
+{
+    lazy_src *src; // 所属文本及其结构索引
+    U32 at;        // '{' 或 '[' 在结构索引中的下标
+} lazy_ref;
+
+/**
+ * @brief JSON值，16 字节
+ * @details
+ *  前 8 字节是类型、标志位等头部，后 8 字节是标量的值或指向容器头部（array/object）的指针。
+ *  容器头部不在节点中，与节点一起分配、紧跟在节点后面，所以标量节点只占 16 字节。
+ *  内联的短字符串从第 4 个字节开始，占用头部剩下的空间和后 8 字节；
+ *  其余节点头部的后 4 字节是快照之间共享的引用计数，见 json_snapshot
+ */
+// 不超过该长度的字符串直接存放在节点中，加上 '\0' 恰好占满节点。
+// 16 字节的节点除去类型、标志位、长度和 '\0' 只剩 12 字节，13~15 字节的字符串（如较长的 IPv4 地址）放不下，单独分配
+#define JSON_SSO_MAX 12
+
+struct value
+{
+    union {
+        struct {
+            unsigned char type;  //JSON值的具体类型，见json_e的定义
+            unsigned char flags; //JSON_F_* 标志位
+            union {
+                unsigned char slen;  //内联字符串的长度，当flags含JSON_F_INLINE时有效
+                unsigned char etype; //打包数组的元素类型（JSON_NUM、JSON_INT 或 JSON_BOL），当flags含JSON_F_PACKED时有效
+            };
+            char sso[JSON_SSO_MAX + 1]; //内联的短字符串，当flags含JSON_F_INLINE时有效
+        };
+        struct {
+            unsigned char head[4]; //与上面的 type、flags、slen 和 sso 的第一个字节重叠
+            U32 refs;              //除自己的父节点外，还有几处引用该节点；内联字符串没有该字段，从不共享
+            union {
+                double num;    //数值，当type==JSON_NUM时有效
+                int64_t i64;   //整数值，当type==JSON_INT时有效
+                BOOL bol;      //布尔值，当type==JSON_BOL时有效
+                char *str;     //字符串值，堆中分配的一个字符串，当type==JSON_STR时有效
+                array *arr;    //值数组的头部，紧跟在节点后面，当type==JSON_ARR时有效
+                object *obj;   //对象的头部，紧跟在节点后面，当type==JSON_OBJ时有效
+                lazy_ref *lazy; //延迟解析的位置，占用容器头部的位置，当flags含JSON_F_LAZY时有效
+            };
+        };
+    };
+};
+
+_Static_assert(sizeof(value) == 16, "struct value must stay 16 bytes");
+#define HEADER_BYTES (sizeof(array) > sizeof(object) ? sizeof(array) : sizeof(object)) // 容器头部的大小
+_Static_assert(sizeof(lazy_ref) <= sizeof(array) && sizeof(lazy_ref) <= sizeof(object),
+               "lazy_ref lives in the container header");
+
+#define JSON_F_ARENA 0x01    // 节点及其字符串、键名、成员数组都分配在 json_doc 的内存池中
+#define JSON_F_BORROWED 0x02 // 字符串不归节点所有（指向文档映射的文件），释放节点时不释放字符串
+#define JSON_F_DOCROOT 0x04  // 文档的根节点，对它调用 json_free 时释放整个文档
+#define JSON_F_LAZY 0x08     // 尚未展开的对象或数组，成员还没有解析，见 lazy_load
+#define JSON_F_INLINE 0x10   // 字符串存放在节点的 sso 中，没有单独分配内存
+#define JSON_F_PACKED 0x20   // 数组的元素按原始值打包存放，见 struct packed
+#define JSON_F_WIDE 0x40     // 节点后面带有容器头部的空间，节点的类型改变后仍然保留，释放时据此得到节点的大小
+#define JSON_F_FROZEN 0x80   // 节点位于 json_open_frozen 映射的只读映像中，不能修改，也不单独释放
+
+#define ARENA_CHUNK (64 * 1024)   // 内存块的大小，也是它的对齐值，节点据此找到所属的内存块
+#define ARENA_BIG (ARENA_CHUNK / 4) // 超过该大小的内存单独分配一个大块，大块中不放节点
+
+typedef struct arena_chunk arena_chunk;
+
+/**
+ * @brief 内存池中的一个内存块
+ */
+struct arena_chunk
+{
+    arena_chunk *next; // 链表中的下一个内存块
+    json_doc *doc;     // 所属文档
+    size_t size;       // data 的容量
+    size_t used;       // data 中已分配出去的字节数
+    char data[];
+};
+
+typedef struct doc_map doc_map;
+
+/**
+ * @brief 文档中映射的一个文件，节点中的字符串可以直接指向映射区
+ */
+struct doc_map
+{
+    doc_map *next; // 链表中的下一个映射
+    void *addr;    // 映射的起始地址
+    size_t len;    // 映射的长度
+};
+
+/**
+ * @brief 延迟加载的一段文本及其结构索引
+ */
+struct lazy_src
+{
+    lazy_src *next;  // 链表中的下一段文本
+    const char *buf; // JSON 文本，指向文档映射的文件
+    size_t len;      // 文本长度
+    U32 *pos;        // 所有结构字符的偏移
+    U32 *close;      // 第 i 个结构字符是 '{' 或 '[' 时，close[i] 是与之配对的结束符的下标
+    U32 count;       // 结构字符的个数
+};
+
+/**
+ * @brief 释放延迟加载的结构索引，文本由文档中的映射负责
+ */
+static void lazy_src_free(lazy_src *src)
+{
+    heap_free(src->pos);
+    heap_free(src->close);
+    heap_free(src);
+}
+
+/**
+ * @brief 键名的驻留表，采用开放定址（线性探测），相同的键名只保存一份
+ * @details 文档中的表随文档重置；堆中解析时每次解析用一张临时表，表持有每个原子的一个引用
+ */
+typedef struct key_table
+{
+    json_key **slots; // 槽位，NULL 表示空槽
+    U32 count;        // 已驻留的键名个数
+    U32 size;         // 槽位个数，为 2 的幂
+} key_table;
+
+/**
+ * @brief JSON 文档：一个按顺序分配（bump allocation）的内存池
+ * @details
+ *  文档中的节点、字符串、键名和成员数组都从大块内存中顺序切分，
+ *  对单个节点调用 json_free 不做任何事，json_doc_free 一次释放全部内存，
+ *  json_doc_reset 则保留内存块供下一次使用
+ */
+struct json_doc
+{
+    arena_chunk *chunks;     // 正在使用的内存块，链表头是当前用于分配的块
+    arena_chunk *spare;      // json_doc_reset 回收的空闲内存块
+    arena_chunk *bigs;       // 正在使用的大块
+    arena_chunk *spare_bigs; // json_doc_reset 回收的空闲大块
+    doc_map *maps;           // json_doc_load_mmap 映射的文件，重置或释放文档时解除映射
+    lazy_src *lazies;        // json_doc_load_lazy 加载的文本的结构索引，重置或释放文档时释放
+    key_table keys;          // 文档中所有对象共享的键名
+    allocator alloc;         // 为内存块和大块分配内存，缺省为创建文档时的全局分配器
+    json_mem_stats stats;    // 分配时累加的计数器，见 json_doc_stats
+    char *block;             // 预留的一整块连续内存，内存块和大块先从中顺序切分，见 json_compact
+    size_t block_size;       // block 的大小，是 ARENA_CHUNK 的整数倍
+    size_t block_used;       // block 中已切分出去的字节数
+};
+
+/**
+ * @brief 从文档预留的连续内存中切出 bytes 字节（向上取整到 ARENA_CHUNK），不够时返回 NULL
+ */
+static arena_chunk *block_carve(json_doc *doc, size_t bytes)
+{
+    bytes = (bytes + ARENA_CHUNK - 1) & ~(size_t)(ARENA_CHUNK - 1);
+    if (!doc->block || doc->block_size - doc->block_used < bytes)
+        return NULL;
+    arena_chunk *chunk = (arena_chunk *)(doc->block + doc->block_used);
+    doc->block_used += bytes;
+    return chunk;
+}
+/**
+ * @brief 释放内存块或大块，切自预留内存的随预留内存一起释放
+ */
+static void chunk_free(json_doc *doc, arena_chunk *chunk)
+{
+    if ((char *)chunk < doc->block || (char *)chunk >= doc->block + doc->block_size)
+        doc->alloc.free(doc->alloc.user, chunk);
+}
+
+/**
+ * @brief 为内存池换一个新的内存块
+ * @details 内存块按 ARENA_CHUNK 对齐，块头记录所属文档，节点不必再单独保存文档指针
+ */
+static arena_chunk *arena_grow(json_doc *doc)
+{
+    arena_chunk *chunk = doc->spare;
+
+    // 优先复用 json_doc_reset 回收的内存块
+    if (chunk)
+    {
+        doc->spare = chunk->next;
+    }
+    else
+    {
+        chunk = block_carve(doc, ARENA_CHUNK);
+        if (!chunk)
+            chunk = (arena_chunk *)doc->alloc.alloc(doc->alloc.user, ARENA_CHUNK, ARENA_CHUNK);
+        if (!chunk)
+        {
+            fprintf(stderr, "arena_grow: alloc(%d) failed\n", ARENA_CHUNK);
+            return NULL;
+        }
+        chunk->doc = doc;
+        chunk->size = ARENA_CHUNK - sizeof(arena_chunk);
+    }
+    chunk->used = 0;
+    chunk->next = doc->chunks;
+    doc->chunks = chunk;
+    return chunk;
+}
+/**
+ * @brief 为超过 ARENA_BIG 的请求单独分配一个大块，整块都分配出去
+ */
+static void *arena_big(json_doc *doc, size_t bytes)
+{
+    arena_chunk **pp = &doc->spare_bigs;
+    arena_chunk *chunk;
+
+    while (*pp && (*pp)->size < bytes)
+        pp = &(*pp)->next;
+    if (*pp)
+    {
+        chunk = *pp;
+        *pp = chunk->next;
+    }
+    else
+    {
+        chunk = block_carve(doc, sizeof(arena_chunk) + bytes);
+        if (!chunk)
+            chunk = (arena_chunk *)doc->alloc.alloc(doc->alloc.user, sizeof(arena_chunk) + bytes, JSON_ALLOC_ALIGN);
+        if (!chunk)
+        {
+            fprintf(stderr, "arena_big: alloc(%lu) failed\n", (unsigned long)(sizeof(arena_chunk) + bytes));
+            return NULL;
+        }
+        chunk->doc = doc;
+        chunk->size = bytes;
+    }
+    chunk->used = chunk->size;
+    chunk->next = doc->bigs;
+    doc->bigs = chunk;
+    return chunk->data;
+}
+/**
+ * @brief 从内存池中分配 bytes 字节，按 8 字节对齐
+ */
+static void *arena_alloc(json_doc *doc, size_t bytes)
+{
+    arena_chunk *chunk = doc->chunks;
+    void *ptr;
+
+    bytes = (bytes + 7) & ~(size_t)7;
+    if (bytes > ARENA_BIG)
+        return arena_big(doc, bytes);
+    if (!chunk || chunk->size - chunk->used < bytes)
+    {
+        chunk = arena_grow(doc);
+        if (!chunk)
+            return NULL;
+    }
+    ptr = chunk->data + chunk->used;
+    chunk->used += bytes;
+    return ptr;
+}
+/**
+ * @brief 获取节点所属的文档，堆分配的节点返回 NULL
+ * @details 内存池中的节点总是分配在按 ARENA_CHUNK 对齐的内存块中，从块头读取所属文档
+ */
+static json_doc *node_doc(const JSON *json)
+{
+    return json->flags & JSON_F_ARENA ? ((arena_chunk *)((uintptr_t)json & ~(uintptr_t)(ARENA_CHUNK - 1)))->doc
+                                      : NULL;
+}
+/**
+ * @brief 分配 bytes 字节，doc 为 NULL 时从堆中分配，否则从文档的内存池中分配
+ */
+static void *mem_alloc(json_doc *doc, size_t bytes)
+{
+    void *ptr = doc ? arena_alloc(doc, bytes) : heap_alloc(bytes);
+    if (!ptr)
+        fprintf(stderr, "mem_alloc: alloc(%lu) failed\n", (unsigned long)bytes);
+    return ptr;
+}
+/**
+ * @brief 把 old 扩大到 new_bytes 字节
+ * @details 内存池不能原地扩大，分配新内存后拷贝，旧内存随文档一起释放
+ */
+static void *mem_grow(json_doc *doc, void *old, size_t old_bytes, size_t new_bytes)
+{
+    void *ptr;
+    if (!doc)
+        return heap_realloc(old, old_bytes, new_bytes);
+    ptr = arena_alloc(doc, new_bytes);
+    if (ptr)
+        memcpy(ptr, old, old_bytes);
+    return ptr;
+}
+/**
+ * @brief 释放 mem_alloc 分配的内存，内存池中的内存不单独释放
+ */
+static void mem_release(json_doc *doc, void *ptr)
+{
+    if (!doc)
+        heap_free(ptr);
+}
+/**
+ * @brief 为节点、容器头部或成员数组分配 bytes 字节，doc 为 NULL 时从 slab 中分配，否则从文档的内存池中分配
+ * @details 与 mem_alloc 不同，释放时需要给出大小，见 slab_release
+ */
+static void *slab_alloc(json_doc *doc, size_t bytes)
+{
+    void *ptr;
+    if (doc)
+    {
+        ptr = arena_alloc(doc, bytes);
+        doc->stats.container_bytes += bytes;
+    }
+    else
+    {
+        ptr = slab_get(bytes);
+    }
+    if (!ptr)
+        fprintf(stderr, "slab_alloc: alloc(%lu) failed\n", (unsigned long)bytes);
+    return ptr;
+}
+/**
+ * @brief 把 slab_alloc 分配的 old_bytes 字节扩大到 new_bytes 字节
+ */
+static void *slab_grow(json_doc *doc, void *old, size_t old_bytes, size_t new_bytes)
+{
+    if (doc)
+    {
+        doc->stats.container_bytes += new_bytes;
+        return mem_grow(doc, old, old_bytes, new_bytes);
+    }
+    if (old_bytes > SLAB_MAX && new_bytes > SLAB_MAX)
+        return heap_realloc(old, old_bytes, new_bytes);
+    if (slab_same(old_bytes, new_bytes))
+        return old;
+    void *ptr = slab_get(new_bytes);
+    if (!ptr)
+        return NULL;
+    memcpy(ptr, old, old_bytes < new_bytes ? old_bytes : new_bytes);
+    slab_put(old, old_bytes);
+    return ptr;
+}
+/**
+ * @brief 释放 slab_alloc 分配的 bytes 字节，内存池中的内存不单独释放
+ */
+static void slab_release(json_doc *doc, void *ptr, size_t bytes)
+{
+    if (!doc)
+        slab_put(ptr, bytes);
+}
+/**
+ * @brief 拷贝长度为 len 的字符串 str
+ */
+static char *str_dup(json_doc *doc, const char *str, size_t len)
+{
+    char *dup = (char *)mem_alloc(doc, len + 1);
+    if (!dup)
+        return NULL;
+    if (doc)
+        doc->stats.string_bytes += len + 1;
+    memcpy(dup, str, len);
+    dup[len] = '\0';
+    return dup;
+}
+
+/**
+ * @brief 计算长度为 len 的键名的哈希值（FNV-1a）
+ */
+static U32 key_hash_n(const char *key, size_t len)
+{
+    U32 h = 2166136261u;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (unsigned char)key[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+/**
+ * @brief 计算键名的哈希值
+ */
+static U32 key_hash(const char *key)
+{
+    return key_hash_n(key, strlen(key));
+}
+/**
+ * @brief 新建一个键名原子
+ * @param borrowed 为 TRUE 时原子直接指向 str，否则把 str 拷贝到原子后面
+ * @return 堆中的原子引用计数为 1，文档中的原子随文档释放，不计数；失败返回 NULL
+ */
+static json_key *key_new(json_doc *doc, const char *str, U32 len, U32 hash, BOOL borrowed)
+{
+    size_t bytes = sizeof(json_key) + (borrowed ? 0 : len + 1);
+    json_key *key = (json_key *)mem_alloc(doc, bytes);
+    if (!key)
+        return NULL;
+    if (doc)
+    {
+        doc->stats.key_bytes += bytes;
+        doc->stats.keys++;
+    }
+    key->refs = doc ? JSON_KEY_STATIC : 1;
+    key->hash = hash;
+    key->len = len;
+    if (borrowed)
+    {
+        key->str = str;
+    }
+    else
+    {
+        char *copy = (char *)(key + 1);
+        memcpy(copy, str, len);
+        copy[len] = '\0';
+        key->str = copy;
+    }
+    return key;
+}
+static json_key *key_retain(json_key *key)
+{
+    if (key->refs != JSON_KEY_STATIC)
+        __atomic_add_fetch(&key->refs, 1, __ATOMIC_RELAXED);
+    return key;
+}
+/**
+ * @brief 释放键名原子的一个引用，最后一个引用释放时释放原子
+ */
+static void key_release(json_key *key)
+{
+    if (key->refs != JSON_KEY_STATIC && __atomic_sub_fetch(&key->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        heap_free(key);
+}
+/**
+ * @brief 把原子放入驻留表中，表中还没有相同的键名
+ * @return 成功返回 0，内存不足返回 -1
+ */
+static int key_table_put(key_table *t, json_key *key)
+{
+    // 装载因子不超过 1/2
+    if ((t->count + 1) * 2 > t->size)
+    {
+        U32 size = t->size ? t->size * 2 : 64;
+        json_key **slots = (json_key **)heap_calloc(size * sizeof(json_key *));
+        if (!slots)
+        {
+            fprintf(stderr, "key_table_put: calloc(%lu) failed\n", (unsigned long)(size * sizeof(json_key *)));
+            return -1;
+        }
+        for (U32 i = 0; i < t->size; i++)
+        {
+            if (!t->slots[i])
+                continue;
+            U32 j = t->slots[i]->hash & (size - 1);
+            while (slots[j])
+                j = (j + 1) & (size - 1);
+            slots[j] = t->slots[i];
+        }
+        heap_free(t->slots);
+        t->slots = slots;
+        t->size = size;
+    }
+    U32 i = key->hash & (t->size - 1);
+    while (t->slots[i])
+        i = (i + 1) & (t->size - 1);
+    t->slots[i] = key;
+    t->count++;
+    return 0;
+}
+/**
+ * @brief 在驻留表 t 中查找长度为 len 的键名 str，没有则新建
+ * @param doc 新原子分配在该文档中，为 NULL 时分配在堆中，表另外持有它的一个引用
+ * @param borrowed 新建时原子是否直接指向 str
+ * @return 键名原子，已为调用者增加一个引用；失败返回 NULL
+ */
+static json_key *key_intern(key_table *t, json_doc *doc, const char *str, U32 len, BOOL borrowed)
+{
+    U32 hash = key_hash_n(str, len);
+    if (t->size)
+    {
+        for (U32 i = hash & (t->size - 1); t->slots[i]; i = (i + 1) & (t->size - 1))
+        {
+            json_key *key = t->slots[i];
+            if (key->hash == hash && key->len == len && memcmp(key->str, str, len) == 0)
+                return key_retain(key);
+        }
+    }
+    json_key *key = key_new(doc, str, len, hash, borrowed);
+    if (!key)
+        return NULL;
+    if (key_table_put(t, key) < 0)
+    {
+        key_release(key);
+        return NULL;
+    }
+    return key_retain(key);
+}
+/**
+ * @brief 清空驻留表，释放表持有的引用，保留槽位供之后使用
+ */
+static void key_table_clear(key_table *t)
+{
+    for (U32 i = 0; i < t->size && t->count; i++)
+    {
+        if (t->slots[i])
+        {
+            key_release(t->slots[i]);
+            t->slots[i] = NULL;
+            t->count--;
+        }
+    }
+}
+/**
+ * @brief 为长度为 len 的键名 str 获取一个原子，文档中的键名在文档内驻留，堆中的键名单独分配
+ */
+static json_key *key_make(json_doc *doc, const char *str, size_t len)
+{
+    json_key *key;
+    if (len >= JSON_KEY_STATIC)
+        return NULL;
+    if (doc)
+        key = key_intern(&doc->keys, doc, str, (U32)len, FALSE);
+    else
+        key = key_new(NULL, str, (U32)len, key_hash_n(str, len), FALSE);
+    if (!key)
+        fprintf(stderr, "key_make: alloc key [%.*s] failed\n", (int)len, str);
+    return key;
+}
+/**
+ * @brief 容量为 size 的对象需要的索引槽位数，取不小于 2 * size 的 2 的幂，保证装载因子不超过 1/2
+ */
+static U32 index_slots(U32 size)
+{
+    U32 n = 1;
+    while (n < size * 2)
+        n <<= 1;
+    return n;
+}
+/**
+ * @brief 容量为 size 的对象，kvs 需要分配的字节数（包括哈希索引）
+ */
+static size_t obj_buf_bytes(U32 size)
+{
+    size_t bytes = size * sizeof(keyvalue);
+    if (size >= OBJ_INDEX_MIN)
+        bytes += index_slots(size) * sizeof(obj_slot);
+    return bytes;
+}
+/**
+ * @brief 获取对象的哈希索引，小对象没有索引，返回 NULL
+ */
+static obj_slot *obj_index(const object *obj)
+{
+    return obj->size >= OBJ_INDEX_MIN ? (obj_slot *)(obj->kvs + obj->size) : NULL;
+}
+/**
+ * @brief 把下标为 pos 的键值对登记到索引中
+ */
+static void index_insert(obj_slot *slots, U32 nslot, U32 hash, U32 pos)
+{
+    U32 i = hash & (nslot - 1);
+    while (slots[i].pos)
+        i = (i + 1) & (nslot - 1);
+    slots[i].pos = pos + 1;
+    slots[i].hash = hash;
+}
+/**
+ * @brief 根据 kvs 重建对象的哈希索引，容量变化后调用
+ */
+static void obj_reindex(object *obj)
+{
+    obj_slot *slots = obj_index(obj);
+    U32 nslot;
+    if (!slots)
+        return;
+    nslot = index_slots(obj->size);
+    memset(slots, 0, nslot * sizeof(obj_slot));
+    for (U32 i = 0; i < obj->count; i++)
+        index_insert(slots, nslot, obj->kvs[i].key->hash, i);
+}
+/**
+ * @brief 判断两个键名原子是否表示同一个键名，同一处驻留的键名只需比较指针
+ */
+static BOOL key_equal(const json_key *a, const json_key *b)
+{
+    return a == b || (a->hash == b->hash && a->len == b->len && memcmp(a->str, b->str, a->len) == 0);
+}
+/**
+ * @brief 在对象中查找键名为 key 的键值对
+ * @return 找到时返回键值对在 kvs 中的下标，找不到返回 -1
+ * @details 有索引时按哈希探测，否则顺序比较；比较时先比较指针，再比较哈希值和长度
+ */
+static long obj_find_key(const object *obj, const json_key *key)
+{
+    obj_slot *slots = obj_index(obj);
+    if (!slots)
+    {
+        for (U32 i = 0; i < obj->count; i++)
+        {
+            if (key_equal(obj->kvs[i].key, key))
+                return i;
+        }
+        return -1;
+    }
+
+    U32 nslot = index_slots(obj->size);
+    for (U32 i = key->hash & (nslot - 1); slots[i].pos; i = (i + 1) & (nslot - 1))
+    {
+        if (slots[i].hash == key->hash && key_equal(obj->kvs[slots[i].pos - 1].key, key))
+            return slots[i].pos - 1;
+    }
+    return -1;
+}
+/**
+ * @brief 在对象中查找键名为 key 的键值对，hash 为事先算好的 key_hash(key)
+ */
+static long obj_find_hashed(const object *obj, const char *key, U32 hash)
+{
+    json_key tmp = {JSON_KEY_STATIC, hash, (U32)strlen(key), key};
+    return obj_find_key(obj, &tmp);
+}
+/**
+ * @brief 在对象中查找键名为 key 的键值对
+ */
+static long obj_find(const object *obj, const char *key)
+{
+    return obj_find_hashed(obj, key, key_hash(key));
+}
+
+static JSON *value_new(json_doc *doc, json_e type);
+static JSON *new_bool(json_doc *doc, BOOL val);
+static JSON *new_num(json_doc *doc, double val);
+static JSON *new_int(json_doc *doc, int64_t val);
+static JSON *new_str(json_doc *doc, const char *str);
+static int str_assign(JSON *json, const char *str, size_t len);
+static void str_release(JSON *json);
+static void frozen_close(JSON *json);
+static int lazy_expand(JSON *json);
+JSON *expand(JSON *json);
+
+/**
+ * @brief 访问对象或数组的成员之前调用，尚未展开的延迟节点在这里展开
+ * @return 成功返回 0，展开失败返回 -1
+ * @details 展开会修改节点，所以延迟加载的文档即使只读也不能被多个线程同时访问
+ */
+static int lazy_load(const JSON *json)
+{
+    return json->flags & JSON_F_LAZY ? lazy_expand((JSON *)json) : 0;
+}
+
+static pthread_mutex_t box_lock = PTHREAD_MUTEX_INITIALIZER; // 串行化为打包数组生成元素节点
+
+/**
+ * @brief 元素类型为 etype、容量为 size 的打包数组需要分配的字节数
+ */
+static size_t packed_bytes(json_e etype, U32 size)
+{
+    return sizeof(packed) + (size_t)size * (etype == JSON_BOL ? sizeof(BOOL) : sizeof(uint64_t));
+}
+static double *packed_nums(const JSON *json)
+{
+    return (double *)json->arr->pk->data;
+}
+static int64_t *packed_ints(const JSON *json)
+{
+    return (int64_t *)json->arr->pk->data;
+}
+static BOOL *packed_bools(const JSON *json)
+{
+    return (BOOL *)json->arr->pk->data;
+}
+/**
+ * @brief 新建打包数组的存储，容量为 size
+ */
+static packed *packed_new(json_doc *doc, json_e etype, U32 size)
+{
+    packed *pk = (packed *)slab_alloc(doc, packed_bytes(etype, size));
+    if (pk)
+        pk->boxed = NULL;
+    return pk;
+}
+/**
+ * @brief 为打包数组的每个元素新建节点
+ * @return 元素节点数组，容量至少为 1；失败返回 NULL
+ */
+static value **packed_box(const JSON *json)
+{
+    json_doc *doc = node_doc(json);
+    U32 n = json->arr->count;
+    value **elems = (value **)slab_alloc(doc, (n ? n : 1) * sizeof(value *));
+
+    if (!elems)
+        return NULL;
+    for (U32 i = 0; i < n; i++)
+    {
+        if (json->etype == JSON_NUM)
+            elems[i] = new_num(doc, packed_nums(json)[i]);
+        else if (json->etype == JSON_INT)
+            elems[i] = new_int(doc, packed_ints(json)[i]);
+        else
+            elems[i] = new_bool(doc, packed_bools(json)[i]);
+        if (!elems[i])
+        {
+            while (i--)
+                json_free(elems[i]);
+            slab_release(doc, elems, (n ? n : 1) * sizeof(value *));
+            return NULL;
+        }
+    }
+    return elems;
+}
+/**
+ * @brief 获取打包数组的元素节点，第一次调用时生成
+ * @return 元素节点数组，失败返回 NULL
+ * @details 只读的访问也会走到这里，所以生成时加锁，生成后原子地发布，原始值保持不变
+ */
+static value **packed_elems(const JSON *json)
+{
+    packed *pk = json->arr->pk;
+    value **elems = __atomic_load_n(&pk->boxed, __ATOMIC_ACQUIRE);
+
+    if (elems)
+        return elems;
+    pthread_mutex_lock(&box_lock);
+    elems = pk->boxed;
+    if (!elems)
+    {
+        elems = packed_box(json);
+        if (elems)
+            __atomic_store_n(&pk->boxed, elems, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&box_lock);
+    return elems;
+}
+/**
+ * @brief 把打包数组永久转为普通数组，以节点为单位修改数组之前调用
+ * @return 成功返回 0，失败返回 -1，数组保持打包
+ */
+static int arr_unpack(JSON *json)
+{
+    if (!(json->flags & JSON_F_PACKED))
+        return 0;
+    packed *pk = json->arr->pk;
+    value **elems = pk->boxed ? pk->boxed : packed_box(json);
+    if (!elems)
+        return -1;
+    slab_release(node_doc(json), pk, packed_bytes(json->etype, json->arr->size));
+    json->flags &= ~JSON_F_PACKED;
+    json->etype = 0;
+    json->arr->elems = elems;
+    json->arr->size = json->arr->count ? json->arr->count : 1;
+    return 0;
+}
+/**
+ * @brief 准备向数组中追加一个 etype 类型的原始值
+ * @return 可以直接追加到打包数组时返回 1；数组不能保持打包时返回 0，由调用者按节点追加；内存不足返回 -1
+ * @details 空的普通数组转为打包数组；已经生成过元素节点的打包数组按节点追加，以免两份数据不一致
+ */
+static int packed_reserve(JSON *json, json_e etype)
+{
+    json_doc *doc = node_doc(json);
+
+    if (json->flags & JSON_F_PACKED)
+    {
+        if (json->etype != etype || json->arr->pk->boxed)
+            return 0;
+        if (json->arr->count == json->arr->size && !expand(json))
+            return -1;
+        return 1;
+    }
+    if (json->arr->count)
+        return 0;
+    U32 size = 4;
+    packed *pk = packed_new(doc, etype, size);
+    if (!pk)
+        return -1;
+    slab_release(doc, json->arr->elems, json->arr->size * sizeof(value *));
+    json->arr->pk = pk;
+    json->arr->size = size;
+    json->flags |= JSON_F_PACKED;
+    json->etype = etype;
+    return 1;
+}
+/**
+ * @brief 获取数组的第 idx 个元素节点，调用者保证 idx 不越界
+ */
+static value *arr_at(const JSON *json, U32 idx)
+{
+    if (json->flags & JSON_F_PACKED)
+    {
+        value **elems = packed_elems(json);
+        return elems ? elems[idx] : NULL;
+    }
+    return json->arr->elems[idx];
+}
+
+/**
+ *  @brief 新建一个type类型的JSON值，采用缺省值初始化
+ *  
+ *  @param [in] type JSON值的类型，见json_e的定义
+ *  @return 堆分配的JSON值
+ *  
+ *  @details 
+ *  1. 对于数值，初始化为0
+ *  2. 对于BOOL，初始化为FALSE
+ *  3. 对于字符串，初始化为NULL
+ *  4. 对于OBJ，初始化为空对象
+ *  5. 对于ARR，初始化为空数组
+ */
+JSON *json_new(json_e type)
+{
+    return value_new(NULL, type);
+}
+/**
+ * @brief 在文档 doc 中分配一个type类型的节点，doc 为 NULL 时在堆中分配，所有字段清零
+ * @details 对象和数组的头部紧跟在节点后面一起分配，成员数组还没有分配
+ */
+static JSON *node_new(json_doc *doc, json_e type)
+{
+    BOOL wide = type == JSON_ARR || type == JSON_OBJ;
+    size_t bytes = sizeof(JSON) + (wide ? HEADER_BYTES : 0);
+    JSON *json;
+
+    if (doc)
+    {
+        json = (JSON *)arena_alloc(doc, bytes);
+        if (!json)
+            return NULL;
+        memset(json, 0, bytes);
+        json->flags = JSON_F_ARENA;
+        doc->stats.values[type]++;
+        doc->stats.nodes++;
+        doc->stats.node_bytes += bytes;
+    }
+    else
+    {
+        json = (JSON *)slab_get(bytes);
+        if (!json)
+        {
+            //想想：为什么输出到stderr，不用printf输出到stdout？
+            fprintf(stderr, "json_new: calloc(%lu) failed\n", (unsigned long)bytes);
+            return NULL;
+        }
+        // 按常量大小清零，编译器直接生成几条存储指令
+        if (wide)
+            memset(json, 0, sizeof(JSON) + HEADER_BYTES);
+        else
+            memset(json, 0, sizeof(JSON));
+    }
+    if (wide)
+        json->flags |= JSON_F_WIDE;
+    json->type = type;
+    if (type == JSON_ARR)
+        json->arr = (array *)(json + 1);
+    else if (type == JSON_OBJ)
+        json->obj = (object *)(json + 1);
+    return json;
+}
+/**
+ * @brief 节点连同紧跟其后的容器头部占用的字节数
+ */
+static size_t node_bytes(const JSON *json)
+{
+    return sizeof(JSON) + (json->flags & JSON_F_WIDE ? HEADER_BYTES : 0);
+}
+/**
+ * @brief 节点是否还被别处引用（快照之间共享的子树），共享的节点不能就地修改
+ * @details 冻结映像中的节点也按共享处理，修改时总是拷贝
+ */
+static BOOL node_shared(const JSON *json)
+{
+    if (json->flags & JSON_F_FROZEN)
+        return TRUE;
+    return !(json->flags & JSON_F_INLINE) && __atomic_load_n(&json->refs, __ATOMIC_ACQUIRE) != 0;
+}
+/**
+ * @brief 修改接口遇到不能就地修改的值时报错
+ * @return json 是冻结的值或被快照共享时返回 TRUE
+ */
+static BOOL write_reject(const JSON *json, const char *func)
+{
+    if (json->flags & JSON_F_FROZEN)
+        fprintf(stderr, "%s: frozen value is read-only!\n", func);
+    else if (node_shared(json))
+        fprintf(stderr, "%s: value is shared by snapshots, modify it through its root!\n", func);
+    else
+        return FALSE;
+    return TRUE;
+}
+/**
+ * @brief 新建一个成员数组容量为 size 的空对象或空数组
+ * @details size 为 0 时按 1 分配，以便扩容时按倍数增长
+ */
+static JSON *container_new(json_doc *doc, json_e type, U32 size)
+{
+    JSON *json = node_new(doc, type);
+    if (!json)
+        return NULL;
+    if (size == 0)
+        size = 1;
+    if (type == JSON_ARR)
+    {
+        json->arr->elems = (value **)slab_alloc(doc, size * sizeof(value *));
+        if (!json->arr->elems)
+        {
+            slab_release(doc, json, node_bytes(json));
+            return NULL;
+        }
+        json->arr->size = size;
+    }
+    else
+    {
+        json->obj->kvs = (keyvalue *)slab_alloc(doc, obj_buf_bytes(size));
+        if (!json->obj->kvs)
+        {
+            slab_release(doc, json, node_bytes(json));
+            return NULL;
+        }
+        json->obj->size = size;
+        obj_reindex(json->obj);
+    }
+    return json;
+}
+/**
+ * @brief 在文档 doc 中新建一个type类型的JSON值，doc 为 NULL 时在堆中新建
+ * @details 初始值与 json_new 相同
+ */
+static JSON *value_new(json_doc *doc, json_e type)
+{
+    if (type == JSON_ARR || type == JSON_OBJ)
+        return container_new(doc, type, 1);
+    return node_new(doc, type);
+}
+//-----------------------------------------------------------------------------
+//  非递归遍历
+//-----------------------------------------------------------------------------
+/*
+json_walk 深度优先地访问整棵树，用显式的栈代替递归：栈的前 WALK_INLINE 层放在 C 栈上，更深时换到堆上按倍数扩容，
+扩容失败时才对这棵子树递归，所以释放这样不能失败的遍历在内存不足时也能完成。
+访问第 i 个子成员时分两级预取：第 i + 2 * WALK_PREFETCH 个兄弟节点本身，以及第 i + WALK_PREFETCH 个兄弟节点
+（此时已经在缓存中）的容器头部、成员数组或字符串，节点在堆中分散时沿指针访问的延迟与前面的访问重叠。
+遍历的状态都在 walker 中，访问者可以要求暂停，之后从原处继续，json_save_step 据此分步输出。
+引擎强制内联到各个内部遍历中，访问者是编译期已知的常量，回调被编译成直接调用。
+json_free、json_save、json_save_step、json_stats、json_compact 和 json_freeze 都建立在它上面。
+ */
+
+#define WALK_INLINE 64  // 放在 C 栈上的层数
+#define WALK_PREFETCH 4 // 预取的距离，以兄弟节点计
+#define WALK_PAUSE 2    // 内部的访问者返回它时，访问完当前节点（数组和对象已经入栈）后暂停，之后用 walk_run 继续
+
+/**
+ * @brief 栈中的一层：正在访问其子成员的数组或对象
+ */
+typedef struct walk_frame
+{
+    const JSON *json; // 数组或对象
+    union
+    {
+        value *const *elems;  // 数组的成员数组
+        const keyvalue *kvs; // 对象的键值对数组
+    };
+    U32 next;          // 下一个要访问的子成员
+    U32 count;         // 子成员个数，打包数组的元素没有节点，记为 0
+    json_walk_pos pos; // json 自己的位置，第 k 层的 pos.up 总是指向第 k - 1 层的 pos
+} walk_frame;
+
+/**
+ * @brief 遍历的状态，暂停时整个保存下来，之后从原处继续
+ */
+typedef struct walker
+{
+    walk_frame *stack; // 开始时指向 frames，更深时换到堆上按倍数扩容
+    U32 depth;         // 栈中的层数
+    U32 cap;           // 栈的容量
+    BOOL pausable;     // 访问者可能返回 WALK_PAUSE；此时栈扩容失败就终止遍历，不能改为递归
+    walk_frame frames[WALK_INLINE];
+} walker;
+
+/**
+ * @brief 让 f 从数组或对象 json 的第一个子成员开始访问
+ */
+static void walk_frame_init(walk_frame *f, const JSON *json)
+{
+    f->json = json;
+    f->next = 0;
+    if (json->type == JSON_OBJ)
+    {
+        f->kvs = json->obj->kvs;
+        f->count = json->obj->count;
+    }
+    else
+    {
+        f->elems = json->arr->elems;
+        f->count = json->flags & JSON_F_PACKED ? 0 : json->arr->count;
+    }
+}
+/**
+ * @brief 把栈的容量扩大一倍，第一次从 frames 搬到堆上
+ * @return 成功返回 0，内存不足返回 -1，原来的栈不变
+ */
+static int walk_grow(walker *wk)
+{
+    U32 size = wk->cap * 2;
+    walk_frame *bigger;
+
+    if (wk->stack == wk->frames)
+    {
+        bigger = (walk_frame *)heap_alloc(size * sizeof(walk_frame));
+        if (bigger)
+            memcpy(bigger, wk->frames, wk->cap * sizeof(walk_frame));
+    }
+    else
+        bigger = (walk_frame *)heap_realloc(wk->stack, wk->cap * sizeof(walk_frame), size * sizeof(walk_frame));
+    if (!bigger)
+        return -1;
+    // 搬动后重新串起各层的 pos.up，第 0 层指向栈外，不变
+    for (U32 i = 1; i < wk->cap; i++)
+        bigger[i].pos.up = &bigger[i - 1].pos;
+    wk->stack = bigger;
+    wk->cap = size;
+    return 0;
+}
+/**
+ * @brief 把已经展开的数组或对象 json 压栈，pos 是它的位置
+ * @return 成功返回 0，内存不足返回 -1
+ */
+static int walk_push(walker *wk, const JSON *json, const json_walk_pos *pos)
+{
+    if (wk->depth == wk->cap && walk_grow(wk) < 0)
+        return -1;
+    walk_frame *f = &wk->stack[wk->depth++];
+    walk_frame_init(f, json);
+    f->pos = *pos;
+    if (wk->depth > 1)
+        f->pos.up = &wk->stack[wk->depth - 2].pos;
+    return 0;
+}
+/**
+ * @brief 结束遍历，释放堆上的栈
+ */
+static void walk_done(walker *wk)
+{
+    if (wk->stack != wk->frames)
+        heap_free(wk->stack);
+    wk->stack = wk->frames;
+    wk->depth = 0;
+}
+static int walk_children(const JSON *json, const json_walk_pos *at, const json_visitor *v, void *ctx);
+
+/**
+ * @brief 从栈顶继续遍历，直到栈空、访问者暂停或出错
+ * @param paused 是否已经要求暂停：此时只退出已经访问完的层，遇到下一个要访问的子成员就返回
+ * @return 遍历完成返回 0，还有子成员没有访问时暂停返回 WALK_PAUSE，enter 或 leave 返回负数时返回该值，展开失败或内存不足返回 -1
+ * @details 预取的方式见本节开头
+ */
+static inline __attribute__((always_inline)) int walk_run(walker *wk, const json_visitor *v, void *ctx, BOOL paused)
+{
+    int ret = 0;
+
+    while (wk->depth)
+    {
+        walk_frame *f = &wk->stack[wk->depth - 1];
+        if (f->next == f->count)
+        {
+            wk->depth--;
+            if (v->leave && (ret = v->leave(ctx, f->json, &f->pos)) < 0)
+                break;
+            ret = 0;
+            continue;
+        }
+        if (paused)
+            return WALK_PAUSE;
+
+        U32 i = f->next++;
+        const JSON *child, *ahead = NULL;
+        json_walk_pos pos = {&f->pos, f->json, NULL, i, f->pos.depth + 1, NULL};
+        if (f->json->type == JSON_ARR)
+        {
+            value *const *elems = f->elems;
+            if (i + 2 * WALK_PREFETCH < f->count)
+                __builtin_prefetch(elems[i + 2 * WALK_PREFETCH]);
+            if (i + WALK_PREFETCH < f->count)
+                ahead = elems[i + WALK_PREFETCH];
+            child = elems[i];
+        }
+        else
+        {
+            const keyvalue *kv = &f->kvs[i];
+            if (i + 2 * WALK_PREFETCH < f->count)
+                __builtin_prefetch(kv[2 * WALK_PREFETCH].val);
+            if (i + WALK_PREFETCH < f->count)
+                ahead = kv[WALK_PREFETCH].val;
+            child = kv->val;
+            pos.key = kv->key;
+        }
+        if (ahead)
+        {
+            // 延迟节点的 arr 和 obj 还没有生成；打包数组的成员只有原始值，由访问者自己读取
+            if (ahead->type == JSON_ARR || ahead->type == JSON_OBJ)
+            {
+                if (!(ahead->flags & (JSON_F_LAZY | JSON_F_PACKED)))
+                {
+                    __builtin_prefetch(ahead->arr);
+                    __builtin_prefetch(ahead->type == JSON_ARR ? (const void *)ahead->arr->elems
+                                                               : (const void *)ahead->obj->kvs);
+                }
+            }
+            else if (ahead->type == JSON_STR && !(ahead->flags & JSON_F_INLINE))
+                __builtin_prefetch(ahead->str);
+        }
+
+        // enter 可能释放 child，之后不能再读它
+        BOOL wide = child->type == JSON_ARR || child->type == JSON_OBJ;
+        int r = v->enter(ctx, child, &pos);
+        if (r < 0)
+        {
+            ret = r;
+            break;
+        }
+        if (r == JSON_WALK_SKIP)
+            continue;
+        if (wide)
+        {
+            if (lazy_load(child) < 0)
+            {
+                ret = -1;
+                break;
+            }
+            if (walk_push(wk, child, &pos) < 0)
+            {
+                // 内存不足时对这棵子树递归，释放这样不能失败的遍历也能完成；可以暂停的遍历只能终止
+                if (wk->pausable || (ret = walk_children(child, &pos, v, ctx)) < 0)
+                {
+                    ret = -1;
+                    break;
+                }
+            }
+        }
+        paused = r == WALK_PAUSE;
+    }
+    walk_done(wk);
+    return ret;
+}
+/**
+ * @brief 访问数组或对象 json 的所有子成员，最后对 json 调用 leave，栈扩容失败时递归
+ * @param at json 的位置，json 已经被 enter 访问过并且已经展开
+ * @return 同 walk_run，访问者不能暂停
+ */
+__attribute__((noinline)) static int walk_children(const JSON *json, const json_walk_pos *at, const json_visitor *v,
+                                                    void *ctx)
+{
+    walker wk = {NULL, 0, WALK_INLINE, FALSE};
+    wk.stack = wk.frames;
+    walk_frame_init(&wk.frames[0], json);
+    wk.frames[0].pos = *at;
+    wk.depth = 1;
+    return walk_run(&wk, v, ctx, FALSE);
+}
+/**
+ * @brief 从根节点 json 开始遍历
+ * @param wk 遍历的状态，暂停时由调用者保存，之后用 walk_run 继续，继续之前不能移动
+ * @return 同 walk_run
+ * @details
+ *  enter 看到的延迟节点尚未展开，需要读取成员的访问者自己调用 lazy_load；
+ *  enter 返回 0 之后，访问子成员之前一定展开
+ */
+static inline __attribute__((always_inline)) int walk_start(walker *wk, const JSON *json, const json_visitor *v,
+                                                            void *ctx)
+{
+    json_walk_pos pos = {NULL, NULL, NULL, 0, 0, NULL};
+
+    wk->stack = wk->frames;
+    wk->depth = 0;
+    wk->cap = WALK_INLINE;
+    BOOL wide = json->type == JSON_ARR || json->type == JSON_OBJ;
+    int ret = v->enter(ctx, json, &pos);
+    if (ret < 0 || ret == JSON_WALK_SKIP || !wide)
+        return ret < 0 ? ret : 0;
+    if (lazy_load(json) < 0 || walk_push(wk, json, &pos) < 0)
+        return -1;
+    return walk_run(wk, v, ctx, ret == WALK_PAUSE);
+}
+/**
+ * @brief 深度优先地遍历 json 及其所有子成员，供内部不会暂停的遍历使用
+ * @return 成功返回 0，enter 或 leave 返回负数时返回该值，延迟节点展开失败返回 -1
+ */
+static inline __attribute__((always_inline)) int walk_tree(const JSON *json, const json_visitor *v, void *ctx)
+{
+    walker wk;
+    wk.pausable = FALSE;
+    return walk_start(&wk, json, v, ctx);
+}
+
+/**
+ * @brief json_walk 的调用者提供的访问者及其参数
+ */
+typedef struct walk_user
+{
+    const json_visitor *v;
+    void *ctx;
+} walk_user;
+
+/**
+ * @brief 先展开延迟节点，再交给调用者的 enter
+ */
+static int walk_user_enter(void *ctx, const JSON *json, json_walk_pos *pos)
+{
+    walk_user *u = (walk_user *)ctx;
+    if (lazy_load(json) < 0)
+        return -1;
+    return u->v->enter(u->ctx, json, pos);
+}
+static int walk_user_leave(void *ctx, const JSON *json, const json_walk_pos *pos)
+{
+    walk_user *u = (walk_user *)ctx;
+    return u->v->leave ? u->v->leave(u->ctx, json, pos) : 0;
+}
+/**
+ * @brief 深度优先地遍历 json 及其所有子成员
+ * @param json JSON值，延迟加载的子树会被展开
+ * @param visitor 访问者，enter 不能为 NULL
+ * @param ctx 传给访问者的参数
+ * @return 成功返回 0，enter 或 leave 返回负数时返回该值，延迟节点展开失败返回 -1
+ * @details
+ *  enter 在访问子成员之前调用，返回 JSON_WALK_SKIP 时跳过子成员，也不再对它调用 leave；
+ *  leave 只对数组和对象调用。遍历过程中不能修改尚未访问到的部分
+ */
+int json_walk(const JSON *json, const json_visitor *visitor, void *ctx)
+{
+    static const json_visitor user_visitor = {walk_user_enter, walk_user_leave};
+    walk_user u = {visitor, ctx};
+
+    assert(json);
+    assert(visitor && visitor->enter);
+    return walk_tree(json, &user_visitor, &u);
+}
+
+/**
+ * @brief 释放堆中节点自己拥有的内容：字符串、成员数组和键名，子成员、节点本身和容器头部保留
+ */
+static void value_release(JSON *json)
+{
+    switch (json->type)
+    {
+    case JSON_STR:
+        str_release(json);
+        break;
+    case JSON_ARR:
+        if (json->flags & JSON_F_PACKED)
+        {
+            value **boxed = json->arr->pk->boxed;
+            for (U32 i = 0; boxed && i < json->arr->count; i++)
+                json_free(boxed[i]);
+            if (boxed)
+                slab_put(boxed, (json->arr->count ? json->arr->count : 1) * sizeof(value *));
+            slab_put(json->arr->pk, packed_bytes(json->etype, json->arr->size));
+            break;
+        }
+        slab_put(json->arr->elems, json->arr->size * sizeof(value *));
+        break;
+    case JSON_OBJ:
+        for (U32 i = 0; i < json->obj->count; i++)
+            key_release(json->obj->kvs[i].key);
+        slab_put(json->obj->kvs, obj_buf_bytes(json->obj->size));
+        break;
+    default:
+        break;
+    }
+}
+/**
+ * @brief 释放堆中节点拥有的内容：字符串、成员及成员数组，节点本身和容器头部保留
+ */
+static void value_clear(JSON *json)
+{
+    if (json->type == JSON_ARR && !(json->flags & JSON_F_PACKED))
+    {
+        for (U32 i = 0; i < json->arr->count; i++)
+            json_free(json->arr->elems[i]);
+    }
+    else if (json->type == JSON_OBJ)
+    {
+        for (U32 i = 0; i < json->obj->count; i++)
+            json_free(json->obj->kvs[i].val);
+    }
+    value_release(json);
+}
+/**
+ * @brief 容器头部是否单独分配，没有紧跟在节点后面
+ * @details 只有被 value_replace 从标量替换成容器的节点才会这样
+ */
+static BOOL header_detached(const JSON *json)
+{
+    return (json->type == JSON_ARR || json->type == JSON_OBJ) && (const void *)json->arr != (const void *)(json + 1);
+}
+/**
+ * @brief 释放堆中的节点，其子成员已经释放
+ */
+static void node_drop(JSON *json)
+{
+    value_release(json);
+    if (header_detached(json))
+        slab_put(json->arr, HEADER_BYTES);
+    slab_put(json, node_bytes(json));
+}
+/**
+ * @brief json_free 的访问者：标量就地释放，数组和对象等子成员释放完再释放
+ * @details 文档和冻结映像中的节点不单独释放，被快照共享的节点只释放一个引用
+ */
+static int free_enter(void *ctx, const JSON *node, json_walk_pos *pos)
+{
+    JSON *json = (JSON *)node;
+
+    (void)ctx;
+    (void)pos;
+    if (json->flags & JSON_F_FROZEN)
+    {
+        // 映像中的节点只读，根节点拥有整个映像
+        if (json->flags & JSON_F_DOCROOT)
+            frozen_close(json);
+        return JSON_WALK_SKIP;
+    }
+    if (json->flags & JSON_F_ARENA)
+    {
+        // 文档中的节点不单独释放，json_load_mmap 返回的根节点拥有整个文档
+        if (json->flags & JSON_F_DOCROOT)
+            json_doc_free(node_doc(json));
+        return JSON_WALK_SKIP;
+    }
+    // 快照共享的节点只释放一个引用，最后一个引用释放时才释放节点
+    if (node_shared(json) && __atomic_fetch_sub(&json->refs, 1, __ATOMIC_ACQ_REL) != 0)
+        return JSON_WALK_SKIP;
+    if (json->type != JSON_ARR && json->type != JSON_OBJ)
+        node_drop(json);
+    return 0;
+}
+static int free_leave(void *ctx, const JSON *json, const json_walk_pos *pos)
+{
+    (void)ctx;
+    (void)pos;
+    node_drop((JSON *)json);
+    return 0;
+}
+/**
+ * @brief 释放一个JSON值
+ * @param json json值
+ * @details
+ * 该JSON值可能含子成员，也要一起释放，遍历不递归，嵌套再深也不会栈溢出
+ * 可以接受 json 为 NULL
+ * 文档（json_doc）中的节点随文档一起释放，这里不做任何事
+ */
+void json_free(JSON *json)
+{
+    static const json_visitor free_visitor = {free_enter, free_leave};
+
+    if (!json)
+    {
+        return;
+    }
+    walk_tree(json, &free_visitor, NULL);
+}
+/**
+ * @brief 获取JSON值json的类型
+ * @param json json值
+ * @return json的实际类型
+ */
+json_e json_type(const JSON *json)
+{
+    assert(json);
+    return json ? json->type : JSON_NONE;
+}
+/**
+ * @brief 新建一个BOOL类型的JSON值
+ * @param val 新建JSON的初值
+ * @return JSON* JSON值，失败返回NULL
+ */
+JSON *json_new_bool(BOOL val)
+{
+    return new_bool(NULL, val);
+}
+/**
+ * @brief 在文档 doc 中新建一个BOOL类型的JSON值，doc 为 NULL 时在堆中新建
+ */
+static JSON *new_bool(json_doc *doc, BOOL val)
+{
+    JSON *json = value_new(doc, JSON_BOL);
+    if (!json)
+        return NULL;
+    json->bol = val;
+    return json;
+}
+/**
+ * @brief 新建一个数字类型的JSON值
+ * @param val 新建JSON的初值
+ * @return JSON* JSON值，失败返回NULL
+ */
+JSON *json_new_num(double val)
+{
+    return new_num(NULL, val);
+}
+/**
+ * @brief 在文档 doc 中新建一个数字类型的JSON值，doc 为 NULL 时在堆中新建
+ */
+static JSON *new_num(json_doc *doc, double val)
+{
+    JSON *json = value_new(doc, JSON_NUM);
+    if (!json)
+        return NULL;
+    json->num = val;
+    return json;
+}
+/**
+ * @brief 新建一个整数类型的JSON值
+ * @param val 新建JSON的初值
+ * @return JSON* JSON值，失败返回NULL
+ */
+JSON *json_new_int(int64_t val)
+{
+    return new_int(NULL, val);
+}
+/**
+ * @brief 在文档 doc 中新建一个整数类型的JSON值，doc 为 NULL 时在堆中新建
+ */
+static JSON *new_int(json_doc *doc, int64_t val)
+{
+    JSON *json = value_new(doc, JSON_INT);
+    if (!json)
+        return NULL;
+    json->i64 = val;
+    return json;
+}
+/**
+ * @brief 新建一个字符串类型的JSON值
+ * @param str 新建JSON的初值
+ * @return JSON* JSON值，失败返回NULL
+ */
+JSON *json_new_str(const char *str)
+{
+    assert(str);
+    return new_str(NULL, str);
+}
+/**
+ * @brief 在文档 doc 中新建一个字符串类型的JSON值，doc 为 NULL 时在堆中新建
+ */
+static JSON *new_str(json_doc *doc, const char *str)
+{
+    JSON *json = value_new(doc, JSON_STR);
+    if (!json)
+        return json;
+    if (str_assign(json, str, strlen(str)) < 0)
+    {
+        fprintf(stderr, "json_new_str: strdup(%s) failed\n", str);
+        json_free(json);
+        return NULL;
+    }
+    return json;
+}
+/**
+ * @brief 把长度为 len 的字符串 str 拷贝到字符串节点中，节点原来不能持有字符串
+ * @return 成功返回 0，内存不足返回 -1
+ * @details 短字符串直接存放在节点中，长字符串分配在节点所在处（堆或文档）
+ */
+static int str_assign(JSON *json, const char *str, size_t len)
+{
+    assert(json->type == JSON_STR);
+    if (len <= JSON_SSO_MAX)
+    {
+        memcpy(json->sso, str, len);
+        json->sso[len] = '\0';
+        json->slen = (unsigned char)len;
+        json->flags |= JSON_F_INLINE;
+        return 0;
+    }
+    json->str = str_dup(node_doc(json), str, len);
+    return json->str ? 0 : -1;
+}
+/**
+ * @brief 释放字符串节点持有的字符串，内联的和借用的字符串不用释放
+ */
+static void str_release(JSON *json)
+{
+    assert(json->type == JSON_STR);
+    if (!(json->flags & (JSON_F_INLINE | JSON_F_BORROWED)))
+        mem_release(node_doc(json), json->str);
+    json->flags &= ~(JSON_F_INLINE | JSON_F_BORROWED);
+    json->refs = 0; // 内联字符串留在该位置的字符
+    json->str = NULL;
+}
+//想想：json_num和json_str为什么带一个def参数？ 方便用户自定义函数执行失败时的返回值，同时防止固定的错误返回值与 JSON_NUM 的内容一致导致误判
+/**
+ * @brief 获取JSON_NUM或JSON_INT类型JSON值的数值
+ * 
+ * @param json 数值类型的JSON值
+ * @param def   类型不匹配时返回的缺省值
+ * @return double 如果json是合法的数值类型，返回其数值，否则返回缺省值def
+ * @details 绝对值超过 2^53 的整数转为 double 时可能丢失精度，需要精确值时用 json_int
+ */
+double json_num(const JSON *json, double def)
+{
+    //想想：为什么这里不assert(json)? 在 return 中会判断
+    if (json && json->type == JSON_INT)
+        return (double)json->i64;
+    return json && json->type == JSON_NUM ? json->num : def;
+}
+/**
+ * @brief 截去 num 的小数部分，非数或超出 int64_t 的范围时返回 def
+ */
+static int64_t num_to_int(double num, int64_t def)
+{
+    // 2^63 能用 double 精确表示，非数在两个比较中都为假
+    if (num >= -9223372036854775808.0 && num < 9223372036854775808.0)
+        return (int64_t)num;
+    return def;
+}
+/**
+ * @brief 获取JSON_INT或JSON_NUM类型JSON值的整数值
+ * 
+ * @param json 数值类型的JSON值
+ * @param def   类型不匹配时返回的缺省值
+ * @return int64_t JSON_INT 返回其值；JSON_NUM 截去小数部分，非数或超出 int64_t 的范围时返回def
+ */
+int64_t json_int(const JSON *json, int64_t def)
+{
+    if (json && json->type == JSON_INT)
+        return json->i64;
+    return json && json->type == JSON_NUM ? num_to_int(json->num, def) : def;
+}
+/**
+ * @brief 获取JSON_BOOL类型JSON值的布尔值
+ * 
+ * @param json 布尔值类型的JSON值
+ * @return BOOL 如果json是合法的JSON_BOL类型，返回其数值，否则返回FALSE
+ */
+BOOL json_bool(const JSON *json)
+{
+    //想想：为什么这里不assert(json)? 在 return 中会判断
+    return json && json->type == JSON_BOL ? json->bol : FALSE;
+}
+/**
+ * @brief 获取JSON_STR类型JSON值的字符串值
+ * 
+ * @param json 字符串类型的JSON值
+ * @param def   类型不匹配时返回的缺省值
+ * @return const char* 如果json是合法的JSON_STR类型，返回其字符串值，否则返回def
+ */
+const char *json_str(const JSON *json, const char *def)
+{
+    //想想：为什么这里不assert(json)? 在 return 中会判断
+    if (!json || json->type != JSON_STR)
+        return def;
+    return json->flags & JSON_F_INLINE ? json->sso : json->str;
+}
+/**
+ * @brief 从对象类型的JSON值中获取名字为key的成员(JSON值)
+ * @param json 对象类型的JSON值
+ * @param key  成员的键名
+ * @return 找到的成员
+ * @details 要求json是个对象类型
+ */
+const JSON *json_get_member(const JSON *json, const char *key)
+{
+    long i;
+    assert(json);
+    assert(json->type == JSON_OBJ);
+    if (lazy_load(json) < 0)
+        return NULL;
+    assert(!(json->obj->count > 0 && json->obj->kvs == NULL));
+    assert(key);
+    assert(key[0]);
+
+    i = obj_find(json->obj, key);
+    return i < 0 ? NULL : json->obj->kvs[i].val;
+}
+/**
+ * 从数组类型的JSON值中获取第idx个元素(子JSON值)
+ * @param json 数组类型的JSON值
+ * @param idx  元素的索引值
+ * @return 找到的元素(JSON值的指针)
+ * @details 要求json是个数组
+ */
+const JSON *json_get_element(const JSON *json, U32 idx)
+{
+    assert(json);
+    assert(json->type == JSON_ARR);
+    if (lazy_load(json) < 0)
+        return NULL;
+    assert(!(json->arr->count > 0 && json->arr->elems == NULL));
+
+    if (idx >= json->arr->count) // idx 为无符号整数，因此一定大于等于零
+        return NULL;
+    return arr_at(json, idx);
+}
+/**
+ * @brief 带缓冲区的输出器，json_save 的所有输出都先写入缓冲区
+ * @details
+ *  fp 不为 NULL 时，缓冲区写满后整块写入文件；
+ *  fp 为 NULL 时输出到内存，缓冲区按需扩容
+ */
+typedef struct writer
+{
+    FILE *fp;   // 输出文件
+    char *buf;  // 缓冲区
+    size_t len; // 缓冲区中待输出的字节数
+    size_t cap; // 缓冲区的容量
+    int error;  // 出错后置为 -1，之后的输出全部忽略
+} writer;
+
+#define WRITER_BLOCK (64 * 1024) // 输出到文件时缓冲区的大小
+
+// 用于输出缩进的空格
+static const char spaces[64] = "                                                                ";
+
+/**
+ * @brief 初始化输出器
+ * @param fp 输出文件，为 NULL 时输出到内存
+ * @return 成功返回 0，失败返回 -1
+ */
+static int writer_init(writer *w, FILE *fp)
+{
+    w->fp = fp;
+    w->len = 0;
+    w->cap = WRITER_BLOCK;
+    w->error = 0;
+    w->buf = (char *)heap_alloc(w->cap);
+    if (!w->buf)
+    {
+        fprintf(stderr, "writer_init: malloc(%lu) failed!\n", (unsigned long)w->cap);
+        return -1;
+    }
+    return 0;
+}
+/**
+ * @brief 把缓冲区中的内容写入文件
+ */
+static void writer_flush(writer *w)
+{
+    if (w->error || !w->fp || w->len == 0)
+        return;
+    if (fwrite(w->buf, 1, w->len, w->fp) != w->len)
+    {
+        fprintf(stderr, "writer_flush: write file failed!\n");
+        w->error = -1;
+    }
+    w->len = 0;
+}
+/**
+ * @brief 保证缓冲区中还能放下 n 个字节
+ * @return 成功返回 0，失败返回 -1
+ */
+static int writer_reserve(writer *w, size_t n)
+{
+    if (w->error)
+        return -1;
+    if (w->cap - w->len >= n)
+        return 0;
+    writer_flush(w);
+    if (w->cap - w->len >= n)
+        return w->error;
+
+    size_t cap = w->cap;
+    while (cap - w->len < n)
+        cap *= 2;
+    char *temp = (char *)heap_realloc(w->buf, w->cap, cap);
+    if (!temp)
+    {
+        fprintf(stderr, "writer_reserve: realloc(%lu) failed!\n", (unsigned long)cap);
+        w->error = -1;
+        return -1;
+    }
+    w->buf = temp;
+    w->cap = cap;
+    return 0;
+}
+/**
+ * @brief 输出 n 个字节
+ */
+static void writer_write(writer *w, const char *s, size_t n)
+{
+    if (writer_reserve(w, n) < 0)
+        return;
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+}
+/**
+ * @brief 输出 n 个空格作为缩进
+ */
+static void writer_indent(writer *w, size_t n)
+{
+    while (n > sizeof(spaces))
+    {
+        writer_write(w, spaces, sizeof(spaces));
+        n -= sizeof(spaces);
+    }
+    writer_write(w, spaces, n);
+}
+/**
+ * @brief 输出字符串 str，将其中的特殊字符转义，并在末尾添加换行符
+ */
+static void writer_escaped(writer *w, const char *str, size_t n)
+{
+    const char *s = str;
+
+    // 最坏情况下每个字符都要转义
+    if (writer_reserve(w, n * 2 + 1) < 0)
+        return;
+    char *out = w->buf + w->len;
+    for (; *s; s++)
+    {
+        switch (*s)
+        {
+        case '\n':
+            *out++ = '\\';
+            *out++ = 'n';
+            break;
+        case '\a':
+            *out++ = '\\';
+            *out++ = 'a';
+            break;
+        case '\b':
+            *out++ = '\\';
+            *out++ = 'b';
+            break;
+        case '\f':
+            *out++ = '\\';
+            *out++ = 'f';
+            break;
+        case '\r':
+            *out++ = '\\';
+            *out++ = 'r';
+            break;
+        case '\t':
+            *out++ = '\\';
+            *out++ = 't';
+            break;
+        case '\v':
+            *out++ = '\\';
+            *out++ = 'v';
+            break;
+        default:
+            *out++ = *s;
+            break;
+        }
+    }
+    *out++ = '\n';
+    w->len = out - w->buf;
+}
+/**
+ * 数字格式化：Grisu2 算法
+ * 输出能被 strtod 精确还原的十进制串，且在绝大多数情况下是最短的；整数走单独的快速路径
+ */
+typedef struct diy_fp
+{
+    uint64_t f; // 有效数字
+    int e;      // 二进制指数，值为 f * 2^e
+} diy_fp;
+
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define DP_EXPONENT_MASK 0x7FF0000000000000ULL
+#define DP_HIDDEN_BIT 0x0010000000000000ULL
+#define DP_SIGNIFICAND_SIZE 52
+#define DP_EXPONENT_BIAS (0x3FF + DP_SIGNIFICAND_SIZE)
+
+// 10^k 的规格化近似值，k = -348, -340, ..., 340
+static const diy_fp cached_powers[] = {
+    {0xfa8fd5a0081c0288ULL, -1220}, {0xbaaee17fa23ebf76ULL, -1193}, {0x8b16fb203055ac76ULL, -1166},
+    {0xcf42894a5dce35eaULL, -1140}, {0x9a6bb0aa55653b2dULL, -1113}, {0xe61acf033d1a45dfULL, -1087},
+    {0xab70fe17c79ac6caULL, -1060}, {0xff77b1fcbebcdc4fULL, -1034}, {0xbe5691ef416bd60cULL, -1007},
+    {0x8dd01fad907ffc3cULL, -980}, {0xd3515c2831559a83ULL, -954}, {0x9d71ac8fada6c9b5ULL, -927},
+    {0xea9c227723ee8bcbULL, -901}, {0xaecc49914078536dULL, -874}, {0x823c12795db6ce57ULL, -847},
+    {0xc21094364dfb5637ULL, -821}, {0x9096ea6f3848984fULL, -794}, {0xd77485cb25823ac7ULL, -768},
+    {0xa086cfcd97bf97f4ULL, -741}, {0xef340a98172aace5ULL, -715}, {0xb23867fb2a35b28eULL, -688},
+    {0x84c8d4dfd2c63f3bULL, -661}, {0xc5dd44271ad3cdbaULL, -635}, {0x936b9fcebb25c996ULL, -608},
+    {0xdbac6c247d62a584ULL, -582}, {0xa3ab66580d5fdaf6ULL, -555}, {0xf3e2f893dec3f126ULL, -529},
+    {0xb5b5ada8aaff80b8ULL, -502}, {0x87625f056c7c4a8bULL, -475}, {0xc9bcff6034c13053ULL, -449},
+    {0x964e858c91ba2655ULL, -422}, {0xdff9772470297ebdULL, -396}, {0xa6dfbd9fb8e5b88fULL, -369},
+    {0xf8a95fcf88747d94ULL, -343}, {0xb94470938fa89bcfULL, -316}, {0x8a08f0f8bf0f156bULL, -289},
+    {0xcdb02555653131b6ULL, -263}, {0x993fe2c6d07b7facULL, -236}, {0xe45c10c42a2b3b06ULL, -210},
+    {0xaa242499697392d3ULL, -183}, {0xfd87b5f28300ca0eULL, -157}, {0xbce5086492111aebULL, -130},
+    {0x8cbccc096f5088ccULL, -103}, {0xd1b71758e219652cULL, -77}, {0x9c40000000000000ULL, -50},
+    {0xe8d4a51000000000ULL, -24}, {0xad78ebc5ac620000ULL, 3}, {0x813f3978f8940984ULL, 30},
+    {0xc097ce7bc90715b3ULL, 56}, {0x8f7e32ce7bea5c70ULL, 83}, {0xd5d238a4abe98068ULL, 109},
+    {0x9f4f2726179a2245ULL, 136}, {0xed63a231d4c4fb27ULL, 162}, {0xb0de65388cc8ada8ULL, 189},
+    {0x83c7088e1aab65dbULL, 216}, {0xc45d1df942711d9aULL, 242}, {0x924d692ca61be758ULL, 269},
+    {0xda01ee641a708deaULL, 295}, {0xa26da3999aef774aULL, 322}, {0xf209787bb47d6b85ULL, 348},
+    {0xb454e4a179dd1877ULL, 375}, {0x865b86925b9bc5c2ULL, 402}, {0xc83553c5c8965d3dULL, 428},
+    {0x952ab45cfa97a0b3ULL, 455}, {0xde469fbd99a05fe3ULL, 481}, {0xa59bc234db398c25ULL, 508},
+    {0xf6c69a72a3989f5cULL, 534}, {0xb7dcbf5354e9beceULL, 561}, {0x88fcf317f22241e2ULL, 588},
+    {0xcc20ce9bd35c78a5ULL, 614}, {0x98165af37b2153dfULL, 641}, {0xe2a0b5dc971f303aULL, 667},
+    {0xa8d9d1535ce3b396ULL, 694}, {0xfb9b7cd9a4a7443cULL, 720}, {0xbb764c4ca7a44410ULL, 747},
+    {0x8bab8eefb6409c1aULL, 774}, {0xd01fef10a657842cULL, 800}, {0x9b10a4e5e9913129ULL, 827},
+    {0xe7109bfba19c0c9dULL, 853}, {0xac2820d9623bf429ULL, 880}, {0x80444b5e7aa7cf85ULL, 907},
+    {0xbf21e44003acdd2dULL, 933}, {0x8e679c2f5e44ff8fULL, 960}, {0xd433179d9c8cb841ULL, 986},
+    {0x9e19db92b4e31ba9ULL, 1013}, {0xeb96bf6ebadf77d9ULL, 1039}, {0xaf87023b9bf0ee6bULL, 1066},
+};
+
+static const uint64_t pow10_u64[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+    10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+    1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL,
+    10000000000000000000ULL};
+
+static const char digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static diy_fp fp_multiply(diy_fp x, diy_fp y)
+{
+    const uint64_t M32 = 0xFFFFFFFFULL;
+    uint64_t a = x.f >> 32, b = x.f & M32, c = y.f >> 32, d = y.f & M32;
+    uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    tmp += 1ULL << 31; // 四舍五入
+    diy_fp r = {ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64};
+    return r;
+}
+
+static diy_fp fp_normalize(diy_fp x)
+{
+#if defined(__GNUC__)
+    int s = __builtin_clzll(x.f);
+    x.f <<= s;
+    x.e -= s;
+#else
+    while (!(x.f & (1ULL << 63)))
+    {
+        x.f <<= 1;
+        x.e--;
+    }
+#endif
+    return x;
+}
+
+/**
+ * @brief 计算 v 的上下边界 m+ 和 m-，两者的指数相同，m+ 已规格化
+ */
+static void fp_boundaries(diy_fp v, diy_fp *minus, diy_fp *plus)
+{
+    diy_fp pl = {(v.f << 1) + 1, v.e - 1};
+    while (!(pl.f & (DP_HIDDEN_BIT << 1)))
+    {
+        pl.f <<= 1;
+        pl.e--;
+    }
+    pl.f <<= 64 - DP_SIGNIFICAND_SIZE - 2;
+    pl.e -= 64 - DP_SIGNIFICAND_SIZE - 2;
+
+    diy_fp mi;
+    if (v.f == DP_HIDDEN_BIT) // 下边界离得更近
+    {
+        mi.f = (v.f << 2) - 1;
+        mi.e = v.e - 2;
+    }
+    else
+    {
+        mi.f = (v.f << 1) - 1;
+        mi.e = v.e - 1;
+    }
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+    *minus = mi;
+    *plus = pl;
+}
+
+/**
+ * @brief 选取 10^-k，使 e + 10^-k 的二进制指数 + 64 落在 [-60, -32] 之间
+ * @param e m+ 的二进制指数
+ * @param k 输出十进制指数 k
+ */
+static diy_fp cached_power(int e, int *k)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347; // log10(2)
+    int ik = (int)dk;
+    if (ik != dk)
+        ik++;
+    unsigned index = (unsigned)((ik >> 3) + 1);
+    *k = -(-348 + (int)(index << 3));
+    return cached_powers[index];
+}
+
+static void grisu_round(char *buf, int len, uint64_t delta, uint64_t rest, uint64_t ten_kappa, uint64_t wp_w)
+{
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+    {
+        buf[len - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+static int count_digits(uint32_t n)
+{
+    int d = 1;
+    while (d < 10 && n >= pow10_u64[d])
+        d++;
+    return d;
+}
+
+/**
+ * @brief 生成 w 的十进制数字，数字个数尽可能少且仍落在 (m-, m+) 内
+ * @return 数字个数，*k 累加上小数点的位置
+ */
+static int digit_gen(diy_fp w, diy_fp mp, uint64_t delta, char *buf, int *k)
+{
+    const diy_fp one = {1ULL << -mp.e, mp.e};
+    const uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = count_digits(p1);
+    int len = 0;
+
+    while (kappa > 0)
+    {
+        uint32_t div = (uint32_t)pow10_u64[kappa - 1];
+        uint32_t d = p1 / div;
+        p1 %= div;
+        if (d || len)
+            buf[len++] = (char)('0' + d);
+        kappa--;
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta)
+        {
+            *k += kappa;
+            grisu_round(buf, len, delta, rest, pow10_u64[kappa] << -one.e, wp_w);
+            return len;
+        }
+    }
+    for (;;)
+    {
+        p2 *= 10;
+        delta *= 10;
+        char d = (char)(p2 >> -one.e);
+        if (d || len)
+            buf[len++] = (char)('0' + d);
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta)
+        {
+            *k += kappa;
+            int index = -kappa;
+            grisu_round(buf, len, delta, p2, one.f, wp_w * (index < 20 ? pow10_u64[index] : 0));
+            return len;
+        }
+    }
+}
+
+/**
+ * @brief 把非负整数 n 的十进制数字写入 buf
+ * @return 写入的字符数
+ */
+static int write_u64(uint64_t n, char *buf)
+{
+    char tmp[20];
+    char *p = tmp + sizeof(tmp);
+
+    while (n >= 100)
+    {
+        unsigned r = (unsigned)(n % 100) * 2;
+        n /= 100;
+        *--p = digit_pairs[r + 1];
+        *--p = digit_pairs[r];
+    }
+    if (n >= 10)
+    {
+        *--p = digit_pairs[n * 2 + 1];
+        *--p = digit_pairs[n * 2];
+    }
+    else
+        *--p = (char)('0' + n);
+
+    int len = (int)(tmp + sizeof(tmp) - p);
+    memcpy(buf, p, len);
+    return len;
+}
+
+/**
+ * @brief 把数字串 buf[0, len) * 10^k 排版成常规写法，指数过大或过小时使用科学计数法
+ * @return 排版后的长度
+ * @details 与 JavaScript 的 Number.prototype.toString 相同：1e21 以下、1e-7 以上不使用科学计数法
+ */
+static int prettify(char *buf, int len, int k)
+{
+    const int kk = len + k; // 10^(kk-1) <= v < 10^kk
+
+    if (len <= kk && kk <= 21) // 1234e7 -> 12340000000
+    {
+        memset(buf + len, '0', kk - len);
+        return kk;
+    }
+    if (0 < kk && kk <= 21) // 1234e-2 -> 12.34
+    {
+        memmove(buf + kk + 1, buf + kk, len - kk);
+        buf[kk] = '.';
+        return len + 1;
+    }
+    if (-6 < kk && kk <= 0) // 1234e-6 -> 0.001234
+    {
+        const int offset = 2 - kk;
+        memmove(buf + offset, buf, len);
+        buf[0] = '0';
+        buf[1] = '.';
+        memset(buf + 2, '0', offset - 2);
+        return len + offset;
+    }
+
+    int n = 1;
+    if (len > 1) // 1234e30 -> 1.234e+33
+    {
+        memmove(buf + 2, buf + 1, len - 1);
+        buf[1] = '.';
+        n = len + 1;
+    }
+    buf[n++] = 'e';
+    buf[n++] = kk - 1 < 0 ? '-' : '+';
+    return n + write_u64(kk - 1 < 0 ? 1 - kk : kk - 1, buf + n);
+}
+
+/**
+ * @brief 将双精度浮点数格式化为能精确还原的最短十进制字符串
+ * @param num 要格式化的数字
+ * @param buf 存放字符串的缓冲区，至少 JSON_NUM_BUF 字节，结果不以 '\0' 结尾
+ * @return 字符串长度
+ * @details
+ *  - 绝对值小于 2^53 的整数直接按整数输出
+ *  - 其余数字使用 Grisu2 算法，如 0.1、1e-9、133333333333.12346
+ *  - 非数和无穷大按 YAML 的写法输出为 .nan、.inf、-.inf
+ */
+int json_num_to_str(double num, char *buf)
+{
+    uint64_t bits;
+    char *p = buf;
+
+    assert(buf);
+    memcpy(&bits, &num, sizeof(bits));
+    if ((bits & DP_EXPONENT_MASK) == DP_EXPONENT_MASK)
+    {
+        if (bits & DP_SIGNIFICAND_MASK)
+        {
+            memcpy(buf, ".nan", 4);
+            return 4;
+        }
+        if (bits >> 63)
+            *p++ = '-';
+        memcpy(p, ".inf", 4);
+        return (int)(p - buf) + 4;
+    }
+    if (bits >> 63)
+    {
+        *p++ = '-';
+        num = -num;
+        bits &= ~(1ULL << 63);
+    }
+
+    // 整数快速路径
+    if (num < 9007199254740992.0 && num == (double)(uint64_t)num)
+        return (int)(p - buf) + write_u64((uint64_t)num, p);
+
+    int biased_e = (int)((bits & DP_EXPONENT_MASK) >> DP_SIGNIFICAND_SIZE);
+    diy_fp v;
+    if (biased_e != 0)
+    {
+        v.f = (bits & DP_SIGNIFICAND_MASK) + DP_HIDDEN_BIT;
+        v.e = biased_e - DP_EXPONENT_BIAS;
+    }
+    else // 非规格化数
+    {
+        v.f = bits & DP_SIGNIFICAND_MASK;
+        v.e = 1 - DP_EXPONENT_BIAS;
+    }
+
+    diy_fp w_m, w_p;
+    int k;
+    fp_boundaries(v, &w_m, &w_p);
+    const diy_fp c_mk = cached_power(w_p.e, &k);
+    const diy_fp w = fp_multiply(fp_normalize(v), c_mk);
+    diy_fp wp = fp_multiply(w_p, c_mk);
+    diy_fp wm = fp_multiply(w_m, c_mk);
+    wm.f++;
+    wp.f--;
+    int len = digit_gen(w, wp, wp.f - wm.f, p, &k);
+    return (int)(p - buf) + prettify(p, len, k);
+}
+/**
+ * @brief 将 64 位整数格式化为十进制字符串
+ * @param buf 存放字符串的缓冲区，至少 JSON_NUM_BUF 字节，结果不以 '\0' 结尾
+ * @return 字符串长度
+ */
+int json_int_to_str(int64_t num, char *buf)
+{
+    uint64_t u = (uint64_t)num;
+
+    assert(buf);
+    if (num >= 0)
+        return write_u64(u, buf);
+    // 取反在无符号数上进行，INT64_MIN 也不会溢出
+    buf[0] = '-';
+    return 1 + write_u64(0 - u, buf + 1);
+}
+/**
+ * @brief 输出一个数值及换行，直接格式化到缓冲区中
+ */
+static void writer_num(writer *w, double num)
+{
+    if (writer_reserve(w, JSON_NUM_BUF + 1) < 0)
+        return;
+    w->len += json_num_to_str(num, w->buf + w->len);
+    w->buf[w->len++] = '\n';
+}
+/**
+ * @brief 输出一个整数及换行
+ */
+static void writer_int(writer *w, int64_t num)
+{
+    if (writer_reserve(w, JSON_NUM_BUF + 1) < 0)
+        return;
+    w->len += json_int_to_str(num, w->buf + w->len);
+    w->buf[w->len++] = '\n';
+}
+/**
+ * @brief 输出一个布尔值及换行
+ */
+static void writer_bool(writer *w, BOOL val)
+{
+    if (val != 0)
+        writer_write(w, "true\n", 5);
+    else
+        writer_write(w, "false\n", 6);
+}
+/**
+ * @brief 输出一个标量值及换行
+ */
+static void yaml_scalar(const JSON *json, writer *w)
+{
+    switch (json->type)
+    {
+    case JSON_NUM:
+        writer_num(w, json->num);
+        break;
+
+    case JSON_INT:
+        writer_int(w, json->i64);
+        break;
+
+    case JSON_BOL:
+        writer_bool(w, json->bol);
+        break;
+
+    case JSON_NONE:
+        // 解析 JSON 文本中的 null 得到 JSON_NONE
+        writer_write(w, "null\n", 5);
+        break;
+
+    case JSON_STR:
+        if (json->flags & JSON_F_INLINE)
+            writer_escaped(w, json->sso, json->slen);
+        else
+            writer_escaped(w, json->str, strlen(json->str));
+        break;
+
+    default:
+        w->error = -1;
+        break;
+    }
+}
+/**
+ * @brief 输出打包数组 json 的第 i 个元素
+ */
+static void yaml_packed(const JSON *json, U32 i, writer *w)
+{
+    if (json->etype == JSON_NUM)
+        writer_num(w, packed_nums(json)[i]);
+    else if (json->etype == JSON_INT)
+        writer_int(w, packed_ints(json)[i]);
+    else
+        writer_bool(w, packed_bools(json)[i]);
+}
+/**
+ * @brief 输出打包数组 json 的第 from 到 to - 1 个元素
+ * @param indent 元素的缩进
+ * @param inline_first 数组本身是数组元素时，第一个元素接在 "- " 之后，不缩进
+ */
+static void yaml_packed_range(const JSON *json, U32 from, U32 to, U32 indent, BOOL inline_first, writer *w)
+{
+    for (U32 i = from; i < to; i++)
+    {
+        if (!(i == 0 && inline_first))
+            writer_indent(w, indent);
+        writer_write(w, "- ", 2);
+        yaml_packed(json, i, w);
+    }
+}
+/**
+ * @brief 输出一个值的缩进、"- " 或键名，以及标量的值；容器的成员和打包数组的元素不在这里输出
+ */
+static int yaml_head(writer *w, const JSON *json, const json_walk_pos *pos)
+{
+    const JSON *parent = pos->parent;
+
+    if (lazy_load(json) < 0)
+        return -1;
+    if (parent)
+    {
+        // 父节点本身是数组元素时，它的第一个子成员接在 "- " 之后
+        if (!(pos->index == 0 && pos->up->parent && pos->up->parent->type == JSON_ARR))
+            writer_indent(w, 2 * (pos->depth - 1));
+        if (parent->type == JSON_ARR)
+            writer_write(w, "- ", 2);
+        else
+        {
+            writer_write(w, pos->key->str, pos->key->len);
+            if (json->type == JSON_ARR || json->type == JSON_OBJ)
+                writer_write(w, ": \n", 3);
+            else
+                writer_write(w, ": ", 2);
+        }
+    }
+    if (json->type != JSON_ARR && json->type != JSON_OBJ)
+        yaml_scalar(json, w);
+    return w->error;
+}
+/**
+ * @brief 将 JSON 对象转换为 YAML 格式写入输出器，json_walk 的访问者，ctx 为输出器
+ * @details
+ *  每个值的缩进为父节点深度的两倍，数组元素和对象成员的第一行如果紧跟在上一层数组的 "- " 之后，则不缩进；
+ *  打包数组的元素没有节点，在这里一并输出
+ */
+static int yaml_enter(void *ctx, const JSON *json, json_walk_pos *pos)
+{
+    writer *w = (writer *)ctx;
+
+    if (yaml_head(w, json, pos) < 0)
+        return -1;
+    if (json->flags & JSON_F_PACKED)
+        yaml_packed_range(json, 0, json->arr->count, 2 * pos->depth, pos->parent && pos->parent->type == JSON_ARR, w);
+    return w->error;
+}
+/**
+ * @brief 将 JSON 对象转换为 YAML 格式写入输出器
+ * @param json 要转换的 JSON 对象
+ * @param w 输出器，出错时 w->error 置为 -1
+ */
+static void json_to_yaml(const JSON *json, writer *w)
+{
+    static const json_visitor yaml_visitor = {yaml_enter, NULL};
+
+    if (walk_tree(json, &yaml_visitor, w) < 0)
+        w->error = -1;
+}
+/**
+ * @brief 把JSON值json以YAML格式输出，保存到名字为fname的文件中
+ * 
+ * @param json  JSON值
+ * @param fname 输出文件名
+ * @return int 0表示成功，非 0 表示失败
+ * @details 输出先写入 64KB 的缓冲区，写满后整块写入文件，文件本身不再做缓冲
+ */
+int json_save(const JSON *json, const char *fname)
+{
+    writer w;
+    FILE *fp;
+
+    assert(json);
+    assert(fname);
+    assert(fname[0]);
+
+    fp = fopen(fname, "w");
+    if (!fp)
+    {
+        fprintf(stderr, "json_save: open file [%s] failed!\n", fname);
+        return -1;
+    }
+    setvbuf(fp, NULL, _IONBF, 0);
+    if (writer_init(&w, fp) < 0)
+    {
+        fclose(fp);
+        return -1;
+    }
+    json_to_yaml(json, &w);
+    writer_flush(&w);
+    heap_free(w.buf);
+    if (fclose(fp) != 0 && w.error == 0)
+    {
+        fprintf(stderr, "json_save: close file [%s] failed!\n", fname);
+        w.error = -1;
+    }
+    return w.error;
+}
+
+/**
+ * @brief 增量输出的状态，暂停的遍历连同它的栈一起保存在这里
+ */
+struct json_saver
+{
+    writer w;
+    FILE *fp;
+    const JSON *root; // 尚未开始输出时是根节点，开始后置为 NULL
+    size_t left;      // 本次还能输出的值的个数
+    const JSON *packed; // 正在输出的打包数组，没有时为 NULL
+    U32 packed_next;    // 打包数组中下一个要输出的元素
+    U32 packed_indent;  // 打包数组元素的缩进
+    BOOL packed_inline; // 打包数组的第一个元素是否接在 "- " 之后
+    walker wk;
+};
+
+/**
+ * @brief 从 packed_next 继续输出打包数组的元素，直到额度用完
+ * @return 打包数组输出完毕返回 TRUE
+ */
+static BOOL save_packed(json_saver *s)
+{
+    U32 end = s->packed->arr->count;
+    if (end - s->packed_next > s->left)
+        end = s->packed_next + (U32)s->left;
+    yaml_packed_range(s->packed, s->packed_next, end, s->packed_indent, s->packed_inline, &s->w);
+    s->left -= end - s->packed_next;
+    s->packed_next = end;
+    if (end < s->packed->arr->count)
+        return FALSE;
+    s->packed = NULL;
+    return TRUE;
+}
+/**
+ * @brief 输出一个值，额度用完时暂停遍历，json_walk 的访问者，ctx 为输出状态
+ * @details 打包数组的元素没有节点，每个元素也算一个值；额度在数组中间用完时记下下一个元素，下次先输出剩下的元素
+ */
+static int save_enter(void *ctx, const JSON *json, json_walk_pos *pos)
+{
+    json_saver *s = (json_saver *)ctx;
+
+    if (yaml_head(&s->w, json, pos) < 0)
+        return -1;
+    s->left--;
+    if (json->flags & JSON_F_PACKED)
+    {
+        s->packed = json;
+        s->packed_next = 0;
+        s->packed_indent = 2 * pos->depth;
+        s->packed_inline = pos->parent && pos->parent->type == JSON_ARR;
+        if (!save_packed(s))
+            return WALK_PAUSE;
+    }
+    return s->left == 0 ? WALK_PAUSE : 0;
+}
+
+/**
+ * @brief 开始把 json 以 YAML 格式增量地保存到文件 fname 中
+ * @return 输出状态，交给 json_save_step 和 json_save_end；失败返回 NULL
+ * @details 输出完成之前 json 不能被修改或释放
+ */
+json_saver *json_save_begin(const JSON *json, const char *fname)
+{
+    assert(json);
+    assert(fname);
+    assert(fname[0]);
+
+    json_saver *s = (json_saver *)heap_calloc(sizeof(json_saver));
+    if (!s)
+    {
+        fprintf(stderr, "json_save_begin: heap_calloc failed!\n");
+        return NULL;
+    }
+    s->fp = fopen(fname, "w");
+    if (!s->fp)
+    {
+        fprintf(stderr, "json_save_begin: open file [%s] failed!\n", fname);
+        heap_free(s);
+        return NULL;
+    }
+    setvbuf(s->fp, NULL, _IONBF, 0);
+    if (writer_init(&s->w, s->fp) < 0)
+    {
+        fclose(s->fp);
+        heap_free(s);
+        return NULL;
+    }
+    s->root = json;
+    s->wk.pausable = TRUE;
+    return s;
+}
+/**
+ * @brief 继续输出，最多输出 budget 个值后返回
+ * @param s json_save_begin 返回的输出状态
+ * @param budget 本次最多输出的值的个数，数组元素和对象成员各算一个，打包数组的元素也各算一个，不能为 0
+ * @return 还有剩余时返回 1，全部输出完毕返回 0，出错返回 -1
+ * @details
+ *  遍历与 json_save 相同，额度用完时暂停，栈保存在输出状态中，下次从原处继续；
+ *  打包数组在元素中间暂停时，下次先从记下的元素继续。
+ *  输出经过 64KB 的缓冲区，缓冲区写满时才写文件，所以每次调用的耗时与 budget 成正比
+ */
+int json_save_step(json_saver *s, size_t budget)
+{
+    static const json_visitor save_visitor = {save_enter, NULL};
+    int ret = 0;
+
+    assert(s);
+    assert(budget > 0);
+
+    s->left = budget;
+    if (s->packed && !save_packed(s))
+        ret = WALK_PAUSE;
+    else if (s->root)
+    {
+        const JSON *root = s->root;
+        s->root = NULL;
+        ret = walk_start(&s->wk, root, &save_visitor, s);
+    }
+    else if (s->wk.depth)
+        ret = s->left ? walk_run(&s->wk, &save_visitor, s, FALSE) : WALK_PAUSE;
+    if (ret < 0)
+        s->w.error = -1;
+    if (s->w.error)
+        return -1;
+    // 暂停在最后一个打包数组中间时，遍历已经没有要访问的节点，返回的是 0
+    if (ret == WALK_PAUSE || s->packed)
+        return 1;
+    writer_flush(&s->w);
+    return s->w.error;
+}
+/**
+ * @brief 结束增量输出，关闭文件并释放输出状态
+ * @return 全部输出完毕且写入成功返回 0；出错或提前结束返回 -1，此时文件内容不完整
+ */
+int json_save_end(json_saver *s)
+{
+    if (!s)
+        return -1;
+    int ret = s->w.error;
+    if (s->root || s->wk.depth || s->packed)
+        ret = -1;
+    heap_free(s->w.buf);
+    walk_done(&s->wk);
+    if (fclose(s->fp) != 0 && ret == 0)
+    {
+        fprintf(stderr, "json_save_end: close file failed!\n");
+        ret = -1;
+    }
+    heap_free(s);
+    return ret;
+}
+
+/**
+ * @brief 扩容函数，将 json 对象的容量扩大一倍
+ * @param json 要扩容的 JSON 对象
+ * @return 扩容成功返回 json，失败返回 NULL
+ * @details 保证 json 的类型为 JSON_OBJ 或 JSON_ARR；json 不为 NULL
+ */
+JSON *expand(JSON *json)
+{
+    assert(json);
+    assert((json->type == JSON_OBJ || json->type == JSON_ARR));
+    switch (json->type)
+    {
+    case JSON_ARR:
+    {
+        // realloc 在内存申请成功后自动释放旧内存；打包数组按原始值的大小扩容
+        size_t old_bytes = json->arr->size * sizeof(value *), new_bytes = old_bytes * 2;
+        if (json->flags & JSON_F_PACKED)
+        {
+            old_bytes = packed_bytes(json->etype, json->arr->size);
+            new_bytes = packed_bytes(json->etype, json->arr->size * 2);
+        }
+        value **temp = (value **)slab_grow(node_doc(json), json->arr->elems, old_bytes, new_bytes);
+        if (!temp)
+        {
+            fprintf(stderr, "expand: expand array size failed!\n");
+            return NULL;
+        }
+        json->arr->size *= 2;
+        json->arr->elems = temp;
+        return json;
+    }
+
+    case JSON_OBJ:
+    {
+        // 内存池中只需拷贝已有的键值对；堆中的旧内存按原来的容量归还
+        json_doc *doc = node_doc(json);
+        size_t old_bytes = doc ? json->obj->count * sizeof(keyvalue) : obj_buf_bytes(json->obj->size);
+        keyvalue *temp = (keyvalue *)slab_grow(doc, json->obj->kvs, old_bytes, obj_buf_bytes(json->obj->size * 2));
+        if (!temp)
+        {
+            fprintf(stderr, "expand: expand object size failed!\n");
+            return NULL;
+        }
+        json->obj->size *= 2;
+        json->obj->kvs = temp;
+        obj_reindex(json->obj); // 索引位于 kvs 之后，扩容后需要重建
+        return json;
+    }
+    default:
+        return NULL;
+    }
+}
+/**
+ * @brief 往对象中放入一个键值对，键名 key 的一个引用一并转移
+ * @param json JSON对象
+ * @param key 与 json 分配在同一处（堆或同一个文档）的键名原子，或者静态的键名原子，允许为空串（解析器会产生这种键名）
+ * @param val 键值，不能为 NULL
+ * @return JSON* 成功返回val，失败返回NULL
+ * @details 键名已存在时覆盖旧值并释放 key；失败时 key 和 val 都会被释放
+ */
+static JSON *obj_put(JSON *json, json_key *key, JSON *val)
+{
+    assert(json->type == JSON_OBJ);
+    assert(key);
+    assert(val);
+    // 文档中的对象只能容纳同一文档中的值，否则堆中的值无人释放
+    assert(!node_doc(json) || node_doc(val) == node_doc(json));
+    if (lazy_load(json) < 0)
+    {
+        key_release(key);
+        json_free(val);
+        return NULL;
+    }
+
+    // 查找键名是否存在
+    long i = obj_find_key(json->obj, key);
+    if (i >= 0)
+    {
+        key_release(key);
+        json_free(json->obj->kvs[i].val);
+        json->obj->kvs[i].val = val;
+        return val;
+    }
+    // 键名不存在，则向 json 中添加新的键值对
+    // 需要扩容
+    if (json->obj->count == json->obj->size)
+    {
+        if (!expand(json))
+        {
+            fprintf(stderr, "json_add_member: expand capacity failed!\n");
+            key_release(key);
+            json_free(val);
+            return NULL;
+        }
+    }
+    json->obj->kvs[json->obj->count].key = key;
+    json->obj->kvs[json->obj->count].val = val;
+    obj_slot *slots = obj_index(json->obj);
+    if (slots)
+        index_insert(slots, index_slots(json->obj->size), key->hash, json->obj->count);
+    json->obj->count++;
+    return val;
+}
+//  想想：json_add_member和json_add_element中，val应该是堆分配，还是栈分配？堆分配的
+//  想想：如果json_add_member失败，应该由谁来释放val？在函数中释放
+/**
+ * @brief 往对象类型的json中增加一个键值对，键名为key，值为val
+ * 
+ * @param json JSON对象
+ * @param key 键名，符合正则：[a-zA-Z_][a-zA-Z_-0-9]*
+ * @param val 键值，必须是堆分配拥有所有权的JSON值
+ * @return JSON* 成功返回val，失败返回NULL
+ * @details
+ *  json_add_member会转移val的所有权，所以调用json_add_member之后不用考虑释放val的问题
+ * 因为需要支持如下写法：
+ *  json_add_member(json, "port", json_new_num(80));
+ * 所以需要做到：
+ *  1) 允许val为NULL；
+ *  2) 当json_add_member内部发生失败时，需要释放val，满足将val的所有权转让给json_add_member的语义设定
+ */
+JSON *json_add_member(JSON *json, const char *key, JSON *val)
+{
+    assert(json->type == JSON_OBJ);
+    assert(!(json->obj->count > 0 && json->obj->kvs == NULL));
+    assert(key);
+    assert(key[0]);
+    //想想: 为啥不用assert检查val？因为允许 val 为 NULL。
+    //想想：如果json中已经存在名字为key的成员，怎么办？覆盖旧成员的值。
+    if (val == NULL)
+    {
+        return NULL;
+    }
+    if (write_reject(json, "json_add_member"))
+    {
+        json_free(val);
+        return NULL;
+    }
+    json_key *atom = key_make(node_doc(json), key, strlen(key));
+    if (atom == NULL)
+    {
+        fprintf(stderr, "json_add_member: strdup(%s) failed!\n", key);
+        json_free(val);
+        return NULL;
+    }
+    return obj_put(json, atom, val);
+}
+/**
+ * @brief 往对象类型的json中增加一个键值对，键名使用静态的键名原子，不拷贝
+ * @param json JSON对象
+ * @param key JSON_KEY_INIT 定义的键名原子，必须比 json 存活得更久
+ * @param val 键值，所有权转移，同 json_add_member
+ * @return JSON* 成功返回val，失败返回NULL
+ * @details 第一次使用 key 时计算它的哈希值
+ */
+JSON *json_add_member_key(JSON *json, json_key *key, JSON *val)
+{
+    assert(json->type == JSON_OBJ);
+    assert(key);
+    assert(key->refs == JSON_KEY_STATIC);
+    assert(key->str && strlen(key->str) == key->len);
+
+    if (val == NULL)
+        return NULL;
+    if (write_reject(json, "json_add_member_key"))
+    {
+        json_free(val);
+        return NULL;
+    }
+    // 不同线程同时计算得到的值相同
+    if (__atomic_load_n(&key->hash, __ATOMIC_RELAXED) == 0)
+        __atomic_store_n(&key->hash, key_hash_n(key->str, key->len), __ATOMIC_RELAXED);
+    return obj_put(json, key, val);
+}
+/**
+ * @brief 往数组类型的json中追加一个元素
+ * 
+ * @param json JSON数组
+ * @param val 加入到数组的元素，必须是堆分配拥有所有权的JSON值
+ * @details
+ *  json_add_element会转移val的所有权，所以调用json_add_element之后不用考虑释放val的问题
+ *  val 允许为 NULL 用以支持 json_add_element(json,json_new(JSON_OBJ)) 的写法
+ */
+JSON *json_add_element(JSON *json, JSON *val)
+{
+    assert(json);
+    assert(json->type == JSON_ARR);
+    assert(!(json->arr->count > 0 && json->arr->elems == NULL));
+
+    //想想：为啥不用assert检查val？ 因为 val 允许为 NULL
+    if (val == NULL)
+        return NULL;
+    // 文档中的数组只能容纳同一文档中的值，否则堆中的值无人释放
+    assert(!node_doc(json) || node_doc(val) == node_doc(json));
+    if (write_reject(json, "json_add_element") || lazy_load(json) < 0 || arr_unpack(json) < 0)
+    {
+        json_free(val);
+        return NULL;
+    }
+
+    // 判断是否需要扩容
+    if (json->arr->count == json->arr->size)
+    {
+        if (!expand(json))
+        {
+            fprintf(stderr, "json_add_element: expand capacity failed!\n");
+            json_free(val);
+            val = NULL;
+            return NULL;
+        }
+    }
+
+    json->arr->elems[json->arr->count] = val;
+    json->arr->count++;
+    return val;
+}
+
+/*
+ * JSON 文本解析，分两个阶段：
+ *  1. 结构扫描：以 64 字节为一块，用 SIMD 指令（AVX2/SSE2，不支持时退化为查表）
+ *     x86 上没有用 -mavx2 编译时同时编译 SSE2 和 AVX2 两个版本，按 __builtin_cpu_supports 选择；
+ *     求出引号、反斜杠、空白和 {}[]:, 的位掩码，再用位运算排除字符串内部的字符，
+ *     得到所有结构字符（包括字符串起始引号和标量的首字符）的偏移，存入 struct_index；
+ *  2. 构建 JSON 树：沿着 struct_index 逐个读取结构字符，递归下降地构建 struct value。
+ * 第一阶段按窗口分段进行：第二阶段取完当前窗口的结构字符后，再扫描下一个窗口，
+ * 索引只需容纳一个窗口的结果，内存占用与文本长度无关，数据也还在缓存中。
+ */
+
+#define JSON_MAX_DEPTH 1024 // 解析时允许的最大嵌套深度，防止恶意输入耗尽栈空间
+
+// 字符分类，供标量扫描使用
+#define CC_QUOTE 0x01
+#define CC_BSLASH 0x02
+#define CC_SPACE 0x04
+#define CC_OP 0x08
+
+static const unsigned char char_class[256] = {
+    ['"'] = CC_QUOTE,
+    ['\\'] = CC_BSLASH,
+    [' '] = CC_SPACE,
+    ['\t'] = CC_SPACE,
+    ['\n'] = CC_SPACE,
+    ['\r'] = CC_SPACE,
+    ['{'] = CC_OP,
+    ['}'] = CC_OP,
+    ['['] = CC_OP,
+    [']'] = CC_OP,
+    [':'] = CC_OP,
+    [','] = CC_OP,
+};
+
+/**
+ * @brief 一个 64 字节块中各类字符的位掩码，第 i 位对应块中第 i 个字节
+ */
+typedef struct block_mask
+{
+    uint64_t quote;  // '"'
+    uint64_t bslash; // '\\'
+    uint64_t space;  // 空白字符
+    uint64_t op;     // {}[]:,
+} block_mask;
+
+/**
+ * @brief 第一阶段的结果：结构字符在文本中的偏移，按出现顺序排列
+ */
+typedef struct struct_index
+{
+    U32 *pos;                 // 结构字符的偏移
+    U32 count;                // pos 中有几个偏移
+    size_t size;              // pos 的容量
+    size_t scanned;           // 已扫描的字节数
+    uint64_t escape_carry;    // 上一块最后一个字符是否为未被转义的反斜杠
+    uint64_t in_string_carry; // 上一块结束时是否处在字符串内部，是则为全 1
+    uint64_t sep_carry;       // 上一块最后一个字符是否为分隔符，文本开头视为分隔符
+} struct_index;
+
+#define SCAN_WINDOW (64 * 1024) // 第一阶段每次扫描的字节数
+
+#if defined(__AVX2__) || defined(JSON_SCAN_DISPATCH)
+// 没有用 -mavx2 编译时由 target 属性单独生成 AVX2 指令，只在 scan_avx2 中使用
+static inline __attribute__((always_inline, target("avx2"))) void classify_block_avx2(const unsigned char *p, block_mask *m)
+{
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i bslash = _mm256_set1_epi8('\\');
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    memset(m, 0, sizeof(*m));
+    for (int i = 0; i < 64; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        // '[' | 0x20 == '{'，']' | 0x20 == '}'，一次比较可以同时识别两个字符
+        __m256i v20 = _mm256_or_si256(v, lower);
+        __m256i op = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v20, _mm256_set1_epi8('{')), _mm256_cmpeq_epi8(v20, _mm256_set1_epi8('}'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(':')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(','))));
+        __m256i space = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, lower), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r'))));
+        m->quote |= (uint64_t)(U32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, quote)) << i;
+        m->bslash |= (uint64_t)(U32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, bslash)) << i;
+        m->space |= (uint64_t)(U32)_mm256_movemask_epi8(space) << i;
+        m->op |= (uint64_t)(U32)_mm256_movemask_epi8(op) << i;
+    }
+}
+#endif
+
+#if defined(__AVX2__)
+#define classify_block classify_block_avx2
+#elif defined(__SSE2__)
+static inline __attribute__((always_inline)) void classify_block(const unsigned char *p, block_mask *m)
+{
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i bslash = _mm_set1_epi8('\\');
+    const __m128i lower = _mm_set1_epi8(0x20);
+    memset(m, 0, sizeof(*m));
+    for (int i = 0; i < 64; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        // '[' | 0x20 == '{'，']' | 0x20 == '}'，一次比较可以同时识别两个字符
+        __m128i v20 = _mm_or_si128(v, lower);
+        __m128i op = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v20, _mm_set1_epi8('{')), _mm_cmpeq_epi8(v20, _mm_set1_epi8('}'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(':')), _mm_cmpeq_epi8(v, _mm_set1_epi8(','))));
+        __m128i space = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(v, lower), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'))),
+            _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\r'))));
+        m->quote |= (uint64_t)(U32)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote)) << i;
+        m->bslash |= (uint64_t)(U32)_mm_movemask_epi8(_mm_cmpeq_epi8(v, bslash)) << i;
+        m->space |= (uint64_t)(U32)_mm_movemask_epi8(space) << i;
+        m->op |= (uint64_t)(U32)_mm_movemask_epi8(op) << i;
+    }
+}
+#else
+static void classify_block(const unsigned char *p, block_mask *m)
+{
+    memset(m, 0, sizeof(*m));
+    for (int i = 0; i < 64; i++)
+    {
+        unsigned char cc = char_class[p[i]];
+        uint64_t bit = (uint64_t)1 << i;
+        if (cc & CC_QUOTE)
+            m->quote |= bit;
+        if (cc & CC_BSLASH)
+            m->bslash |= bit;
+        if (cc & CC_SPACE)
+            m->space |= bit;
+        if (cc & CC_OP)
+            m->op |= bit;
+    }
+}
+#endif
+
+/**
+ * @brief 求出被反斜杠转义的字符
+ * @param bslash 本块中反斜杠的位掩码
+ * @param carry 上一块最后一个字符是否为未被转义的反斜杠，返回时更新为本块的情况
+ * @return 被转义字符的位掩码
+ * @details 配置文件中很少出现反斜杠，所以逐个处理即可
+ */
+static uint64_t find_escaped(uint64_t bslash, uint64_t *carry)
+{
+    uint64_t escaped = *carry;
+    bslash &= ~*carry; // 被转义的反斜杠不再转义后一个字符
+    *carry = 0;
+    while (bslash)
+    {
+        int i = __builtin_ctzll(bslash);
+        bslash &= bslash - 1;
+        if (i == 63)
+        {
+            *carry = 1;
+            break;
+        }
+        escaped |= (uint64_t)1 << (i + 1);
+        bslash &= ~((uint64_t)1 << (i + 1));
+    }
+    return escaped;
+}
+
+/**
+ * @brief 前缀异或：结果的第 i 位是 x 的第 0~i 位的异或
+ */
+static uint64_t prefix_xor(uint64_t x)
+{
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+/**
+ * @brief 清空第一阶段的状态，准备扫描一段新的文本，保留已分配的索引
+ */
+static void scan_reset(struct_index *idx)
+{
+    idx->count = 0;
+    idx->scanned = 0;
+    idx->escape_carry = 0;
+    idx->in_string_carry = 0;
+    idx->sep_carry = 1; // 文本开头视为分隔符
+}
+/**
+ * @brief 初始化第一阶段的状态
+ * @return 成功返回 0，内存不足返回 -1
+ */
+static int scan_init(struct_index *idx)
+{
+    // 配置文本中结构字符约占 1/8，先按此估算，不够时再扩容
+    memset(idx, 0, sizeof(*idx));
+    scan_reset(idx);
+    idx->size = SCAN_WINDOW / 8 + 64;
+    idx->pos = (U32 *)heap_alloc(idx->size * sizeof(U32));
+    if (!idx->pos)
+    {
+        fprintf(stderr, "json_parse: malloc(%lu) failed\n", (unsigned long)(idx->size * sizeof(U32)));
+        return -1;
+    }
+    return 0;
+}
+/**
+ * @brief scan_structurals 的循环体，classify 为按块分类的函数，内联到各个指令集的版本中
+ */
+static inline __attribute__((always_inline)) int scan_blocks(const char *buf, size_t len, struct_index *idx, size_t upto,
+                                                             void (*classify)(const unsigned char *, block_mask *))
+{
+    const unsigned char *p = (const unsigned char *)buf;
+    uint64_t escape_carry = idx->escape_carry;
+    uint64_t in_string_carry = idx->in_string_carry;
+    uint64_t sep_carry = idx->sep_carry;
+    unsigned char tail[64];
+    size_t off;
+
+    for (off = idx->scanned; off < len && off < upto; off += 64)
+    {
+        block_mask m;
+        // 每个字节最多产生一个结构字符，保证本块的结果放得下
+        if (idx->size - idx->count < 64)
+        {
+            U32 *temp = (U32 *)heap_realloc(idx->pos, idx->size * sizeof(U32), idx->size * 2 * sizeof(U32));
+            if (!temp)
+            {
+                fprintf(stderr, "json_parse: expand structural index failed!\n");
+                heap_free(idx->pos);
+                idx->pos = NULL;
+                return -1;
+            }
+            idx->pos = temp;
+            idx->size *= 2;
+        }
+        if (len - off >= 64)
+        {
+            classify(p + off, &m);
+        }
+        else
+        {
+            // 最后不满 64 字节的块用空格补齐，空格不会产生结构字符
+            memset(tail, ' ', sizeof(tail));
+            memcpy(tail, p + off, len - off);
+            classify(tail, &m);
+        }
+
+        uint64_t quote = m.quote & ~find_escaped(m.bslash, &escape_carry);
+        // 从起始引号到闭合引号之前的字符都在字符串内部
+        uint64_t in_string = prefix_xor(quote) ^ in_string_carry;
+        in_string_carry = (uint64_t)((int64_t)in_string >> 63);
+        uint64_t outside = ~in_string;
+
+        uint64_t sep = (m.op | m.space | quote) & outside;
+        uint64_t scalar = ~(m.op | m.space | quote) & outside;
+        uint64_t scalar_start = scalar & ((sep << 1) | sep_carry);
+        sep_carry = sep >> 63;
+
+        uint64_t structurals = (m.op & outside) | (quote & in_string) | scalar_start;
+        // 用局部变量计数，避免每写一个偏移都要重新读取 idx->count
+        U32 *out = idx->pos + idx->count;
+        while (structurals)
+        {
+            *out++ = (U32)(off + __builtin_ctzll(structurals));
+            structurals &= structurals - 1;
+        }
+        idx->count = out - idx->pos;
+    }
+    idx->scanned = off < len ? off : len;
+    idx->escape_carry = escape_carry;
+    idx->in_string_carry = in_string_carry;
+    idx->sep_carry = sep_carry;
+
+    if (idx->scanned == len && in_string_carry)
+    {
+        fprintf(stderr, "json_parse: unterminated string\n");
+        heap_free(idx->pos);
+        idx->pos = NULL;
+        return -1;
+    }
+    return 0;
+}
+#ifdef JSON_SCAN_DISPATCH
+static __attribute__((target("avx2"), noinline)) int scan_avx2(const char *buf, size_t len, struct_index *idx, size_t upto)
+{
+    return scan_blocks(buf, len, idx, upto, classify_block_avx2);
+}
+#endif
+/**
+ * @brief 第一阶段：从上次停下的位置继续扫描文本，直到扫过 upto 字节，把结构字符的偏移追加到 idx 中
+ * @param buf JSON 文本
+ * @param len 文本长度
+ * @param idx 扫描状态和结果，idx->pos 由调用者释放
+ * @param upto 至少扫描到该偏移，按 64 字节取整
+ * @return 成功返回 0，字符串未闭合或内存不足返回 -1
+ */
+static int scan_structurals(const char *buf, size_t len, struct_index *idx, size_t upto)
+{
+#ifdef JSON_SCAN_DISPATCH
+    // 每个窗口判断一次，__builtin_cpu_supports 只读取 libgcc 启动时填好的全局变量
+    if (__builtin_cpu_supports("avx2"))
+        return scan_avx2(buf, len, idx, upto);
+#endif
+    return scan_blocks(buf, len, idx, upto, classify_block);
+}
+/**
+ * @brief 只做第一阶段，统计整个文本中结构字符的个数
+ * @param buf JSON 文本
+ * @param len 文本长度
+ * @param count 输出结构字符的个数
+ * @return 成功返回 0，字符串未闭合或内存不足返回 -1
+ * @details 按窗口扫描，索引只占一个窗口的大小；供性能测试单独衡量结构扫描，也可以用来预先检查字符串是否闭合
+ */
+int json_scan(const char *buf, size_t len, size_t *count)
+{
+    struct_index idx;
+
+    assert(buf);
+    assert(count);
+    *count = 0;
+    if (scan_init(&idx) < 0)
+        return -1;
+    while (idx.scanned < len)
+    {
+        if (scan_structurals(buf, len, &idx, idx.scanned + SCAN_WINDOW) < 0)
+            return -1;
+        *count += idx.count;
+        idx.count = 0;
+    }
+    heap_free(idx.pos);
+    return 0;
+}
+
+/**
+ * @brief 第二阶段的解析上下文
+ */
+/**
+ * @brief 解析时暂存的一项：对象的键名或值、数组的元素，打包中的数组暂存原始值
+ */
+typedef union stack_item
+{
+    json_key *key;
+    JSON *val;
+    double num;
+    int64_t i64;
+    BOOL bol;
+} stack_item;
+
+typedef struct parser
+{
+    json_doc *doc;    // 节点分配在该文档中，为 NULL 时分配在堆中
+    const char *buf;  // JSON 文本
+    size_t len;       // 文本长度
+    struct_index idx; // 第一阶段的结果
+    U32 cur;          // 下一个待处理的结构字符在 idx.pos 中的下标
+    BOOL insitu;      // 为 TRUE 时 buf 可写，字符串就地还原，不再拷贝
+    lazy_src *lazy;   // 不为 NULL 时只解析一层，子对象和子数组生成延迟节点
+    key_table *keys;  // 键名的驻留表
+    stack_item *stack; // 正在解析的数组的元素、对象的键名和值，容器结束时再一次分配恰好大小的成员数组
+    U32 top;          // stack 中已用的项数
+    U32 cap;          // stack 的容量
+} parser;
+
+/**
+ * @brief 报告解析错误，给出出错位置的行号和列号
+ */
+static void parse_error(const parser *p, size_t pos, const char *info)
+{
+    unsigned long line = 1, col = 1;
+    if (pos > p->len)
+        pos = p->len;
+    for (size_t i = 0; i < pos; i++)
+    {
+        if (p->buf[i] == '\n')
+        {
+            line++;
+            col = 1;
+        }
+        else
+        {
+            col++;
+        }
+    }
+    fprintf(stderr, "json_parse: %s at line %lu, column %lu\n", info, line, col);
+}
+
+/**
+ * @brief 丢弃已经取走的结构字符，继续第一阶段的扫描，直到扫过 upto 字节
+ * @return 成功返回 0，失败返回 -1
+ */
+static int scan_more(parser *p, size_t upto)
+{
+    struct_index *idx = &p->idx;
+    memmove(idx->pos, idx->pos + p->cur, (idx->count - p->cur) * sizeof(U32));
+    idx->count -= p->cur;
+    p->cur = 0;
+    return scan_structurals(p->buf, p->len, idx, upto);
+}
+/**
+ * @brief 当前窗口的结构字符已经取完，扫描后面的窗口，直到找到结构字符
+ * @return 成功返回 0，文本结束或出错返回 -1
+ */
+static int next_window(parser *p)
+{
+    while (p->cur >= p->idx.count)
+    {
+        if (p->idx.scanned >= p->len)
+        {
+            parse_error(p, p->len, "unexpected end of input");
+            return -1;
+        }
+        if (scan_more(p, p->idx.scanned + SCAN_WINDOW) < 0)
+            return -1;
+    }
+    return 0;
+}
+/**
+ * @brief 取出下一个结构字符的偏移
+ * @return 成功返回 0，没有更多结构字符时返回 -1
+ */
+static inline int next_structural(parser *p, U32 *at)
+{
+    if (p->cur >= p->idx.count && next_window(p) < 0)
+        return -1;
+    *at = p->idx.pos[p->cur++];
+    return 0;
+}
+
+/**
+ * @brief 判断 pos 处是否是一个标量的结束位置
+ */
+static BOOL is_token_end(const parser *p, size_t pos)
+{
+    return pos >= p->len || (char_class[(unsigned char)p->buf[pos]] & (CC_SPACE | CC_OP));
+}
+
+static int hex_value(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * @brief 读取 \uXXXX 中的 4 位十六进制数
+ * @return 成功返回码点，失败返回 -1
+ */
+static long read_hex4(const char *s, const char *end)
+{
+    long cp = 0;
+    if (end - s < 4)
+        return -1;
+    for (int i = 0; i < 4; i++)
+    {
+        int h = hex_value(s[i]);
+        if (h < 0)
+            return -1;
+        cp = (cp << 4) | h;
+    }
+    return cp;
+}
+
+/**
+ * @brief 把码点 cp 按 UTF-8 编码写入 out
+ * @return 写入的字节数
+ */
+static int utf8_encode(unsigned long cp, char *out)
+{
+    if (cp < 0x80)
+    {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800)
+    {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000)
+    {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+/**
+ * @brief 把字符串 [s, end) 中的转义序列还原后写入 out
+ * @param out 输出缓冲区，长度不小于 end - s
+ * @return 成功返回输出的字节数，转义序列非法时返回 -1
+ * @details UTF-8 编码的结果不会比 \uXXXX 更长，所以输出不会超过输入的长度
+ */
+static long unescape(const char *s, const char *end, char *out)
+{
+    char *o = out;
+    while (s < end)
+    {
+        if (*s != '\\')
+        {
+            *o++ = *s++;
+            continue;
+        }
+        s++;
+        switch (*s++)
+        {
+        case '"':
+            *o++ = '"';
+            break;
+        case '\\':
+            *o++ = '\\';
+            break;
+        case '/':
+            *o++ = '/';
+            break;
+        case 'b':
+            *o++ = '\b';
+            break;
+        case 'f':
+            *o++ = '\f';
+            break;
+        case 'n':
+            *o++ = '\n';
+            break;
+        case 'r':
+            *o++ = '\r';
+            break;
+        case 't':
+            *o++ = '\t';
+            break;
+        case 'u':
+        {
+            long cp = read_hex4(s, end);
+            if (cp < 0)
+                return -1;
+            s += 4;
+            if (cp >= 0xD800 && cp <= 0xDBFF)
+            {
+                // UTF-16 代理对，后面必须紧跟低位代理
+                long lo;
+                if (end - s < 6 || s[0] != '\\' || s[1] != 'u')
+                    return -1;
+                lo = read_hex4(s + 2, end);
+                if (lo < 0xDC00 || lo > 0xDFFF)
+                    return -1;
+                s += 6;
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+            }
+            else if (cp >= 0xDC00 && cp <= 0xDFFF)
+            {
+                return -1;
+            }
+            o += utf8_encode((unsigned long)cp, o);
+            break;
+        }
+        default:
+            return -1;
+        }
+    }
+    return o - out;
+}
+
+/**
+ * @brief 找到 at 处开始的字符串的结束引号
+ * @param p 解析上下文
+ * @param at 起始引号的偏移
+ * @param escaped 输出字符串中是否含有转义序列
+ * @return 成功返回结束引号的位置，失败返回 NULL
+ */
+static const char *string_end(parser *p, U32 at, BOOL *escaped)
+{
+    const char *q = p->buf + at + 1;
+    const char *end = p->buf + p->len;
+
+    // 字符串可能还没有被第一阶段扫描过，需要检查边界
+    while (q < end && *q != '"')
+    {
+        if ((unsigned char)*q < 0x20)
+        {
+            parse_error(p, q - p->buf, "control character in string");
+            return NULL;
+        }
+        if (*q == '\\')
+        {
+            *escaped = TRUE;
+            q++;
+        }
+        q++;
+    }
+    if (q >= end)
+    {
+        parse_error(p, at, "unterminated string");
+        return NULL;
+    }
+    return q;
+}
+/**
+ * @brief 还原 [s, q) 之间的字符串内容
+ * @param escaped 字符串中是否含有转义序列
+ * @return 成功返回分配在 p->doc 中（或堆中）的字符串，就地解析时返回原文中的字符串，失败返回 NULL
+ */
+static char *string_copy(parser *p, const char *s, const char *q, BOOL escaped)
+{
+    if (p->insitu)
+    {
+        // 就地修改之前，第一阶段必须已经扫描过整个字符串
+        if (p->idx.scanned <= (size_t)(q - p->buf) && scan_more(p, q - p->buf + 1) < 0)
+            return NULL;
+        // 还原后的字符串不会比原文长，直接写回原处，用 '\0' 覆盖结束引号
+        char *str = (char *)s;
+        long n = q - s;
+        if (escaped && (n = unescape(s, q, str)) < 0)
+        {
+            parse_error(p, s - p->buf, "invalid escape sequence");
+            return NULL;
+        }
+        str[n] = '\0';
+        return str;
+    }
+    if (!escaped)
+        return str_dup(p->doc, s, q - s);
+    char *str = (char *)mem_alloc(p->doc, q - s + 1);
+    if (!str)
+        return NULL;
+    if (p->doc)
+        p->doc->stats.string_bytes += q - s + 1;
+    long n = unescape(s, q, str);
+    if (n < 0)
+    {
+        parse_error(p, s - p->buf, "invalid escape sequence");
+        mem_release(p->doc, str);
+        return NULL;
+    }
+    str[n] = '\0';
+    return str;
+}
+/**
+ * @brief 解析 at 处开始的键名，在 p->keys 中驻留
+ * @param p 解析上下文
+ * @param at 起始引号的偏移
+ * @return 成功返回键名原子，失败返回 NULL
+ * @details 没有转义序列的键名直接从原文中查找，驻留表中已有时不再分配；就地解析时原子直接指向原文
+ */
+static json_key *parse_key(parser *p, U32 at)
+{
+    const char *s = p->buf + at + 1;
+    BOOL escaped = FALSE;
+    const char *q = string_end(p, at, &escaped);
+    json_key *key;
+
+    if (!q)
+        return NULL;
+    if (p->insitu)
+    {
+        char *str = string_copy(p, s, q, escaped);
+        if (!str)
+            return NULL;
+        key = key_intern(p->keys, p->doc, str, strlen(str), TRUE);
+    }
+    else if (!escaped)
+    {
+        key = key_intern(p->keys, p->doc, s, q - s, FALSE);
+    }
+    else
+    {
+        char *str = string_copy(p, s, q, escaped);
+        if (!str)
+            return NULL;
+        key = key_intern(p->keys, p->doc, str, strlen(str), FALSE);
+        mem_release(p->doc, str);
+    }
+    if (!key)
+        fprintf(stderr, "json_parse: intern key failed\n");
+    return key;
+}
+
+/**
+ * @brief 解析 at 处开始的字符串值
+ * @return 成功返回 JSON_STR 类型的 JSON 值，失败返回 NULL
+ * @details 短字符串直接还原到节点的 sso 中，不再单独分配，就地解析时也不修改原文
+ */
+static JSON *parse_string_value(parser *p, U32 at)
+{
+    const char *s = p->buf + at + 1;
+    BOOL escaped = FALSE;
+    const char *q = string_end(p, at, &escaped);
+    if (!q)
+        return NULL;
+    JSON *json = value_new(p->doc, JSON_STR);
+    if (!json)
+        return NULL;
+
+    if (q - s <= JSON_SSO_MAX)
+    {
+        // 还原后的字符串不会比原文长
+        long n = q - s;
+        if (!escaped)
+            memcpy(json->sso, s, n);
+        else if ((n = unescape(s, q, json->sso)) < 0)
+        {
+            parse_error(p, s - p->buf, "invalid escape sequence");
+            json_free(json);
+            return NULL;
+        }
+        json->sso[n] = '\0';
+        json->slen = (unsigned char)n;
+        json->flags |= JSON_F_INLINE;
+        return json;
+    }
+    json->str = string_copy(p, s, q, escaped);
+    if (!json->str)
+    {
+        json_free(json);
+        return NULL;
+    }
+    if (p->insitu)
+        json->flags |= JSON_F_BORROWED;
+    return json;
+}
+
+/**
+ * @brief 扫描得到的数字，整数为 JSON_INT，其余为 JSON_NUM
+ */
+typedef struct number
+{
+    json_e type;
+    union {
+        double num;
+        int64_t i64;
+    };
+} number;
+
+/**
+ * @brief 按 JSON 语法扫描 [s, end) 开头的数值
+ * @param out 输出数值
+ * @return 成功返回数值之后的位置，格式错误返回 NULL
+ * @details
+ *  没有小数部分和指数、且在 int64_t 范围内的数字直接得到整数（-0 除外，按 double 保留符号）；
+ *  尾数不超过 2^53 且十进制指数不超过 22 时，double 的一次乘除就是精确结果，直接计算；
+ *  其余情况交给 strtod
+ */
+static const char *scan_number(const char *s, const char *end, number *out)
+{
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const char *c = s;
+    BOOL neg = FALSE;
+    uint64_t mant = 0;
+    int digits = 0; // 有效数字的个数，超过 19 位时 mant 会溢出
+    long exp10 = 0;
+
+    if (*c == '-')
+    {
+        neg = TRUE;
+        c++;
+    }
+    if (c == end || *c < '0' || *c > '9')
+        return NULL;
+    if (*c == '0')
+    {
+        c++;
+    }
+    else
+    {
+        for (; c < end && *c >= '0' && *c <= '9'; c++)
+        {
+            if (digits < 19)
+                mant = mant * 10 + (*c - '0');
+            else
+                exp10++;
+            digits++;
+        }
+    }
+    // 整数快速路径，19 位以内的尾数不会溢出 uint64_t
+    if (digits <= 19 && (c == end || (*c != '.' && *c != 'e' && *c != 'E')) &&
+        (neg ? mant - 1 <= (uint64_t)INT64_MAX : mant <= (uint64_t)INT64_MAX))
+    {
+        out->type = JSON_INT;
+        out->i64 = neg ? -(int64_t)(mant - 1) - 1 : (int64_t)mant;
+        return c;
+    }
+    out->type = JSON_NUM;
+    double *num = &out->num;
+    if (c < end && *c == '.')
+    {
+        c++;
+        if (c == end || *c < '0' || *c > '9')
+            return NULL;
+        for (; c < end && *c >= '0' && *c <= '9'; c++)
+        {
+            if (mant == 0 && *c == '0')
+            {
+                exp10--; // 前导 0 不算有效数字
+                continue;
+            }
+            if (digits < 19)
+            {
+                mant = mant * 10 + (*c - '0');
+                exp10--;
+            }
+            digits++;
+        }
+    }
+    if (c < end && (*c == 'e' || *c == 'E'))
+    {
+        BOOL eneg = FALSE;
+        long e = 0;
+        c++;
+        if (c < end && (*c == '+' || *c == '-'))
+            eneg = *c++ == '-';
+        if (c == end || *c < '0' || *c > '9')
+            return NULL;
+        for (; c < end && *c >= '0' && *c <= '9'; c++)
+        {
+            if (e < 100000)
+                e = e * 10 + (*c - '0');
+        }
+        exp10 += eneg ? -e : e;
+    }
+
+    if (digits <= 19 && mant <= ((uint64_t)1 << 53) && exp10 >= -22 && exp10 <= 22)
+    {
+        *num = (double)mant;
+        *num = exp10 < 0 ? *num / pow10[-exp10] : *num * pow10[exp10];
+        if (neg)
+            *num = -*num;
+        return c;
+    }
+
+    char local[64];
+    char *tok = local;
+    size_t n = c - s;
+    if (n >= sizeof(local))
+    {
+        tok = (char *)heap_alloc(n + 1);
+        if (!tok)
+        {
+            fprintf(stderr, "scan_number: malloc(%lu) failed\n", (unsigned long)(n + 1));
+            return NULL;
+        }
+    }
+    memcpy(tok, s, n);
+    tok[n] = '\0';
+    *num = strtod(tok, NULL);
+    if (tok != local)
+        heap_free(tok);
+    return c;
+}
+
+/**
+ * @brief 解析 at 处的数字，结果存入 num
+ * @return 成功返回 0，失败返回 -1
+ */
+static int number_at(parser *p, U32 at, number *num)
+{
+    const char *c = scan_number(p->buf + at, p->buf + p->len, num);
+
+    if (!c || !is_token_end(p, c - p->buf))
+    {
+        parse_error(p, at, "invalid number");
+        return -1;
+    }
+    return 0;
+}
+/**
+ * @brief 解析 at 处开始的数值
+ * @return 成功返回 JSON_INT 或 JSON_NUM 类型的 JSON 值，失败返回 NULL
+ */
+static JSON *parse_number(parser *p, U32 at)
+{
+    number num;
+    if (number_at(p, at, &num) < 0)
+        return NULL;
+    return num.type == JSON_INT ? new_int(p->doc, num.i64) : new_num(p->doc, num.num);
+}
+
+/**
+ * @brief 解析 at 处开始的 true / false / null
+ */
+/**
+ * @brief 解析 at 处的 true 或 false，结果存入 val
+ * @return 成功返回 0，失败返回 -1
+ */
+static int bool_at(parser *p, U32 at, BOOL *val)
+{
+    const char *s = p->buf + at;
+    size_t left = p->len - at;
+
+    if (left >= 4 && memcmp(s, "true", 4) == 0 && is_token_end(p, at + 4))
+        *val = TRUE;
+    else if (left >= 5 && memcmp(s, "false", 5) == 0 && is_token_end(p, at + 5))
+        *val = FALSE;
+    else
+    {
+        parse_error(p, at, "invalid literal");
+        return -1;
+    }
+    return 0;
+}
+static JSON *parse_literal(parser *p, U32 at)
+{
+    const char *s = p->buf + at;
+    size_t left = p->len - at;
+
+    if (left >= 4 && memcmp(s, "true", 4) == 0 && is_token_end(p, at + 4))
+        return new_bool(p->doc, TRUE);
+    if (left >= 5 && memcmp(s, "false", 5) == 0 && is_token_end(p, at + 5))
+        return new_bool(p->doc, FALSE);
+    if (left >= 4 && memcmp(s, "null", 4) == 0 && is_token_end(p, at + 4))
+        return value_new(p->doc, JSON_NONE);
+    parse_error(p, at, "invalid literal");
+    return NULL;
+}
+
+static JSON *parse_value(parser *p, U32 at, int depth);
+static JSON *lazy_new(parser *p, U32 at);
+
+/**
+ * @brief 确保暂存栈中还能放下 n 项
+ * @return 成功返回 0，内存不足返回 -1
+ */
+static int stack_reserve(parser *p, U32 n)
+{
+    if (p->cap - p->top >= n)
+        return 0;
+    U32 cap = p->cap ? p->cap * 2 : 64;
+    stack_item *stack = (stack_item *)heap_realloc(p->stack, p->cap * sizeof(stack_item), cap * sizeof(stack_item));
+    if (!stack)
+    {
+        fprintf(stderr, "stack_reserve: realloc(%lu) failed\n", (unsigned long)(cap * sizeof(stack_item)));
+        return -1;
+    }
+    p->stack = stack;
+    p->cap = cap;
+    return 0;
+}
+
+/**
+ * @brief 解析对象，at 为 '{' 的偏移
+ * @details 键名和值成对暂存在栈中，对象结束时按成员个数一次分配 kvs，重复的键名仍由 obj_put 覆盖
+ */
+static JSON *parse_object(parser *p, U32 at, int depth)
+{
+    U32 base = p->top;
+    JSON *json;
+
+    if (next_structural(p, &at) < 0)
+        return NULL;
+    if (p->buf[at] != '}')
+    {
+        for (;;)
+        {
+            if (p->buf[at] != '"')
+            {
+                parse_error(p, at, "expect string key");
+                goto failed_;
+            }
+            json_key *key = parse_key(p, at);
+            if (!key)
+                goto failed_;
+            if (next_structural(p, &at) < 0)
+            {
+                key_release(key);
+                goto failed_;
+            }
+            if (p->buf[at] != ':')
+            {
+                parse_error(p, at, "expect ':'");
+                key_release(key);
+                goto failed_;
+            }
+            if (next_structural(p, &at) < 0)
+            {
+                key_release(key);
+                goto failed_;
+            }
+            JSON *val = parse_value(p, at, depth);
+            if (!val)
+            {
+                key_release(key);
+                goto failed_;
+            }
+            if (stack_reserve(p, 2) < 0)
+            {
+                key_release(key);
+                json_free(val);
+                goto failed_;
+            }
+            p->stack[p->top++].key = key;
+            p->stack[p->top++].val = val;
+
+            if (next_structural(p, &at) < 0)
+                goto failed_;
+            if (p->buf[at] == '}')
+                break;
+            if (p->buf[at] != ',')
+            {
+                parse_error(p, at, "expect ',' or '}'");
+                goto failed_;
+            }
+            if (next_structural(p, &at) < 0)
+                goto failed_;
+        }
+    }
+
+    json = container_new(p->doc, JSON_OBJ, (p->top - base) / 2);
+    if (!json)
+        goto failed_;
+    // 容量已经足够，obj_put 不会扩容，也就不会失败
+    for (U32 i = base; i < p->top; i += 2)
+        obj_put(json, p->stack[i].key, p->stack[i + 1].val);
+    p->top = base;
+    return json;
+
+failed_:
+    for (U32 i = base; i < p->top; i += 2)
+    {
+        key_release(p->stack[i].key);
+        json_free(p->stack[i + 1].val);
+    }
+    p->top = base;
+    return NULL;
+}
+
+/**
+ * @brief at 处的元素能否按原始值打包：数字（包括整数）返回 JSON_NUM，true/false 返回 JSON_BOL，其余返回 JSON_NONE
+ */
+static json_e packable_at(const parser *p, U32 at)
+{
+    char c = p->buf[at];
+    if (c == '-' || (c >= '0' && c <= '9'))
+        return JSON_NUM;
+    return c == 't' || c == 'f' ? JSON_BOL : JSON_NONE;
+}
+/**
+ * @brief 把栈中 base 之后暂存的原始值换成节点，数组中出现其他类型的元素时调用
+ * @return 成功返回 0；失败返回 -1，已经生成的节点被释放，栈退回到 base
+ */
+static int stack_box(parser *p, U32 base, json_e etype)
+{
+    for (U32 i = base; i < p->top; i++)
+    {
+        JSON *val;
+        if (etype == JSON_NUM)
+            val = new_num(p->doc, p->stack[i].num);
+        else if (etype == JSON_INT)
+            val = new_int(p->doc, p->stack[i].i64);
+        else
+            val = new_bool(p->doc, p->stack[i].bol);
+        if (!val)
+        {
+            while (i-- > base)
+                json_free(p->stack[i].val);
+            p->top = base;
+            return -1;
+        }
+        p->stack[i].val = val;
+    }
+    return 0;
+}
+
+/**
+ * @brief 整数能否用 double 精确表示
+ */
+static BOOL int_exact(int64_t val)
+{
+    return val >= -((int64_t)1 << 53) && val <= ((int64_t)1 << 53);
+}
+/**
+ * @brief 打包数值数组时，按新读到的数字 num 调整元素类型 etype
+ * @return 调整后的元素类型；整数与小数混合时都按 JSON_NUM 存放，num 和栈中已暂存的整数一并转换；
+ *         有整数不能用 double 精确表示时返回 JSON_NONE，由调用者改为按节点存放
+ */
+static json_e packed_merge(parser *p, U32 base, json_e etype, number *num)
+{
+    if (p->top == base || num->type == etype)
+        return num->type;
+    if (num->type == JSON_INT)
+    {
+        if (!int_exact(num->i64))
+            return JSON_NONE;
+        num->type = JSON_NUM;
+        num->num = (double)num->i64;
+        return JSON_NUM;
+    }
+    for (U32 i = base; i < p->top; i++)
+    {
+        if (!int_exact(p->stack[i].i64))
+            return JSON_NONE;
+    }
+    for (U32 i = base; i < p->top; i++)
+        p->stack[i].num = (double)p->stack[i].i64;
+    return JSON_NUM;
+}
+
+/**
+ * @brief 解析数组，at 为 '[' 的偏移
+ * @details
+ *  元素暂存在栈中，数组结束时按元素个数一次分配 elems。
+ *  元素都是数字或都是布尔值时直接暂存原始值，最后生成打包数组，不为元素分配节点；
+ *  全是整数时打包为 int64_t，混有小数时打包为 double；
+ *  出现其他类型的元素时，把已暂存的原始值换成节点，按普通数组继续解析
+ */
+static JSON *parse_array(parser *p, U32 at, int depth)
+{
+    U32 base = p->top;
+    json_e etype = JSON_NONE; // 正在打包的元素类型，JSON_NONE 表示按节点暂存
+    JSON *json;
+
+    if (next_structural(p, &at) < 0)
+        return NULL;
+    if (p->buf[at] != ']')
+    {
+        etype = packable_at(p, at);
+        for (;;)
+        {
+            json_e kind = packable_at(p, at);
+            number num;
+
+            if (stack_reserve(p, 1) < 0)
+                goto failed_;
+            if (etype != JSON_NONE && (kind == JSON_BOL) != (etype == JSON_BOL))
+                kind = JSON_NONE;
+            if (etype != JSON_NONE && kind == JSON_NUM)
+            {
+                if (number_at(p, at, &num) < 0)
+                    goto failed_;
+                kind = packed_merge(p, base, etype, &num);
+            }
+            if (etype != JSON_NONE && kind == JSON_NONE)
+            {
+                if (stack_box(p, base, etype) < 0)
+                    return NULL;
+                etype = JSON_NONE;
+            }
+            if (etype != JSON_NONE)
+                etype = kind;
+            if (etype == JSON_NUM)
+                p->stack[p->top++].num = num.num;
+            else if (etype == JSON_INT)
+                p->stack[p->top++].i64 = num.i64;
+            else if (etype == JSON_BOL)
+            {
+                if (bool_at(p, at, &p->stack[p->top].bol) < 0)
+                    goto failed_;
+                p->top++;
+            }
+            else
+            {
+                JSON *val = parse_value(p, at, depth);
+                if (!val)
+                    goto failed_;
+                p->stack[p->top++].val = val;
+            }
+
+            if (next_structural(p, &at) < 0)
+                goto failed_;
+            if (p->buf[at] == ']')
+                break;
+            if (p->buf[at] != ',')
+            {
+                parse_error(p, at, "expect ',' or ']'");
+                goto failed_;
+            }
+            if (next_structural(p, &at) < 0)
+                goto failed_;
+        }
+    }
+
+    U32 count = p->top - base;
+    if (etype != JSON_NONE)
+    {
+        json = node_new(p->doc, JSON_ARR);
+        packed *pk = json ? packed_new(p->doc, etype, count) : NULL;
+        if (!pk)
+        {
+            json_free(json);
+            goto failed_;
+        }
+        for (U32 i = 0; i < count; i++)
+        {
+            if (etype == JSON_NUM)
+                ((double *)pk->data)[i] = p->stack[base + i].num;
+            else if (etype == JSON_INT)
+                ((int64_t *)pk->data)[i] = p->stack[base + i].i64;
+            else
+                ((BOOL *)pk->data)[i] = p->stack[base + i].bol;
+        }
+        json->flags |= JSON_F_PACKED;
+        json->etype = etype;
+        json->arr->pk = pk;
+        json->arr->count = json->arr->size = count;
+        p->top = base;
+        return json;
+    }
+    json = container_new(p->doc, JSON_ARR, count);
+    if (!json)
+        goto failed_;
+    json->arr->count = count;
+    for (U32 i = 0; i < count; i++)
+        json->arr->elems[i] = p->stack[base + i].val;
+    p->top = base;
+    return json;
+
+failed_:
+    // 打包中的原始值不需要释放
+    while (etype == JSON_NONE && p->top > base)
+        json_free(p->stack[--p->top].val);
+    p->top = base;
+    return NULL;
+}
+
+/**
+ * @brief 解析 at 处开始的 JSON 值
+ * @param depth 当前的嵌套深度
+ */
+static JSON *parse_value(parser *p, U32 at, int depth)
+{
+    switch (p->buf[at])
+    {
+    case '{':
+    case '[':
+        if (p->lazy)
+            return lazy_new(p, at);
+        if (depth >= JSON_MAX_DEPTH)
+        {
+            parse_error(p, at, "nesting too deep");
+            return NULL;
+        }
+        return p->buf[at] == '{' ? parse_object(p, at, depth + 1) : parse_array(p, at, depth + 1);
+    case '"':
+        return parse_string_value(p, at);
+    case 't':
+    case 'f':
+    case 'n':
+        return parse_literal(p, at);
+    case '-':
+    case '0':
+    case '1':
+    case '2':
+    case '3':
+    case '4':
+    case '5':
+    case '6':
+    case '7':
+    case '8':
+    case '9':
+        return parse_number(p, at);
+    default:
+        parse_error(p, at, "unexpected character");
+        return NULL;
+    }
+}
+
+/**
+ * @brief 解析 p 中的整段文本，文本中只能有一个 JSON 值
+ */
+static JSON *parse_root(parser *p)
+{
+    JSON *json = NULL;
+    U32 at;
+
+    if (next_structural(p, &at) == 0)
+        json = parse_value(p, at, 0);
+    // 扫描剩余的文本，根值之后只允许有空白
+    while (json && p->cur >= p->idx.count && p->idx.scanned < p->len)
+    {
+        if (scan_more(p, p->idx.scanned + SCAN_WINDOW) < 0)
+        {
+            json_free(json);
+            json = NULL;
+        }
+    }
+    if (json && p->cur != p->idx.count)
+    {
+        parse_error(p, p->idx.pos[p->cur], "unexpected trailing characters");
+        json_free(json);
+        json = NULL;
+    }
+    return json;
+}
+/**
+ * @brief 解析内存中的 JSON 文本，节点分配在 doc 中，doc 为 NULL 时分配在堆中
+ * @param insitu 为 TRUE 时就地解析，buf 必须可写且与 doc 的生命周期相同
+ */
+static JSON *parse_text(json_doc *doc, const char *buf, size_t len, BOOL insitu)
+{
+    parser p = {0};
+    key_table keys = {0}; // 堆中解析时，同一次解析得到的键名共享原子
+    JSON *json;
+
+    assert(buf || len == 0);
+    if (len >= 0xFFFFFFFFu)
+    {
+        fprintf(stderr, "json_parse: input too large (%lu bytes)\n", (unsigned long)len);
+        return NULL;
+    }
+    assert(!insitu || doc);
+    p.doc = doc;
+    p.buf = buf;
+    p.len = len;
+    p.insitu = insitu;
+    p.keys = doc ? &doc->keys : &keys;
+    if (scan_init(&p.idx) < 0)
+        return NULL;
+
+    json = parse_root(&p);
+    heap_free(p.idx.pos);
+    heap_free(p.stack);
+    key_table_clear(&keys);
+    heap_free(keys.slots);
+    return json;
+}
+/**
+ * @brief 用 p 解析另一段文本 buf，复用 p 中已分配的索引
+ * @details 用于连续解析大量短文本，避免每次都申请索引；用完后由调用者释放 p->idx.pos
+ */
+static JSON *parse_again(parser *p, const char *buf, size_t len)
+{
+    assert(len < 0xFFFFFFFFu);
+    // 上一次扫描失败时索引已被释放
+    if (!p->idx.pos && scan_init(&p->idx) < 0)
+        return NULL;
+    scan_reset(&p->idx);
+    p->buf = buf;
+    p->len = len;
+    p->cur = 0;
+    return parse_root(p);
+}
+/**
+ * @brief 读取名字为fname的文件并解析，节点分配在 doc 中，doc 为 NULL 时分配在堆中
+ */
+static JSON *load_file(json_doc *doc, const char *fname)
+{
+    FILE *fp;
+    long len;
+    char *buf;
+    JSON *json;
+
+    assert(fname);
+    assert(fname[0]);
+
+    fp = fopen(fname, "rb");
+    if (!fp)
+    {
+        fprintf(stderr, "json_load: open file [%s] failed!\n", fname);
+        return NULL;
+    }
+    if (fseek(fp, 0, SEEK_END) != 0 || (len = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0)
+    {
+        fprintf(stderr, "json_load: get size of [%s] failed!\n", fname);
+        fclose(fp);
+        return NULL;
+    }
+    buf = (char *)heap_alloc(len + 1);
+    if (!buf)
+    {
+        fprintf(stderr, "json_load: malloc(%ld) failed!\n", len + 1);
+        fclose(fp);
+        return NULL;
+    }
+    if (fread(buf, 1, len, fp) != (size_t)len)
+    {
+        fprintf(stderr, "json_load: read file [%s] failed!\n", fname);
+        heap_free(buf);
+        fclose(fp);
+        return NULL;
+    }
+    fclose(fp);
+
+    json = parse_text(doc, buf, len, FALSE);
+    heap_free(buf);
+    return json;
+}
+/**
+ * @brief 解析内存中的 JSON 文本
+ * @param buf JSON 文本，不要求以 '\0' 结尾
+ * @param len 文本长度
+ * @return JSON* 解析得到的 JSON 值，失败返回 NULL，错误原因输出到 stderr
+ * @details
+ *  1. 字符串中的转义序列会被还原，\uXXXX 转换为 UTF-8 编码
+ *  2. null 解析为 JSON_NONE 类型的 JSON 值
+ *  3. 对象中键名重复时，后出现的值覆盖先出现的值，与 json_add_member 一致
+ */
+JSON *json_parse(const char *buf, size_t len)
+{
+    return parse_text(NULL, buf, len, FALSE);
+}
+/**
+ * @brief 从名字为fname的文件中读取并解析 JSON 文本
+ * @param fname 文件名
+ * @return JSON* 解析得到的 JSON 值，失败返回 NULL
+ */
+JSON *json_load(const char *fname)
+{
+    return load_file(NULL, fname);
+}
+
+/**
+ * @brief 新建一个空文档
+ * @return json_doc* 文档，失败返回 NULL
+ * @details 文档第一次分配节点时才申请内存块
+ */
+json_doc *json_doc_new(void)
+{
+    json_doc *doc = (json_doc *)heap_calloc(sizeof(json_doc));
+    if (!doc)
+    {
+        fprintf(stderr, "json_doc_new: calloc(%lu) failed\n", sizeof(json_doc));
+        return NULL;
+    }
+    doc->alloc = heap;
+    return doc;
+}
+/**
+ * @brief 设置分配器，三个函数都为 NULL 时恢复为 malloc、realloc 和 free
+ * @param doc 为 NULL 时设置全局分配器，否则设置该文档的内存块使用的分配器
+ * @return 成功返回 0；文档已经持有内存块时返回 -1
+ * @details
+ *  全局分配器负责堆中的节点、字符串、成员数组、文档本身和解析、输出时的临时缓冲区，
+ *  必须在分配任何 JSON 值之前设置，且不能与其他接口并发调用；更换之前先调用 json_slab_trim
+ *  把完全空闲的 slab 大块还给原来的分配器，仍有对象在使用的大块等以后整理时再还；
+ *  文档的分配器只负责文档的内存块，内存块按 ARENA_CHUNK 对齐，节点据此找到所属文档
+ */
+int json_set_allocator(json_doc *doc, json_alloc_fn alloc_fn, json_realloc_fn realloc_fn, json_free_fn free_fn,
+                       void *user)
+{
+    allocator a = {alloc_fn, realloc_fn, free_fn, user};
+
+    assert((alloc_fn && realloc_fn && free_fn) || (!alloc_fn && !realloc_fn && !free_fn));
+    if (!alloc_fn)
+        a = std_allocator;
+    if (!doc)
+    {
+        slab_retire();
+        heap = a;
+        return 0;
+    }
+    if (doc->chunks || doc->spare || doc->bigs || doc->spare_bigs || doc->block)
+    {
+        fprintf(stderr, "json_set_allocator: document already holds memory\n");
+        return -1;
+    }
+    doc->alloc = a;
+    return 0;
+}
+/**
+ * @brief 释放文档，文档中的所有 JSON 值随之失效
+ * @param doc 文档，可以为 NULL
+ */
+void json_doc_free(json_doc *doc)
+{
+    if (!doc)
+        return;
+    json_doc_reset(doc);
+    heap_free(doc->keys.slots);
+    while (doc->spare)
+    {
+        arena_chunk *next = doc->spare->next;
+        chunk_free(doc, doc->spare);
+        doc->spare = next;
+    }
+    while (doc->spare_bigs)
+    {
+        arena_chunk *next = doc->spare_bigs->next;
+        chunk_free(doc, doc->spare_bigs);
+        doc->spare_bigs = next;
+    }
+    if (doc->block)
+        doc->alloc.free(doc->alloc.user, doc->block);
+    heap_free(doc);
+}
+/**
+ * @brief 清空文档，文档中的所有 JSON 值随之失效，但保留内存块供之后使用
+ * @param doc 文档
+ * @details 反复“重置-加载”同一个文档时，稳定后不再调用 malloc
+ */
+void json_doc_reset(json_doc *doc)
+{
+    assert(doc);
+    while (doc->maps)
+    {
+        doc_map *next = doc->maps->next;
+        munmap(doc->maps->addr, doc->maps->len);
+        heap_free(doc->maps);
+        doc->maps = next;
+    }
+    while (doc->lazies)
+    {
+        lazy_src *next = doc->lazies->next;
+        lazy_src_free(doc->lazies);
+        doc->lazies = next;
+    }
+    // 文档中的原子分配在内存池中，只需清空槽位
+    key_table_clear(&doc->keys);
+    memset(&doc->stats, 0, sizeof(doc->stats));
+    while (doc->chunks)
+    {
+        arena_chunk *next = doc->chunks->next;
+        doc->chunks->next = doc->spare;
+        doc->spare = doc->chunks;
+        doc->chunks = next;
+    }
+    while (doc->bigs)
+    {
+        arena_chunk *next = doc->bigs->next;
+        doc->bigs->next = doc->spare_bigs;
+        doc->spare_bigs = doc->bigs;
+        doc->bigs = next;
+    }
+}
+/**
+ * @brief 在文档中新建一个type类型的JSON值，初始值与 json_new 相同
+ */
+JSON *json_doc_new_value(json_doc *doc, json_e type)
+{
+    assert(doc);
+    return value_new(doc, type);
+}
+/**
+ * @brief 在文档中新建一个数字类型的JSON值
+ */
+JSON *json_doc_new_num(json_doc *doc, double val)
+{
+    assert(doc);
+    return new_num(doc, val);
+}
+/**
+ * @brief 在文档中新建一个整数类型的JSON值
+ */
+JSON *json_doc_new_int(json_doc *doc, int64_t val)
+{
+    assert(doc);
+    return new_int(doc, val);
+}
+/**
+ * @brief 在文档中新建一个BOOL类型的JSON值
+ */
+JSON *json_doc_new_bool(json_doc *doc, BOOL val)
+{
+    assert(doc);
+    return new_bool(doc, val);
+}
+/**
+ * @brief 在文档中新建一个字符串类型的JSON值，字符串拷贝到文档中
+ */
+JSON *json_doc_new_str(json_doc *doc, const char *str)
+{
+    assert(doc);
+    assert(str);
+    return new_str(doc, str);
+}
+
+/**
+ * @brief json_stats 遍历时的上下文：已计入的键名原子的集合，采用开放定址（线性探测）
+ */
+typedef struct stats_walk
+{
+    json_mem_stats *out;
+    const json_key **seen; // 已计入的原子，NULL 表示空槽
+    size_t count;          // 已计入的原子个数
+    size_t size;           // 槽位个数，为 2 的幂
+} stats_walk;
+
+/**
+ * @brief 原子在集合中的起始槽位，地址先乘以黄金分割常数打散，分散在堆中的原子也不会在某些槽位扎堆
+ */
+static size_t stats_slot(const json_key *key, size_t size)
+{
+    uint64_t h = ((uintptr_t)key >> 4) * 0x9E3779B97F4A7C15ull;
+    return (size_t)(h ^ (h >> 32)) & (size - 1);
+}
+/**
+ * @brief 把键名原子加入集合
+ * @return 第一次出现返回 1，已经计入过返回 0，内存不足返回 -1
+ */
+static int stats_key(stats_walk *w, const json_key *key)
+{
+    if (2 * (w->count + 1) > w->size)
+    {
+        size_t size = w->size ? w->size * 2 : 64;
+        const json_key **seen = (const json_key **)heap_calloc(size * sizeof(*seen));
+        if (!seen)
+        {
+            fprintf(stderr, "json_stats: calloc(%lu) failed\n", (unsigned long)(size * sizeof(*seen)));
+            return -1;
+        }
+        for (size_t i = 0; i < w->size; i++)
+        {
+            if (!w->seen[i])
+                continue;
+            size_t j = stats_slot(w->seen[i], size);
+            while (seen[j])
+                j = (j + 1) & (size - 1);
+            seen[j] = w->seen[i];
+        }
+        heap_free(w->seen);
+        w->seen = seen;
+        w->size = size;
+    }
+    size_t i = stats_slot(key, w->size);
+    for (; w->seen[i]; i = (i + 1) & (w->size - 1))
+    {
+        if (w->seen[i] == key)
+            return 0;
+    }
+    w->seen[i] = key;
+    w->count++;
+    return 1;
+}
+/**
+ * @brief 成员个数 n 所在的扇出桶：0、1、2~3、4~7、……
+ */
+static U32 fanout_bucket(U32 n)
+{
+    U32 b = 0;
+    while (n)
+    {
+        b++;
+        n >>= 1;
+    }
+    return b < JSON_STATS_BUCKETS ? b : JSON_STATS_BUCKETS - 1;
+}
+/**
+ * @brief 把 n 个值计入第 depth 层，打包数组的元素没有节点，也按层计入
+ */
+static void stats_level(json_mem_stats *out, U32 depth, size_t n)
+{
+    out->depth[depth < JSON_STATS_BUCKETS ? depth : JSON_STATS_BUCKETS - 1] += n;
+    if (n && depth > out->max_depth)
+        out->max_depth = depth;
+}
+/**
+ * @brief 统计一个值，json_walk 的访问者，ctx 为 stats_walk
+ * @return 成功返回 0，延迟节点返回 JSON_WALK_SKIP，内存不足返回 -1
+ */
+static int stats_enter(void *ctx, const JSON *json, json_walk_pos *pos)
+{
+    stats_walk *w = (stats_walk *)ctx;
+    json_mem_stats *out = w->out;
+    U32 depth = pos->depth;
+
+    // 对象成员的键名在成员之前计入
+    if (pos->key)
+    {
+        // 只有一个引用的原子不会再出现，不必放进集合
+        int fresh = pos->key->refs == 1 ? 1 : stats_key(w, pos->key);
+        if (fresh < 0)
+            return -1;
+        if (fresh)
+        {
+            out->keys++;
+            out->key_bytes += sizeof(json_key) + (pos->key->str == (const char *)(pos->key + 1) ? pos->key->len + 1 : 0);
+        }
+    }
+    out->values[json->type]++;
+    out->nodes++;
+    out->node_bytes += node_bytes(json) + (header_detached(json) ? HEADER_BYTES : 0);
+    stats_level(out, depth, 1);
+    if (json->flags & JSON_F_LAZY)
+    {
+        out->lazy++;
+        return JSON_WALK_SKIP;
+    }
+    switch (json->type)
+    {
+    case JSON_STR:
+        if (!(json->flags & (JSON_F_INLINE | JSON_F_BORROWED)) && json->str)
+            out->string_bytes += strlen(json->str) + 1;
+        break;
+    case JSON_ARR:
+    {
+        const array *arr = json->arr;
+        out->fanout[fanout_bucket(arr->count)]++;
+        if (json->flags & JSON_F_PACKED)
+        {
+            size_t elem = packed_bytes(json->etype, 1) - packed_bytes(json->etype, 0);
+            out->values[json->etype] += arr->count;
+            out->container_bytes += packed_bytes(json->etype, arr->size);
+            out->slack_bytes += (arr->size - arr->count) * elem;
+            stats_level(out, depth + 1, arr->count);
+            // 按需生成的元素节点与原始值并存
+            if (arr->pk->boxed)
+            {
+                out->nodes += arr->count;
+                out->node_bytes += (size_t)arr->count * sizeof(JSON);
+                out->container_bytes += (arr->count ? arr->count : 1) * sizeof(value *);
+            }
+            break;
+        }
+        out->container_bytes += arr->size * sizeof(value *);
+        out->slack_bytes += (arr->size - arr->count) * sizeof(value *);
+        break;
+    }
+    case JSON_OBJ:
+    {
+        const object *obj = json->obj;
+        out->fanout[fanout_bucket(obj->count)]++;
+        out->container_bytes += obj_buf_bytes(obj->size);
+        out->slack_bytes += (obj->size - obj->count) * sizeof(keyvalue);
+        break;
+    }
+    default:
+        break;
+    }
+    return 0;
+}
+/**
+ * @brief 遍历 json 统计各类型的值的个数和内存占用
+ * @param json JSON值
+ * @param out 统计结果
+ * @return 成功返回 0，失败返回 -1
+ * @details
+ *  只统计 json 这棵树能到达的内存：共享的键名原子只计一次，延迟加载尚未展开的子树只计它的节点，不会被展开；
+ *  内存池和 slab 中按块预留、尚未分配出去的内存不计，文档的用量见 json_doc_stats
+ */
+int json_stats(const JSON *json, json_mem_stats *out)
+{
+    static const json_visitor stats_visitor = {stats_enter, NULL};
+    stats_walk w = {out, NULL, 0, 0};
+    int ret;
+
+    assert(json);
+    assert(out);
+    memset(out, 0, sizeof(*out));
+    ret = walk_tree(json, &stats_visitor, &w);
+    heap_free(w.seen);
+    return ret;
+}
+/**
+ * @brief json 及其所有子成员占用的总字节数
+ * @return 统计失败时返回 0
+ */
+size_t json_memory_usage(const JSON *json)
+{
+    json_mem_stats st;
+
+    if (json_stats(json, &st) < 0)
+        return 0;
+    return st.node_bytes + st.string_bytes + st.key_bytes + st.container_bytes;
+}
+/**
+ * @brief 读取文档的分配计数器，不遍历节点
+ * @param doc 文档
+ * @param out 统计结果，计数器记录的是 json_doc_new 或上次 json_doc_reset 以来的累计分配
+ * @return 总是返回 0
+ * @details 值被覆盖或移出树后内存仍留在文档中，所以计数器可能大于 json_stats 对根节点的统计
+ */
+int json_doc_stats(const json_doc *doc, json_mem_stats *out)
+{
+    assert(doc);
+    assert(out);
+    *out = doc->stats;
+    for (const arena_chunk *c = doc->chunks; c; c = c->next)
+    {
+        out->arena_bytes += sizeof(arena_chunk) + c->size;
+        out->arena_used += c->used;
+    }
+    for (const arena_chunk *c = doc->bigs; c; c = c->next)
+    {
+        out->arena_bytes += sizeof(arena_chunk) + c->size;
+        out->arena_used += c->used;
+    }
+    return 0;
+}
+
+//-----------------------------------------------------------------------------
+//  紧凑拷贝
+//-----------------------------------------------------------------------------
+/*
+逐步构建的树，节点散落在堆中，成员数组按倍数扩容后最多空着一半。json_compact 把整棵树拷贝到一个内部文档中，
+文档的内存块全部切自一整块预先申请的连续内存：先按内存池的分配规则模拟一遍，算出需要几个内存块，
+再按深度优先的顺序拷贝，节点、成员数组、键名和字符串依次排列，成员数组的容量等于成员个数。
+模拟与拷贝按同样的顺序遍历，分配顺序相同，万一预留不足，内存池照常另外申请内存块，结果仍然正确。
+ */
+
+/**
+ * @brief 模拟内存池的分配，计算紧凑拷贝需要的内存块个数
+ */
+typedef struct compact_plan
+{
+    size_t chunks;   // 需要的 ARENA_CHUNK 个数
+    size_t used;     // 当前内存块中已分配的字节数
+    BOOL open;       // 是否已有当前内存块
+    key_table keys;  // 已计入的键名，文档中相同的键名只驻留一次；表不持有原子的引用
+} compact_plan;
+
+/**
+ * @brief json_compact 的拷贝上下文
+ */
+typedef struct compact_copy
+{
+    json_doc *doc; // 拷贝到这个文档中
+    JSON *root;    // 拷贝得到的根节点
+} compact_copy;
+
+/**
+ * @brief 记录拷贝时要驻留的键名
+ * @return 第一次出现返回 1，已经出现过返回 0，内存不足返回 -1
+ */
+static int plan_key(compact_plan *plan, json_key *key)
+{
+    key_table *t = &plan->keys;
+    for (U32 i = t->size ? key->hash & (t->size - 1) : 0; t->size && t->slots[i]; i = (i + 1) & (t->size - 1))
+    {
+        if (key_equal(t->slots[i], key))
+            return 0;
+    }
+    return key_table_put(t, key) < 0 ? -1 : 1;
+}
+
+/**
+ * @brief 按 arena_alloc 的规则模拟分配 bytes 字节
+ */
+static void plan_alloc(compact_plan *plan, size_t bytes)
+{
+    bytes = (bytes + 7) & ~(size_t)7;
+    if (bytes > ARENA_BIG)
+    {
+        plan->chunks += (sizeof(arena_chunk) + bytes + ARENA_CHUNK - 1) / ARENA_CHUNK;
+        return;
+    }
+    if (!plan->open || ARENA_CHUNK - sizeof(arena_chunk) - plan->used < bytes)
+    {
+        plan->chunks++;
+        plan->used = 0;
+        plan->open = TRUE;
+    }
+    plan->used += bytes;
+}
+/**
+ * @brief 按 compact_enter 的顺序模拟拷贝一个值时的每一次分配，json_walk 的访问者，ctx 为 compact_plan
+ * @return 成功返回 0，延迟节点展开失败或内存不足返回 -1
+ */
+static int plan_enter(void *ctx, const JSON *json, json_walk_pos *pos)
+{
+    compact_plan *plan = (compact_plan *)ctx;
+    BOOL wide = json->type == JSON_ARR || json->type == JSON_OBJ;
+    U32 n;
+
+    if (pos->key)
+    {
+        int fresh = plan_key(plan, (json_key *)pos->key);
+        if (fresh < 0)
+            return -1;
+        if (fresh)
+            plan_alloc(plan, sizeof(json_key) + pos->key->len + 1);
+    }
+    if (lazy_load(json) < 0)
+        return -1;
+    plan_alloc(plan, sizeof(JSON) + (wide ? HEADER_BYTES : 0));
+    switch (json->type)
+    {
+    case JSON_STR:
+        n = (U32)strlen(json_str(json, ""));
+        if (n > JSON_SSO_MAX)
+            plan_alloc(plan, n + 1);
+        break;
+    case JSON_ARR:
+        n = json->arr->count;
+        if (json->flags & JSON_F_PACKED)
+            plan_alloc(plan, packed_bytes(json->etype, n ? n : 1));
+        else
+            plan_alloc(plan, (n ? n : 1) * sizeof(value *));
+        break;
+    case JSON_OBJ:
+        n = json->obj->count;
+        plan_alloc(plan, obj_buf_bytes(n ? n : 1));
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+/**
+ * @brief 把一个值拷贝到文档中，json_walk 的访问者，ctx 为 compact_copy
+ * @details
+ *  拷贝得到的数组和对象记在 pos->data 中，子成员拷贝后挂到 pos->up->data 上；
+ *  对象成员的键名先于成员的值分配，与 plan_enter 的顺序相同
+ * @return 成功返回 0，失败返回 -1，已分配的内存留在文档中
+ */
+static int compact_enter(void *ctx, const JSON *json, json_walk_pos *pos)
+{
+    compact_copy *cc = (compact_copy *)ctx;
+    json_doc *doc = cc->doc;
+    JSON *parent = pos->up ? (JSON *)pos->up->data : NULL;
+    json_key *key = NULL;
+    JSON *copy;
+    U32 n;
+
+    if (pos->key && !(key = key_make(doc, pos->key->str, pos->key->len)))
+        return -1;
+    if (lazy_load(json) < 0)
+        return -1;
+    switch (json->type)
+    {
+    case JSON_NUM:
+        copy = new_num(doc, json->num);
+        break;
+    case JSON_INT:
+        copy = new_int(doc, json->i64);
+        break;
+    case JSON_BOL:
+        copy = new_bool(doc, json->bol);
+        break;
+    case JSON_STR:
+        copy = new_str(doc, json_str(json, ""));
+        break;
+    case JSON_ARR:
+        n = json->arr->count;
+        if (!(json->flags & JSON_F_PACKED))
+        {
+            copy = container_new(doc, JSON_ARR, n);
+            break;
+        }
+        copy = node_new(doc, JSON_ARR);
+        if (!copy || !(copy->arr->pk = packed_new(doc, json->etype, n ? n : 1)))
+            return -1;
+        memcpy(copy->arr->pk->data, json->arr->pk->data, packed_bytes(json->etype, n) - sizeof(packed));
+        copy->flags |= JSON_F_PACKED;
+        copy->etype = json->etype;
+        copy->arr->count = n;
+        copy->arr->size = n ? n : 1;
+        break;
+    case JSON_OBJ:
+        copy = container_new(doc, JSON_OBJ, json->obj->count);
+        break;
+    default:
+        copy = node_new(doc, json->type);
+        break;
+    }
+    if (!copy)
+        return -1;
+    pos->data = copy;
+    if (!parent)
+        cc->root = copy;
+    else if (parent->type == JSON_ARR)
+        parent->arr->elems[parent->arr->count++] = copy;
+    else
+    {
+        keyvalue *kv = &parent->obj->kvs[parent->obj->count++];
+        kv->key = key;
+        kv->val = copy;
+    }
+    return 0;
+}
+/**
+ * @brief 对象的成员都拷贝完之后建立哈希索引
+ */
+static int compact_leave(void *ctx, const JSON *json, const json_walk_pos *pos)
+{
+    JSON *copy = (JSON *)pos->data;
+
+    (void)ctx;
+    (void)json;
+    if (copy->type == JSON_OBJ)
+        obj_reindex(copy->obj);
+    return 0;
+}
+/**
+ * @brief 把 json 拷贝到一整块连续的内存中
+ * @param json JSON值，延迟加载的子树会被展开
+ * @return 拷贝得到的 JSON 值，对它调用 json_free 时释放整块内存；失败返回 NULL
+ * @details
+ *  节点、成员数组、键名和字符串按深度优先的顺序排列，成员数组的容量等于成员个数，
+ *  适合在配置定型之后做一次，此后的遍历和 json_save 顺序访问内存。
+ *  拷贝得到的值可以继续修改，新分配的内存来自同一个文档
+ */
+JSON *json_compact(const JSON *json)
+{
+    static const json_visitor plan_visitor = {plan_enter, NULL};
+    static const json_visitor copy_visitor = {compact_enter, compact_leave};
+    compact_plan plan = {0, 0, FALSE, {NULL, 0, 0}};
+    compact_copy cc = {NULL, NULL};
+    json_doc *doc;
+    JSON *copy;
+    int ret;
+
+    assert(json);
+    ret = walk_tree(json, &plan_visitor, &plan);
+    heap_free(plan.keys.slots);
+    if (ret < 0 || !(doc = json_doc_new()))
+        return NULL;
+    doc->block_size = plan.chunks * ARENA_CHUNK;
+    doc->block = (char *)doc->alloc.alloc(doc->alloc.user, doc->block_size, ARENA_CHUNK);
+    if (!doc->block)
+    {
+        fprintf(stderr, "json_compact: alloc(%lu) failed\n", (unsigned long)doc->block_size);
+        json_doc_free(doc);
+        return NULL;
+    }
+    cc.doc = doc;
+    if (walk_tree(json, &copy_visitor, &cc) < 0 || !(copy = cc.root))
+    {
+        json_doc_free(doc);
+        return NULL;
+    }
+    copy->flags |= JSON_F_DOCROOT;
+    return copy;
+}
+/**
+ * @brief 解析 JSON 文本，所有节点都分配在文档 doc 中
+ * @return JSON* 解析得到的 JSON 值，失败返回 NULL；失败时已分配的内存留在文档中，随文档释放或重置
+ */
+JSON *json_doc_parse(json_doc *doc, const char *buf, size_t len)
+{
+    assert(doc);
+    return parse_text(doc, buf, len, FALSE);
+}
+/**
+ * @brief 读取并解析名字为fname的文件，所有节点都分配在文档 doc 中
+ */
+JSON *json_doc_load(json_doc *doc, const char *fname)
+{
+    assert(doc);
+    return load_file(doc, fname);
+}
+
+/**
+ * @brief 以 MAP_PRIVATE 方式把名字为fname的文件映射到内存中，映射区可写，但写入不会影响文件
+ * @param advice 传给 madvise 的访问模式
+ * @return doc_map* 映射，由调用者解除映射并释放；失败返回 NULL
+ */
+static doc_map *map_file(const char *fname, int advice)
+{
+    struct stat st;
+    doc_map *map;
+    int fd;
+
+    assert(fname);
+    assert(fname[0]);
+
+    fd = open(fname, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "map_file: open file [%s] failed!\n", fname);
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        fprintf(stderr, "map_file: file [%s] is empty or unreadable!\n", fname);
+        close(fd);
+        return NULL;
+    }
+    map = (doc_map *)heap_alloc(sizeof(doc_map));
+    if (!map)
+    {
+        fprintf(stderr, "map_file: malloc(%lu) failed!\n", (unsigned long)sizeof(doc_map));
+        close(fd);
+        return NULL;
+    }
+    map->len = st.st_size;
+    map->addr = mmap(NULL, map->len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map->addr == MAP_FAILED)
+    {
+        fprintf(stderr, "map_file: mmap [%s] failed!\n", fname);
+        heap_free(map);
+        return NULL;
+    }
+    madvise(map->addr, map->len, advice);
+    return map;
+}
+/**
+ * @brief 把名字为fname的文件映射到内存中就地解析，所有节点都分配在文档 doc 中
+ * @return JSON* 解析得到的 JSON 值，失败返回 NULL
+ * @details
+ *  文件以 MAP_PRIVATE 方式映射，就地写入的 '\0' 和还原的转义序列不会影响文件本身。
+ *  字符串和键名直接指向映射区，不再拷贝；映射随文档的重置或释放一起解除
+ */
+JSON *json_doc_load_mmap(json_doc *doc, const char *fname)
+{
+    doc_map *map;
+    JSON *json;
+
+    assert(doc);
+    map = map_file(fname, MADV_SEQUENTIAL); // 两个阶段都是顺序读取
+    if (!map)
+        return NULL;
+
+    json = parse_text(doc, (const char *)map->addr, map->len, TRUE);
+    if (!json)
+    {
+        // 解析失败时没有可达的节点引用映射区，立即解除映射
+        munmap(map->addr, map->len);
+        heap_free(map);
+        return NULL;
+    }
+    map->next = doc->maps;
+    doc->maps = map;
+    return json;
+}
+/**
+ * @brief 把名字为fname的文件映射到内存中就地解析
+ * @return JSON* 解析得到的 JSON 值，失败返回 NULL
+ * @details
+ *  节点分配在一个内部文档中，字符串直接指向映射区。
+ *  返回的根节点拥有整个文档，对它调用 json_free 时释放全部节点并解除映射；
+ *  对其中的子节点调用 json_free 不做任何事
+ */
+JSON *json_load_mmap(const char *fname)
+{
+    json_doc *doc = json_doc_new();
+    JSON *json;
+
+    if (!doc)
+        return NULL;
+    json = json_doc_load_mmap(doc, fname);
+    if (!json)
+    {
+        json_doc_free(doc);
+        return NULL;
+    }
+    json->flags |= JSON_F_DOCROOT;
+    return json;
+}
+
+//-----------------------------------------------------------------------------
+//  冻结映像
+//-----------------------------------------------------------------------------
+/*
+json_freeze 把一棵树写成二进制映像，json_open_frozen 把映像映射到内存中，节点原样就是 struct value，
+读取接口直接访问，不解析也不分配节点。映像依次是：
+    文件头 | 节点区：节点、容器头部、成员数组和键值对数组（含哈希索引），按深度优先的顺序排列 |
+    字符串池：键名原子及其字符串、长字符串，相同的键名只存一份 | 重定位表：映像中每个指针字段的偏移
+映像中的指针按文件头中的首选地址计算好。打开时先请求把文件映射到首选地址，成功时只读的页面直接来自
+页缓存，各进程共享；地址被占用时映射到别处，按重定位表给每个指针加上偏差，这些页面变为进程私有。
+映射到首选地址时只核对文件头的校验和并检查根节点，开销与映像大小无关；重定位时本来就要访问每个指针，
+顺带按重定位表检查每个指针都指向节点区或字符串池，指针被改坏的映像打开失败。空的对象和数组与堆中的
+一样，成员数组的指针为 NULL，不登记重定位。
+映像只读：修改接口对冻结的值返回失败，需要修改时先用 json_compact 拷贝出来。
+ */
+
+#define FROZEN_MAGIC "JSONFRZ2"
+#define FROZEN_NODES 64                 // 节点区的偏移，根节点总在这里，据此由根节点找到文件头
+#define FROZEN_BASE 0x300000000000ull   // 首选地址的起点，按文件名散列到不同的槽位
+#define FROZEN_SLOT (1ull << 34)        // 每个槽位的大小，超过它的映像可能与相邻的槽位重叠，打开时会重定位
+#define FROZEN_SLOTS 256
+
+/**
+ * @brief 映像的文件头
+ */
+typedef struct frozen_header
+{
+    char magic[8];       // FROZEN_MAGIC
+    U32 value_size;      // sizeof(struct value)，结构变化后旧映像不能再用
+    U32 ptr_size;        // sizeof(void *)
+    uint64_t base;       // 映像中的指针按映像映射到该地址计算
+    uint64_t size;       // 映像的总字节数，等于文件大小
+    uint64_t nodes_size; // 节点区的字节数
+    uint64_t relocs;     // 重定位表的偏移，表中每项是一个指针字段在映像中的偏移
+    uint64_t nreloc;     // 重定位表的项数
+    uint64_t check;      // 以上各字段的校验和（FNV-1a），见 frozen_check
+} frozen_header;
+
+_Static_assert(sizeof(frozen_header) <= FROZEN_NODES, "frozen header overlaps the root node");
+
+/**
+ * @brief 字符串池中已写入的键名原子
+ */
+typedef struct frozen_key
+{
+    const json_key *src; // 原来的原子，NULL 表示空槽
+    U32 hash;            // 键名的哈希值
+    size_t at;           // 写入的原子在映像中的偏移
+} frozen_key;
+
+/**
+ * @brief json_freeze 的写入上下文，节点区按第一遍算出的大小一次分配，字符串池和重定位表按需扩大
+ */
+typedef struct freezer
+{
+    uint64_t base;     // 映像的首选地址
+    char *nodes;       // 节点区
+    size_t node_size;  // 节点区的大小
+    size_t node_used;  // 节点区中已写入的字节数
+    char *pool;        // 字符串池
+    size_t pool_size;  // 字符串池的容量
+    size_t pool_used;  // 字符串池中已写入的字节数
+    uint64_t *relocs;  // 重定位表
+    size_t nreloc;     // 重定位表的项数
+    size_t reloc_size; // 重定位表的容量
+    frozen_key *keys;  // 已写入的键名，采用开放定址（线性探测）
+    size_t nkey;       // 已写入的键名个数
+    size_t key_slots;  // keys 的槽位个数，为 2 的幂
+} freezer;
+
+/**
+ * @brief 计算一个值在节点区中占用的字节数，与 freeze_enter 的写入一一对应，json_walk 的访问者，ctx 为累计的字节数
+ * @return 成功返回 0，延迟节点展开失败返回 -1
+ */
+static int measure_enter(void *ctx, const JSON *json, json_walk_pos *pos)
+{
+    size_t *bytes = (size_t *)ctx;
+    U32 n;
+
+    (void)pos;
+    if (lazy_load(json) < 0)
+        return -1;
+    switch (json->type)
+    {
+    case JSON_ARR:
+        n = json->arr->count;
+        *bytes += sizeof(JSON) + HEADER_BYTES + n * sizeof(value *);
+        // 打包数组的元素写成节点，映像中的数组不打包，读取时不必再生成元素节点
+        if (json->flags & JSON_F_PACKED)
+            *bytes += (size_t)n * sizeof(JSON);
+        break;
+    case JSON_OBJ:
+        n = json->obj->count;
+        *bytes += sizeof(JSON) + HEADER_BYTES + obj_buf_bytes(n);
+        break;
+    default:
+        *bytes += sizeof(JSON);
+        break;
+    }
+    return 0;
+}
+/**
+ * @brief 在节点区中占用 bytes 字节
+ * @return 占用的空间在映像中的偏移
+ */
+static size_t freeze_take(freezer *fz, size_t bytes)
+{
+    size_t at = FROZEN_NODES + fz->node_used;
+    assert(fz->node_used + bytes <= fz->node_size);
+    fz->node_used += bytes;
+    return at;
+}
+/**
+ * @brief 映像中偏移为 at 的位置在写入缓冲区中的地址，字符串池扩大后之前得到的地址失效
+ */
+static void *freeze_addr(freezer *fz, size_t at)
+{
+    if (at < FROZEN_NODES + fz->node_size)
+        return fz->nodes + (at - FROZEN_NODES);
+    return fz->pool + (at - FROZEN_NODES - fz->node_size);
+}
+/**
+ * @brief 把长度为 len 的 data 按 align 对齐追加到字符串池中
+ * @return data 在映像中的偏移，内存不足返回 0
+ */
+static size_t freeze_pool(freezer *fz, const void *data, size_t len, size_t align)
+{
+    size_t start = (fz->pool_used + align - 1) & ~(align - 1);
+    if (start + len > fz->pool_size)
+    {
+        size_t size = fz->pool_size ? fz->pool_size : 4096;
+        while (start + len > size)
+            size *= 2;
+        char *pool = (char *)heap_realloc(fz->pool, fz->pool_size, size);
+        if (!pool)
+        {
+            fprintf(stderr, "json_freeze: realloc(%lu) failed\n", (unsigned long)size);
+            return 0;
+        }
+        fz->pool = pool;
+        fz->pool_size = size;
+    }
+    memset(fz->pool + fz->pool_used, 0, start - fz->pool_used);
+    memcpy(fz->pool + start, data, len);
+    fz->pool_used = start + len;
+    return FROZEN_NODES + fz->node_size + start;
+}
+/**
+ * @brief 让映像中偏移为 field 的指针指向偏移为 target 的位置，并登记到重定位表中
+ * @return 成功返回 0，内存不足返回 -1
+ */
+static int freeze_link(freezer *fz, size_t field, size_t target)
+{
+    uint64_t ptr = fz->base + target;
+
+    if (fz->nreloc == fz->reloc_size)
+    {
+        size_t size = fz->reloc_size ? fz->reloc_size * 2 : 1024;
+        uint64_t *relocs = (uint64_t *)heap_realloc(fz->relocs, fz->reloc_size * sizeof(uint64_t), size * sizeof(uint64_t));
+        if (!relocs)
+        {
+            fprintf(stderr, "json_freeze: realloc(%lu) failed\n", (unsigned long)(size * sizeof(uint64_t)));
+            return -1;
+        }
+        fz->relocs = relocs;
+        fz->reloc_size = size;
+    }
+    fz->relocs[fz->nreloc++] = field;
+    memcpy(freeze_addr(fz, field), &ptr, sizeof(ptr));
+    return 0;
+}
+/**
+ * @brief 把键名原子写入字符串池，相同的键名只写一次
+ * @return 原子在映像中的偏移，内存不足返回 0
+ */
+static size_t freeze_key(freezer *fz, const json_key *key)
+{
+    U32 hash = key->hash ? key->hash : key_hash_n(key->str, key->len);
+
+    if (2 * (fz->nkey + 1) > fz->key_slots)
+    {
+        size_t size = fz->key_slots ? fz->key_slots * 2 : 256;
+        frozen_key *keys = (frozen_key *)heap_calloc(size * sizeof(frozen_key));
+        if (!keys)
+        {
+            fprintf(stderr, "json_freeze: calloc(%lu) failed\n", (unsigned long)(size * sizeof(frozen_key)));
+            return 0;
+        }
+        for (size_t i = 0; i < fz->key_slots; i++)
+        {
+            if (!fz->keys[i].src)
+                continue;
+            size_t j = fz->keys[i].hash & (size - 1);
+            while (keys[j].src)
+                j = (j + 1) & (size - 1);
+            keys[j] = fz->keys[i];
+        }
+        heap_free(fz->keys);
+        fz->keys = keys;
+        fz->key_slots = size;
+    }
+    size_t i = hash & (fz->key_slots - 1);
+    for (; fz->keys[i].src; i = (i + 1) & (fz->key_slots - 1))
+    {
+        const json_key *src = fz->keys[i].src;
+        if (fz->keys[i].hash == hash && src->len == key->len && memcmp(src->str, key->str, key->len) == 0)
+            return fz->keys[i].at;
+    }
+
+    json_key atom = {JSON_KEY_STATIC, hash, key->len, NULL};
+    size_t at = freeze_pool(fz, &atom, sizeof(atom), sizeof(void *));
+    size_t str = at ? freeze_pool(fz, key->str, key->len + 1, 1) : 0;
+    if (!str || freeze_link(fz, at + offsetof(json_key, str), str) < 0)
+        return 0;
+    fz->keys[i].src = key;
+    fz->keys[i].hash = hash;
+    fz->keys[i].at = at;
+    fz->nkey++;
+    return at;
+}
+/**
+ * @brief 把一个值写入节点区，长字符串和键名写入字符串池，json_walk 的访问者，ctx 为 freezer
+ * @details
+ *  数组和对象在节点区中的偏移记在 pos->data 中，成员数组紧跟在节点和容器头部后面，
+ *  子成员写入后链接到父节点的成员数组中
+ * @return 成功返回 0，失败返回 -1
+ */
+static int freeze_enter(void *ctx, const JSON *json, json_walk_pos *pos)
+{
+    freezer *fz = (freezer *)ctx;
+    BOOL wide = json->type == JSON_ARR || json->type == JSON_OBJ;
+    size_t atom = 0;
+    U32 n;
+
+    if (pos->key && !(atom = freeze_key(fz, pos->key)))
+        return -1;
+    if (lazy_load(json) < 0)
+        return -1;
+
+    size_t off = freeze_take(fz, sizeof(JSON) + (wide ? HEADER_BYTES : 0));
+    JSON *node = (JSON *)freeze_addr(fz, off);
+    node->type = json->type;
+    node->flags = JSON_F_FROZEN | (wide ? JSON_F_WIDE : 0);
+    switch (json->type)
+    {
+    case JSON_NUM:
+        node->num = json->num;
+        break;
+    case JSON_INT:
+        node->i64 = json->i64;
+        break;
+    case JSON_BOL:
+        node->bol = json->bol;
+        break;
+    case JSON_STR:
+    {
+        const char *str = json_str(json, "");
+        size_t len = strlen(str);
+        if (len <= JSON_SSO_MAX)
+        {
+            memcpy(node->sso, str, len + 1);
+            node->slen = (unsigned char)len;
+            node->flags |= JSON_F_INLINE;
+            break;
+        }
+        size_t at = freeze_pool(fz, str, len + 1, 1);
+        if (!at || freeze_link(fz, off + offsetof(JSON, str), at) < 0)
+            return -1;
+        break;
+    }
+    case JSON_ARR:
+    {
+        n = json->arr->count;
+        size_t elems = freeze_take(fz, n * sizeof(value *));
+        array *arr = (array *)(node + 1);
+        arr->count = arr->size = n;
+        // 空数组的 elems 留作 NULL，否则它指向下一个节点，数组在节点区末尾时指到节点区以外
+        if (freeze_link(fz, off + offsetof(JSON, arr), off + sizeof(JSON)) < 0 ||
+            (n && freeze_link(fz, off + sizeof(JSON) + offsetof(array, elems), elems) < 0))
+            return -1;
+        for (U32 i = 0; (json->flags & JSON_F_PACKED) && i < n; i++)
+        {
+            size_t child = freeze_take(fz, sizeof(JSON));
+            JSON *elem = (JSON *)freeze_addr(fz, child);
+            elem->type = json->etype;
+            elem->flags = JSON_F_FROZEN;
+            if (json->etype == JSON_NUM)
+                elem->num = packed_nums(json)[i];
+            else if (json->etype == JSON_INT)
+                elem->i64 = packed_ints(json)[i];
+            else
+                elem->bol = packed_bools(json)[i];
+            if (freeze_link(fz, elems + i * sizeof(value *), child) < 0)
+                return -1;
+        }
+        break;
+    }
+    case JSON_OBJ:
+    {
+        n = json->obj->count;
+        size_t kvs = freeze_take(fz, obj_buf_bytes(n));
+        object *obj = (object *)(node + 1);
+        obj->count = obj->size = n;
+        if (freeze_link(fz, off + offsetof(JSON, obj), off + sizeof(JSON)) < 0 ||
+            (n && freeze_link(fz, off + sizeof(JSON) + offsetof(object, kvs), kvs) < 0))
+            return -1;
+        break;
+    }
+    default:
+        break;
+    }
+    pos->data = (void *)(uintptr_t)off;
+    if (!pos->parent)
+        return 0;
+
+    // 父节点的成员数组紧跟在它的节点和容器头部之后
+    size_t buf = (uintptr_t)pos->up->data + sizeof(JSON) + HEADER_BYTES;
+    if (pos->parent->type == JSON_ARR)
+        return freeze_link(fz, buf + pos->index * sizeof(value *), off);
+    size_t kv = buf + pos->index * sizeof(keyvalue);
+    if (freeze_link(fz, kv + offsetof(keyvalue, key), atom) < 0 || freeze_link(fz, kv + offsetof(keyvalue, val), off) < 0)
+        return -1;
+    // 映像中的指针还不能解引用，索引按原来的键名建立
+    n = pos->parent->obj->count;
+    if (n >= OBJ_INDEX_MIN)
+        index_insert((obj_slot *)freeze_addr(fz, buf + n * sizeof(keyvalue)), index_slots(n),
+                     ((json_key *)freeze_addr(fz, atom))->hash, pos->index);
+    return 0;
+}
+/**
+ * @brief 计算文件头中 check 以前各字段的校验和
+ */
+static uint64_t frozen_check(const frozen_header *hdr)
+{
+    return key_hash_n((const char *)hdr, offsetof(frozen_header, check));
+}
+/**
+ * @brief 把 json 写成冻结映像，保存在文件 fname 中
+ * @param json JSON值，延迟加载的子树会被展开
+ * @param fname 映像文件名
+ * @return 成功返回 0，失败返回 -1
+ * @details 映像中含有指针，只能在字长、字节序和 struct value 的布局都相同的机器上打开
+ */
+int json_freeze(const JSON *json, const char *fname)
+{
+    static const json_visitor measure_visitor = {measure_enter, NULL};
+    static const json_visitor freeze_visitor = {freeze_enter, NULL};
+    freezer fz;
+    frozen_header hdr;
+    FILE *fp;
+    int ret = -1;
+
+    assert(json);
+    assert(fname);
+    assert(fname[0]);
+    memset(&fz, 0, sizeof(fz));
+    if (walk_tree(json, &measure_visitor, &fz.node_size) < 0)
+        return -1;
+    fz.base = FROZEN_BASE + (key_hash(fname) % FROZEN_SLOTS) * FROZEN_SLOT;
+    fz.nodes = (char *)heap_calloc(fz.node_size);
+    if (!fz.nodes)
+    {
+        fprintf(stderr, "json_freeze: calloc(%lu) failed\n", (unsigned long)fz.node_size);
+        return -1;
+    }
+    if (walk_tree(json, &freeze_visitor, &fz) < 0)
+        goto out;
+    // 根节点最先写入，位于节点区的开头
+    assert(fz.node_used == fz.node_size);
+    ((JSON *)fz.nodes)->flags |= JSON_F_DOCROOT;
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, FROZEN_MAGIC, sizeof(hdr.magic));
+    hdr.value_size = sizeof(JSON);
+    hdr.ptr_size = sizeof(void *);
+    hdr.base = fz.base;
+    hdr.nodes_size = fz.node_size;
+    hdr.relocs = (FROZEN_NODES + fz.node_size + fz.pool_used + 7) & ~(uint64_t)7;
+    hdr.nreloc = fz.nreloc;
+    hdr.size = hdr.relocs + fz.nreloc * sizeof(uint64_t);
+    hdr.check = frozen_check(&hdr);
+
+    static const char zeros[FROZEN_NODES];
+    fp = fopen(fname, "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "json_freeze: open file [%s] failed!\n", fname);
+        goto out;
+    }
+    size_t pad = hdr.relocs - (FROZEN_NODES + fz.node_size + fz.pool_used);
+    if (fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+        (sizeof(hdr) == FROZEN_NODES || fwrite(zeros, FROZEN_NODES - sizeof(hdr), 1, fp) == 1) &&
+        fwrite(fz.nodes, 1, fz.node_size, fp) == fz.node_size &&
+        (!fz.pool_used || fwrite(fz.pool, 1, fz.pool_used, fp) == fz.pool_used) &&
+        (!pad || fwrite(zeros, 1, pad, fp) == pad) &&
+        (!fz.nreloc || fwrite(fz.relocs, sizeof(uint64_t), fz.nreloc, fp) == fz.nreloc))
+        ret = 0;
+    if (fclose(fp) != 0)
+        ret = -1;
+    if (ret < 0)
+        fprintf(stderr, "json_freeze: write file [%s] failed!\n", fname);
+out:
+    heap_free(fz.nodes);
+    heap_free(fz.pool);
+    heap_free(fz.relocs);
+    heap_free(fz.keys);
+    return ret;
+}
+/**
+ * @brief 检查映像的文件头
+ * @param size 文件大小
+ */
+static BOOL frozen_valid(const frozen_header *hdr, size_t size)
+{
+    return memcmp(hdr->magic, FROZEN_MAGIC, sizeof(hdr->magic)) == 0 && hdr->value_size == sizeof(JSON) &&
+           hdr->ptr_size == sizeof(void *) && hdr->size == size && hdr->base % sysconf(_SC_PAGESIZE) == 0 &&
+           hdr->nodes_size >= sizeof(JSON) && hdr->nodes_size <= size - FROZEN_NODES &&
+           hdr->relocs >= FROZEN_NODES + hdr->nodes_size && hdr->relocs <= size &&
+           hdr->nreloc == (size - hdr->relocs) / sizeof(uint64_t) && hdr->check == frozen_check(hdr);
+}
+/**
+ * @brief 映射在首选地址时检查根节点：容器的头部紧跟在根节点之后，成员数组和字符串在映像之内
+ * @details 只检查根节点这一层，其余的指针按 json_freeze 写出的内容使用
+ */
+static BOOL frozen_root_valid(const char *addr, const frozen_header *hdr)
+{
+    const JSON *root = (const JSON *)(addr + FROZEN_NODES);
+    const char *head = addr + FROZEN_NODES + sizeof(JSON);
+    const char *buf;
+    size_t bytes;
+
+    switch (root->type)
+    {
+    case JSON_STR:
+        return (root->flags & JSON_F_INLINE) ||
+               (root->str >= head && root->str < addr + hdr->relocs && memchr(root->str, 0, addr + hdr->relocs - root->str));
+    case JSON_ARR:
+        if (hdr->nodes_size < sizeof(JSON) + HEADER_BYTES || (const char *)root->arr != head)
+            return FALSE;
+        buf = (const char *)root->arr->elems;
+        bytes = root->arr->count * sizeof(value *);
+        break;
+    case JSON_OBJ:
+        if (hdr->nodes_size < sizeof(JSON) + HEADER_BYTES || (const char *)root->obj != head)
+            return FALSE;
+        buf = (const char *)root->obj->kvs;
+        bytes = obj_buf_bytes(root->obj->count);
+        break;
+    default:
+        return root->type <= JSON_INT;
+    }
+    if (!bytes)
+        return buf == NULL;
+    return buf >= head + HEADER_BYTES && buf <= addr + FROZEN_NODES + hdr->nodes_size &&
+           bytes <= (size_t)(addr + FROZEN_NODES + hdr->nodes_size - buf);
+}
+/**
+ * @brief 按重定位表检查映像中的每个指针，delta 不为 0 时给每个指针加上 delta
+ * @param addr 映像映射到的地址，delta 不为 0 时须可写
+ * @return 成功返回 0；表项不在节点区和字符串池中，或者指针指向节点区和字符串池以外时返回 -1
+ */
+static int frozen_relocate(char *addr, const frozen_header *hdr, uint64_t delta)
+{
+    const uint64_t *relocs = (const uint64_t *)(addr + hdr->relocs);
+
+    for (uint64_t i = 0; i < hdr->nreloc; i++)
+    {
+        uint64_t ptr;
+        if (relocs[i] % sizeof(uint64_t) || relocs[i] < FROZEN_NODES || relocs[i] > hdr->relocs - sizeof(uint64_t))
+            return -1;
+        memcpy(&ptr, addr + relocs[i], sizeof(ptr));
+        if (ptr - hdr->base < FROZEN_NODES || ptr - hdr->base >= hdr->relocs)
+            return -1;
+        if (delta)
+        {
+            ptr += delta;
+            memcpy(addr + relocs[i], &ptr, sizeof(ptr));
+        }
+    }
+    return 0;
+}
+/**
+ * @brief 打开 json_freeze 写的映像，映射到内存中直接访问
+ * @return JSON* 映像的根节点，失败返回 NULL
+ * @details
+ *  不解析、不为节点分配内存。映像映射到首选地址时页面只读共享，否则重定位后变为进程私有，此时在标准错误中提示。
+ *  在首选地址上只核对文件头的校验和与根节点，映像的内容须是 json_freeze 写出的；重定位时按重定位表检查每个指针
+ *  都指向映像之内，指针被改坏的映像打开失败。
+ *  映像中的值只能读取；对根节点调用 json_free 时解除映射，对其中的子节点调用 json_free 不做任何事
+ */
+JSON *json_open_frozen(const char *fname)
+{
+    frozen_header hdr;
+    struct stat st;
+    char *addr;
+    int fd;
+
+    assert(fname);
+    assert(fname[0]);
+    fd = open(fname, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "json_open_frozen: open file [%s] failed!\n", fname);
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size < FROZEN_NODES || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) ||
+        !frozen_valid(&hdr, st.st_size))
+    {
+        fprintf(stderr, "json_open_frozen: file [%s] is not a frozen image!\n", fname);
+        close(fd);
+        return NULL;
+    }
+    addr = (char *)mmap((void *)(uintptr_t)hdr.base, hdr.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED && (uintptr_t)addr != hdr.base)
+    {
+        // 首选地址被占用（映像超过一个槽位，或者另一个映像散列到同一个槽位），映射到别处后重定位
+        fprintf(stderr, "json_open_frozen: base %#llx of [%s] is taken, relocating into private pages\n",
+                (unsigned long long)hdr.base, fname);
+        munmap(addr, hdr.size);
+        addr = (char *)mmap(NULL, hdr.size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (addr == MAP_FAILED)
+    {
+        fprintf(stderr, "json_open_frozen: mmap [%s] failed!\n", fname);
+        return NULL;
+    }
+    if ((uintptr_t)addr == hdr.base)
+    {
+        if (!frozen_root_valid(addr, &hdr))
+        {
+            fprintf(stderr, "json_open_frozen: file [%s] has a bad root!\n", fname);
+            munmap(addr, hdr.size);
+            return NULL;
+        }
+        return (JSON *)(addr + FROZEN_NODES);
+    }
+    if (frozen_relocate(addr, &hdr, (uintptr_t)addr - hdr.base) < 0)
+    {
+        fprintf(stderr, "json_open_frozen: file [%s] has a bad relocation!\n", fname);
+        munmap(addr, hdr.size);
+        return NULL;
+    }
+    mprotect(addr, hdr.size, PROT_READ);
+    return (JSON *)(addr + FROZEN_NODES);
+}
+/**
+ * @brief 解除根节点 json 所在映像的映射
+ */
+static void frozen_close(JSON *json)
+{
+    frozen_header *hdr = (frozen_header *)((char *)json - FROZEN_NODES);
+    munmap(hdr, hdr->size);
+}
+
+//-----------------------------------------------------------------------------
+//  延迟解析
+//-----------------------------------------------------------------------------
+/*
+加载时只做第一阶段，保留整个文本的结构索引，并为每个 '{' 和 '[' 记下与之配对的结束符的下标。
+对象和数组先生成延迟节点（JSON_F_LAZY），第一次访问成员时才解析这一层：
+标量直接解析，子对象和子数组仍然生成延迟节点，按配对的下标整个跳过。
+没有访问过的子树既不分配节点，也不读取其中的文本。
+字符串拷贝到文档中，文本本身保持不变，所以展开失败后可以重试；
+加载时只检查括号是否配对，子树中其余的语法错误在展开时才报告，展开失败的对象和数组按不存在处理
+ */
+
+/**
+ * @brief 对整个文本做第一阶段扫描，并为括号配对
+ * @return lazy_src* 文本的结构索引，失败返回 NULL，错误原因输出到 stderr
+ */
+static lazy_src *lazy_index(const char *buf, size_t len)
+{
+    parser p = {0};
+    U32 stack[JSON_MAX_DEPTH]; // 尚未闭合的括号的下标
+    U32 depth = 0;
+    lazy_src *src;
+
+    if (len >= 0xFFFFFFFFu)
+    {
+        fprintf(stderr, "json_load_lazy: input too large (%lu bytes)\n", (unsigned long)len);
+        return NULL;
+    }
+    src = (lazy_src *)heap_calloc(sizeof(lazy_src));
+    if (!src)
+    {
+        fprintf(stderr, "json_load_lazy: calloc(%lu) failed!\n", (unsigned long)sizeof(lazy_src));
+        return NULL;
+    }
+    p.buf = buf;
+    p.len = len;
+    if (scan_init(&p.idx) < 0 || scan_structurals(buf, len, &p.idx, len) < 0)
+    {
+        heap_free(src);
+        return NULL;
+    }
+    src->buf = buf;
+    src->len = len;
+    src->pos = p.idx.pos;
+    src->count = p.idx.count;
+    src->close = (U32 *)heap_alloc((src->count + 1) * sizeof(U32));
+    if (!src->close)
+    {
+        fprintf(stderr, "json_load_lazy: malloc(%lu) failed!\n", (unsigned long)((src->count + 1) * sizeof(U32)));
+        goto failed_;
+    }
+
+    for (U32 i = 0; i < src->count; i++)
+    {
+        U32 at = src->pos[i];
+        // 根值结束之后只允许有空白
+        if (i > 0 && depth == 0)
+        {
+            parse_error(&p, at, "unexpected trailing characters");
+            goto failed_;
+        }
+        if (buf[at] == '{' || buf[at] == '[')
+        {
+            if (depth >= JSON_MAX_DEPTH)
+            {
+                parse_error(&p, at, "nesting too deep");
+                goto failed_;
+            }
+            stack[depth++] = i;
+        }
+        else if (buf[at] == '}' || buf[at] == ']')
+        {
+            if (depth == 0 || buf[src->pos[stack[depth - 1]]] != (buf[at] == '}' ? '{' : '['))
+            {
+                parse_error(&p, at, "unmatched bracket");
+                goto failed_;
+            }
+            src->close[stack[--depth]] = i;
+        }
+    }
+    if (src->count == 0 || depth > 0)
+    {
+        parse_error(&p, len, "unexpected end of input");
+        goto failed_;
+    }
+    return src;
+
+failed_:
+    lazy_src_free(src);
+    return NULL;
+}
+/**
+ * @brief 初始化在 src 上解析的上下文，从第 cur 个结构字符开始
+ */
+static void lazy_parser(parser *p, json_doc *doc, lazy_src *src, U32 cur)
+{
+    memset(p, 0, sizeof(*p));
+    p->doc = doc;
+    p->buf = src->buf;
+    p->len = src->len;
+    p->idx.pos = src->pos;
+    p->idx.count = src->count;
+    p->idx.scanned = src->len; // 索引已经完整，不会再扫描
+    p->cur = cur;
+    p->lazy = src;
+    p->keys = &doc->keys;
+}
+/**
+ * @brief 为 at 处的对象或数组生成延迟节点，并跳过整个子树
+ * @details at 对应的结构字符刚刚被取走，它的下标是 p->cur - 1
+ */
+static JSON *lazy_new(parser *p, U32 at)
+{
+    U32 i = p->cur - 1;
+    // 延迟位置借用容器头部的空间，展开时再换成真正的头部
+    JSON *json = node_new(p->doc, p->buf[at] == '{' ? JSON_OBJ : JSON_ARR);
+    if (!json)
+        return NULL;
+    json->flags |= JSON_F_LAZY;
+    json->lazy->src = p->lazy;
+    json->lazy->at = i;
+    p->cur = p->lazy->close[i] + 1;
+    return json;
+}
+/**
+ * @brief 展开延迟节点：解析它的直接成员，子对象和子数组仍然是延迟节点
+ * @return 成功返回 0，失败返回 -1，节点保持未展开
+ */
+static int lazy_expand(JSON *json)
+{
+    lazy_src *src = json->lazy->src;
+    U32 i = json->lazy->at;
+    U32 at = src->pos[i];
+    parser p;
+    JSON *full;
+
+    lazy_parser(&p, node_doc(json), src, i + 1);
+    full = json->type == JSON_OBJ ? parse_object(&p, at, 0) : parse_array(&p, at, 0);
+    heap_free(p.stack);
+    if (!full)
+        return -1;
+    assert(p.cur == src->close[i] + 1);
+    // 把展开的结果搬到延迟节点的头部中，full 本身随文档释放
+    json->flags &= ~JSON_F_LAZY;
+    if (json->type == JSON_OBJ)
+    {
+        *json->obj = *full->obj;
+    }
+    else
+    {
+        *json->arr = *full->arr;
+        json->flags |= full->flags & JSON_F_PACKED;
+        json->etype = full->etype;
+    }
+    return 0;
+}
+/**
+ * @brief 延迟加载名字为fname的文件，所有节点都分配在文档 doc 中
+ * @return JSON* 根值，失败返回 NULL
+ * @details
+ *  文件被映射到内存中，加载时只建立结构索引，根值是对象或数组时返回一个延迟节点。
+ *  通过 json_get_member、json_get_element 等接口访问成员时才逐层展开，
+ *  各种 getter 和修改接口的用法都不变；映射和索引随文档的重置或释放一起释放
+ */
+JSON *json_doc_load_lazy(json_doc *doc, const char *fname)
+{
+    doc_map *map;
+    lazy_src *src;
+    parser p;
+    JSON *json;
+
+    assert(doc);
+    map = map_file(fname, MADV_NORMAL);
+    if (!map)
+        return NULL;
+    src = lazy_index((const char *)map->addr, map->len);
+    if (!src)
+    {
+        munmap(map->addr, map->len);
+        heap_free(map);
+        return NULL;
+    }
+    lazy_parser(&p, doc, src, 1);
+    json = parse_value(&p, src->pos[0], 0);
+    heap_free(p.stack);
+    if (!json)
+    {
+        lazy_src_free(src);
+        munmap(map->addr, map->len);
+        heap_free(map);
+        return NULL;
+    }
+    map->next = doc->maps;
+    doc->maps = map;
+    src->next = doc->lazies;
+    doc->lazies = src;
+    return json;
+}
+/**
+ * @brief 延迟加载名字为fname的文件
+ * @return JSON* 根值，失败返回 NULL
+ * @details 节点分配在一个内部文档中，对返回的根节点调用 json_free 时释放整个文档
+ */
+JSON *json_load_lazy(const char *fname)
+{
+    json_doc *doc = json_doc_new();
+    JSON *json;
+
+    if (!doc)
+        return NULL;
+    json = json_doc_load_lazy(doc, fname);
+    if (!json)
+    {
+        json_doc_free(doc);
+        return NULL;
+    }
+    json->flags |= JSON_F_DOCROOT;
+    return json;
+}
+
+//-----------------------------------------------------------------------------
+//  按行并行解析
+//-----------------------------------------------------------------------------
+/*
+JSON Lines 文件每行一个 JSON 值。文件映射到内存后，在换行处切成约 LINES_CHUNK 大小的任务，
+工作线程逐个领取任务，把其中的每一行解析到线程自己的文档中，文档在任务交付后重置，
+稳定后不再调用 malloc；结构索引也在各行之间复用。
+交付时持有 deliver_lock，回调总是串行执行；要求按序交付时，任务还要等前一个任务交付完毕。
+ */
+
+#define LINES_CHUNK (1024 * 1024) // 每个任务的大致大小，在此之后的第一个换行处切分
+
+/**
+ * @brief 各工作线程共享的加载状态
+ */
+typedef struct lines_ctx
+{
+    const char *buf;              // 映射的文件内容
+    size_t len;                   // 文件长度
+    json_line_cb cb;              // 回调
+    void *user;                   // 回调的 ctx 参数
+    BOOL ordered;                 // 是否按文件中的顺序交付
+    pthread_mutex_t fetch_lock;   // 保护 next 和 next_seq
+    size_t next;                  // 下一个任务的起始偏移
+    U32 next_seq;                 // 下一个任务的序号
+    pthread_mutex_t deliver_lock; // 保护 deliver_seq，并串行化回调
+    pthread_cond_t turn;          // deliver_seq 变化时广播
+    U32 deliver_seq;              // 按序交付时，下一个应交付的任务序号
+    int failed;                   // 出错或回调要求停止后置 1，所有线程尽快退出
+} lines_ctx;
+
+/**
+ * @brief 一个任务中解析出的记录
+ */
+typedef struct lines_batch
+{
+    JSON **recs;  // 记录
+    size_t *offs; // 记录在文件中的偏移
+    size_t count; // 记录个数
+    size_t size;  // 数组容量
+} lines_batch;
+
+/**
+ * @brief 把一条记录追加到 b 中
+ * @return 成功返回 0，内存不足返回 -1
+ */
+static int batch_push(lines_batch *b, JSON *rec, size_t off)
+{
+    if (b->count == b->size)
+    {
+        size_t size = b->size ? b->size * 2 : 1024;
+        JSON **recs = (JSON **)heap_realloc(b->recs, b->size * sizeof(JSON *), size * sizeof(JSON *));
+        if (recs)
+            b->recs = recs;
+        size_t *offs = (size_t *)heap_realloc(b->offs, b->size * sizeof(size_t), size * sizeof(size_t));
+        if (offs)
+            b->offs = offs;
+        if (!recs || !offs)
+        {
+            fprintf(stderr, "json_load_lines: expand batch failed!\n");
+            return -1;
+        }
+        b->size = size;
+    }
+    b->recs[b->count] = rec;
+    b->offs[b->count] = off;
+    b->count++;
+    return 0;
+}
+/**
+ * @brief 领取下一个任务
+ * @return 成功返回 0，没有任务或已出错返回 -1
+ */
+static int lines_fetch(lines_ctx *lc, size_t *start, size_t *end, U32 *seq)
+{
+    int ret = -1;
+    pthread_mutex_lock(&lc->fetch_lock);
+    if (!__atomic_load_n(&lc->failed, __ATOMIC_RELAXED) && lc->next < lc->len)
+    {
+        *start = lc->next;
+        *end = lc->len;
+        if (lc->len - lc->next > LINES_CHUNK)
+        {
+            const char *nl = (const char *)memchr(lc->buf + lc->next + LINES_CHUNK, '\n',
+                                                  lc->len - lc->next - LINES_CHUNK);
+            if (nl)
+                *end = nl - lc->buf + 1;
+        }
+        lc->next = *end;
+        *seq = lc->next_seq++;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&lc->fetch_lock);
+    return ret;
+}
+/**
+ * @brief 解析 [start, end) 中的每一行，空行跳过
+ * @return 成功返回 0，有非法记录或内存不足返回 -1
+ */
+static int lines_parse(lines_ctx *lc, parser *p, lines_batch *b, size_t start, size_t end)
+{
+    while (start < end)
+    {
+        const char *line = lc->buf + start;
+        const char *nl = (const char *)memchr(line, '\n', end - start);
+        size_t n = nl ? (size_t)(nl - line) : end - start;
+        size_t i = 0;
+
+        while (i < n && (char_class[(unsigned char)line[i]] & CC_SPACE))
+            i++;
+        if (i < n)
+        {
+            JSON *rec = n < 0xFFFFFFFFu ? parse_again(p, line, n) : NULL;
+            if (!rec)
+            {
+                fprintf(stderr, "json_load_lines: invalid record at offset %lu\n", (unsigned long)start);
+                return -1;
+            }
+            if (batch_push(b, rec, start) < 0)
+                return -1;
+        }
+        start += n + 1;
+    }
+    return 0;
+}
+/**
+ * @brief 交付一个任务的记录，按序交付时等待轮到自己
+ * @param ok 任务是否解析成功，失败时只推进交付序号
+ */
+static void lines_deliver(lines_ctx *lc, const lines_batch *b, U32 seq, BOOL ok)
+{
+    pthread_mutex_lock(&lc->deliver_lock);
+    if (lc->ordered)
+    {
+        while (lc->deliver_seq != seq && !__atomic_load_n(&lc->failed, __ATOMIC_RELAXED))
+            pthread_cond_wait(&lc->turn, &lc->deliver_lock);
+    }
+    if (!ok)
+        __atomic_store_n(&lc->failed, 1, __ATOMIC_RELAXED);
+    for (size_t i = 0; i < b->count && !__atomic_load_n(&lc->failed, __ATOMIC_RELAXED); i++)
+    {
+        if (lc->cb(lc->user, b->recs[i], b->offs[i]) != 0)
+            __atomic_store_n(&lc->failed, 1, __ATOMIC_RELAXED);
+    }
+    lc->deliver_seq++;
+    pthread_cond_broadcast(&lc->turn);
+    pthread_mutex_unlock(&lc->deliver_lock);
+}
+/**
+ * @brief 工作线程：反复领取任务、解析、交付
+ */
+static void *lines_worker(void *arg)
+{
+    lines_ctx *lc = (lines_ctx *)arg;
+    lines_batch b = {0};
+    parser p = {0};
+    size_t start, end;
+    U32 seq;
+
+    p.doc = json_doc_new();
+    if (!p.doc)
+    {
+        __atomic_store_n(&lc->failed, 1, __ATOMIC_RELAXED);
+        return NULL;
+    }
+    p.keys = &p.doc->keys;
+    while (lines_fetch(lc, &start, &end, &seq) == 0)
+    {
+        json_doc_reset(p.doc);
+        b.count = 0;
+        int ret = lines_parse(lc, &p, &b, start, end);
+        lines_deliver(lc, &b, seq, ret == 0);
+    }
+    // 出错后还在等待交付的线程需要被唤醒
+    pthread_mutex_lock(&lc->deliver_lock);
+    pthread_cond_broadcast(&lc->turn);
+    pthread_mutex_unlock(&lc->deliver_lock);
+
+    heap_free(p.idx.pos);
+    heap_free(p.stack);
+    json_doc_free(p.doc);
+    heap_free(b.recs);
+    heap_free(b.offs);
+    return NULL;
+}
+/**
+ * @brief 用 nthreads 个线程并行加载 JSON Lines 文件，每解析出一条记录调用一次 cb
+ * @param fname 文件名，每行一个 JSON 值，空行被跳过
+ * @param nthreads 线程数（含调用线程），不大于 0 时使用全部 CPU
+ * @param cb 回调，参数为 ctx、记录和记录在文件中的偏移；返回非 0 时停止加载
+ * @param ctx 传给回调的参数
+ * @param ordered 为 TRUE 时按文件中的顺序交付记录，否则按解析完成的顺序交付
+ * @return int 全部记录交付成功返回 0，文件无法读取、记录非法或回调要求停止返回 -1
+ * @details
+ *  回调不会被并发调用；记录分配在工作线程的文档中，回调返回后即失效，不能保存，也不能 json_free
+ */
+int json_load_lines(const char *fname, int nthreads, json_line_cb cb, void *ctx, BOOL ordered)
+{
+    lines_ctx lc = {0};
+    pthread_t *tids;
+    doc_map *map;
+    int started = 0;
+
+    assert(cb);
+    if (nthreads <= 0)
+        nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads <= 0)
+        nthreads = 1;
+    tids = (pthread_t *)heap_alloc(nthreads * sizeof(pthread_t));
+    if (!tids)
+    {
+        fprintf(stderr, "json_load_lines: malloc(%lu) failed!\n", (unsigned long)(nthreads * sizeof(pthread_t)));
+        return -1;
+    }
+    map = map_file(fname, MADV_SEQUENTIAL);
+    if (!map)
+    {
+        heap_free(tids);
+        return -1;
+    }
+
+    lc.buf = (const char *)map->addr;
+    lc.len = map->len;
+    lc.cb = cb;
+    lc.user = ctx;
+    lc.ordered = ordered;
+    pthread_mutex_init(&lc.fetch_lock, NULL);
+    pthread_mutex_init(&lc.deliver_lock, NULL);
+    pthread_cond_init(&lc.turn, NULL);
+
+    // 调用线程也作为一个工作线程，创建线程失败时用已有的线程继续
+    for (int i = 1; i < nthreads; i++)
+    {
+        if (pthread_create(&tids[started], NULL, lines_worker, &lc) != 0)
+            break;
+        started++;
+    }
+    lines_worker(&lc);
+    for (int i = 0; i < started; i++)
+        pthread_join(tids[i], NULL);
+
+    pthread_cond_destroy(&lc.turn);
+    pthread_mutex_destroy(&lc.deliver_lock);
+    pthread_mutex_destroy(&lc.fetch_lock);
+    munmap(map->addr, map->len);
+    heap_free(map);
+    heap_free(tids);
+    return lc.failed ? -1 : 0;
+}
+
+//-----------------------------------------------------------------------------
+//  流式解析
+//-----------------------------------------------------------------------------
+/*
+输入分块到达，每块按字节推进一个状态机：
+  - expect 记录下一个期待的语法成分，容器嵌套用位栈记录（1 表示对象，0 表示数组）
+  - 字符串、数值和字面量可能跨块，未结束的部分暂存在 tok 中
+内存占用只与嵌套深度和最长的单个标量有关，与文本总长度无关
+ */
+
+/**
+ * @brief 流式解析器期待的下一个语法成分
+ */
+typedef enum push_expect
+{
+    EXPECT_VALUE,      // 任意值
+    EXPECT_FIRST_ELEM, // '[' 之后：值或 ']'
+    EXPECT_FIRST_KEY,  // '{' 之后：键名或 '}'
+    EXPECT_KEY,        // 对象中的 ',' 之后：键名
+    EXPECT_COLON,      // 键名之后：':'
+    EXPECT_NEXT,       // 容器中的值之后：',' 或结束括号
+    EXPECT_EOF,        // 根值之后：只允许空白
+} push_expect;
+
+/**
+ * @brief 正在读取的标量
+ */
+typedef enum push_token
+{
+    TOKEN_NONE,
+    TOKEN_STRING, // 字符串值
+    TOKEN_KEY,    // 键名
+    TOKEN_BARE,   // 数值或 true / false / null，读到空白或运算符为止
+} push_token;
+
+struct json_parser
+{
+    json_handler handler; // 回调
+    void *ctx;            // 传给回调的参数
+
+    push_expect expect;
+    push_token token;
+    int depth;                                  // 当前嵌套深度
+    unsigned char nest[JSON_MAX_DEPTH / 8 + 1]; // 每层容器的类型，1 表示对象
+    char *tok;                                  // 跨块标量的缓冲区
+    size_t tok_len;
+    size_t tok_cap;
+    BOOL escaped;    // 当前字符串中是否有转义序列
+    BOOL bslash;     // 上一块以字符串中的 '\\' 结尾
+    size_t offset;   // 已处理的字节数，用于报告出错位置
+    int error;       // 出错后置为 -1，之后的输入全部拒绝
+
+    // 以下用于构建 JSON 树
+    json_doc *doc;                 // 节点分配在该文档中，为 NULL 时分配在堆中
+    JSON *root;                    // 根值
+    JSON *stack[JSON_MAX_DEPTH];   // 正在构建的容器
+    json_key *key;                 // 等待值的键名
+};
+
+/**
+ * @brief 报告流式解析中的错误
+ * @param pos 出错字节在全部输入中的偏移
+ */
+static void push_error(json_parser *p, size_t pos, const char *info)
+{
+    fprintf(stderr, "json_parser_feed: %s at offset %lu\n", info, (unsigned long)pos);
+    p->error = -1;
+}
+/**
+ * @brief 把 [s, s + n) 追加到标量缓冲区中，并保证末尾还能放一个 '\0'
+ */
+static int tok_append(json_parser *p, const char *s, size_t n)
+{
+    if (p->tok_cap - p->tok_len <= n)
+    {
+        size_t cap = p->tok_cap ? p->tok_cap : 64;
+        while (cap - p->tok_len <= n)
+            cap *= 2;
+        char *temp = (char *)heap_realloc(p->tok, p->tok_cap, cap);
+        if (!temp)
+        {
+            fprintf(stderr, "json_parser_feed: realloc(%lu) failed!\n", (unsigned long)cap);
+            p->error = -1;
+            return -1;
+        }
+        p->tok = temp;
+        p->tok_cap = cap;
+    }
+    memcpy(p->tok + p->tok_len, s, n);
+    p->tok_len += n;
+    return 0;
+}
+/**
+ * @brief 当前层是否是对象
+ */
+static BOOL nest_is_obj(const json_parser *p)
+{
+    return (p->nest[(p->depth - 1) >> 3] >> ((p->depth - 1) & 7)) & 1;
+}
+/**
+ * @brief 一个值结束后，根据所在的层决定下一个期待的语法成分
+ */
+static void push_value_done(json_parser *p)
+{
+    p->expect = p->depth == 0 ? EXPECT_EOF : EXPECT_NEXT;
+}
+/**
+ * @brief 进入一层容器
+ * @param is_obj 为 TRUE 时是对象，否则是数组
+ */
+static int push_open(json_parser *p, BOOL is_obj, size_t pos)
+{
+    if (p->depth >= JSON_MAX_DEPTH)
+    {
+        push_error(p, pos, "nesting too deep");
+        return -1;
+    }
+    unsigned char bit = (unsigned char)(1u << (p->depth & 7));
+    if (is_obj)
+        p->nest[p->depth >> 3] |= bit;
+    else
+        p->nest[p->depth >> 3] &= ~bit;
+    p->depth++;
+
+    int ret;
+    if (is_obj)
+        ret = p->handler.start_object ? p->handler.start_object(p->ctx) : 0;
+    else
+        ret = p->handler.start_array ? p->handler.start_array(p->ctx) : 0;
+    if (ret != 0)
+    {
+        push_error(p, pos, "aborted by handler");
+        return -1;
+    }
+    p->expect = is_obj ? EXPECT_FIRST_KEY : EXPECT_FIRST_ELEM;
+    return 0;
+}
+/**
+ * @brief 离开一层容器
+ */
+static int push_close(json_parser *p, BOOL is_obj, size_t pos)
+{
+    if (p->depth == 0 || nest_is_obj(p) != is_obj ||
+        (p->expect != EXPECT_NEXT && p->expect != (is_obj ? EXPECT_FIRST_KEY : EXPECT_FIRST_ELEM)))
+    {
+        push_error(p, pos, is_obj ? "unexpected '}'" : "unexpected ']'");
+        return -1;
+    }
+    p->depth--;
+
+    int ret;
+    if (is_obj)
+        ret = p->handler.end_object ? p->handler.end_object(p->ctx) : 0;
+    else
+        ret = p->handler.end_array ? p->handler.end_array(p->ctx) : 0;
+    if (ret != 0)
+    {
+        push_error(p, pos, "aborted by handler");
+        return -1;
+    }
+    push_value_done(p);
+    return 0;
+}
+/**
+ * @brief 字符串或键名读完，还原转义序列后交给回调
+ * @param pos 字符串起始位置，用于报告错误
+ */
+static int push_string_done(json_parser *p, size_t pos)
+{
+    if (p->escaped)
+    {
+        // 还原后的长度不会超过原长度，可以原地还原
+        long n = unescape(p->tok, p->tok + p->tok_len, p->tok);
+        if (n < 0)
+        {
+            push_error(p, pos, "invalid escape sequence");
+            return -1;
+        }
+        p->tok_len = n;
+    }
+    p->tok[p->tok_len] = '\0';
+
+    int ret;
+    if (p->token == TOKEN_KEY)
+    {
+        ret = p->handler.key ? p->handler.key(p->ctx, p->tok, p->tok_len) : 0;
+        p->expect = EXPECT_COLON;
+    }
+    else
+    {
+        ret = p->handler.string ? p->handler.string(p->ctx, p->tok, p->tok_len) : 0;
+        push_value_done(p);
+    }
+    p->token = TOKEN_NONE;
+    if (ret != 0)
+    {
+        push_error(p, pos, "aborted by handler");
+        return -1;
+    }
+    return 0;
+}
+/**
+ * @brief 数值或字面量读完，校验后交给回调
+ */
+static int push_bare_done(json_parser *p, size_t pos)
+{
+    const char *s = p->tok;
+    size_t n = p->tok_len;
+    int ret;
+
+    p->token = TOKEN_NONE;
+    if (n == 4 && memcmp(s, "true", 4) == 0)
+        ret = p->handler.boolean ? p->handler.boolean(p->ctx, TRUE) : 0;
+    else if (n == 5 && memcmp(s, "false", 5) == 0)
+        ret = p->handler.boolean ? p->handler.boolean(p->ctx, FALSE) : 0;
+    else if (n == 4 && memcmp(s, "null", 4) == 0)
+        ret = p->handler.null ? p->handler.null(p->ctx) : 0;
+    else
+    {
+        number num;
+        if (scan_number(s, s + n, &num) != s + n)
+        {
+            push_error(p, pos, *s == '-' || (*s >= '0' && *s <= '9') ? "invalid number" : "invalid literal");
+            return -1;
         }
+        if (num.type == JSON_INT && p->handler.integer)
+            ret = p->handler.integer(p->ctx, num.i64);
+        else if (num.type == JSON_INT)
+            ret = p->handler.number ? p->handler.number(p->ctx, (double)num.i64) : 0;
+        else
+            ret = p->handler.number ? p->handler.number(p->ctx, num.num) : 0;
+    }
+    if (ret != 0)
+    {
+        push_error(p, pos, "aborted by handler");
+        return -1;
+    }
+    push_value_done(p);
+    return 0;
+}
+/**
+ * @brief 继续读取未结束的标量
+ * @return 标量之后的位置（可能等于 end），出错返回 NULL
+ */
+static const char *push_scan_token(json_parser *p, const char *s, const char *end, const char *chunk)
+{
+    const char *q = s;
+
+    if (p->token == TOKEN_BARE)
+    {
+        while (q < end && !(char_class[(unsigned char)*q] & (CC_SPACE | CC_OP)))
+            q++;
+        if (tok_append(p, s, q - s) < 0)
+            return NULL;
+        if (q < end && push_bare_done(p, p->offset + (q - chunk) - p->tok_len) < 0)
+            return NULL;
+        return q;
+    }
+
+    // 上一块以 '\\' 结尾时，这一块的第一个字符属于转义序列
+    if (p->bslash && q < end)
+    {
+        p->bslash = FALSE;
+        q++;
+    }
+    while (q < end)
+    {
+        unsigned char c = (unsigned char)*q;
+        if (c == '"')
+            break;
+        if (c == '\\')
+        {
+            p->escaped = TRUE;
+            if (q + 1 == end)
+            {
+                p->bslash = TRUE;
+                q++;
+                break;
+            }
+            q += 2;
+            continue;
+        }
+        if (c < 0x20)
+        {
+            push_error(p, p->offset + (q - chunk), "control character in string");
+            return NULL;
+        }
+        q++;
+    }
+    if (tok_append(p, s, q - s) < 0)
+        return NULL;
+    if (q < end && !p->bslash)
+    {
+        // 遇到了结束引号
+        if (push_string_done(p, p->offset + (q - chunk) - p->tok_len - 1) < 0)
+            return NULL;
+        q++;
+    }
+    return q;
+}
+/**
+ * @brief 新建一个流式解析器
+ * @param handler 回调，不需要的回调可以为 NULL
+ * @param ctx 传给回调的参数
+ * @return json_parser* 失败返回 NULL
+ */
+json_parser *json_parser_new(const json_handler *handler, void *ctx)
+{
+    assert(handler);
+
+    json_parser *p = (json_parser *)heap_calloc(sizeof(json_parser));
+    if (!p)
+    {
+        fprintf(stderr, "json_parser_new: calloc failed!\n");
+        return NULL;
+    }
+    p->handler = *handler;
+    p->ctx = ctx;
+    p->expect = EXPECT_VALUE;
+    return p;
+}
+/**
+ * @brief 把分块到达的 JSON 文本交给解析器
+ * @param p 流式解析器
+ * @param chunk 文本块，不要求以 '\0' 结尾，返回后即可重用
+ * @param len 文本块的长度
+ * @return int 成功返回 0，出错返回 -1；出错后解析器不再接受输入
+ */
+int json_parser_feed(json_parser *p, const char *chunk, size_t len)
+{
+    const char *s = chunk;
+    const char *end = chunk + len;
+
+    assert(p);
+    assert(chunk || len == 0);
+
+    if (p->error)
+        return -1;
+    while (s < end)
+    {
+        if (p->token != TOKEN_NONE)
+        {
+            s = push_scan_token(p, s, end, chunk);
+            if (!s)
+                return -1;
+            continue;
+        }
+
+        char c = *s;
+        size_t pos = p->offset + (s - chunk);
+        if (char_class[(unsigned char)c] & CC_SPACE)
+        {
+            s++;
+            continue;
+        }
+        switch (c)
+        {
+        case '{':
+        case '[':
+            if (p->expect != EXPECT_VALUE && p->expect != EXPECT_FIRST_ELEM)
+                goto unexpected_;
+            if (push_open(p, c == '{', pos) < 0)
+                return -1;
+            s++;
+            break;
+        case '}':
+        case ']':
+            if (push_close(p, c == '}', pos) < 0)
+                return -1;
+            s++;
+            break;
+        case ',':
+            if (p->expect != EXPECT_NEXT)
+                goto unexpected_;
+            p->expect = nest_is_obj(p) ? EXPECT_KEY : EXPECT_VALUE;
+            s++;
+            break;
+        case ':':
+            if (p->expect != EXPECT_COLON)
+                goto unexpected_;
+            p->expect = EXPECT_VALUE;
+            s++;
+            break;
+        case '"':
+            if (p->expect == EXPECT_FIRST_KEY || p->expect == EXPECT_KEY)
+                p->token = TOKEN_KEY;
+            else if (p->expect == EXPECT_VALUE || p->expect == EXPECT_FIRST_ELEM)
+                p->token = TOKEN_STRING;
+            else
+                goto unexpected_;
+            p->tok_len = 0;
+            p->escaped = FALSE;
+            s++;
+            break;
+        default:
+            if (p->expect != EXPECT_VALUE && p->expect != EXPECT_FIRST_ELEM)
+                goto unexpected_;
+            p->token = TOKEN_BARE;
+            p->tok_len = 0;
+            break;
+        }
+        continue;
+
+    unexpected_:
+        push_error(p, pos, "unexpected character");
+        return -1;
+    }
+    p->offset += len;
+    return 0;
+}
+/**
+ * @brief 通知解析器输入已经结束
+ * @return int 输入恰好是一个完整的 JSON 值时返回 0，否则返回 -1
+ */
+int json_parser_finish(json_parser *p)
+{
+    assert(p);
+
+    if (p->error)
+        return -1;
+    // 根值是数值或字面量时，只有输入结束才能确定它结束了
+    if (p->token == TOKEN_BARE && push_bare_done(p, p->offset - p->tok_len) < 0)
+        return -1;
+    if (p->token != TOKEN_NONE || p->expect != EXPECT_EOF)
+    {
+        push_error(p, p->offset, "unexpected end of input");
+        return -1;
+    }
+    return 0;
+}
+/**
+ * @brief 释放流式解析器，以及尚未取走的 JSON 树
+ */
+void json_parser_free(json_parser *p)
+{
+    if (!p)
+        return;
+    if (p->key)
+        key_release(p->key);
+    json_free(p->root);
+    heap_free(p->tok);
+    heap_free(p);
+}
+
+/**
+ * @brief 把新建的值挂到正在构建的树上
+ * @param level val 所在的层数，0 表示 val 是根值
+ */
+static int tree_attach(json_parser *p, JSON *val, int level)
+{
+    if (!val)
+        return -1;
+    if (level == 0)
+    {
+        p->root = val;
         return 0;
     }
+    JSON *parent = p->stack[level - 1];
+    if (parent->type == JSON_OBJ)
+    {
+        json_key *key = p->key;
+        p->key = NULL;
+        return obj_put(parent, key, val) ? 0 : -1;
+    }
+    return json_add_element(parent, val) ? 0 : -1;
+}
+/**
+ * @brief 容器的 start 回调在进入新的一层之后调用，容器本身位于上一层
+ */
+static int tree_start_container(json_parser *p, json_e type)
+{
+    JSON *json = value_new(p->doc, type);
+    if (tree_attach(p, json, p->depth - 1) < 0)
+        return -1;
+    p->stack[p->depth - 1] = json;
+    return 0;
+}
+static int tree_start_object(void *ctx)
+{
+    return tree_start_container((json_parser *)ctx, JSON_OBJ);
+}
+static int tree_start_array(void *ctx)
+{
+    return tree_start_container((json_parser *)ctx, JSON_ARR);
+}
+static int tree_key(void *ctx, const char *key, size_t len)
+{
+    json_parser *p = (json_parser *)ctx;
+    assert(!p->key);
+    p->key = key_make(p->doc, key, len);
+    return p->key ? 0 : -1;
+}
+static int tree_string(void *ctx, const char *str, size_t len)
+{
+    json_parser *p = (json_parser *)ctx;
+    JSON *json = value_new(p->doc, JSON_STR);
+    if (!json)
+        return -1;
+    if (str_assign(json, str, len) < 0)
+    {
+        json_free(json);
+        return -1;
+    }
+    return tree_attach(p, json, p->depth);
+}
+static int tree_number(void *ctx, double num)
+{
+    json_parser *p = (json_parser *)ctx;
+    return tree_attach(p, new_num(p->doc, num), p->depth);
+}
+static int tree_integer(void *ctx, int64_t num)
+{
+    json_parser *p = (json_parser *)ctx;
+    return tree_attach(p, new_int(p->doc, num), p->depth);
+}
+static int tree_boolean(void *ctx, BOOL val)
+{
+    json_parser *p = (json_parser *)ctx;
+    return tree_attach(p, new_bool(p->doc, val), p->depth);
+}
+static int tree_null(void *ctx)
+{
+    json_parser *p = (json_parser *)ctx;
+    return tree_attach(p, value_new(p->doc, JSON_NONE), p->depth);
+}
+
+/**
+ * @brief 新建一个边解析边构建 JSON 树的流式解析器
+ * @param doc 节点分配在该文档中，为 NULL 时分配在堆中
+ * @return json_parser* 失败返回 NULL
+ * @details json_parser_finish 成功后用 json_parser_root 取走构建好的树
+ */
+json_parser *json_parser_new_tree(json_doc *doc)
+{
+    static const json_handler tree_handler = {
+        tree_start_object, NULL, tree_start_array, NULL,
+        tree_key, tree_string, tree_number, tree_boolean, tree_null, tree_integer};
+
+    json_parser *p = json_parser_new(&tree_handler, NULL);
+    if (!p)
+        return NULL;
+    p->ctx = p;
+    p->doc = doc;
+    return p;
+}
+/**
+ * @brief 取走构建好的 JSON 树，所有权转移给调用者
+ * @return JSON* 解析尚未成功结束时返回 NULL
+ */
+JSON *json_parser_root(json_parser *p)
+{
+    assert(p);
+
+    if (p->error || p->token != TOKEN_NONE || p->expect != EXPECT_EOF)
+        return NULL;
+    JSON *root = p->root;
+    p->root = NULL;
+    return root;
+}
+
+//-----------------------------------------------------------------------------
+//  路径表达式
+//-----------------------------------------------------------------------------
+/*
+路径表达式的语法：
+
+root ::= EOF | member child | index child;
+member ::= <name>;
+index ::= '[' <number> ']';
+child ::= EOF | dot_member child | index child;
+dot_member ::= '.' member;
+
+路径先编译为一组步骤，查询时只需逐级查找，不再解析字符串
+ */
+
+/**
+ * @brief 编译后路径中的一步
+ */
+typedef struct path_step
+{
+    const char *key; // 成员名，为 NULL 表示这一步是数组下标
+    U32 hash;        // 成员名的哈希值，编译时算好
+    U32 idx;         // 数组下标
+} path_step;
+
+struct json_path
+{
+    U32 count;          // 步骤数，为 0 表示 JSON 值本身
+    path_step steps[1]; // 步骤，成员名存放在步骤数组之后
+};
+
+/**
+ * @brief 路径解析的上下文
+ */
+typedef struct query_ctx
+{
+    const char *path; //原始路径
+    json_path *out;   //编译结果
+    char *names;      //下一个成员名的存放位置
+} query_ctx;
+
+/**
+ * @brief 报告路径解析过程发现的语法错误
+ * 
+ * @param ctx   路径解析的上下文
+ * @param info  错误说明
+ * @param cur   出错位置
+ */
+static void report_syntax_error(const query_ctx *ctx, const char *info, const char *cur)
+{
+    fprintf(stderr, "%s\n", info);
+    fprintf(stderr, "path: %s\n", ctx->path);
+    fprintf(stderr, "%*s^\n", (int)(cur - ctx->path + 6), " ");
+}
+/**
+ * @brief 解析MEMBER表达式，即成员名，遇到 '.'、'[' 或结束符为止
+ * 
+ * @param ctx   路径解析的上下文
+ * @param cur   MEMBER表达式
+ * @return const char* 成功返回成员名之后的位置，失败返回NULL
+ */
+static const char *compile_member(query_ctx *ctx, const char *cur)
+{
+    size_t len = strcspn(cur, ".[");
+    if (len == 0)
+    {
+        report_syntax_error(ctx, "member name expected", cur);
+        return NULL;
+    }
+
+    path_step *step = &ctx->out->steps[ctx->out->count++];
+    memcpy(ctx->names, cur, len);
+    ctx->names[len] = '\0';
+    step->key = ctx->names;
+    step->hash = key_hash(ctx->names);
+    step->idx = 0;
+    ctx->names += len + 1;
+    return cur + len;
+}
+/**
+ * @brief 解析INDEX表达式，即 '[' <number> ']'
+ * 
+ * @param ctx   路径解析的上下文
+ * @param cur   INDEX表达式
+ * @return const char* 成功返回 ']' 之后的位置，失败返回NULL
+ */
+static const char *compile_index(query_ctx *ctx, const char *cur)
+{
+    unsigned long idx = 0;
+    const char *p = cur + 1;
+
+    assert(*cur == '[');
+    if (*p < '0' || *p > '9')
+    {
+        report_syntax_error(ctx, "array index expected", p);
+        return NULL;
+    }
+    for (; *p >= '0' && *p <= '9'; p++)
+    {
+        idx = idx * 10 + (*p - '0');
+        if (idx > 0xFFFFFFFFUL)
+        {
+            report_syntax_error(ctx, "array index too large", cur + 1);
+            return NULL;
+        }
+    }
+    if (*p != ']')
+    {
+        report_syntax_error(ctx, "']' expected", p);
+        return NULL;
+    }
+
+    path_step *step = &ctx->out->steps[ctx->out->count++];
+    step->key = NULL;
+    step->hash = 0;
+    step->idx = (U32)idx;
+    return p + 1;
+}
+/**
+ * @brief 解析CHILD表达式中的一级，即 dot_member 或 index
+ * 
+ * @param ctx   路径解析的上下文
+ * @param cur   CHILD表达式，不为结束符
+ * @return const char* 成功返回这一级之后的位置，失败返回NULL
+ */
+static const char *compile_child(query_ctx *ctx, const char *cur)
+{
+    switch (*cur)
+    {
+    case '.':
+        if (cur[1] == '\0')
+        {
+            report_syntax_error(ctx, "unexpected end", cur + 1);
+            return NULL;
+        }
+        return compile_member(ctx, cur + 1);
+    case '[':
+        return compile_index(ctx, cur);
+    default:
+        report_syntax_error(ctx, "JSON path invalid", cur);
+        return NULL;
+    }
+}
+/**
+ * @brief 编译路径表达式
+ * 
+ * @param path 路径表达式，如：basic.dns[1]，空串表示 JSON 值本身
+ * @return json_path* 编译得到的路径，语法错误或内存不足时返回NULL
+ * @details 步骤和成员名放在同一块内存中，用 json_path_free 释放
+ */
+json_path *json_path_compile(const char *path)
+{
+    query_ctx ctx;
+    size_t len, max_steps = 1;
+    const char *cur;
+
+    assert(path);
+
+    // 每个 '.' 或 '[' 最多开始一步，成员名的总长度不超过路径长度
+    len = strlen(path);
+    for (cur = path; *cur; cur++)
+    {
+        if (*cur == '.' || *cur == '[')
+            max_steps++;
+    }
+    ctx.path = path;
+    ctx.out = (json_path *)heap_alloc(sizeof(json_path) + max_steps * sizeof(path_step) + len + max_steps);
+    if (!ctx.out)
+    {
+        fprintf(stderr, "json_path_compile: malloc failed!\n");
+        return NULL;
+    }
+    ctx.out->count = 0;
+    ctx.names = (char *)(ctx.out->steps + max_steps);
+
+    cur = path;
+    if (*cur == '[')
+        cur = compile_index(&ctx, cur);
+    else if (*cur != '\0')
+        cur = compile_member(&ctx, cur);
+    while (cur && *cur)
+        cur = compile_child(&ctx, cur);
+    if (!cur)
+    {
+        heap_free(ctx.out);
+        return NULL;
+    }
+    return ctx.out;
+}
+/**
+ * @brief 释放编译后的路径
+ */
+void json_path_free(json_path *path)
+{
+    heap_free(path);
+}
+/**
+ * @brief 按一步路径找到 json 的子成员
+ * @return 子成员，不存在或类型不匹配时返回NULL
+ */
+static JSON *path_step_into(const JSON *json, const path_step *step)
+{
+    if (lazy_load(json) < 0)
+        return NULL;
+    if (step->key)
+    {
+        if (json->type != JSON_OBJ)
+            return NULL;
+        long i = obj_find_hashed(json->obj, step->key, step->hash);
+        return i < 0 ? NULL : json->obj->kvs[i].val;
+    }
+    if (json->type != JSON_ARR || step->idx >= json->arr->count)
+        return NULL;
+    return arr_at(json, step->idx);
+}
+/**
+ * @brief 在JSON值json中找到编译后的路径path指示的成员
+ * 
+ * @param json JSON值
+ * @param path json_path_compile 编译得到的路径
+ * @return const JSON* 路径指示的成员值，不存在则返回NULL
+ */
+const JSON *json_get_compiled(const JSON *json, const json_path *path)
+{
+    assert(json);
+    assert(path);
+
+    for (U32 i = 0; i < path->count && json; i++)
+        json = path_step_into(json, &path->steps[i]);
+    return json;
+}
+/**
+ * @brief 用 val 的内容替换 json 的内容，json 原来的内容和 val 的节点一并释放
+ * @return 成功返回 0，失败返回 -1，失败时 val 被释放，json 保持不变
+ * @details
+ *  容器头部紧跟在节点后面，不能随节点内容一起搬走：val 是容器时把它的头部拷贝到 json 的头部中，
+ *  json 原来不是容器、没有头部时为它另外分配一个
+ */
+static int value_replace(JSON *json, JSON *val)
+{
+    json_doc *doc = node_doc(json);
+    BOOL had_header = json->type == JSON_ARR || json->type == JSON_OBJ;
+    void *header = had_header ? (void *)json->arr : NULL;
+    BOOL is_container = val->type == JSON_ARR || val->type == JSON_OBJ;
 
-    case JSON_STR:
+    assert(doc == node_doc(val));
+    if (is_container && !header)
     {
-        char *t_str = transfer_str(json->str); // 已经加好换行符了
-        if (!t_str)
+        header = slab_alloc(doc, HEADER_BYTES);
+        if (!header)
         {
-            fprintf(stderr, "json_to_yaml: transfer string [%s] failed!\n", json->str);
-            *error = -1;
+            json_free(val);
             return -1;
         }
-        int len = strlen(t_str);
-        int num_sucess = fwrite(t_str, sizeof(char), len, fp);
-        free(t_str);
-        if (num_sucess != len)
-        {
-            fprintf(stderr, "json_to_yaml: write JSON_STR into file failed!\n");
-            *error = -1;
+    }
+    if (!doc)
+        value_clear(json);
 
-            return -1;
-        }
-        return 0;
+    // 根节点标记和节点的大小属于 json 本身，不随内容搬动
+    unsigned char keep = json->flags & (JSON_F_DOCROOT | JSON_F_WIDE);
+    memcpy(json, val, sizeof(*json));
+    json->flags = (json->flags & ~(JSON_F_DOCROOT | JSON_F_WIDE)) | keep;
+    if (is_container)
+    {
+        memcpy(header, val->arr, val->type == JSON_ARR ? sizeof(array) : sizeof(object));
+        json->arr = (array *)header;
+        if (!doc && header_detached(val))
+            slab_put(val->arr, HEADER_BYTES);
+    }
+    else if (had_header && !doc && header != (void *)(json + 1))
+    {
+        slab_put(header, HEADER_BYTES);
     }
+    slab_release(doc, val, node_bytes(val));
+    return 0;
+}
+/**
+ * @brief 为 json 增加一个引用，供另一个父节点使用
+ * @return 共享的节点；内联字符串没有引用计数，返回它的拷贝，失败返回 NULL
+ */
+static JSON *node_share(JSON *json)
+{
+    if (json->flags & JSON_F_INLINE)
+        return new_str(node_doc(json), json->sso);
+    __atomic_add_fetch(&json->refs, 1, __ATOMIC_RELAXED);
+    return json;
+}
+/**
+ * @brief 浅拷贝 json：新建同样的节点和成员数组，子成员与 json 共享
+ * @return 拷贝得到的节点，分配在 json 所在处（堆或文档）；失败返回 NULL
+ */
+static JSON *node_clone(const JSON *json)
+{
+    json_doc *doc = node_doc(json);
+    JSON *copy;
+    U32 n;
 
-    case JSON_ARR:
+    if (lazy_load(json) < 0)
+        return NULL;
+    switch (json->type)
     {
-        for (int i = 0; i < json->arr.count; i++)
+    case JSON_STR:
+        return new_str(doc, json_str(json, ""));
+    case JSON_ARR:
+        n = json->arr->count;
+        if (json->flags & JSON_F_PACKED)
         {
-            char *buf = (char *)malloc((space_num + 3) * sizeof(char));
-            buf[0] = '\0';
-            if (!(flag == JSON_ARR && i == 0))
+            // 原始值直接拷贝，按需生成的元素节点不共享
+            copy = node_new(doc, JSON_ARR);
+            if (!copy)
+                return NULL;
+            copy->arr->pk = packed_new(doc, json->etype, json->arr->size);
+            if (!copy->arr->pk)
             {
-                for (int j = 0; j < space_num; j++)
-                {
-                    buf[j] = ' ';
-                }
-                buf[space_num] = '\0';
+                slab_release(doc, copy, node_bytes(copy));
+                return NULL;
             }
-
-            strcat(buf, "- ");
-            int len = strlen(buf);
-            int num_sucess = fwrite(buf, sizeof(char), len, fp);
-            free(buf);
-            if (num_sucess != len)
+            memcpy(copy->arr->pk->data, json->arr->pk->data, packed_bytes(json->etype, n) - sizeof(packed));
+            copy->flags |= JSON_F_PACKED;
+            copy->etype = json->etype;
+            copy->arr->count = n;
+            copy->arr->size = json->arr->size;
+            return copy;
+        }
+        copy = container_new(doc, JSON_ARR, n);
+        for (U32 i = 0; copy && i < n; i++)
+        {
+            if (!(copy->arr->elems[i] = node_share(json->arr->elems[i])))
             {
-                fprintf(stderr, "json_to_yaml: write JSON_ARR prefix into file failed!\n");
-                *error = -1;
-                return -1;
+                json_free(copy);
+                return NULL;
             }
-
-            json_to_yaml(json->arr.elems[i], fp, space_num + 2, JSON_ARR, error);
+            copy->arr->count++;
         }
-        return 0;
-    }
-
+        return copy;
     case JSON_OBJ:
-    {
-        for (int i = 0; i < json->obj.count; i++)
+        n = json->obj->count;
+        copy = container_new(doc, JSON_OBJ, n);
+        for (U32 i = 0; copy && i < n; i++)
         {
-            char *buf = (char *)malloc((space_num + strlen(json->obj.kvs[i].key) + 4) * sizeof(char));
-            buf[0] = '\0';
-            if (!(flag == JSON_ARR && i == 0))
-            {
-                for (int j = 0; j < space_num; j++)
-                {
-                    buf[j] = ' ';
-                }
-                buf[space_num] = '\0';
-            }
-
-            strcat(buf, json->obj.kvs[i].key);
-            strcat(buf, ": ");
-            if (json->obj.kvs[i].val->type == JSON_ARR || json->obj.kvs[i].val->type == JSON_OBJ)
-            {
-                strcat(buf, "\n");
-
-                int num_sucess = fwrite(buf, sizeof(char), strlen(buf), fp);
-
-                if (num_sucess != strlen(buf))
-                {
-                    fprintf(stderr, "json_to_yaml: write JSON_OBJ prefix into file failed!\n");
-                    free(buf);
-                    *error = -1;
-                    return -1;
-                }
-                free(buf);
-            }
-            else
+            keyvalue *kv = &copy->obj->kvs[i];
+            if (!(kv->val = node_share(json->obj->kvs[i].val)))
             {
-                int num_sucess = fwrite(buf, sizeof(char), strlen(buf), fp);
-
-                if (num_sucess != strlen(buf))
-                {
-                    fprintf(stderr, "json_to_yaml: write into file failed!\n");
-                    free(buf);
-                    *error = -1;
-                    return -1;
-                }
-                free(buf);
+                json_free(copy);
+                return NULL;
             }
-            json_to_yaml(json->obj.kvs[i].val, fp, space_num + 2, JSON_OBJ, error);
+            kv->key = key_retain(json->obj->kvs[i].key);
+            copy->obj->count++;
         }
-        return 0;
-    }
-
+        if (copy)
+            obj_reindex(copy->obj);
+        return copy;
     default:
-        return -1;
+        copy = node_new(doc, json->type);
+        if (copy)
+            copy->i64 = json->i64;
+        return copy;
     }
 }
 /**
- * @brief 把JSON值json以YAML格式输出，保存到名字为fname的文件中
+ * @brief 修改 *slot 指向的子成员之前调用：子成员被共享时换成它的浅拷贝，原来的子成员释放一个引用
+ * @return 可以就地修改的子成员，失败返回 NULL
+ */
+static JSON *node_own(JSON **slot)
+{
+    JSON *json = *slot;
+    if (!node_shared(json))
+        return json;
+    JSON *copy = node_clone(json);
+    if (!copy)
+        return NULL;
+    *slot = copy;
+    json_free(json);
+    return copy;
+}
+/**
+ * @brief 为 json 建立一个快照
+ * @param json 对象或数组，可以是另一个快照
+ * @return 新的根节点，失败返回 NULL
+ * @details
+ *  只拷贝根节点及其成员数组，所有子成员与 json 共享，按引用计数释放。
+ *  此后通过根节点修改（json_set_compiled 以及直接对根节点调用的 json_add_member、json_obj_set_* 等）
+ *  只拷贝从根到被修改成员的路径，其余子树仍然共享，两个版本互不影响。
+ *  共享的子成员不能就地修改，修改接口对它们返回失败
+ */
+JSON *json_snapshot(const JSON *json)
+{
+    assert(json);
+    if (write_reject(json, "json_snapshot"))
+        return NULL;
+    return node_clone(json);
+}
+/**
+ * @brief 按一步路径找到 json 的子成员在 json 中的位置，以便替换
+ * @return 子成员的位置，不存在、类型不匹配或是打包数组的元素时返回 NULL
+ */
+static JSON **path_step_slot(JSON *json, const path_step *step)
+{
+    if (lazy_load(json) < 0)
+        return NULL;
+    if (step->key)
+    {
+        if (json->type != JSON_OBJ)
+            return NULL;
+        long i = obj_find_hashed(json->obj, step->key, step->hash);
+        return i < 0 ? NULL : &json->obj->kvs[i].val;
+    }
+    if (json->type != JSON_ARR || step->idx >= json->arr->count || (json->flags & JSON_F_PACKED))
+        return NULL;
+    return &json->arr->elems[step->idx];
+}
+/**
+ * @brief 在JSON值json中找到编译后的路径path指示的成员，将其值修改为val
  * 
- * @param json  JSON值
- * @param fname 输出文件名
- * @return int 0表示成功，非 0 表示失败
+ * @param json JSON值
+ * @param path json_path_compile 编译得到的路径
+ * @param val 新的值，所有权转移给 json_set_compiled，失败时被释放
+ * @return int <0表示失败，否则表示成功
+ * @details
+ *  1. 路径的最后一步是成员名且成员不存在时，新建该成员
+ *  2. 路径的最后一步是数组下标且等于数组长度时，追加到数组末尾
+ *  3. 其余的中间成员必须已经存在
+ *  4. 路径为空时，json 的内容被替换为 val 的内容，两者必须分配在同一处（堆或同一个文档）
  */
-int json_save(const JSON *json, const char *fname)
+int json_set_compiled(JSON *json, const json_path *path, JSON *val)
 {
     assert(json);
-    assert(fname);
-    assert(fname[0]);
-    //TODO:
-    FILE *fp;
-    fp = fopen(fname, "w");
-    if (!fp)
+    assert(path);
+
+    if (!val)
+        return -1;
+    if (write_reject(json, "json_set_compiled"))
     {
-        fprintf(stderr, "json_save: open file [%s] failed!\n", fname);
+        json_free(val);
         return -1;
     }
-    int *error = (int *)malloc(sizeof(int));
-    if (!error)
+    if (path->count == 0)
     {
-        fclose(fp);
-        fprintf(stderr, "json_save: malloc failed!\n");
+        if (node_doc(json) != node_doc(val))
+        {
+            fprintf(stderr, "json_set_compiled: value belongs to another document!\n");
+            json_free(val);
+            return -1;
+        }
+        return value_replace(json, val);
+    }
+
+    // 沿途被快照共享的成员换成浅拷贝，修改不会影响其他版本
+    JSON *parent = json;
+    for (U32 i = 0; i + 1 < path->count && parent; i++)
+    {
+        JSON **slot = path_step_slot(parent, &path->steps[i]);
+        parent = slot ? node_own(slot) : NULL;
+    }
+    if (!parent || lazy_load(parent) < 0)
+    {
+        json_free(val);
         return -1;
     }
-    *error = 0;
-    int ans = json_to_yaml(json, fp, 0, JSON_NONE, error);
-    free(error);
-    fclose(fp);
-    return ans;
+
+    const path_step *last = &path->steps[path->count - 1];
+    if (last->key)
+    {
+        if (parent->type != JSON_OBJ)
+        {
+            json_free(val);
+            return -1;
+        }
+        long i = obj_find_hashed(parent->obj, last->key, last->hash);
+        if (i >= 0)
+        {
+            assert(!node_doc(parent) || node_doc(val) == node_doc(parent));
+            json_free(parent->obj->kvs[i].val);
+            parent->obj->kvs[i].val = val;
+            return 0;
+        }
+        return json_add_member(parent, last->key, val) ? 0 : -1;
+    }
+
+    if (parent->type != JSON_ARR || last->idx > parent->arr->count || arr_unpack(parent) < 0)
+    {
+        json_free(val);
+        return -1;
+    }
+    if (last->idx == parent->arr->count)
+        return json_add_element(parent, val) ? 0 : -1;
+    assert(!node_doc(parent) || node_doc(val) == node_doc(parent));
+    json_free(parent->arr->elems[last->idx]);
+    parent->arr->elems[last->idx] = val;
+    return 0;
 }
 
+//-----------------------------------------------------------------------------
+//  快照发布
+//-----------------------------------------------------------------------------
+
 /**
- * @brief 扩容函数，将 json 对象的容量扩大一倍
- * @param json 要扩容的 JSON 对象
- * @return 扩容成功返回 json，失败返回 NULL
- * @details 保证 json 的类型为 JSON_OBJ 或 JSON_ARR；json 不为 NULL
+ * @brief 读者线程的登记记录，独占一个缓存行，只有所属线程写 active 和 nest
  */
-JSON *expand(JSON *json)
+typedef struct rcu_reader
 {
-    assert(json);
-    assert((json->type == JSON_OBJ || json->type == JSON_ARR));
-    switch (json->type)
+    uint64_t active;         // 进入读区时看到的纪元，0 表示不在读区
+    U32 nest;                // json_acquire 的嵌套层数
+    BOOL in_use;             // 是否属于某个存活的线程
+    struct rcu_reader *next; // 所有记录串成链表，记录不释放，线程退出后复用
+} __attribute__((aligned(64))) rcu_reader;
+
+/**
+ * @brief 等待回收的旧版本
+ */
+typedef struct rcu_retired
+{
+    JSON *json;
+    uint64_t epoch; // 换下时的纪元，进入读区时纪元不大于它的读者可能还在使用
+    struct rcu_retired *next;
+} rcu_retired;
+
+struct json_slot
+{
+    JSON *cur;            // 当前发布的版本，读者只读
+    pthread_mutex_t lock; // 串行化发布者，保护 retired
+    rcu_retired *retired;
+};
+
+static uint64_t rcu_epoch = 1;                               // 全局纪元，只有发布者推进
+static rcu_reader *rcu_readers;                              // 所有登记记录，只增不减
+static pthread_mutex_t rcu_lock = PTHREAD_MUTEX_INITIALIZER; // 保护 rcu_readers 的登记
+static __thread rcu_reader *rcu_self;
+static pthread_key_t rcu_key;
+static pthread_once_t rcu_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief 线程退出时交还登记记录
+ */
+static void rcu_thread_exit(void *arg)
+{
+    rcu_reader *r = (rcu_reader *)arg;
+    r->nest = 0;
+    __atomic_store_n(&r->active, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&r->in_use, FALSE, __ATOMIC_RELEASE);
+    rcu_self = NULL;
+}
+static void rcu_key_init(void)
+{
+    pthread_key_create(&rcu_key, rcu_thread_exit);
+}
+/**
+ * @brief 为当前线程取得一条登记记录，优先复用已退出线程留下的
+ * @details 每个线程只在第一次 json_acquire 时调用一次，不内联
+ */
+__attribute__((noinline)) static rcu_reader *rcu_register(void)
+{
+    rcu_reader *r;
+
+    pthread_once(&rcu_once, rcu_key_init);
+    pthread_mutex_lock(&rcu_lock);
+    for (r = rcu_readers; r; r = r->next)
     {
-    case JSON_ARR:
+        if (!__atomic_load_n(&r->in_use, __ATOMIC_ACQUIRE))
+            break;
+    }
+    if (!r)
     {
-        // realloc 在内存申请成功后自动释放旧内存
-        value **temp = (value **)realloc(json->arr.elems, json->arr.size * 2 * sizeof(value *));
-        if (!temp)
+        void *mem = NULL;
+        if (posix_memalign(&mem, sizeof(rcu_reader), sizeof(rcu_reader)) == 0)
         {
-            fprintf(stderr, "expand: expand array size failed!\n");
-            return NULL;
+            r = (rcu_reader *)memset(mem, 0, sizeof(rcu_reader));
+            r->next = rcu_readers;
+            __atomic_store_n(&rcu_readers, r, __ATOMIC_RELEASE);
         }
-        json->arr.size *= 2;
-        json->arr.elems = temp;
-        return json;
     }
+    if (r)
+        r->in_use = TRUE;
+    pthread_mutex_unlock(&rcu_lock);
+    if (r)
+    {
+        pthread_setspecific(rcu_key, r);
+        rcu_self = r;
+    }
+    return r;
+}
+/**
+ * @brief 是否仍有读者可能在使用纪元 epoch 之前换下的版本
+ */
+static BOOL rcu_busy(uint64_t epoch)
+{
+    for (rcu_reader *r = __atomic_load_n(&rcu_readers, __ATOMIC_ACQUIRE); r; r = r->next)
+    {
+        uint64_t active = __atomic_load_n(&r->active, __ATOMIC_SEQ_CST);
+        if (active && active <= epoch)
+            return TRUE;
+    }
+    return FALSE;
+}
+/**
+ * @brief 释放 slot 中不再有读者使用的旧版本，调用者持有 slot->lock
+ * @param wait 是否等到所有旧版本都能释放
+ */
+static void rcu_reclaim(json_slot *slot, BOOL wait)
+{
+    rcu_retired **pp = &slot->retired;
 
-    case JSON_OBJ:
+    while (*pp)
     {
-        keyvalue *temp = (keyvalue *)realloc(json->obj.kvs, json->obj.size * 2 * sizeof(keyvalue));
-        if (!temp)
+        rcu_retired *old = *pp;
+        if (rcu_busy(old->epoch))
         {
-            fprintf(stderr, "expand: expand object size failed!\n");
-            return NULL;
+            if (wait)
+            {
+                sched_yield();
+                continue;
+            }
+            pp = &old->next;
+            continue;
         }
-        json->obj.size *= 2;
-        json->obj.kvs = temp;
-        return json;
+        *pp = old->next;
+        json_free(old->json);
+        heap_free(old);
     }
-    default:
+}
+
+/**
+ * @brief 新建一个发布槽，初始版本为 json
+ * @param json 初始版本，所有权转移给发布槽，可以为 NULL
+ * @return 发布槽，内存不足返回 NULL，此时 json 不被释放
+ */
+json_slot *json_slot_new(JSON *json)
+{
+    json_slot *slot = (json_slot *)heap_calloc(sizeof(json_slot));
+    if (!slot)
+    {
+        fprintf(stderr, "json_slot_new: heap_calloc failed\n");
         return NULL;
     }
+    pthread_mutex_init(&slot->lock, NULL);
+    slot->cur = json;
+    return slot;
 }
-//  想想：json_add_member和json_add_element中，val应该是堆分配，还是栈分配？堆分配的
-//  想想：如果json_add_member失败，应该由谁来释放val？在函数中释放
 /**
- * @brief 往对象类型的json中增加一个键值对，键名为key，值为val
- * 
- * @param json JSON对象
- * @param key 键名，符合正则：[a-zA-Z_][a-zA-Z_-0-9]*
- * @param val 键值，必须是堆分配拥有所有权的JSON值
- * @return JSON* 成功返回val，失败返回NULL
+ * @brief 释放发布槽以及其中的当前版本和所有旧版本
+ * @details 调用者保证不再有线程对 slot 调用 json_acquire；仍在读区的读者会被等待
+ */
+void json_slot_free(json_slot *slot)
+{
+    if (!slot)
+        return;
+    json_publish(slot, NULL);
+    pthread_mutex_lock(&slot->lock);
+    rcu_reclaim(slot, TRUE);
+    pthread_mutex_unlock(&slot->lock);
+    pthread_mutex_destroy(&slot->lock);
+    heap_free(slot);
+}
+/**
+ * @brief 用 json 替换 slot 中的当前版本
+ * @param slot 发布槽
+ * @param json 新版本，所有权转移给发布槽，可以为 NULL
+ * @details
+ *  新版本原子地换入，之后进入读区的读者都看到它。旧版本记下当前纪元后推进纪元，
+ *  等所有在此之前进入读区的读者都离开后，由之后的 json_publish 或 json_slot_free 释放。
+ *  发布者之间互斥，读者从不加锁。读取会展开延迟节点，所以不能发布 json_load_lazy 加载的版本
+ */
+void json_publish(json_slot *slot, JSON *json)
+{
+    assert(slot);
+
+    pthread_mutex_lock(&slot->lock);
+    JSON *old = __atomic_exchange_n(&slot->cur, json, __ATOMIC_SEQ_CST);
+    uint64_t epoch = __atomic_fetch_add(&rcu_epoch, 1, __ATOMIC_SEQ_CST);
+    if (old)
+    {
+        rcu_retired *retired = (rcu_retired *)heap_alloc(sizeof(rcu_retired));
+        if (retired)
+        {
+            retired->json = old;
+            retired->epoch = epoch;
+            retired->next = slot->retired;
+            slot->retired = retired;
+        }
+        else
+        {
+            // 记不下旧版本时就地等待读者离开
+            while (rcu_busy(epoch))
+                sched_yield();
+            json_free(old);
+        }
+    }
+    rcu_reclaim(slot, FALSE);
+    pthread_mutex_unlock(&slot->lock);
+}
+/**
+ * @brief 进入读区并取得 slot 中的当前版本
+ * @return 当前版本，在配对的 json_release 之前一直有效；没有发布任何版本或内存不足时返回 NULL，
+ *  此时仍需调用 json_release
+ * @details
+ *  只写本线程的登记记录，不加锁，也不修改任何共享的缓存行。可以嵌套，也可以同时读多个发布槽，
+ *  最外层的 json_release 之后取得的所有版本都不能再使用
+ */
+const JSON *json_acquire(json_slot *slot)
+{
+    assert(slot);
+
+    rcu_reader *r = rcu_self;
+    if (!r && !(r = rcu_register()))
+    {
+        fprintf(stderr, "json_acquire: rcu_register failed\n");
+        return NULL;
+    }
+    if (r->nest++ == 0)
+    {
+        // 先公布纪元再读指针，与发布者的“先换指针再检查读者”配对
+        __atomic_store_n(&r->active, __atomic_load_n(&rcu_epoch, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+    return __atomic_load_n(&slot->cur, __ATOMIC_ACQUIRE);
+}
+/**
+ * @brief 离开 json_acquire 进入的读区
+ */
+void json_release(void)
+{
+    rcu_reader *r = rcu_self;
+    if (!r)
+        return;
+    assert(r->nest > 0);
+    if (--r->nest == 0)
+        __atomic_store_n(&r->active, 0, __ATOMIC_RELEASE);
+}
+
+//-----------------------------------------------------------------------------
+//  后台释放
+//-----------------------------------------------------------------------------
+
+#define RECLAIM_QUEUE 256 // 等待后台线程释放的树的最大个数
+
+static pthread_mutex_t reclaim_lock = PTHREAD_MUTEX_INITIALIZER; // 保护以下所有 reclaim_ 变量
+static pthread_cond_t reclaim_more = PTHREAD_COND_INITIALIZER;  // 队列由空变为非空
+static pthread_cond_t reclaim_idle = PTHREAD_COND_INITIALIZER;  // 队列清空且后台线程空闲
+static JSON *reclaim_queue[RECLAIM_QUEUE];
+static U32 reclaim_head, reclaim_count;
+static BOOL reclaim_busy;    // 后台线程正在释放一棵已出队的树
+static BOOL reclaim_started; // 后台线程是否在运行
+static pthread_once_t reclaim_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief 后台线程：依次释放队列中的树，不持锁调用 json_free
+ */
+static void *reclaim_main(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&reclaim_lock);
+    for (;;)
+    {
+        while (reclaim_count == 0)
+            pthread_cond_wait(&reclaim_more, &reclaim_lock);
+        JSON *json = reclaim_queue[reclaim_head];
+        reclaim_head = (reclaim_head + 1) % RECLAIM_QUEUE;
+        reclaim_count--;
+        reclaim_busy = TRUE;
+        pthread_mutex_unlock(&reclaim_lock);
+        json_free(json);
+        pthread_mutex_lock(&reclaim_lock);
+        reclaim_busy = FALSE;
+        if (reclaim_count == 0)
+            pthread_cond_broadcast(&reclaim_idle);
+    }
+    return NULL;
+}
+static void reclaim_prepare(void)
+{
+    pthread_mutex_lock(&reclaim_lock);
+}
+static void reclaim_parent(void)
+{
+    pthread_mutex_unlock(&reclaim_lock);
+}
+/**
+ * @brief fork 出的子进程没有后台线程，队列中剩下的树由子进程下次启动的后台线程或 json_free_drain 释放
+ * @details fork 时后台线程正在释放的那棵树在子进程中不再释放
+ */
+static void reclaim_child(void)
+{
+    reclaim_busy = FALSE;
+    reclaim_started = FALSE;
+    pthread_mutex_init(&reclaim_lock, NULL);
+    pthread_cond_init(&reclaim_more, NULL);
+    pthread_cond_init(&reclaim_idle, NULL);
+}
+static void reclaim_atfork(void)
+{
+    pthread_atfork(reclaim_prepare, reclaim_parent, reclaim_child);
+}
+/**
+ * @brief 释放 json 的开销是否小到不值得交给后台线程
+ */
+static BOOL free_is_cheap(const JSON *json)
+{
+    if (json->flags & (JSON_F_ARENA | JSON_F_FROZEN))
+        return !(json->flags & JSON_F_DOCROOT);
+    return json->type != JSON_ARR && json->type != JSON_OBJ;
+}
+
+/**
+ * @brief 把 json 交给后台线程释放，立即返回
+ * @param json 与 json_free 相同，可以为 NULL；调用之后不能再访问
  * @details
- *  json_add_member会转移val的所有权，所以调用json_add_member之后不用考虑释放val的问题
- * 因为需要支持如下写法：
- *  json_add_member(json, "port", json_new_num(80));
- * 所以需要做到：
- *  1) 允许val为NULL；
- *  2) 当json_add_member内部发生失败时，需要释放val，满足将val的所有权转让给json_add_member的语义设定
+ *  后台线程在第一次调用时启动。标量和文档中的非根节点直接释放；
+ *  队列已满或后台线程无法启动时退化为在调用者线程中 json_free
  */
-JSON *json_add_member(JSON *json, const char *key, JSON *val)
+void json_free_async(JSON *json)
 {
-    assert(json->type == JSON_OBJ);
-    assert(!(json->obj.count > 0 && json->obj.kvs == NULL));
-    assert(key);
-    assert(key[0]);
-    //想想: 为啥不用assert检查val？因为允许 val 为 NULL。
-    //想想：如果json中已经存在名字为key的成员，怎么办？覆盖旧成员的值。
-    //TODO:
-    if (val == NULL)
+    if (!json || free_is_cheap(json))
     {
-        return NULL;
+        json_free(json);
+        return;
     }
-    else
+    pthread_mutex_lock(&reclaim_lock);
+    if (!reclaim_started)
     {
-        // 查找键名是否存在
-        for (int i = 0; i < json->obj.count; i++)
-        {
-            if (strcmp(json->obj.kvs[i].key, key) == 0)
-            {
-                json_free(json->obj.kvs[i].val);
-                json->obj.kvs[i].val = val;
-                return val;
-            }
-        }
-        // 键名不存在，则向 json 中添加新的键值对
-        // 需要扩容
-        if (json->obj.count == json->obj.size)
-        {
-            if (!expand(json))
-            {
-                fprintf(stderr, "json_add_member: expand capacity failed!\n");
-                json_free(val);
-                val = NULL;
-                return NULL;
-            }
-        }
-        json->obj.kvs[json->obj.count].key = strdup(key);
-        if (json->obj.kvs[json->obj.count].key == NULL)
+        pthread_t tid;
+        pthread_once(&reclaim_once, reclaim_atfork);
+        if (pthread_create(&tid, NULL, reclaim_main, NULL) == 0)
         {
-            fprintf(stderr, "json_add_member: strdup(%s) failed!\n", key);
-            json_free(val);
-            val = NULL;
-            return NULL;
+            pthread_detach(tid);
+            reclaim_started = TRUE;
         }
-        json->obj.kvs[json->obj.count].val = val;
-        json->obj.count++;
-        return val;
     }
+    if (!reclaim_started || reclaim_count == RECLAIM_QUEUE)
+    {
+        pthread_mutex_unlock(&reclaim_lock);
+        json_free(json);
+        return;
+    }
+    reclaim_queue[(reclaim_head + reclaim_count) % RECLAIM_QUEUE] = json;
+    if (reclaim_count++ == 0)
+        pthread_cond_signal(&reclaim_more);
+    pthread_mutex_unlock(&reclaim_lock);
 }
 /**
- * @brief 往数组类型的json中追加一个元素
- * 
- * @param json JSON数组
- * @param val 加入到数组的元素，必须是堆分配拥有所有权的JSON值
- * @details
- *  json_add_element会转移val的所有权，所以调用json_add_element之后不用考虑释放val的问题
- *  val 允许为 NULL 用以支持 json_add_element(json,json_new(JSON_OBJ)) 的写法
+ * @brief 等待此前交给 json_free_async 的树全部释放完毕，用于退出前和测试中
  */
-JSON *json_add_element(JSON *json, JSON *val)
+void json_free_drain(void)
 {
-    assert(json);
-    assert(json->type == JSON_ARR);
-    assert(!(json->arr.count > 0 && json->arr.elems == NULL));
-
-    //想想：为啥不用assert检查val？ 因为 val 允许为 NULL
-    //TODO:
-    if (val == NULL)
-        return NULL;
-
-    // 判断是否需要扩容
-    if (json->arr.count == json->arr.size)
+    pthread_mutex_lock(&reclaim_lock);
+    if (!reclaim_started)
     {
-        if (!expand(json))
+        // fork 出的子进程中没有后台线程，就地释放
+        while (reclaim_count)
         {
-            fprintf(stderr, "json_add_element: expand capacity failed!\n");
-            json_free(val);
-            val = NULL;
-            return NULL;
+            JSON *json = reclaim_queue[reclaim_head];
+            reclaim_head = (reclaim_head + 1) % RECLAIM_QUEUE;
+            reclaim_count--;
+            pthread_mutex_unlock(&reclaim_lock);
+            json_free(json);
+            pthread_mutex_lock(&reclaim_lock);
         }
     }
-
-    json->arr.elems[json->arr.count] = val;
-    json->arr.count++;
-    return val;
+    while (reclaim_count || reclaim_busy)
+        pthread_cond_wait(&reclaim_idle, &reclaim_lock);
+    pthread_mutex_unlock(&reclaim_lock);
 }
 
 #if ACTIVE_PLAN == 1
@@ -754,10 +7712,18 @@ static const JSON *get_child(const JSON *json, const char *key, json_e expect_ty
  */
 double json_obj_get_num(const JSON *json, const char *key, double def)
 {
-    const JSON *child = get_child(json, key, JSON_NUM);
-    if (!child)
-        return def;
-    return child->num;
+    return json_num(json_get_member(json, key), def);
+}
+/**
+ * 获取JSON对象中键名为key的整数值，如果获取不到，或者类型不对，返回def
+ * @param json json对象
+ * @param key  成员键名
+ * @param def  取不到结果时返回的默认值
+ * @return int64_t 获取到的整数值，JSON_NUM 的值见 json_int
+ */
+int64_t json_obj_get_int(const JSON *json, const char *key, int64_t def)
+{
+    return json_int(json_get_member(json, key), def);
 }
 /**
  * 获取JSON对象中键名为key的BOOL值，如果获取不到，或者类型不对，返回false
@@ -790,10 +7756,7 @@ BOOL json_obj_get_bool(const JSON *json, const char *key)
  */
 const char *json_obj_get_str(const JSON *json, const char *key, const char *def)
 {
-    const JSON *child = get_child(json, key, JSON_STR);
-    if (!child)
-        return def;
-    return child->str;
+    return json_str(get_child(json, key, JSON_STR), def);
 }
 
 /**
@@ -807,22 +7770,21 @@ const char *json_obj_get_str(const JSON *json, const char *key, const char *def)
  */
 static JSON *find_child(JSON *json, const char *key, json_e type)
 {
-    U32 i;
+    long i;
     assert(json);
     assert(json->type == JSON_OBJ);
-    assert(!(json->obj.count > 0 && json->obj.kvs == NULL));
+    if (write_reject(json, "find_child") || lazy_load(json) < 0)
+        return NULL;
+    assert(!(json->obj->count > 0 && json->obj->kvs == NULL));
     assert(key);
     assert(key[0]);
-    for (i = 0; i < json->obj.count; ++i)
-    {
-        if (strcmp(json->obj.kvs[i].key, key) == 0)
-        {
-            if (json->obj.kvs[i].val->type == type)
-            {
-                return json->obj.kvs[i].val;
-            }
-        }
-    }
+    i = obj_find(json->obj, key);
+    if (i < 0)
+        return NULL;
+    // 两种数字可以互相覆盖
+    json_e found = json->obj->kvs[i].val->type;
+    if (found == type || (type == JSON_NUM && found == JSON_INT))
+        return node_own(&json->obj->kvs[i].val);
     return NULL;
 }
 /**
@@ -839,6 +7801,7 @@ int json_obj_set_num(JSON *json, const char *key, double val)
     JSON *ret = find_child(json, key, JSON_NUM);
     if (ret)
     {
+        ret->type = JSON_NUM;
         ret->num = val;
         return 0;
     }
@@ -883,7 +7846,19 @@ int json_obj_set_str(JSON *json, const char *key, const char *val)
     JSON *ret = find_child(json, key, JSON_STR);
     if (ret)
     {
-        ret->str = strdup(val);
+        // val 可能就是旧值，先拷贝新值再释放旧值；分配失败时旧值保持不变
+        char buf[JSON_SSO_MAX + 1];
+        size_t len = strlen(val);
+        char *dup = NULL;
+        if (len > JSON_SSO_MAX && !(dup = str_dup(node_doc(ret), val, len)))
+            return -1;
+        if (!dup)
+            memcpy(buf, val, len);
+        str_release(ret);
+        if (dup)
+            ret->str = dup;
+        else
+            str_assign(ret, buf, len);
         return 0;
     }
     else
@@ -899,9 +7874,9 @@ int json_obj_set_str(JSON *json, const char *key, const char *val)
  */
 int json_arr_count(const JSON *json)
 {
-    if (!json || json->type != JSON_ARR)
+    if (!json || json->type != JSON_ARR || lazy_load(json) < 0)
         return -1;
-    return json->arr.count;
+    return json->arr->count;
 }
 
 /**
@@ -910,23 +7885,51 @@ int json_arr_count(const JSON *json)
  * @param idx 数组下标
  * @param def 获取失败时返回的缺省值
  * @return 成功时返回获取到的值，失败时返回 def
- * @details 调用 json_get_element
+ * @details 打包的数组直接读取原始值，否则调用 json_get_element
  */
 double json_arr_get_num(const JSON *json, int idx, double def)
 {
     //TODO:
+    if (json && json->flags & JSON_F_PACKED)
+    {
+        if ((U32)idx >= json->arr->count || json->etype == JSON_BOL)
+            return def;
+        return json->etype == JSON_NUM ? packed_nums(json)[idx] : (double)packed_ints(json)[idx];
+    }
     return json_num(json_get_element(json, idx), def);
 }
+/**
+ * @brief 根据下标获取 JSON_ARR 型 json 中的 JSON_INT 或 JSON_NUM 元素的整数值
+ * @return 成功时返回获取到的值，失败时返回 def
+ * @details 打包的数组直接读取原始值，小数按 json_int 转换
+ */
+int64_t json_arr_get_int(const JSON *json, int idx, int64_t def)
+{
+    if (json && json->flags & JSON_F_PACKED)
+    {
+        if ((U32)idx >= json->arr->count || json->etype == JSON_BOL)
+            return def;
+        if (json->etype == JSON_INT)
+            return packed_ints(json)[idx];
+        return num_to_int(packed_nums(json)[idx], def);
+    }
+    return json_int(json_get_element(json, idx), def);
+}
 
 BOOL json_arr_get_bool(const JSON *json, int idx)
 {
     //TODO:
+    if (json && json->flags & JSON_F_PACKED)
+        return json->etype == JSON_BOL && (U32)idx < json->arr->count ? packed_bools(json)[idx] : FALSE;
     return json_bool(json_get_element(json, idx));
 }
 
 const char *json_arr_get_str(const JSON *json, int idx, const char *def)
 {
     //TODO:
+    // 打包的数组中没有字符串
+    if (json && json->flags & JSON_F_PACKED)
+        return def;
     return json_str(json_get_element(json, idx), def);
 }
 
@@ -935,14 +7938,21 @@ const char *json_arr_get_str(const JSON *json, int idx, const char *def)
  * @param json 数组型 JSON 对象
  * @param val 要添加的数据
  * @return 添加成功返回 1，失败返回 -1
+ * @details 空数组或元素都是数值的数组按原始值打包存放，否则追加一个数值节点
  */
 int json_arr_add_num(JSON *json, double val)
 {
     assert(json);
     assert(json->type == JSON_ARR);
-    assert(!(json->arr.count > 0 && json->arr.elems == NULL));
+    assert(!(json->arr->count > 0 && json->arr->elems == NULL));
     //TODO:
-    if (!json_add_element(json, json_new_num(val)))
+    int packable = write_reject(json, "json_arr_add_num") || lazy_load(json) < 0 ? -1 : packed_reserve(json, JSON_NUM);
+    if (packable > 0)
+    {
+        packed_nums(json)[json->arr->count++] = val;
+        return 1;
+    }
+    if (packable < 0 || !json_add_element(json, new_num(node_doc(json), val)))
     {
         fprintf(stderr, "json_arr_add_num: add failed!\n");
         return -1;
@@ -952,20 +7962,51 @@ int json_arr_add_num(JSON *json, double val)
         return 1;
     }
 }
+/**
+ * @brief 向数组型 JSON 对象中添加 JSON_INT 型数据
+ * @param json 数组型 JSON 对象
+ * @param val 要添加的数据
+ * @return 添加成功返回 1，失败返回 -1
+ * @details 空数组或元素都是整数的数组按原始值打包存放，否则追加一个整数节点
+ */
+int json_arr_add_int(JSON *json, int64_t val)
+{
+    assert(json);
+    assert(json->type == JSON_ARR);
+    int packable = write_reject(json, "json_arr_add_int") || lazy_load(json) < 0 ? -1 : packed_reserve(json, JSON_INT);
+    if (packable > 0)
+    {
+        packed_ints(json)[json->arr->count++] = val;
+        return 1;
+    }
+    if (packable < 0 || !json_add_element(json, new_int(node_doc(json), val)))
+    {
+        fprintf(stderr, "json_arr_add_int: add failed!\n");
+        return -1;
+    }
+    return 1;
+}
 
 /**
  * @brief 向数组型 JSON 对象中添加 JSON_BOL 型数据
  * @param json 数组型 JSON 对象
  * @param val 要添加的数据
  * @return 添加成功返回 1，失败返回 -1
+ * @details 空数组或元素都是布尔值的数组按位打包存放，否则追加一个布尔节点
  */
 int json_arr_add_bool(JSON *json, BOOL val)
 {
     assert(json);
     assert(json->type == JSON_ARR);
-    assert(!(json->arr.count > 0 && json->arr.elems == NULL));
+    assert(!(json->arr->count > 0 && json->arr->elems == NULL));
     //TODO:
-    if (!json_add_element(json, json_new_bool(val)))
+    int packable = write_reject(json, "json_arr_add_bool") || lazy_load(json) < 0 ? -1 : packed_reserve(json, JSON_BOL);
+    if (packable > 0)
+    {
+        packed_bools(json)[json->arr->count++] = val;
+        return 1;
+    }
+    if (packable < 0 || !json_add_element(json, new_bool(node_doc(json), val)))
     {
         fprintf(stderr, "json_arr_add_bool: add failed!\n");
         return -1;
@@ -986,10 +8027,10 @@ int json_arr_add_str(JSON *json, const char *val)
 {
     assert(json);
     assert(json->type == JSON_ARR);
-    assert(!(json->arr.count > 0 && json->arr.elems == NULL));
+    assert(!(json->arr->count > 0 && json->arr->elems == NULL));
     assert(val);
     //TODO:
-    if (!json_add_element(json, json_new_str(val)))
+    if (!json_add_element(json, new_str(node_doc(json), val)))
     {
         fprintf(stderr, "json_arr_add_str: add failed!\n");
         return -1;
@@ -1001,243 +8042,55 @@ int json_arr_add_str(JSON *json, const char *val)
 }
 
 #elif ACTIVE_PLAN == 2
-/*
-json_get和json_get所使用的路径表达式语法：
-
-root ::= member | index;
-member ::= <name> child;
-index ::= '[' <number> ']' child;
-child ::= dot_member | index | EOF;
-dot_member ::= '.' member;
- */
-
-/**
- * @brief 交换两个json值的内容
- * 
- * @param lhs 左手侧JSON值
- * @param rhs 右手侧JSON值
- */
-static void json_swap(JSON *lhs, JSON *rhs)
-{
-    JSON tmp;
-    memcpy(&tmp, lhs, sizeof(tmp));
-    memcpy(lhs, rhs, sizeof(*lhs));
-    memcpy(rhs, &tmp, sizeof(tmp));
-}
-/**
- * @brief 路径解析的上下文
- */
-typedef struct query_ctx
-{
-    JSON *root;       //待查找的根JSON值
-    JSON *val;        //待替换的JSON值
-    const char *path; //原始路径
-} query_ctx;
-
-/**
- * @brief 处理查询结果
- * 
- * @param json  查找到的JSON值
- * @param val   需要替换的JSON值，如果val不为空，表示需要将json替换为val
- * @return const JSON* 查找结果
- */
-static const JSON *deal_query_result(JSON *json, JSON *val)
-{
-    assert(json);
-
-    if (val)
-    {
-        json_swap(json, val);
-        json_free(val);
-    }
-    return json;
-}
-/**
- * @brief 报告路径解析过程发现的语法错误
- * 
- * @param ctx   路径解析的上下文
- * @param info  错误说明
- * @param cur   出错位置
- */
-static void report_syntax_error(const query_ctx *ctx, const char *info, const char *cur)
-{
-    fprintf(stderr, "%s\n", info);
-    fprintf(stderr, "path: %s\n", ctx->path);
-    fprintf(stderr, "%*s^\n", (int)(cur - ctx->path + 6), " ");
-}
-
-static const JSON *query_child(const query_ctx *ctx, JSON *json, const char *cur);
-
-/**
- * @brief 期待解析结束，即希望接下来的是结束符
- * 
- * @param json  JSON值
- * @param cur   当前解析位置
- * @param val   待替换的JSON值。val为NULL，表示只查询，否则将查到的子孙成员值替换为val
- * @return const JSON* 查找到的子孙成员
- */
-static const JSON *query_eof(const query_ctx *ctx, JSON *json, const char *cur)
-{
-    assert(ctx);
-    assert(json);
-    assert(cur);
-
-    if (*cur == '\0')
-    {
-        return deal_query_result(json, ctx->val);
-    }
-    else
-    {
-        report_syntax_error(ctx, "JSON path invalid", cur);
-        json_free(ctx->val);
-        return NULL;
-    }
-}
-/**
- * @brief 在JSON值json中查询MEMBER表达式cur对应的子孙成员
- * 
- * @param json  JSON值
- * @param cur  MEMBER表达式
- * @param val   待替换的JSON值。val为NULL，表示只查询，否则将查到的子孙成员值替换为val
- * @return const JSON* 查找到的子孙成员
- */
-static const JSON *query_member(const query_ctx *ctx, JSON *json, const char *cur)
-{
-    //TODO:
-    return NULL;
-}
-/**
- * @brief 在JSON值json中查询DOT_MEMBER表达式cur对应的子孙成员
- * 
- * @param json  JSON值
- * @param cur  DOT_MEMBER表达式
- * @param val   待替换的JSON值。val为NULL，表示只查询，否则将查到的子孙成员值替换为val
- * @return const JSON* 查找到的子孙成员
- */
-static const JSON *query_dot_member(const query_ctx *ctx, JSON *json, const char *cur)
-{
-    assert(ctx);
-    assert(json);
-    assert(json->type == JSON_OBJ);
-    assert(cur);
-
-    if (*cur == '.')
-    {
-        if (cur[1] == '\0')
-        {
-            report_syntax_error(ctx, "unexpected end", cur);
-            json_free(ctx->val);
-            return NULL;
-        }
-        return query_member(ctx, json, cur + 1);
-    }
-    else
-    {
-        return query_eof(ctx, json, cur);
-    }
-}
-/**
- * @brief 在JSON值json中查询INDEX表达式cur对应的子孙成员
- * 
- * @param json  JSON值
- * @param cur  INDEX表达式
- * @param val   待替换的JSON值。val为NULL，表示只查询，否则将查到的子孙成员值替换为val
- * @return const JSON* 查找到的子孙成员
- */
-static const JSON *query_index(const query_ctx *ctx, JSON *json, const char *cur)
-{
-    //TODO:
-    return NULL;
-}
-/**
- * @brief 在JSON值json中查询CHILD表达式cur对应的子孙成员
- * 
- * @param json  JSON值
- * @param cur  CHILD表达式
- * @param val   待替换的JSON值。val为NULL，表示只查询，否则将查到的子孙成员值替换为val
- * @return const JSON* 查找到的子孙成员
- */
-static const JSON *query_child(const query_ctx *ctx, JSON *json, const char *cur)
-{
-    assert(ctx);
-    assert(json);
-    assert(cur);
-
-    switch (json_type(json))
-    {
-    case JSON_NUM:
-    case JSON_STR:
-    case JSON_BOL:
-    case JSON_NONE:
-        return query_eof(ctx, json, cur);
-    case JSON_ARR:
-        return query_index(ctx, json, cur);
-    case JSON_OBJ:
-        return query_dot_member(ctx, json, cur);
-    default:
-        assert(!"dead code");
-        return NULL;
-    }
-}
-
-/**
- * @brief 在JSON值json中查询ROOT表达式cur对应的子孙成员
- * 
- * @param json  JSON值
- * @param cur  ROOT表达式
- * @param val   待替换的JSON值。val为NULL，表示只查询，否则将查到的子孙成员值替换为val
- * @return const JSON* 查找到的子孙成员
- */
-static const JSON *query_root(JSON *json, const char *path, JSON *val)
-{
-    query_ctx ctx = {0};
-
-    assert(json);
-    assert(path);
-
-    ctx.root = json;
-    ctx.path = path;
-    ctx.val = val;
-
-    if (json_type(json) == JSON_OBJ)
-    {
-        return query_member(&ctx, json, path);
-    }
-    else
-    {
-        return query_child(&ctx, json, path);
-    }
-}
 /**
  * 在JSON值json中找到路径为path的成员，将其值修改为val
  * @param json JSON值
  * @param path 待修改成员的路径，如：basic.dns[1]，空串表示本身
  * @param val 新的值
  * @return <0表示失败，否则表示成功
+ * @details 成员不存在时的处理见 json_set_compiled
  */
 int json_set(JSON *json, const char *path, JSON *val)
 {
+    json_path *compiled;
+    int ret;
+
     assert(json);
     assert(path);
 
     if (!val)
         return -1;
-    if (query_root(json, path, val))
-        return 0;
-    return -1;
+    compiled = json_path_compile(path);
+    if (!compiled)
+    {
+        json_free(val);
+        return -1;
+    }
+    ret = json_set_compiled(json, compiled, val);
+    json_path_free(compiled);
+    return ret;
 }
 /**
  * 在JSON值json中找到路径为path的成员
  * @param json JSON值
  * @param path 路径表达式，待查找成员的路径，如：basic.dns[1]，空串表示本身
  * @return 路径path指示的成员值，不存在则返回NULL
+ * @details 每次调用都要编译路径，频繁查询同一路径时应使用 json_path_compile 和 json_get_compiled
  */
 const JSON *json_get(const JSON *json, const char *path)
 {
+    json_path *compiled;
+    const JSON *ret;
+
     assert(json);
     assert(path);
 
-    return query_root((JSON *)json, path, NULL);
+    compiled = json_path_compile(path);
+    if (!compiled)
+        return NULL;
+    ret = json_get_compiled(json, compiled);
+    json_path_free(compiled);
+    return ret;
 }
 #elif ACTIVE_PLAN == 3
 /**
@@ -1283,7 +8136,7 @@ int json_get_int(const JSON *json, const char *path, int def)
     const JSON *child = json_get_value(json, path);
     if (!child)
         return def;
-    return (int)json_num(child, def);
+    return (int)json_int(child, def);
 }
 /**
  * @brief 从JSON值json中读取一个BOOL类型配置项的值，配置项的位置由路径path标识
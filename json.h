@@ -1,6 +1,9 @@
 #ifndef JSON_H_
 #define JSON_H_
 
+#include <stddef.h>
+#include <stdint.h>
+
 /**
  *  想想：
  *  1. 你的JSON接口是为什么场景设计的？
@@ -17,6 +20,7 @@ typedef enum json_e
     JSON_STR, //字符串类型
     JSON_ARR, //数组类型
     JSON_OBJ, //对象类型
+    JSON_INT, //64 位整数类型，没有小数部分和指数的数字解析为该类型
 } json_e;
 
 typedef unsigned int BOOL;
@@ -27,8 +31,10 @@ typedef struct value JSON;
 #define TRUE 1
 #define FALSE 0
 
-// 启用第几套方案
+// 启用第几套方案，可在编译时用 -DACTIVE_PLAN=n 指定
+#ifndef ACTIVE_PLAN
 #define ACTIVE_PLAN 1
+#endif
 
 // 通过 json_e 创建制定类型的 JSON
 JSON *json_new(json_e type);
@@ -36,15 +42,29 @@ JSON *json_new(json_e type);
 json_e json_type(const JSON *json);
 // 释放 JSON 占用的内存
 void json_free(JSON *json);
+// 把 json 交给后台线程释放并立即返回，用于不能被大树的释放阻塞的线程；队列满时就地释放
+void json_free_async(JSON *json);
+// 等待此前交给 json_free_async 的值全部释放完毕
+void json_free_drain(void);
 
 // 将 JSON 存储在文件中
 int json_save(const JSON *json, const char *fname);
+// 增量保存：json_save_begin 打开文件，json_save_step 每次最多输出 budget 个值，
+// 返回 1 表示还有剩余、0 表示完成、-1 表示出错；json_save_end 关闭文件，完整写入返回 0
+// 输出完成之前 json 不能被修改或释放，输出结果与 json_save 相同
+typedef struct json_saver json_saver;
+json_saver *json_save_begin(const JSON *json, const char *fname);
+int json_save_step(json_saver *s, size_t budget);
+int json_save_end(json_saver *s);
 
 double json_num(const JSON *json, double def);
+// 获取整数值；JSON_NUM 的值截去小数部分，超出 int64_t 范围时返回 def
+int64_t json_int(const JSON *json, int64_t def);
 BOOL json_bool(const JSON *json);
 const char *json_str(const JSON *json, const char *def);
 
 JSON *json_new_num(double val);
+JSON *json_new_int(int64_t val);
 JSON *json_new_bool(BOOL val);
 JSON *json_new_str(const char *str);
 
@@ -57,6 +77,21 @@ const JSON *json_get_element(const JSON *json, U32 idx);
 JSON *json_add_member(JSON *json, const char *key, JSON *val);
 // 向 JSON 数组中添加新成员，直接加在数组后面
 JSON *json_add_element(JSON *json, JSON *val);
+
+// 键名原子：对象中的键名都指向共享的原子，原子中记录了键名的长度和哈希值
+typedef struct json_key
+{
+    U32 refs;        // 引用计数，JSON_KEY_STATIC 表示不计数
+    U32 hash;        // 键名的哈希值，0 表示尚未计算
+    U32 len;         // 键名的长度
+    const char *str; // 键名
+} json_key;
+
+#define JSON_KEY_STATIC 0xFFFFFFFFu
+// 定义静态的键名原子，如：static json_key key_ip = JSON_KEY_INIT("ip");
+#define JSON_KEY_INIT(lit) {JSON_KEY_STATIC, 0, sizeof(lit) - 1, lit}
+// 同 json_add_member，键名使用静态的键名原子 key，不拷贝；key 必须比 json 存活得更久
+JSON *json_add_member_key(JSON *json, json_key *key, JSON *val);
 /*
 在完成API的设计初稿的时候，要写个demo，验证API设计OK，并找到API实现当中需要注意的问题。
 比如下述代码，如果要这样写，对json_new，json_add_member有什么要求？怎么保证内存不会泄漏？不出错？
@@ -85,11 +120,13 @@ json_free(json);
 //  方案1
 //-----------------------------------------------------------------------------
 double json_obj_get_num(const JSON *json, const char *key, double def);
+int64_t json_obj_get_int(const JSON *json, const char *key, int64_t def);
 BOOL json_obj_get_bool(const JSON *json, const char *key);
 const char *json_obj_get_str(const JSON *json, const char *key, const char *def);
 
 int json_arr_count(const JSON *json);
 double json_arr_get_num(const JSON *json, int idx, double def);
+int64_t json_arr_get_int(const JSON *json, int idx, int64_t def);
 BOOL json_arr_get_bool(const JSON *json, int idx);
 const char *json_arr_get_str(const JSON *json, int idx, const char *def);
 
@@ -98,6 +135,7 @@ int json_obj_set_bool(JSON *json, const char *key, BOOL val);
 int json_obj_set_str(JSON *json, const char *key, const char *val);
 
 int json_arr_add_num(JSON *json, double val);
+int json_arr_add_int(JSON *json, int64_t val);
 int json_arr_add_bool(JSON *json, BOOL val);
 int json_arr_add_str(JSON *json, const char *val);
 
@@ -175,4 +213,191 @@ json_free(json);
 //  TODO: 增加你认为还应该增加的接口
 //-----------------------------------------------------------------------------
 
+// 解析内存中长度为 len 的 JSON 文本，失败返回 NULL
+JSON *json_parse(const char *buf, size_t len);
+// 从文件中读取并解析 JSON 文本，失败返回 NULL
+JSON *json_load(const char *fname);
+// 只做解析的第一阶段（结构扫描），count 输出结构字符的个数；字符串未闭合时返回 -1，成功返回 0
+int json_scan(const char *buf, size_t len, size_t *count);
+
+// JSON 文档：节点、字符串和成员数组都从文档的内存池中分配，随文档一起释放
+typedef struct json_doc json_doc;
+
+json_doc *json_doc_new(void);
+// 释放文档及其中所有的 JSON 值；对文档中的 JSON 值调用 json_free 不做任何事
+void json_doc_free(json_doc *doc);
+// 清空文档中所有的 JSON 值，保留内存供下次使用
+void json_doc_reset(json_doc *doc);
+
+// 自定义内存分配：align 为 JSON_ALLOC_ALIGN、文档内存块或 slab 大块的大小（2 的幂），失败返回 NULL
+#define JSON_ALLOC_ALIGN 16
+typedef void *(*json_alloc_fn)(void *user, size_t size, size_t align);
+// ptr 不为 NULL，old_size 是它原来的大小
+typedef void *(*json_realloc_fn)(void *user, void *ptr, size_t old_size, size_t new_size);
+// ptr 不为 NULL
+typedef void (*json_free_fn)(void *user, void *ptr);
+// doc 为 NULL 时设置全局分配器，须在分配任何 JSON 值之前调用；否则设置文档内存块的分配器，文档须为空
+// 堆中的节点和小的成员数组先经过线程缓存的 slab，slab 的大块从全局分配器申请；编译时定义 JSON_NO_SLAB 可关闭
+// 三个函数都为 NULL 时恢复为 malloc、realloc 和 free；成功返回 0，失败返回 -1
+int json_set_allocator(json_doc *doc, json_alloc_fn alloc_fn, json_realloc_fn realloc_fn, json_free_fn free_fn,
+                       void *user);
+// 把完全空闲的 slab 大块还给申请它时的分配器，当前线程缓存的对象先还给全局仓库；长期运行的程序释放大量 JSON 后可以调用
+void json_slab_trim(void);
+
+// 内存统计的直方图桶数：深度直方图按层计数，最后一个桶包含更深的层；扇出直方图的桶为 0、1、2~3、4~7、……
+#define JSON_STATS_BUCKETS 16
+typedef struct json_mem_stats
+{
+    size_t values[JSON_INT + 1];       // 各类型 JSON 值的个数，打包数组的元素按元素类型计入
+    size_t nodes;                      // 节点个数，打包数组的元素没有节点
+    size_t lazy;                       // 尚未展开的对象和数组个数，其成员不计入统计
+    size_t node_bytes;                 // 节点及容器头部占用的字节数
+    size_t string_bytes;               // 字符串单独占用的字节数，内联的和指向映射文件的字符串不计
+    size_t key_bytes;                  // 键名原子占用的字节数，共享的原子只计一次
+    size_t keys;                       // 不同的键名原子个数
+    size_t container_bytes;            // 成员数组、键值对数组（含哈希索引）和打包存储占用的字节数
+    size_t slack_bytes;                // 成员数组中已分配但未使用的字节数，即 (容量 - 成员个数) * 成员大小
+    size_t arena_bytes;                // 文档内存池申请的字节数，只有 json_doc_stats 填写
+    size_t arena_used;                 // 文档内存池中已分配出去的字节数，只有 json_doc_stats 填写
+    U32 max_depth;                     // 最大嵌套深度，根为第 0 层
+    size_t depth[JSON_STATS_BUCKETS];  // 每一层的 JSON 值个数
+    size_t fanout[JSON_STATS_BUCKETS]; // 按成员个数分桶的容器个数
+} json_mem_stats;
+// 遍历 json 统计内存占用，不展开延迟加载的子树；成功返回 0，失败返回 -1
+int json_stats(const JSON *json, json_mem_stats *out);
+// json 及其所有子成员占用的总字节数：节点、字符串、键名和成员数组之和
+size_t json_memory_usage(const JSON *json);
+// 不遍历，直接读取文档分配时累加的计数器；文档中新建过的值都计入，不论是否还在树中
+// 只填写类型计数、各类字节数和内存池用量，slack_bytes、深度和扇出为 0；打包数组的元素不计入 values
+int json_doc_stats(const json_doc *doc, json_mem_stats *out);
+
+// 遍历时一个值所在的位置
+typedef struct json_walk_pos
+{
+    const struct json_walk_pos *up; // 父节点的位置，根节点为 NULL
+    const JSON *parent;             // 父节点，根节点为 NULL
+    const json_key *key;            // 对象成员的键名，数组元素和根节点为 NULL
+    U32 index;                      // 在父节点中的下标
+    U32 depth;                      // 嵌套深度，根节点为 0
+    void *data;                     // 由访问者在 enter 中为数组和对象设置，子成员通过 up->data 读取
+} json_walk_pos;
+// 访问者：enter 在访问子成员之前调用，返回 0 继续，返回 JSON_WALK_SKIP 跳过子成员，返回负数终止遍历；
+// leave 在数组和对象的子成员都访问完之后调用，可以为 NULL。打包数组的元素没有节点，不单独访问
+typedef struct json_visitor
+{
+    int (*enter)(void *ctx, const JSON *json, json_walk_pos *pos);
+    int (*leave)(void *ctx, const JSON *json, const json_walk_pos *pos);
+} json_visitor;
+#define JSON_WALK_SKIP 1
+// 深度优先、非递归地遍历 json，嵌套再深也不会栈溢出，延迟加载的子树会被展开；
+// 成功返回 0，访问者返回负数时返回该值，展开失败返回 -1
+int json_walk(const JSON *json, const json_visitor *visitor, void *ctx);
+
+// 在文档中创建 JSON 值，文档中的对象和数组只能添加同一文档中的值
+JSON *json_doc_new_value(json_doc *doc, json_e type);
+JSON *json_doc_new_num(json_doc *doc, double val);
+JSON *json_doc_new_int(json_doc *doc, int64_t val);
+JSON *json_doc_new_bool(json_doc *doc, BOOL val);
+JSON *json_doc_new_str(json_doc *doc, const char *str);
+
+// 解析 JSON 文本，结果分配在文档中
+JSON *json_doc_parse(json_doc *doc, const char *buf, size_t len);
+JSON *json_doc_load(json_doc *doc, const char *fname);
+
+// 把文件映射到内存中就地解析，字符串直接指向映射区；映射随文档的重置或释放一起解除
+JSON *json_doc_load_mmap(json_doc *doc, const char *fname);
+// 同上，节点分配在一个内部文档中，对返回值调用 json_free 时释放整个文档
+JSON *json_load_mmap(const char *fname);
+
+// 延迟加载：只建立结构索引，对象和数组在第一次访问成员时才逐层解析，未访问的子树不分配节点
+// 访问会修改文档，同一个文档不能被多个线程同时访问；子树中的语法错误在访问时报告，该子树按不存在处理
+JSON *json_doc_load_lazy(json_doc *doc, const char *fname);
+// 同上，节点分配在一个内部文档中，对返回值调用 json_free 时释放整个文档
+JSON *json_load_lazy(const char *fname);
+
+// 把 json 拷贝到一整块连续内存中：按深度优先的顺序排列，成员数组没有空余容量，延迟加载的子树会被展开
+// 原来的 json 保持不变；对返回值调用 json_free 时释放整块内存，失败返回 NULL
+JSON *json_compact(const JSON *json);
+
+// 把 json 写成冻结映像：节点、键名表和字符串池按原样排列，指针可以重定位；成功返回 0，失败返回 -1
+int json_freeze(const JSON *json, const char *fname);
+// 映射冻结映像直接读取，不解析也不分配节点，各进程尽量共享页面；映像只读，修改接口返回失败
+// 对返回值调用 json_free 时解除映射；失败返回 NULL
+JSON *json_open_frozen(const char *fname);
+
+// json_load_lines 的回调，offset 为记录在文件中的偏移；返回 0 继续，返回非 0 停止加载
+// record 分配在工作线程的文档中，只在回调期间有效
+typedef int (*json_line_cb)(void *ctx, JSON *record, size_t offset);
+// 用 nthreads 个线程并行加载 JSON Lines 文件（每行一个 JSON 值），nthreads 不大于 0 时使用全部 CPU
+// ordered 为 TRUE 时按文件中的顺序回调；回调不会被并发调用。全部成功返回 0，否则返回 -1
+int json_load_lines(const char *fname, int nthreads, json_line_cb cb, void *ctx, BOOL ordered);
+
+// 流式解析的回调，返回 0 继续解析，返回非 0 终止解析；不需要的回调可以为 NULL
+// 键名和字符串以 '\0' 结尾，只在回调期间有效
+typedef struct json_handler
+{
+    int (*start_object)(void *ctx);
+    int (*end_object)(void *ctx);
+    int (*start_array)(void *ctx);
+    int (*end_array)(void *ctx);
+    int (*key)(void *ctx, const char *key, size_t len);
+    int (*string)(void *ctx, const char *str, size_t len);
+    int (*number)(void *ctx, double num);
+    int (*boolean)(void *ctx, BOOL val);
+    int (*null)(void *ctx);
+    // 能用 int64_t 精确表示的整数；为 NULL 时整数也交给 number
+    int (*integer)(void *ctx, int64_t num);
+} json_handler;
+
+// 流式解析器：文本可以分成任意大小的块依次输入，内存占用只与嵌套深度和最长的标量有关
+typedef struct json_parser json_parser;
+
+json_parser *json_parser_new(const json_handler *handler, void *ctx);
+// 边解析边构建 JSON 树，节点分配在 doc 中，doc 为 NULL 时分配在堆中
+json_parser *json_parser_new_tree(json_doc *doc);
+// 输入一块文本，出错返回 -1，之后的输入全部拒绝
+int json_parser_feed(json_parser *p, const char *chunk, size_t len);
+// 输入结束，恰好是一个完整的 JSON 值时返回 0
+int json_parser_finish(json_parser *p);
+// 取走 json_parser_new_tree 构建的 JSON 树，解析未成功结束时返回 NULL
+JSON *json_parser_root(json_parser *p);
+void json_parser_free(json_parser *p);
+
+// 编译后的路径表达式，各套方案都可以使用
+typedef struct json_path json_path;
+
+// 编译路径表达式，如：basic.dns[1]，空串表示 JSON 值本身；语法错误返回 NULL
+json_path *json_path_compile(const char *path);
+void json_path_free(json_path *path);
+// 按编译后的路径查找成员，不存在则返回 NULL
+const JSON *json_get_compiled(const JSON *json, const json_path *path);
+// 按编译后的路径修改成员的值，最后一级成员不存在时新建，val 的所有权一并转移；失败返回 -1
+int json_set_compiled(JSON *json, const json_path *path, JSON *val);
+
+// 快照：返回一个新的根节点，所有子成员与 json 共享（写时复制），失败返回 NULL；各版本分别用 json_free 释放
+// 通过根节点修改时（json_set_compiled，或直接对根节点调用 json_add_member、json_obj_set_* 等）
+// 只拷贝从根到被修改成员的路径；共享的子成员不能就地修改。同一个版本不能被多个线程同时修改
+JSON *json_snapshot(const JSON *json);
+
+// 发布槽：一个线程用 json_publish 换入新版本，其他线程用 json_acquire/json_release 无锁读取，
+// 旧版本在所有读者离开之后用 json_free 释放
+typedef struct json_slot json_slot;
+// 新建发布槽，初始版本 json 的所有权转移给发布槽，可以为 NULL；失败返回 NULL
+json_slot *json_slot_new(JSON *json);
+// 释放发布槽及其中所有版本，调用者保证此后没有线程再读取它
+void json_slot_free(json_slot *slot);
+// 用 json 替换当前版本，json 的所有权转移给发布槽
+void json_publish(json_slot *slot, JSON *json);
+// 进入读区并返回当前版本，返回值在配对的 json_release 之前有效，可以嵌套
+const JSON *json_acquire(json_slot *slot);
+// 离开 json_acquire 进入的读区
+void json_release(void);
+
+// 存放 json_num_to_str 结果所需的缓冲区大小
+#define JSON_NUM_BUF 32
+// 将数字格式化为能精确还原的最短十进制字符串，结果不以 '\0' 结尾，返回字符串长度
+int json_num_to_str(double num, char *buf);
+// 将 64 位整数格式化为十进制字符串，buf 至少 JSON_NUM_BUF 字节，返回长度，结果不以 '\0' 结尾
+int json_int_to_str(int64_t num, char *buf);
+
 #endif
@@ -3,6 +3,10 @@
 #include <stdio.h>
 #include <assert.h>
 #include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
 
 //  完整使用场景的测试
 TEST(test, scene)
@@ -123,6 +127,63 @@ TEST(json_add_member, val_is_null)
     json_free(json);
 }
 
+// 测试静态的键名原子与普通键名混用
+TEST(json_add_member, static_key)
+{
+    static json_key key_ip = JSON_KEY_INIT("ip");
+    JSON *json = json_new(JSON_OBJ);
+    ASSERT_TRUE(json != NULL);
+
+    ASSERT_TRUE(json_add_member_key(json, &key_ip, json_new_str("200.200.0.1")) != NULL);
+    ASSERT_STREQ("200.200.0.1", json_obj_get_str(json, "ip", NULL));
+    ASSERT_TRUE(key_ip.hash != 0);
+    // 用普通键名覆盖，再用静态键名覆盖
+    ASSERT_TRUE(json_add_member(json, "ip", json_new_str("200.200.0.2")) != NULL);
+    ASSERT_TRUE(json_add_member_key(json, &key_ip, json_new_str("200.200.0.3")) != NULL);
+    ASSERT_STREQ("200.200.0.3", json_obj_get_str(json, "ip", NULL));
+    ASSERT_TRUE(json_add_member_key(json, &key_ip, NULL) == NULL);
+
+    // 大对象按哈希索引查找
+    char key[16];
+    for (int i = 0; i < 40; i++)
+    {
+        sprintf(key, "k%d", i);
+        ASSERT_TRUE(json_add_member(json, key, json_new_num(i)) != NULL);
+    }
+    ASSERT_TRUE(json_add_member_key(json, &key_ip, json_new_str("200.200.0.4")) != NULL);
+    ASSERT_STREQ("200.200.0.4", json_obj_get_str(json, "ip", NULL));
+    EXPECT_EQ(39, json_obj_get_num(json, "k39", 0));
+    json_free(json);
+}
+
+// 测试解析时共享的键名：重复键名覆盖的子树被释放后，其他对象中的同名键名仍然有效
+TEST(json_add_member, shared_keys)
+{
+    const char *text = "{\"a\": {\"x\": 1, \"y\": 2}, \"a\": 2, \"b\": {\"x\": 3, \"k\\u0065y\": 4}, \"c\": [{\"y\": 5}]}";
+    JSON *json = json_parse(text, strlen(text));
+    ASSERT_TRUE(json);
+    EXPECT_EQ(2, json_obj_get_num(json, "a", 0));
+    EXPECT_EQ(3, json_obj_get_num(json_get_member(json, "b"), "x", 0));
+    EXPECT_EQ(4, json_obj_get_num(json_get_member(json, "b"), "key", 0));
+    EXPECT_EQ(5, json_obj_get_num(json_get_element(json_get_member(json, "c"), 0), "y", 0));
+    json_free(json);
+
+    // 文档中的键名在整个文档内共享，重置后重新驻留
+    json_doc *doc = json_doc_new();
+    ASSERT_TRUE(doc);
+    for (int i = 0; i < 2; i++)
+    {
+        json_doc_reset(doc);
+        json = json_doc_parse(doc, text, strlen(text));
+        ASSERT_TRUE(json);
+        JSON *b = (JSON *)json_get_member(json, "b");
+        ASSERT_TRUE(json_add_member(b, "y", json_doc_new_num(doc, 6)) != NULL);
+        EXPECT_EQ(6, json_obj_get_num(b, "y", 0));
+        EXPECT_EQ(5, json_obj_get_num(json_get_element(json_get_member(json, "c"), 0), "y", 0));
+    }
+    json_doc_free(doc);
+}
+
 //----------------------------------------------------------------------------------------------------
 //  json_add_element
 //----------------------------------------------------------------------------------------------------
@@ -246,6 +307,31 @@ TEST(json_new_str, empty_string2)
     json_free(json);
 }
 
+// 测试内联存放的短字符串与单独分配的长字符串的分界
+TEST(json_new_str, inline_boundary)
+{
+    const char *s12 = "200.200.0.20";
+    const char *s13 = "200.200.0.201";
+    JSON *arr = json_new(JSON_ARR);
+    ASSERT_TRUE(arr);
+    ASSERT_TRUE(json_add_element(arr, json_new_str(s12)));
+    ASSERT_TRUE(json_add_element(arr, json_new_str(s13)));
+    ASSERT_STREQ(s12, json_arr_get_str(arr, 0, NULL));
+    ASSERT_STREQ(s13, json_arr_get_str(arr, 1, NULL));
+
+    // 解析得到的短字符串在还原转义序列后存放在节点中
+    const char *text = "[\"200.200.0.20\", \"200.200.0.201\", \"a\\tb\\u4e2d\", \"\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\\"]";
+    JSON *json = json_parse(text, strlen(text));
+    ASSERT_TRUE(json);
+    ASSERT_STREQ(s12, json_arr_get_str(json, 0, NULL));
+    ASSERT_STREQ(s13, json_arr_get_str(json, 1, NULL));
+    ASSERT_STREQ("a\tb\xe4\xb8\xad", json_arr_get_str(json, 2, NULL));
+    ASSERT_STREQ("\\\\\\\\\\\\\\\\", json_arr_get_str(json, 3, NULL));
+
+    json_free(json);
+    json_free(arr);
+}
+
 //----------------------------------------------------------------------------------------------------
 //  json_arr_add_str
 //----------------------------------------------------------------------------------------------------
@@ -477,6 +563,32 @@ TEST(json_get_member, nonexist)
     json_free(json);
 }
 
+// 测试建立了哈希索引的大对象
+TEST(json_get_member, large_object)
+{
+    char key[32];
+    JSON *json = json_new(JSON_OBJ);
+    ASSERT_TRUE(json);
+
+    for (int i = 0; i < 10000; i++)
+    {
+        sprintf(key, "key%d", i);
+        ASSERT_TRUE(json_add_member(json, key, json_new_num(i)));
+    }
+    // 覆盖已有的键名，不增加成员
+    ASSERT_TRUE(json_add_member(json, "key5000", json_new_num(-1)));
+    ASSERT_TRUE(json_obj_set_num(json, "key9999", -2) == 0);
+
+    for (int i = 0; i < 10000; i++)
+    {
+        sprintf(key, "key%d", i);
+        double expect = i == 5000 ? -1 : i == 9999 ? -2 : i;
+        ASSERT_TRUE(json_obj_get_num(json, key, 0) == expect);
+    }
+    ASSERT_TRUE(!json_get_member(json, "key10000"));
+    json_free(json);
+}
+
 //----------------------------------------------------------------------------------------------------
 //  json_obj_get_str
 //----------------------------------------------------------------------------------------------------
@@ -797,6 +909,79 @@ TEST(json_save, arr_embed_obj_arr)
     json_free(json);
 }
 
+// 测试建立哈希索引后，成员仍然按插入顺序输出
+TEST(json_save, large_object_order)
+{
+    char key[32];
+    char expect[512] = "";
+    buf_t result;
+    JSON *json = json_new(JSON_OBJ);
+    ASSERT_TRUE(json);
+
+    for (int i = 20; i > 0; i--)
+    {
+        sprintf(key, "k%d", i);
+        ASSERT_TRUE(json_add_member(json, key, json_new_num(i)));
+        sprintf(expect + strlen(expect), "k%d: %d\n", i, i);
+    }
+    EXPECT_EQ(0, json_save(json, "test.yml"));
+    EXPECT_EQ(0, read_file(&result, "test.yml"));
+
+    ASSERT_TRUE(strcmp(result.str, expect) == 0);
+    free(result.str);
+    json_free(json);
+}
+
+// 测试缩进超过空格表长度的深层嵌套
+TEST(json_save, deep_indent)
+{
+    buf_t result;
+    JSON *json = json_new(JSON_OBJ);
+    ASSERT_TRUE(json);
+
+    JSON *cur = json;
+    for (int i = 0; i < 40; i++)
+    {
+        JSON *child = json_new(JSON_OBJ);
+        ASSERT_TRUE(json_add_member(cur, "k", child));
+        cur = child;
+    }
+    ASSERT_TRUE(json_add_member(cur, "v", json_new_num(1)));
+
+    EXPECT_EQ(0, json_save(json, "test.yml"));
+    EXPECT_EQ(0, read_file(&result, "test.yml"));
+
+    // 最后一行缩进 80 个空格
+    const char *last = strrchr(result.str, 'v');
+    ASSERT_TRUE(last && last - result.str >= 80);
+    ASSERT_TRUE(strcmp(last, "v: 1\n") == 0);
+    for (int i = 1; i <= 80; i++)
+        ASSERT_TRUE(last[-i] == ' ');
+    ASSERT_TRUE(last[-81] == '\n');
+    free(result.str);
+    json_free(json);
+}
+
+// 测试超过缓冲区大小的输出
+TEST(json_save, large_output)
+{
+    buf_t result;
+    JSON *json = json_new(JSON_ARR);
+    ASSERT_TRUE(json);
+
+    for (int i = 0; i < 100000; i++)
+        ASSERT_TRUE(json_arr_add_str(json, "200.200.0.1") == 1);
+
+    EXPECT_EQ(0, json_save(json, "test.yml"));
+    EXPECT_EQ(0, read_file(&result, "test.yml"));
+
+    ASSERT_TRUE(result.size == 100000 * strlen("- 200.200.0.1\n") + 1);
+    for (int i = 0; i < 100000; i++)
+        ASSERT_TRUE(strncmp(result.str + i * 14, "- 200.200.0.1\n", 14) == 0);
+    free(result.str);
+    json_free(json);
+}
+
 //----------------------------------------------------------------------------------------------------
 //  json_type
 //----------------------------------------------------------------------------------------------------
@@ -1305,6 +1490,2156 @@ TEST(json_obj_set_str, key_exist_no_json_str)
     json_free(json);
 }
 
+// 测试在内联的短字符串和单独分配的长字符串之间来回修改，以及用旧值本身修改
+TEST(json_obj_set_str, inline_switch)
+{
+    const char *s = "a string longer than fifteen bytes";
+    JSON *json = json_new(JSON_OBJ);
+    ASSERT_TRUE(json);
+    ASSERT_TRUE(json_add_member(json, "he", json_new_str("ip")));
+
+    ASSERT_TRUE(json_obj_set_str(json, "he", s) == 0);
+    ASSERT_STREQ(s, json_obj_get_str(json, "he", NULL));
+    ASSERT_TRUE(json_obj_set_str(json, "he", json_obj_get_str(json, "he", NULL)) == 0);
+    ASSERT_STREQ(s, json_obj_get_str(json, "he", NULL));
+
+    ASSERT_TRUE(json_obj_set_str(json, "he", "200.200.0.1") == 0);
+    ASSERT_STREQ("200.200.0.1", json_obj_get_str(json, "he", NULL));
+    ASSERT_TRUE(json_obj_set_str(json, "he", json_obj_get_str(json, "he", NULL)) == 0);
+    ASSERT_STREQ("200.200.0.1", json_obj_get_str(json, "he", NULL));
+
+    json_free(json);
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_parse
+//----------------------------------------------------------------------------------------------------
+
+// 测试读取完整的配置文件
+TEST(json_load, scene)
+{
+    JSON *json = json_load("json-test.json");
+    ASSERT_TRUE(json);
+
+    const JSON *basic = json_get_member(json, "basic");
+    ASSERT_TRUE(basic);
+    EXPECT_EQ(TRUE, json_obj_get_bool(basic, "enable"));
+    EXPECT_EQ(389, json_obj_get_num(basic, "port", 0));
+    EXPECT_EQ(-1, json_obj_get_num(basic, "fd", 0));
+    EXPECT_TRUE(json_obj_get_num(basic, "maxcnt", 0) == 133333333333.0);
+    ASSERT_STREQ("200.200.3.61", json_obj_get_str(basic, "ip", NULL));
+    const JSON *dns = json_get_member(basic, "dns");
+    EXPECT_EQ(2, json_arr_count(dns));
+    ASSERT_STREQ("200.0.0.254", json_arr_get_str(dns, 1, NULL));
+
+    const JSON *advance = json_get_member(json, "advance");
+    ASSERT_TRUE(advance);
+    EXPECT_TRUE(json_obj_get_num(advance, "value", 0) == 3.14);
+    EXPECT_EQ(132, json_arr_get_num(json_get_member(advance, "portpool"), 2, 0));
+    dns = json_get_member(advance, "dns");
+    EXPECT_EQ(3, json_arr_count(dns));
+    ASSERT_STREQ("huabei", json_obj_get_str(json_get_element(dns, 1), "name", NULL));
+    const JSON *inner = json_get_element(dns, 2);
+    ASSERT_STREQ("tao", json_obj_get_str(json_get_element(inner, 2), "name", NULL));
+
+    json_free(json);
+}
+
+// 测试文件不存在
+TEST(json_load, nonexist)
+{
+    ASSERT_TRUE(json_load("nonexist.json") == NULL);
+}
+
+// 测试字面量和 null
+TEST(json_parse, literal)
+{
+    const char *text = " [true, false, null] ";
+    JSON *json = json_parse(text, strlen(text));
+    ASSERT_TRUE(json);
+    EXPECT_EQ(3, json_arr_count(json));
+    EXPECT_EQ(TRUE, json_arr_get_bool(json, 0));
+    EXPECT_EQ(FALSE, json_arr_get_bool(json, 1));
+    EXPECT_TRUE(json_type(json_get_element(json, 2)) == JSON_NONE);
+    json_free(json);
+}
+
+// 测试各种格式的数值
+TEST(json_parse, number)
+{
+    const char *text = "[0, -0.5e2, 1e-9, 133333333333.123456, 12345678901234567890, 1.5E+3]";
+    JSON *json = json_parse(text, strlen(text));
+    ASSERT_TRUE(json);
+    EXPECT_TRUE(json_arr_get_num(json, 0, 1) == 0);
+    EXPECT_TRUE(json_arr_get_num(json, 1, 0) == -50);
+    EXPECT_TRUE(json_arr_get_num(json, 2, 0) == 1e-9);
+    EXPECT_TRUE(json_arr_get_num(json, 3, 0) == 133333333333.123456);
+    EXPECT_TRUE(json_arr_get_num(json, 4, 0) == 12345678901234567890.0);
+    EXPECT_TRUE(json_arr_get_num(json, 5, 0) == 1500);
+    json_free(json);
+}
+
+// 测试转义序列
+TEST(json_parse, escape)
+{
+    const char *text = "{\"s\": \"a\\\"b\\\\c\\/\\n\\u4e2d\\ud83d\\ude00\"}";
+    JSON *json = json_parse(text, strlen(text));
+    ASSERT_TRUE(json);
+    ASSERT_STREQ("a\"b\\c/\n\xe4\xb8\xad\xf0\x9f\x98\x80", json_obj_get_str(json, "s", NULL));
+    json_free(json);
+}
+
+// 测试跨越 64 字节块边界的字符串和转义
+TEST(json_parse, block_boundary)
+{
+    char text[256];
+    int n = 0;
+    text[n++] = '[';
+    text[n++] = '"';
+    while (n < 62)
+        text[n++] = 'a';
+    text[n++] = '\\'; // 第 62 个字节
+    text[n++] = '\\'; // 第 63 个字节，转义第 62 个
+    text[n++] = '\\'; // 第 64 个字节，转义下一块的引号
+    text[n++] = '"';
+    text[n++] = '"';
+    text[n++] = ',';
+    text[n++] = '1';
+    text[n++] = ']';
+
+    JSON *json = json_parse(text, n);
+    ASSERT_TRUE(json);
+    EXPECT_EQ(2, json_arr_count(json));
+    const char *str = json_arr_get_str(json, 0, NULL);
+    ASSERT_TRUE(str);
+    EXPECT_EQ(62, strlen(str));
+    EXPECT_STREQ("\\\"", str + 60);
+    EXPECT_EQ(1, json_arr_get_num(json, 1, 0));
+    json_free(json);
+}
+
+// 测试只做第一阶段的 json_scan：结构字符的个数，跨越扫描窗口的文本，以及未闭合的字符串
+TEST(json_parse, scan)
+{
+    size_t count, n = 0, items = 50000;
+    const char *text = "{\"a\": [1, \"x,y\"], \"b\": null}";
+    // { "a : [ 1 , "x,y ] , "b : null }
+    EXPECT_EQ(0, json_scan(text, strlen(text), &count));
+    EXPECT_EQ(13, count);
+    EXPECT_EQ(-1, json_scan("[\"abc]", 6, &count));
+
+    // [1,1,...,1]，远大于一个扫描窗口
+    char *big = (char *)malloc(items * 2 + 2);
+    ASSERT_TRUE(big);
+    big[n++] = '[';
+    for (size_t i = 0; i < items; i++)
+    {
+        big[n++] = '1';
+        big[n++] = ',';
+    }
+    big[n - 1] = ']';
+    EXPECT_EQ(0, json_scan(big, n, &count));
+    EXPECT_EQ(items * 2 + 1, count);
+    free(big);
+}
+
+// 测试重复的键名，后者覆盖前者
+TEST(json_parse, duplicate_key)
+{
+    const char *text = "{\"a\": 1, \"b\": 2, \"a\": 3}";
+    JSON *json = json_parse(text, strlen(text));
+    ASSERT_TRUE(json);
+    EXPECT_EQ(3, json_obj_get_num(json, "a", 0));
+    EXPECT_EQ(2, json_obj_get_num(json, "b", 0));
+    json_free(json);
+}
+
+// 测试不合法的 JSON 文本
+TEST(json_parse, invalid)
+{
+    const char *texts[] = {"", "   ", "{", "[1,]", "{\"a\" 1}", "[1 2]", "\"abc", "tru",
+                           "01", "[1]x", "{\"a\":1,}", "[\"a\"1]", "\"\\x\"", "[-]", "\"\\ud800\""};
+    for (unsigned int i = 0; i < sizeof(texts) / sizeof(texts[0]); i++)
+    {
+        JSON *json = json_parse(texts[i], strlen(texts[i]));
+        EXPECT_TRUE(json == NULL);
+        json_free(json);
+    }
+}
+
+// 测试解析后保存为 YAML
+TEST(json_parse, save)
+{
+    buf_t result;
+    const char *text = "{\"a\": [1, \"x\", null], \"b\": {\"c\": false}}";
+    const char *expect = "a: \n  - 1\n  - x\n  - null\nb: \n  c: false\n";
+
+    JSON *json = json_parse(text, strlen(text));
+    ASSERT_TRUE(json);
+
+    EXPECT_EQ(0, json_save(json, "test.yml"));
+    EXPECT_EQ(0, read_file(&result, "test.yml"));
+
+    ASSERT_TRUE(strcmp(result.str, expect) == 0);
+    free(result.str);
+    json_free(json);
+}
+
+// 测试元素类型相同的数字数组和布尔数组：读取、取出元素节点、输出，以及修改后转为普通数组
+TEST(json_parse, packed_array)
+{
+    buf_t result;
+    const char *text = "{\"portpool\": [130, 131, 132], \"flags\": [true, false], \"mixed\": [1, true, \"x\"]}";
+    const char *expect = "portpool: \n  - 130\n  - 131\n  - 132\nflags: \n  - true\n  - false\nmixed: \n  - 1\n  - true\n  - x\n";
+
+    JSON *json = json_parse(text, strlen(text));
+    ASSERT_TRUE(json);
+    JSON *pool = (JSON *)json_get_member(json, "portpool");
+    const JSON *flags = json_get_member(json, "flags");
+    const JSON *mixed = json_get_member(json, "mixed");
+    EXPECT_EQ(3, json_arr_count(pool));
+    EXPECT_EQ(131, json_arr_get_num(pool, 1, 0));
+    EXPECT_EQ(-1, json_arr_get_num(pool, 3, -1));
+    EXPECT_EQ(FALSE, json_arr_get_bool(pool, 0));
+    ASSERT_TRUE(json_arr_get_str(pool, 0, NULL) == NULL);
+    EXPECT_EQ(TRUE, json_arr_get_bool(flags, 0));
+    EXPECT_EQ(FALSE, json_arr_get_bool(flags, 1));
+    EXPECT_EQ(-1, json_arr_get_num(flags, 0, -1));
+    EXPECT_EQ(1, json_arr_get_num(mixed, 0, 0));
+    EXPECT_EQ(TRUE, json_arr_get_bool(mixed, 1));
+    ASSERT_STREQ("x", json_arr_get_str(mixed, 2, NULL));
+
+    EXPECT_EQ(0, json_save(json, "test.yml"));
+    EXPECT_EQ(0, read_file(&result, "test.yml"));
+    ASSERT_STREQ(expect, result.str);
+    free(result.str);
+
+    // 取出的元素节点是稳定的
+    const JSON *elem = json_get_element(pool, 2);
+    ASSERT_TRUE(elem);
+    EXPECT_EQ(132, json_num(elem, 0));
+    ASSERT_TRUE(json_get_element(pool, 2) == elem);
+    json_path *path = json_path_compile("portpool[0]");
+    ASSERT_TRUE(path);
+    EXPECT_EQ(130, json_num(json_get_compiled(json, path), 0));
+    json_path_free(path);
+
+    // 继续按原始值追加，再追加其他类型的元素
+    ASSERT_TRUE(json_arr_add_num(pool, 133) > 0);
+    ASSERT_TRUE(json_arr_add_str(pool, "134") > 0);
+    EXPECT_EQ(5, json_arr_count(pool));
+    EXPECT_EQ(133, json_arr_get_num(pool, 3, 0));
+    ASSERT_STREQ("134", json_arr_get_str(pool, 4, NULL));
+    EXPECT_EQ(130, json_arr_get_num(pool, 0, 0));
+
+    path = json_path_compile("flags[1]");
+    ASSERT_TRUE(path);
+    EXPECT_EQ(0, json_set_compiled(json, path, json_new_num(2)));
+    EXPECT_EQ(2, json_arr_get_num(flags, 1, 0));
+    EXPECT_EQ(TRUE, json_arr_get_bool(flags, 0));
+    json_path_free(path);
+    json_free(json);
+
+    // 文档中的打包数组
+    json_doc *doc = json_doc_new();
+    ASSERT_TRUE(doc);
+    json = json_doc_parse(doc, text, strlen(text));
+    ASSERT_TRUE(json);
+    pool = (JSON *)json_get_member(json, "portpool");
+    for (int i = 0; i < 100; i++)
+        ASSERT_TRUE(json_arr_add_num(pool, 133 + i) > 0);
+    EXPECT_EQ(232, json_arr_get_num(pool, 102, 0));
+    EXPECT_EQ(232, json_num(json_get_element(pool, 102), 0));
+    json_doc_free(doc);
+}
+
+// 测试用 json_arr_add_num 和 json_arr_add_bool 构建的数组
+TEST(json_arr_add_num, packed)
+{
+    buf_t result;
+    JSON *json = json_new(JSON_ARR);
+    ASSERT_TRUE(json);
+
+    for (int i = 0; i < 100; i++)
+        ASSERT_TRUE(json_arr_add_num(json, i * 0.5) > 0);
+    EXPECT_EQ(100, json_arr_count(json));
+    EXPECT_EQ(49.5, json_arr_get_num(json, 99, 0));
+    // 生成过元素节点之后再追加，原始值和节点保持一致
+    EXPECT_EQ(1, json_num(json_get_element(json, 2), 0));
+    ASSERT_TRUE(json_arr_add_num(json, 100) > 0);
+    EXPECT_EQ(100, json_num(json_get_element(json, 100), 0));
+    EXPECT_EQ(100, json_arr_get_num(json, 100, 0));
+    json_free(json);
+
+    json = json_new(JSON_ARR);
+    ASSERT_TRUE(json);
+    ASSERT_TRUE(json_arr_add_bool(json, TRUE) > 0);
+    ASSERT_TRUE(json_arr_add_bool(json, FALSE) > 0);
+    ASSERT_TRUE(json_arr_add_num(json, 3) > 0);
+    EXPECT_EQ(TRUE, json_arr_get_bool(json, 0));
+    EXPECT_EQ(3, json_arr_get_num(json, 2, 0));
+    EXPECT_EQ(0, json_save(json, "test.yml"));
+    EXPECT_EQ(0, read_file(&result, "test.yml"));
+    ASSERT_STREQ("- true\n- false\n- 3\n", result.str);
+    free(result.str);
+    json_free(json);
+}
+
+// 测试超过 2^53 的整数解析、读取和保存都保持精确
+TEST(json_parse, integer)
+{
+    buf_t result;
+    const char *text = "{\"id\": 9007199254740993, \"min\": -9223372036854775808, \"big\": 9223372036854775808, "
+                       "\"one\": 1.0, \"zero\": -0, \"ids\": [1, 9007199254740993], \"mix\": [1, 2.5, 9007199254740993]}";
+    const char *expect = "id: 9007199254740993\nmin: -9223372036854775808\nbig: 9223372036854776000\none: 1\nzero: -0\n"
+                         "ids: \n  - 1\n  - 9007199254740993\nmix: \n  - 1\n  - 2.5\n  - 9007199254740993\n";
+
+    JSON *json = json_parse(text, strlen(text));
+    ASSERT_TRUE(json);
+    EXPECT_EQ(JSON_INT, json_type(json_get_member(json, "id")));
+    EXPECT_EQ(9007199254740993LL, json_obj_get_int(json, "id", 0));
+    EXPECT_EQ(INT64_MIN, json_obj_get_int(json, "min", 0));
+    // 超出 int64_t 的整数、小数和 -0 仍然是 JSON_NUM
+    EXPECT_EQ(JSON_NUM, json_type(json_get_member(json, "big")));
+    EXPECT_EQ(-1, json_obj_get_int(json, "big", -1));
+    EXPECT_EQ(JSON_NUM, json_type(json_get_member(json, "one")));
+    EXPECT_EQ(1, json_obj_get_int(json, "one", 0));
+    EXPECT_EQ(JSON_NUM, json_type(json_get_member(json, "zero")));
+    EXPECT_EQ(9007199254740992.0, json_obj_get_num(json, "id", 0));
+
+    const JSON *ids = json_get_member(json, "ids");
+    EXPECT_EQ(9007199254740993LL, json_arr_get_int(ids, 1, 0));
+    EXPECT_EQ(JSON_INT, json_type(json_get_element(ids, 0)));
+    // 混有小数时不能精确转换的整数保留为节点
+    const JSON *mix = json_get_member(json, "mix");
+    EXPECT_EQ(JSON_NUM, json_type(json_get_element(mix, 0)));
+    EXPECT_EQ(2, json_arr_get_int(mix, 1, 0));
+    EXPECT_EQ(9007199254740993LL, json_arr_get_int(mix, 2, 0));
+
+    EXPECT_EQ(0, json_save(json, "test.yml"));
+    EXPECT_EQ(0, read_file(&result, "test.yml"));
+    ASSERT_STREQ(expect, result.str);
+    free(result.str);
+
+    // 整数成员可以被小数覆盖
+    EXPECT_EQ(0, json_obj_set_num(json, "id", 0.5));
+    EXPECT_EQ(JSON_NUM, json_type(json_get_member(json, "id")));
+    EXPECT_EQ(0.5, json_obj_get_num(json, "id", 0));
+    json_free(json);
+}
+
+TEST(json_arr_add_int, packed)
+{
+    buf_t result;
+    char buf[JSON_NUM_BUF];
+    JSON *json = json_new(JSON_ARR);
+    ASSERT_TRUE(json);
+
+    for (int i = 0; i < 100; i++)
+        ASSERT_TRUE(json_arr_add_int(json, INT64_MAX - i) > 0);
+    EXPECT_EQ(100, json_arr_count(json));
+    EXPECT_EQ(INT64_MAX - 99, json_arr_get_int(json, 99, 0));
+    EXPECT_EQ(INT64_MAX, json_int(json_get_element(json, 0), 0));
+    ASSERT_TRUE(json_arr_add_num(json, 0.5) > 0);
+    EXPECT_EQ(INT64_MAX - 1, json_arr_get_int(json, 1, 0));
+    EXPECT_EQ(0.5, json_arr_get_num(json, 100, 0));
+    json_free(json);
+
+    json = json_new(JSON_ARR);
+    ASSERT_TRUE(json);
+    ASSERT_TRUE(json_arr_add_int(json, INT64_MIN) > 0);
+    ASSERT_TRUE(json_arr_add_int(json, 0) > 0);
+    EXPECT_EQ(0, json_save(json, "test.yml"));
+    EXPECT_EQ(0, read_file(&result, "test.yml"));
+    ASSERT_STREQ("- -9223372036854775808\n- 0\n", result.str);
+    free(result.str);
+    json_free(json);
+
+    EXPECT_EQ(20, json_int_to_str(INT64_MIN, buf));
+    ASSERT_TRUE(memcmp(buf, "-9223372036854775808", 20) == 0);
+    EXPECT_EQ(1, json_int_to_str(7, buf));
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_doc
+//----------------------------------------------------------------------------------------------------
+
+// 测试在文档中构建 JSON 值
+TEST(json_doc, build)
+{
+    json_doc *doc = json_doc_new();
+    ASSERT_TRUE(doc);
+
+    JSON *json = json_doc_new_value(doc, JSON_OBJ);
+    ASSERT_TRUE(json);
+    JSON *dns = json_doc_new_value(doc, JSON_ARR);
+    ASSERT_TRUE(json_add_member(json, "dns", dns));
+    ASSERT_TRUE(json_add_member(json, "port", json_doc_new_num(doc, 389)));
+    ASSERT_TRUE(json_add_member(json, "enable", json_doc_new_bool(doc, TRUE)));
+    ASSERT_TRUE(json_add_member(json, "ip", json_doc_new_str(doc, "200.200.3.61")));
+    for (int i = 0; i < 100; i++)
+        ASSERT_TRUE(json_arr_add_num(dns, i) == 1);
+    ASSERT_TRUE(json_arr_add_str(dns, "last") == 1);
+
+    // 覆盖已有成员，修改字符串
+    ASSERT_TRUE(json_add_member(json, "port", json_doc_new_num(doc, 80)));
+    ASSERT_TRUE(json_obj_set_str(json, "ip", "127.0.0.1") == 0);
+    // 对文档中的值调用 json_free 不做任何事
+    json_free((JSON *)json_get_element(dns, 0));
+
+    EXPECT_EQ(80, json_obj_get_num(json, "port", 0));
+    EXPECT_EQ(TRUE, json_obj_get_bool(json, "enable"));
+    ASSERT_STREQ("127.0.0.1", json_obj_get_str(json, "ip", NULL));
+    EXPECT_EQ(101, json_arr_count(dns));
+    EXPECT_EQ(0, json_arr_get_num(dns, 0, -1));
+    EXPECT_EQ(99, json_arr_get_num(dns, 99, 0));
+    ASSERT_STREQ("last", json_arr_get_str(dns, 100, NULL));
+
+    json_doc_free(doc);
+}
+
+// 测试文档中的大对象
+TEST(json_doc, large_object)
+{
+    char key[32];
+    json_doc *doc = json_doc_new();
+    ASSERT_TRUE(doc);
+    JSON *json = json_doc_new_value(doc, JSON_OBJ);
+    ASSERT_TRUE(json);
+
+    for (int i = 0; i < 1000; i++)
+    {
+        sprintf(key, "key%d", i);
+        ASSERT_TRUE(json_add_member(json, key, json_doc_new_num(doc, i)));
+    }
+    for (int i = 0; i < 1000; i++)
+    {
+        sprintf(key, "key%d", i);
+        ASSERT_TRUE(json_obj_get_num(json, key, -1) == i);
+    }
+    json_doc_free(doc);
+}
+
+// 测试节点分布在很多内存块中，以及成员数组超过单独分配大块的阈值时，修改节点仍然使用所属文档
+TEST(json_doc, many_chunks)
+{
+    json_doc *doc = json_doc_new();
+    ASSERT_TRUE(doc);
+
+    for (int round = 0; round < 2; round++)
+    {
+        JSON *arr = json_doc_new_value(doc, JSON_ARR);
+        ASSERT_TRUE(arr);
+        for (int i = 0; i < 20000; i++)
+        {
+            JSON *obj = json_add_element(arr, json_doc_new_value(doc, JSON_OBJ));
+            ASSERT_TRUE(obj);
+            ASSERT_TRUE(json_add_member(obj, "port", json_doc_new_num(doc, i)));
+        }
+        for (int i = 0; i < 20000; i += 999)
+        {
+            JSON *obj = (JSON *)json_get_element(arr, i);
+            ASSERT_TRUE(json_add_member(obj, "url", json_doc_new_str(doc, "")));
+            ASSERT_TRUE(json_obj_set_str(obj, "url", "http://200.200.0.4/main") == 0);
+            ASSERT_TRUE(json_arr_add_num(json_add_member(obj, "pool", json_doc_new_value(doc, JSON_ARR)), i) > 0);
+        }
+        EXPECT_EQ(20000, json_arr_count(arr));
+        EXPECT_EQ(19999, json_obj_get_num(json_get_element(arr, 19999), "port", 0));
+        ASSERT_STREQ("http://200.200.0.4/main", json_obj_get_str(json_get_element(arr, 19980), "url", NULL));
+        EXPECT_EQ(19980, json_arr_get_num(json_get_member(json_get_element(arr, 19980), "pool"), 0, 0));
+        json_doc_reset(doc);
+    }
+    json_doc_free(doc);
+}
+
+// 测试重置后重复加载
+TEST(json_doc, reset_reload)
+{
+    json_doc *doc = json_doc_new();
+    ASSERT_TRUE(doc);
+
+    for (int round = 0; round < 3; round++)
+    {
+        JSON *json = json_doc_load(doc, "json-test.json");
+        ASSERT_TRUE(json);
+        const JSON *basic = json_get_member(json, "basic");
+        EXPECT_EQ(389, json_obj_get_num(basic, "port", 0));
+        ASSERT_STREQ("200.0.0.254", json_arr_get_str(json_get_member(basic, "dns"), 1, NULL));
+        json_doc_reset(doc);
+    }
+
+    const char *text = "[1, {\"a\": \"b\\n\"}]";
+    JSON *json = json_doc_parse(doc, text, strlen(text));
+    ASSERT_TRUE(json);
+    ASSERT_STREQ("b\n", json_obj_get_str(json_get_element(json, 1), "a", NULL));
+    ASSERT_TRUE(json_doc_parse(doc, "[1,", 3) == NULL);
+
+    json_doc_free(doc);
+}
+
+// 测试把文档中的值挂到堆中的对象上
+TEST(json_doc, attach_to_heap)
+{
+    json_doc *doc = json_doc_new();
+    ASSERT_TRUE(doc);
+    JSON *json = json_new(JSON_OBJ);
+    ASSERT_TRUE(json);
+
+    ASSERT_TRUE(json_add_member(json, "name", json_doc_new_str(doc, "huanan")));
+    ASSERT_STREQ("huanan", json_obj_get_str(json, "name", NULL));
+
+    json_free(json);
+    json_doc_free(doc);
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_set_allocator
+//----------------------------------------------------------------------------------------------------
+
+// 记录调用次数的分配器，user 指向计数器
+typedef struct alloc_counter
+{
+    long live;     // 尚未释放的内存块个数
+    long calls;    // 分配和调整大小的次数
+    size_t align;  // 见过的最大对齐要求
+} alloc_counter;
+
+static void *counting_alloc(void *user, size_t size, size_t align)
+{
+    alloc_counter *c = (alloc_counter *)user;
+    void *ptr = align <= JSON_ALLOC_ALIGN ? malloc(size) : aligned_alloc(align, (size + align - 1) & ~(align - 1));
+    if (ptr)
+        c->live++;
+    c->calls++;
+    if (align > c->align)
+        c->align = align;
+    return ptr;
+}
+static void *counting_realloc(void *user, void *ptr, size_t old_size, size_t new_size)
+{
+    ((alloc_counter *)user)->calls++;
+    return realloc(ptr, new_size);
+}
+static void counting_free(void *user, void *ptr)
+{
+    ((alloc_counter *)user)->live--;
+    free(ptr);
+}
+
+// 测试全局分配器接管堆中节点、解析和输出的所有内存
+TEST(json_set_allocator, global)
+{
+    alloc_counter c = {0, 0, 0};
+    const char *text = "{\"basic\": {\"ip\": \"200.200.200.200\", \"dns\": [\"200.200.3.254\", 1, true]}}";
+    long live = 0;
+
+    EXPECT_EQ(0, json_set_allocator(NULL, counting_alloc, counting_realloc, counting_free, &c));
+    // 第二轮复用第一轮留在 slab 中的节点，除此之外的内存都已归还
+    for (int round = 0; round < 2; round++)
+    {
+        JSON *json = json_parse(text, strlen(text));
+        ASSERT_TRUE(json);
+        ASSERT_TRUE(json_arr_add_str((JSON *)json_get_member(json_get_member(json, "basic"), "dns"), "200.200.1.1") > 0);
+        EXPECT_EQ(0, json_save(json, "test.yml"));
+        ASSERT_TRUE(c.calls > 0 && c.live > live);
+        json_free(json);
+        if (round == 1)
+            EXPECT_EQ(live, c.live);
+        live = c.live;
+    }
+    // 换回默认分配器时空闲的 slab 大块都还给了原来的分配器
+    EXPECT_EQ(0, json_set_allocator(NULL, NULL, NULL, NULL, NULL));
+    EXPECT_EQ(0, c.live);
+}
+
+// 测试 json_slab_trim 归还完全空闲的大块，仍有对象在使用的大块保留
+TEST(json_slab_trim, release)
+{
+    alloc_counter c = {0, 0, 0};
+    JSON *keep, *arr;
+
+    EXPECT_EQ(0, json_set_allocator(NULL, counting_alloc, counting_realloc, counting_free, &c));
+    keep = json_new_num(1);
+    ASSERT_TRUE(keep);
+    arr = json_new(JSON_ARR);
+    ASSERT_TRUE(arr);
+    for (int i = 0; i < 100000; i++)
+        ASSERT_TRUE(json_arr_add_str(arr, "200.200.200.200.200.200") > 0);
+    long peak = c.live;
+    json_free(arr);
+    json_slab_trim();
+    ASSERT_TRUE(c.live > 0 && c.live < peak / 2);
+    json_free(keep);
+    json_slab_trim();
+    EXPECT_EQ(0, c.live);
+    EXPECT_EQ(0, json_set_allocator(NULL, NULL, NULL, NULL, NULL));
+}
+
+// 测试文档的内存块使用文档自己的分配器，按内存块的大小对齐
+TEST(json_set_allocator, doc)
+{
+    alloc_counter c = {0, 0, 0};
+    const char *text = "[{\"name\": \"huanan\"}, 1, 2.5]";
+    json_doc *doc = json_doc_new();
+    ASSERT_TRUE(doc);
+
+    EXPECT_EQ(0, json_set_allocator(doc, counting_alloc, counting_realloc, counting_free, &c));
+    JSON *json = json_doc_parse(doc, text, strlen(text));
+    ASSERT_TRUE(json);
+    ASSERT_STREQ("huanan", json_obj_get_str(json_get_element(json, 0), "name", NULL));
+    EXPECT_EQ(1, c.live);
+    ASSERT_TRUE(c.align > JSON_ALLOC_ALIGN);
+    // 已经持有内存块的文档不能再换分配器
+    EXPECT_EQ(-1, json_set_allocator(doc, NULL, NULL, NULL, NULL));
+    json_doc_reset(doc);
+    ASSERT_TRUE(json_doc_parse(doc, text, strlen(text)));
+    EXPECT_EQ(1, c.live);
+    json_doc_free(doc);
+    EXPECT_EQ(0, c.live);
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_load_mmap
+//----------------------------------------------------------------------------------------------------
+
+// 把 text 写入文件 fname
+static int write_text(const char *fname, const char *text)
+{
+    FILE *fp = fopen(fname, "wb");
+    if (!fp)
+        return -1;
+    size_t n = fwrite(text, 1, strlen(text), fp);
+    fclose(fp);
+    return n == strlen(text) ? 0 : -1;
+}
+
+// 测试映射加载的结果与普通加载相同
+TEST(json_load_mmap, scene)
+{
+    buf_t expect, result;
+
+    JSON *json = json_load("json-test.json");
+    ASSERT_TRUE(json);
+    EXPECT_EQ(0, json_save(json, "test.yml"));
+    EXPECT_EQ(0, read_file(&expect, "test.yml"));
+    json_free(json);
+
+    json = json_load_mmap("json-test.json");
+    ASSERT_TRUE(json);
+    EXPECT_EQ(389, json_obj_get_num(json_get_member(json, "basic"), "port", 0));
+    EXPECT_EQ(0, json_save(json, "test.yml"));
+    EXPECT_EQ(0, read_file(&result, "test.yml"));
+    ASSERT_TRUE(strcmp(expect.str, result.str) == 0);
+
+    free(expect.str);
+    free(result.str);
+    json_free(json);
+}
+
+// 测试转义序列就地还原，而文件内容不变
+TEST(json_load_mmap, escape)
+{
+    const char *text = "{\"k\\u0065y\": \"a\\tb\", \"ip\": \"200.200.3.61\", \"dns\": [\"\\u4e2d\"]}";
+    buf_t result;
+
+    ASSERT_TRUE(write_text("test.json", text) == 0);
+    JSON *json = json_load_mmap("test.json");
+    ASSERT_TRUE(json);
+    ASSERT_STREQ("a\tb", json_obj_get_str(json, "key", NULL));
+    ASSERT_STREQ("200.200.3.61", json_obj_get_str(json, "ip", NULL));
+    ASSERT_STREQ("\xe4\xb8\xad", json_arr_get_str(json_get_member(json, "dns"), 0, NULL));
+
+    // 修改指向映射区的字符串
+    EXPECT_EQ(0, json_obj_set_str(json, "ip", "127.0.0.1"));
+    ASSERT_STREQ("127.0.0.1", json_obj_get_str(json, "ip", NULL));
+
+    EXPECT_EQ(0, read_file(&result, "test.json"));
+    ASSERT_TRUE(strcmp(text, result.str) == 0);
+    free(result.str);
+    json_free(json);
+}
+
+// 测试在同一个文档中反复映射加载
+TEST(json_load_mmap, doc_reset)
+{
+    json_doc *doc = json_doc_new();
+    ASSERT_TRUE(doc);
+
+    for (int i = 0; i < 3; i++)
+    {
+        json_doc_reset(doc);
+        JSON *json = json_doc_load_mmap(doc, "json-test.json");
+        ASSERT_TRUE(json);
+        ASSERT_STREQ("200.200.3.61", json_obj_get_str(json_get_member(json, "basic"), "ip", NULL));
+        // 文档中的节点不单独释放
+        json_free(json);
+    }
+    json_doc_free(doc);
+}
+
+// 测试文件不存在、为空或内容非法
+TEST(json_load_mmap, invalid)
+{
+    ASSERT_TRUE(json_load_mmap("nonexist.json") == NULL);
+    ASSERT_TRUE(write_text("test.json", "") == 0);
+    ASSERT_TRUE(json_load_mmap("test.json") == NULL);
+    ASSERT_TRUE(write_text("test.json", "{\"a\": [1, 2}") == 0);
+    ASSERT_TRUE(json_load_mmap("test.json") == NULL);
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_load_lazy
+//----------------------------------------------------------------------------------------------------
+
+// 测试延迟加载后逐层展开保存的结果与普通加载相同
+TEST(json_load_lazy, scene)
+{
+    buf_t expect, result;
+
+    JSON *json = json_load("json-test.json");
+    ASSERT_TRUE(json);
+    EXPECT_EQ(0, json_save(json, "test.yml"));
+    EXPECT_EQ(0, read_file(&expect, "test.yml"));
+    json_free(json);
+
+    json = json_load_lazy("json-test.json");
+    ASSERT_TRUE(json);
+    EXPECT_EQ(JSON_OBJ, json_type(json));
+    EXPECT_EQ(0, json_save(json, "test.yml"));
+    EXPECT_EQ(0, read_file(&result, "test.yml"));
+    ASSERT_TRUE(strcmp(expect.str, result.str) == 0);
+
+    free(expect.str);
+    free(result.str);
+    json_free(json);
+}
+
+// 测试各种 getter、编译后的路径和修改接口都能直接用于延迟节点
+TEST(json_load_lazy, access)
+{
+    const char *text = "{\"basic\": {\"port\": 389, \"ip\": \"a\\tb\", \"dns\": [\"x\", [1, 2], {\"k\": true}]},"
+                       " \"list\": [], \"empty\": {}}";
+    json_doc *doc = json_doc_new();
+    ASSERT_TRUE(doc);
+    ASSERT_TRUE(write_text("test.json", text) == 0);
+    JSON *json = json_doc_load_lazy(doc, "test.json");
+    ASSERT_TRUE(json);
+
+    JSON *basic = (JSON *)json_get_member(json, "basic");
+    ASSERT_TRUE(basic);
+    EXPECT_EQ(389, json_obj_get_num(basic, "port", 0));
+    ASSERT_STREQ("a\tb", json_obj_get_str(basic, "ip", NULL));
+    const JSON *dns = json_get_member(basic, "dns");
+    EXPECT_EQ(3, json_arr_count(dns));
+    ASSERT_STREQ("x", json_arr_get_str(dns, 0, NULL));
+    EXPECT_EQ(2, json_arr_get_num(json_get_element(dns, 1), 1, 0));
+
+    json_path *path = json_path_compile("basic.dns[2].k");
+    ASSERT_TRUE(path);
+    EXPECT_EQ(TRUE, json_bool(json_get_compiled(json, path)));
+    json_path_free(path);
+
+    // 未展开的对象和数组也可以直接修改
+    EXPECT_EQ(0, json_obj_set_num(basic, "port", 80));
+    EXPECT_EQ(80, json_obj_get_num(basic, "port", 0));
+    EXPECT_EQ(1, json_arr_add_num((JSON *)json_get_member(json, "list"), 7));
+    EXPECT_EQ(7, json_arr_get_num(json_get_member(json, "list"), 0, 0));
+    JSON *empty = (JSON *)json_get_member(json, "empty");
+    ASSERT_TRUE(json_add_member(empty, "on", json_doc_new_bool(doc, TRUE)));
+    EXPECT_EQ(TRUE, json_obj_get_bool(empty, "on"));
+
+    json_doc_free(doc);
+}
+
+// 测试标量根值，以及加载时能发现的错误
+TEST(json_load_lazy, invalid)
+{
+    ASSERT_TRUE(write_text("test.json", " \"str\" ") == 0);
+    JSON *json = json_load_lazy("test.json");
+    ASSERT_TRUE(json);
+    ASSERT_STREQ("str", json_str(json, NULL));
+    json_free(json);
+
+    ASSERT_TRUE(json_load_lazy("nonexist.json") == NULL);
+    ASSERT_TRUE(write_text("test.json", "{\"a\": [1, 2}") == 0);
+    ASSERT_TRUE(json_load_lazy("test.json") == NULL);
+    ASSERT_TRUE(write_text("test.json", "{\"a\": [1, 2]") == 0);
+    ASSERT_TRUE(json_load_lazy("test.json") == NULL);
+    ASSERT_TRUE(write_text("test.json", "[1] 2") == 0);
+    ASSERT_TRUE(json_load_lazy("test.json") == NULL);
+    ASSERT_TRUE(write_text("test.json", "{\"a\": \"b}") == 0);
+    ASSERT_TRUE(json_load_lazy("test.json") == NULL);
+}
+
+// 测试子树中的语法错误在访问时才报告，出错的子树按不存在处理，不影响其他成员
+TEST(json_load_lazy, broken_subtree)
+{
+    ASSERT_TRUE(write_text("test.json", "{\"bad\": [1 2], \"good\": {\"port\": 389}}") == 0);
+    JSON *json = json_load_lazy("test.json");
+    ASSERT_TRUE(json);
+
+    const JSON *bad = json_get_member(json, "bad");
+    ASSERT_TRUE(bad);
+    EXPECT_EQ(JSON_ARR, json_type(bad));
+    EXPECT_EQ(-1, json_arr_count(bad));
+    ASSERT_TRUE(json_get_element(bad, 0) == NULL);
+    // 再次访问仍然失败
+    EXPECT_EQ(-1, json_arr_count(bad));
+    EXPECT_EQ(389, json_obj_get_num(json_get_member(json, "good"), "port", 0));
+    EXPECT_EQ(-1, json_save(json, "test.yml"));
+    json_free(json);
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_stats
+//----------------------------------------------------------------------------------------------------
+
+static const char *stats_text = "{\"name\": \"a string longer than sso\", \"ids\": [1, 2, 3],"
+                                " \"tags\": [{\"k\": 1}, {\"k\": true}], \"ok\": null}";
+
+// 测试遍历统计各类型的个数、深度和扇出，共享的键名只计一次
+TEST(json_stats, tree)
+{
+    json_mem_stats st;
+    JSON *json = json_parse(stats_text, strlen(stats_text));
+    ASSERT_TRUE(json);
+
+    EXPECT_EQ(0, json_stats(json, &st));
+    EXPECT_EQ(3, st.values[JSON_OBJ]);
+    EXPECT_EQ(2, st.values[JSON_ARR]);
+    EXPECT_EQ(4, st.values[JSON_INT]);
+    EXPECT_EQ(1, st.values[JSON_STR]);
+    EXPECT_EQ(1, st.values[JSON_BOL]);
+    EXPECT_EQ(1, st.values[JSON_NONE]);
+    EXPECT_EQ(9, st.nodes);
+    EXPECT_EQ(0, st.lazy);
+    EXPECT_EQ(5, st.keys);
+    EXPECT_EQ(strlen("a string longer than sso") + 1, st.string_bytes);
+    ASSERT_TRUE(st.node_bytes >= st.nodes * 16 && st.container_bytes > 0);
+    EXPECT_EQ(3, st.max_depth);
+    EXPECT_EQ(1, st.depth[0]);
+    EXPECT_EQ(4, st.depth[1]);
+    EXPECT_EQ(5, st.depth[2]);
+    EXPECT_EQ(2, st.depth[3]);
+    EXPECT_EQ(2, st.fanout[1]);
+    EXPECT_EQ(2, st.fanout[2]);
+    EXPECT_EQ(1, st.fanout[3]);
+    EXPECT_EQ(st.node_bytes + st.string_bytes + st.key_bytes + st.container_bytes, json_memory_usage(json));
+
+    // 添加成员后容量翻倍，多出的空间计入 slack_bytes
+    size_t slack = st.slack_bytes;
+    ASSERT_TRUE(json_arr_add_str((JSON *)json_get_member(json, "tags"), "x") > 0);
+    EXPECT_EQ(0, json_stats(json, &st));
+    ASSERT_TRUE(st.slack_bytes > slack);
+    json_free(json);
+}
+
+// 测试文档的计数器不遍历也能给出分配的用量，重置后清零
+TEST(json_stats, doc_counters)
+{
+    json_mem_stats st, walk;
+    json_doc *doc = json_doc_new();
+    ASSERT_TRUE(doc);
+    JSON *json = json_doc_parse(doc, stats_text, strlen(stats_text));
+    ASSERT_TRUE(json);
+
+    EXPECT_EQ(0, json_doc_stats(doc, &st));
+    EXPECT_EQ(0, json_stats(json, &walk));
+    EXPECT_EQ(3, st.values[JSON_OBJ]);
+    EXPECT_EQ(1, st.values[JSON_INT]);
+    EXPECT_EQ(walk.nodes, st.nodes);
+    EXPECT_EQ(walk.node_bytes, st.node_bytes);
+    EXPECT_EQ(walk.string_bytes, st.string_bytes);
+    EXPECT_EQ(5, st.keys);
+    ASSERT_TRUE(st.arena_used > 0 && st.arena_bytes >= st.arena_used);
+
+    json_doc_reset(doc);
+    EXPECT_EQ(0, json_doc_stats(doc, &st));
+    EXPECT_EQ(0, st.nodes);
+    EXPECT_EQ(0, st.arena_used);
+    json_doc_free(doc);
+}
+
+// 测试统计不展开延迟加载的子树
+TEST(json_stats, lazy)
+{
+    json_mem_stats st;
+    json_doc *doc = json_doc_new();
+    ASSERT_TRUE(doc);
+    ASSERT_TRUE(write_text("test.json", stats_text) == 0);
+    JSON *json = json_doc_load_lazy(doc, "test.json");
+    ASSERT_TRUE(json);
+
+    EXPECT_EQ(0, json_stats(json, &st));
+    EXPECT_EQ(1, st.nodes);
+    EXPECT_EQ(1, st.lazy);
+    ASSERT_TRUE(json_get_member(json, "ok"));
+    EXPECT_EQ(0, json_stats(json, &st));
+    EXPECT_EQ(5, st.nodes);
+    EXPECT_EQ(2, st.lazy);
+    EXPECT_EQ(0, json_stats(json, &st));
+    EXPECT_EQ(2, st.lazy);
+    json_doc_free(doc);
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_compact
+//----------------------------------------------------------------------------------------------------
+
+// 把 json 输出到 test.yml 中再读回来
+static int save_text(buf_t *buf, const JSON *json)
+{
+    if (json_save(json, "test.yml") < 0)
+        return -1;
+    return read_file(buf, "test.yml");
+}
+
+// 测试紧凑拷贝与原来的树输出相同，成员数组没有空余容量，节点按深度优先的顺序排列
+TEST(json_compact, scene)
+{
+    buf_t expect, result;
+    json_mem_stats st;
+    JSON *json = json_load("json-test.json");
+    ASSERT_TRUE(json);
+    JSON *list = json_new(JSON_ARR);
+    ASSERT_TRUE(json_add_member(json, "list", list));
+    for (int i = 0; i < 5; i++)
+    {
+        JSON *item = json_new(JSON_OBJ);
+        ASSERT_TRUE(json_add_element(list, item));
+        ASSERT_TRUE(json_add_member(item, "id", json_new_num(i)));
+        ASSERT_TRUE(json_add_member(item, "name", json_new_str("a name longer than sso")));
+    }
+
+    JSON *copy = json_compact(json);
+    ASSERT_TRUE(copy);
+    EXPECT_EQ(0, save_text(&expect, json));
+    EXPECT_EQ(0, save_text(&result, copy));
+    ASSERT_TRUE(strcmp(expect.str, result.str) == 0);
+    free(expect.str);
+    free(result.str);
+
+    EXPECT_EQ(0, json_stats(json, &st));
+    ASSERT_TRUE(st.slack_bytes > 0);
+    EXPECT_EQ(0, json_stats(copy, &st));
+    EXPECT_EQ(0, st.slack_bytes);
+    const JSON *items = json_get_member(copy, "list");
+    ASSERT_TRUE((const char *)items > (const char *)copy);
+    ASSERT_TRUE((const char *)json_get_element(items, 0) > (const char *)items);
+    ASSERT_TRUE((const char *)json_get_element(items, 1) > (const char *)json_get_element(items, 0));
+
+    // 拷贝可以继续修改，与原来的树互不影响
+    EXPECT_EQ(0, json_obj_set_str((JSON *)json_get_member(copy, "basic"), "ip", "10.0.0.1"));
+    EXPECT_EQ(1, json_arr_add_num((JSON *)items, 7));
+    ASSERT_STREQ("10.0.0.1", json_obj_get_str(json_get_member(copy, "basic"), "ip", NULL));
+    ASSERT_STREQ("200.200.3.61", json_obj_get_str(json_get_member(json, "basic"), "ip", NULL));
+    EXPECT_EQ(6, json_arr_count(items));
+    json_free(json);
+    json_free(copy);
+}
+
+// 测试超出一个内存块的大树，以及打包数组、大对象的索引
+TEST(json_compact, large)
+{
+    buf_t expect, result;
+    char key[16];
+    JSON *json = json_new(JSON_OBJ);
+    ASSERT_TRUE(json);
+    JSON *nums = json_new(JSON_ARR);
+    ASSERT_TRUE(json_add_member(json, "nums", nums));
+    for (int i = 0; i < 5000; i++)
+    {
+        ASSERT_TRUE(json_arr_add_int(nums, i) > 0);
+        sprintf(key, "k%d", i);
+        ASSERT_TRUE(json_add_member(json, key, json_new_str(key)));
+    }
+
+    JSON *copy = json_compact(json);
+    ASSERT_TRUE(copy);
+    EXPECT_EQ(0, save_text(&expect, json));
+    EXPECT_EQ(0, save_text(&result, copy));
+    ASSERT_TRUE(strcmp(expect.str, result.str) == 0);
+    free(expect.str);
+    free(result.str);
+    EXPECT_EQ(4999, json_arr_get_int(json_get_member(copy, "nums"), 4999, 0));
+    ASSERT_STREQ("k4321", json_obj_get_str(copy, "k4321", NULL));
+    json_free(json);
+    json_free(copy);
+}
+
+// 测试延迟加载的树在拷贝时被展开
+TEST(json_compact, lazy)
+{
+    JSON *json = json_load_lazy("json-test.json");
+    ASSERT_TRUE(json);
+    JSON *copy = json_compact(json);
+    ASSERT_TRUE(copy);
+    json_free(json);
+    EXPECT_EQ(389, json_obj_get_num(json_get_member(copy, "basic"), "port", 0));
+    ASSERT_STREQ("200.0.0.254", json_arr_get_str(json_get_member(json_get_member(copy, "basic"), "dns"), 1, NULL));
+    json_free(copy);
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_freeze
+//----------------------------------------------------------------------------------------------------
+
+// 构建冻结测试用的树：含打包数组、带哈希索引的大对象和长字符串
+static JSON *frozen_sample(void)
+{
+    char key[16];
+    JSON *json = json_load("json-test.json");
+    if (!json)
+        return NULL;
+    JSON *nums = json_new(JSON_ARR);
+    JSON *big = json_new(JSON_OBJ);
+    if (!json_add_member(json, "nums", nums) || !json_add_member(json, "big", big))
+        return json;
+    for (int i = 0; i < 40; i++)
+    {
+        json_arr_add_num(nums, i + 0.5);
+        sprintf(key, "key%d", i);
+        json_add_member(big, key, json_new_str(i % 2 ? "a string longer than sso" : "short"));
+    }
+    return json;
+}
+
+// 测试冻结映像的输出和读取结果与原来的树相同
+TEST(json_freeze, scene)
+{
+    buf_t expect, result;
+    JSON *json = frozen_sample();
+    ASSERT_TRUE(json);
+    EXPECT_EQ(0, json_freeze(json, "test.frz"));
+    JSON *frozen = json_open_frozen("test.frz");
+    ASSERT_TRUE(frozen);
+
+    EXPECT_EQ(0, save_text(&expect, json));
+    EXPECT_EQ(0, save_text(&result, frozen));
+    ASSERT_TRUE(strcmp(expect.str, result.str) == 0);
+    free(expect.str);
+    free(result.str);
+
+    const JSON *basic = json_get_member(frozen, "basic");
+    EXPECT_EQ(389, json_obj_get_num(basic, "port", 0));
+    ASSERT_STREQ("200.0.0.254", json_arr_get_str(json_get_member(basic, "dns"), 1, NULL));
+    EXPECT_EQ(39.5, json_arr_get_num(json_get_member(frozen, "nums"), 39, 0));
+    ASSERT_STREQ("a string longer than sso", json_obj_get_str(json_get_member(frozen, "big"), "key37", NULL));
+    json_path *path = json_path_compile("big.key12");
+    ASSERT_TRUE(path);
+    ASSERT_STREQ("short", json_str(json_get_compiled(frozen, path), NULL));
+    json_path_free(path);
+
+    json_free(frozen);
+    json_free(json);
+}
+
+// 测试同一个映像打开两次，第二次不在首选地址上，重定位后结果相同
+TEST(json_freeze, relocate)
+{
+    buf_t expect, result;
+    JSON *json = frozen_sample();
+    ASSERT_TRUE(json);
+    EXPECT_EQ(0, json_freeze(json, "test.frz"));
+    json_free(json);
+
+    JSON *first = json_open_frozen("test.frz");
+    JSON *second = json_open_frozen("test.frz");
+    ASSERT_TRUE(first && second && first != second);
+    EXPECT_EQ(0, save_text(&expect, first));
+    EXPECT_EQ(0, save_text(&result, second));
+    ASSERT_TRUE(strcmp(expect.str, result.str) == 0);
+    free(expect.str);
+    free(result.str);
+    json_free(first);
+    ASSERT_STREQ("short", json_obj_get_str(json_get_member(second, "big"), "key0", NULL));
+    json_free(second);
+}
+
+// 测试修改接口拒绝冻结的值，拷贝出来后可以修改
+TEST(json_freeze, read_only)
+{
+    JSON *json = frozen_sample();
+    ASSERT_TRUE(json);
+    EXPECT_EQ(0, json_freeze(json, "test.frz"));
+    json_free(json);
+    JSON *frozen = json_open_frozen("test.frz");
+    ASSERT_TRUE(frozen);
+
+    JSON *basic = (JSON *)json_get_member(frozen, "basic");
+    EXPECT_EQ(-1, json_obj_set_num(basic, "port", 80));
+    EXPECT_EQ(-1, json_arr_add_num((JSON *)json_get_member(frozen, "nums"), 1));
+    ASSERT_TRUE(json_add_member(basic, "x", json_new_num(1)) == NULL);
+    EXPECT_EQ(389, json_obj_get_num(basic, "port", 0));
+
+    JSON *copy = json_compact(frozen);
+    ASSERT_TRUE(copy);
+    EXPECT_EQ(0, json_obj_set_num((JSON *)json_get_member(copy, "basic"), "port", 80));
+    EXPECT_EQ(80, json_obj_get_num(json_get_member(copy, "basic"), "port", 0));
+    json_free(copy);
+    json_free(frozen);
+}
+
+// 测试拒绝打开不是映像或不完整的文件
+TEST(json_freeze, invalid)
+{
+    buf_t image;
+    ASSERT_TRUE(json_open_frozen("json-test.json") == NULL);
+    ASSERT_TRUE(json_open_frozen("no-such-file.frz") == NULL);
+
+    JSON *json = frozen_sample();
+    ASSERT_TRUE(json);
+    EXPECT_EQ(0, json_freeze(json, "test.frz"));
+    json_free(json);
+    EXPECT_EQ(0, read_file(&image, "test.frz"));
+    FILE *fp = fopen("test.frz", "wb");
+    ASSERT_TRUE(fp);
+    fwrite(image.str, 1, (image.size - 1) / 2, fp);
+    fclose(fp);
+    free(image.str);
+    ASSERT_TRUE(json_open_frozen("test.frz") == NULL);
+}
+
+// 测试文件头的校验和：改动首选地址后文件头的其余检查都能通过，但校验和不符
+TEST(json_freeze, bad_header)
+{
+    buf_t image;
+    uint64_t base;
+
+    JSON *json = frozen_sample();
+    ASSERT_TRUE(json);
+    EXPECT_EQ(0, json_freeze(json, "test.frz"));
+    json_free(json);
+    EXPECT_EQ(0, read_file(&image, "test.frz"));
+    // 首选地址在魔数和两个 U32 之后
+    memcpy(&base, image.str + 16, sizeof(base));
+    base += 1 << 20;
+    memcpy(image.str + 16, &base, sizeof(base));
+    FILE *fp = fopen("test.frz", "wb");
+    ASSERT_TRUE(fp);
+    fwrite(image.str, 1, image.size - 1, fp);
+    fclose(fp);
+    free(image.str);
+    ASSERT_TRUE(json_open_frozen("test.frz") == NULL);
+}
+
+// 比较两个值保存的文本，空的对象和数组保存的文本为空
+static BOOL same_text(const JSON *a, const JSON *b)
+{
+    char text[2][256] = {"", ""};
+    const JSON *json[2] = {a, b};
+    for (int i = 0; i < 2; i++)
+    {
+        if (json_save(json[i], "test.yml") < 0)
+            return FALSE;
+        FILE *fp = fopen("test.yml", "rb");
+        if (!fp)
+            return FALSE;
+        fread(text[i], 1, sizeof(text[i]) - 1, fp);
+        fclose(fp);
+    }
+    return json_type(a) == json_type(b) && strcmp(text[0], text[1]) == 0;
+}
+
+// 测试空的对象和数组，包括位于节点区末尾的，映射在首选地址和重定位两种情况下都能打开
+TEST(json_freeze, empty)
+{
+    static const char *const texts[] = {"[]", "{}", "[1,[]]", "{\"k\":1,\"z\":{}}", "{\"a\":[],\"b\":[{}]}"};
+
+    for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); i++)
+    {
+        JSON *json = json_parse(texts[i], strlen(texts[i]));
+        ASSERT_TRUE(json);
+        EXPECT_EQ(0, json_freeze(json, "test.frz"));
+        JSON *first = json_open_frozen("test.frz");
+        JSON *second = json_open_frozen("test.frz");
+        ASSERT_TRUE(first && second && first != second);
+        ASSERT_TRUE(same_text(json, first));
+        ASSERT_TRUE(same_text(json, second));
+        json_free(second);
+        json_free(first);
+        json_free(json);
+    }
+    JSON *json = json_parse("[1,[]]", 6);
+    ASSERT_TRUE(json);
+    EXPECT_EQ(0, json_freeze(json, "test.frz"));
+    json_free(json);
+    JSON *frozen = json_open_frozen("test.frz");
+    ASSERT_TRUE(frozen);
+    EXPECT_EQ(JSON_ARR, json_type(json_get_element(frozen, 1)));
+    EXPECT_EQ(0, json_arr_count(json_get_element(frozen, 1)));
+    ASSERT_TRUE(json_get_element(json_get_element(frozen, 1), 0) == NULL);
+    json_free(frozen);
+}
+
+// 测试重定位时拒绝打开指针被改坏的映像；映射在首选地址时只检查文件头和根节点，不逐个检查指针
+TEST(json_freeze, bad_pointer)
+{
+    buf_t image;
+    uint64_t field, wild = 0x4141414141414140ull;
+
+    JSON *json = frozen_sample();
+    ASSERT_TRUE(json);
+    EXPECT_EQ(0, json_freeze(json, "test.frz"));
+    json_free(json);
+    EXPECT_EQ(0, read_file(&image, "test.frz"));
+    // 完好的副本，首选地址与 test.frz 相同
+    FILE *fp = fopen("test2.frz", "wb");
+    ASSERT_TRUE(fp);
+    fwrite(image.str, 1, image.size - 1, fp);
+    fclose(fp);
+    // 重定位表在映像的末尾，把最后一项登记的指针改成野指针
+    memcpy(&field, image.str + image.size - 1 - sizeof(field), sizeof(field));
+    ASSERT_TRUE(field + sizeof(wild) < image.size);
+    memcpy(image.str + field, &wild, sizeof(wild));
+    fp = fopen("test.frz", "wb");
+    ASSERT_TRUE(fp);
+    fwrite(image.str, 1, image.size - 1, fp);
+    fclose(fp);
+    free(image.str);
+
+    // 完好的副本占住首选地址，改坏的映像只能重定位
+    JSON *good = json_open_frozen("test2.frz");
+    ASSERT_TRUE(good);
+    ASSERT_TRUE(json_open_frozen("test.frz") == NULL);
+    json_free(good);
+    remove("test2.frz");
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_load_lines
+//----------------------------------------------------------------------------------------------------
+
+// 检查记录是否按顺序到达，并累计记录中的数值
+typedef struct line_sum
+{
+    int count;
+    int stop_at; // 收到这么多条记录后要求停止，0 表示不停止
+    BOOL in_order;
+    double sum;
+    size_t last_off;
+} line_sum;
+
+static int on_line(void *ctx, JSON *record, size_t offset)
+{
+    line_sum *s = (line_sum *)ctx;
+    double id = json_obj_get_num(record, "id", -1);
+    if (id != s->count || (s->count > 0 && offset <= s->last_off))
+        s->in_order = FALSE;
+    s->count++;
+    s->sum += id;
+    s->last_off = offset;
+    return s->stop_at && s->count >= s->stop_at;
+}
+
+// 写入 n 行记录，跨越多个任务，夹杂空行和 \r\n
+static int write_lines(const char *fname, int n)
+{
+    FILE *fp = fopen(fname, "wb");
+    if (!fp)
+        return -1;
+    for (int i = 0; i < n; i++)
+    {
+        fprintf(fp, "{\"id\": %d, \"name\": \"record-%d\", \"tags\": [1, 2, 3]}%s", i, i, i % 7 ? "\n" : "\r\n");
+        if (i % 1000 == 0)
+            fprintf(fp, "  \n");
+    }
+    fclose(fp);
+    return 0;
+}
+
+// 测试按序交付时，多个线程加载的记录顺序与文件中相同
+TEST(json_load_lines, ordered)
+{
+    const int n = 60000;
+    ASSERT_TRUE(write_lines("test.json", n) == 0);
+
+    for (int threads = 1; threads <= 4; threads++)
+    {
+        line_sum s = {0, 0, TRUE, 0, 0};
+        EXPECT_EQ(0, json_load_lines("test.json", threads, on_line, &s, TRUE));
+        EXPECT_EQ(n, s.count);
+        EXPECT_EQ(TRUE, s.in_order);
+        EXPECT_EQ((double)n * (n - 1) / 2, s.sum);
+    }
+}
+
+// 测试不要求顺序时，所有记录都恰好交付一次
+TEST(json_load_lines, unordered)
+{
+    const int n = 60000;
+    line_sum s = {0, 0, TRUE, 0, 0};
+    ASSERT_TRUE(write_lines("test.json", n) == 0);
+
+    EXPECT_EQ(0, json_load_lines("test.json", 0, on_line, &s, FALSE));
+    EXPECT_EQ(n, s.count);
+    EXPECT_EQ((double)n * (n - 1) / 2, s.sum);
+}
+
+// 测试非法记录和回调要求停止
+TEST(json_load_lines, stop)
+{
+    line_sum s = {0, 0, TRUE, 0, 0};
+    ASSERT_TRUE(write_text("test.json", "{\"id\": 0}\n{\"id\": 1}\n{\"id\": }\n{\"id\": 3}\n") == 0);
+    EXPECT_EQ(-1, json_load_lines("test.json", 2, on_line, &s, TRUE));
+    ASSERT_TRUE(json_load_lines("nonexist.json", 2, on_line, &s, TRUE) == -1);
+
+    ASSERT_TRUE(write_lines("test.json", 60000) == 0);
+    memset(&s, 0, sizeof(s));
+    s.in_order = TRUE;
+    s.stop_at = 100;
+    EXPECT_EQ(-1, json_load_lines("test.json", 4, on_line, &s, TRUE));
+    EXPECT_EQ(100, s.count);
+    EXPECT_EQ(TRUE, s.in_order);
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_parser
+//----------------------------------------------------------------------------------------------------
+
+// 统计回调次数，并把事件记录成字符串
+typedef struct event_log
+{
+    char text[256];
+    int count;
+} event_log;
+
+static void log_event(event_log *log, const char *event)
+{
+    strcat(log->text, event);
+    log->count++;
+}
+static int on_start_object(void *ctx)
+{
+    log_event((event_log *)ctx, "{");
+    return 0;
+}
+static int on_end_object(void *ctx)
+{
+    log_event((event_log *)ctx, "}");
+    return 0;
+}
+static int on_start_array(void *ctx)
+{
+    log_event((event_log *)ctx, "[");
+    return 0;
+}
+static int on_end_array(void *ctx)
+{
+    log_event((event_log *)ctx, "]");
+    return 0;
+}
+static int on_key(void *ctx, const char *key, size_t len)
+{
+    log_event((event_log *)ctx, key);
+    log_event((event_log *)ctx, ":");
+    return strlen(key) == len ? 0 : -1;
+}
+static int on_string(void *ctx, const char *str, size_t len)
+{
+    log_event((event_log *)ctx, str);
+    return 0;
+}
+static int on_number(void *ctx, double num)
+{
+    char buf[JSON_NUM_BUF + 1];
+    buf[json_num_to_str(num, buf)] = '\0';
+    log_event((event_log *)ctx, buf);
+    return 0;
+}
+static int on_boolean(void *ctx, BOOL val)
+{
+    log_event((event_log *)ctx, val ? "T" : "F");
+    return 0;
+}
+static int on_null(void *ctx)
+{
+    log_event((event_log *)ctx, "N");
+    return 0;
+}
+
+// 测试每次只输入一个字节时，回调的顺序和内容
+TEST(json_parser, events)
+{
+    const json_handler handler = {on_start_object, on_end_object, on_start_array, on_end_array,
+                                  on_key, on_string, on_number, on_boolean, on_null};
+    const char *text = "{\"a\": [1, -2.5e1, \"x\\ty\"], \"b\": {\"c\": true, \"d\": null}, \"e\": false}";
+    event_log log = {"", 0};
+
+    json_parser *p = json_parser_new(&handler, &log);
+    ASSERT_TRUE(p);
+    for (size_t i = 0; text[i]; i++)
+        ASSERT_TRUE(json_parser_feed(p, text + i, 1) == 0);
+    EXPECT_EQ(0, json_parser_finish(p));
+    EXPECT_STREQ("{a:[1-25x\ty]b:{c:Td:N}e:F}", log.text);
+    EXPECT_EQ(22, log.count);
+    // 没有使用 json_parser_new_tree，不会构建 JSON 树
+    ASSERT_TRUE(json_parser_root(p) == NULL);
+    json_parser_free(p);
+}
+
+// 测试按任意大小分块输入时，构建的 JSON 树与一次性解析的结果相同
+TEST(json_parser, tree_chunks)
+{
+    const char *text = "{\"basic\": {\"enable\": true, \"port\": 389, \"ip\": \"200.200.3.61\","
+                       " \"dns\": [\"200.200.3.254\", \"\\u4e2d\"], \"timeout\": 1.5e-3}, \"advance\": null}";
+    size_t len = strlen(text);
+    buf_t expect, result;
+
+    JSON *json = json_parse(text, len);
+    ASSERT_TRUE(json);
+    EXPECT_EQ(0, json_save(json, "test.yml"));
+    EXPECT_EQ(0, read_file(&expect, "test.yml"));
+    json_free(json);
+
+    for (size_t chunk = 1; chunk <= len; chunk++)
+    {
+        json_parser *p = json_parser_new_tree(NULL);
+        ASSERT_TRUE(p);
+        for (size_t off = 0; off < len; off += chunk)
+            ASSERT_TRUE(json_parser_feed(p, text + off, off + chunk > len ? len - off : chunk) == 0);
+        EXPECT_EQ(0, json_parser_finish(p));
+        json = json_parser_root(p);
+        json_parser_free(p);
+        ASSERT_TRUE(json);
+
+        EXPECT_EQ(0, json_save(json, "test.yml"));
+        EXPECT_EQ(0, read_file(&result, "test.yml"));
+        ASSERT_TRUE(strcmp(expect.str, result.str) == 0);
+        free(result.str);
+        json_free(json);
+    }
+    free(expect.str);
+}
+
+// 测试在文档中构建 JSON 树，根值为标量时在输入结束后才确定
+TEST(json_parser, tree_doc)
+{
+    json_doc *doc = json_doc_new();
+    ASSERT_TRUE(doc);
+
+    json_parser *p = json_parser_new_tree(doc);
+    ASSERT_TRUE(p);
+    EXPECT_EQ(0, json_parser_feed(p, "12", 2));
+    EXPECT_EQ(0, json_parser_feed(p, "34", 2));
+    ASSERT_TRUE(json_parser_root(p) == NULL);
+    EXPECT_EQ(0, json_parser_finish(p));
+    JSON *json = json_parser_root(p);
+    json_parser_free(p);
+    EXPECT_EQ(1234, json_num(json, 0));
+    EXPECT_EQ(JSON_INT, json_type(json));
+
+    // 超过 2^53 的整数按 JSON_INT 精确构建
+    p = json_parser_new_tree(doc);
+    ASSERT_TRUE(p);
+    EXPECT_EQ(0, json_parser_feed(p, "[9007199254740993]", 18));
+    EXPECT_EQ(0, json_parser_finish(p));
+    json = json_parser_root(p);
+    json_parser_free(p);
+    EXPECT_EQ(9007199254740993LL, json_arr_get_int(json, 0, 0));
+
+    json_doc_free(doc);
+}
+
+// 测试非法输入，出错后不再接受输入
+TEST(json_parser, invalid)
+{
+    const char *texts[] = {"", "{", "[1,]", "{\"a\" 1}", "{\"a\":}", "01", "-", "tru", "truex", "[1 2]",
+                           "\"abc", "{\"a\":1}}", "[\"\\x\"]", "{1:2}", "[1]]", "nul", "1.", "[\"a\nb\"]"};
+
+    for (size_t i = 0; i < sizeof(texts) / sizeof(texts[0]); i++)
+    {
+        json_parser *p = json_parser_new_tree(NULL);
+        ASSERT_TRUE(p);
+        if (json_parser_feed(p, texts[i], strlen(texts[i])) == 0)
+            EXPECT_EQ(-1, json_parser_finish(p));
+        EXPECT_EQ(-1, json_parser_feed(p, " ", 1));
+        ASSERT_TRUE(json_parser_root(p) == NULL);
+        json_parser_free(p);
+    }
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_num_to_str
+//----------------------------------------------------------------------------------------------------
+
+// 测试整数、小数和科学计数法的写法
+TEST(json_num_to_str, format)
+{
+    const struct
+    {
+        double num;
+        const char *expect;
+    } cases[] = {
+        {0, "0"},
+        {-0.0, "-0"},
+        {10, "10"},
+        {-389, "-389"},
+        {1.58, "1.58"},
+        {0.1, "0.1"},
+        {1e-9, "1e-9"},
+        {0.000001234, "0.000001234"},
+        {133333333333.123456, "133333333333.12346"},
+        {1e20, "100000000000000000000"},
+        {1e21, "1e+21"},
+        {5e-324, "5e-324"},
+        {1.7976931348623157e308, "1.7976931348623157e+308"},
+    };
+    char buf[JSON_NUM_BUF];
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        int len = json_num_to_str(cases[i].num, buf);
+        ASSERT_TRUE(len > 0 && len < JSON_NUM_BUF);
+        buf[len] = '\0';
+        EXPECT_STREQ(cases[i].expect, buf);
+    }
+}
+
+// 测试任意位模式的双精度数都能被 strtod 精确还原
+TEST(json_num_to_str, roundtrip)
+{
+    unsigned long long seed = 88172645463325252ULL;
+    char buf[JSON_NUM_BUF];
+
+    for (int i = 0; i < 100000; i++)
+    {
+        double num;
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        memcpy(&num, &seed, sizeof(num));
+        if (num != num || num - num != 0) // 跳过非数和无穷大
+            continue;
+
+        int len = json_num_to_str(num, buf);
+        ASSERT_TRUE(len > 0 && len < JSON_NUM_BUF);
+        buf[len] = '\0';
+        ASSERT_TRUE(strtod(buf, NULL) == num);
+    }
+}
+
+// 测试保存时数字不再丢失精度
+TEST(json_num_to_str, save)
+{
+    buf_t result;
+    const char *expect = "- 1e-9\n- 133333333333.12346\n- .inf\n";
+    JSON *json = json_new(JSON_ARR);
+    ASSERT_TRUE(json);
+
+    ASSERT_TRUE(json_arr_add_num(json, 1e-9));
+    ASSERT_TRUE(json_arr_add_num(json, 133333333333.123456));
+    ASSERT_TRUE(json_arr_add_num(json, HUGE_VAL));
+
+    EXPECT_EQ(0, json_save(json, "test.yml"));
+    EXPECT_EQ(0, read_file(&result, "test.yml"));
+
+    ASSERT_TRUE(strcmp(result.str, expect) == 0);
+    free(result.str);
+    json_free(json);
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_path_compile
+//----------------------------------------------------------------------------------------------------
+
+// 测试路径的语法检查
+TEST(json_path_compile, syntax)
+{
+    const char *valid[] = {"", "basic", "basic.dns[1]", "[0]", "[0][1].a", "a.b.c"};
+    const char *invalid[] = {".", "a.", "a..b", "a[", "a[]", "a[x]", "a[1", "[1]x", "a[99999999999]"};
+
+    for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); i++)
+    {
+        json_path *path = json_path_compile(valid[i]);
+        ASSERT_TRUE(path != NULL);
+        json_path_free(path);
+    }
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+        ASSERT_TRUE(json_path_compile(invalid[i]) == NULL);
+}
+
+// 测试按编译后的路径查找
+TEST(json_path_compile, get)
+{
+    const char *text = "{\"basic\": {\"enable\": true, \"dns\": [\"200.200.3.254\", \"200.200.1.1\"]}}";
+    JSON *json = json_parse(text, strlen(text));
+    ASSERT_TRUE(json);
+
+    json_path *path = json_path_compile("basic.dns[1]");
+    ASSERT_TRUE(path);
+    ASSERT_STREQ("200.200.1.1", json_str(json_get_compiled(json, path), NULL));
+    json_path_free(path);
+
+    path = json_path_compile("");
+    ASSERT_TRUE(json_get_compiled(json, path) == json);
+    json_path_free(path);
+
+    const char *missing[] = {"basic.dns[2]", "basic.ip", "basic.enable.x", "[0]", "basic[0]"};
+    for (size_t i = 0; i < sizeof(missing) / sizeof(missing[0]); i++)
+    {
+        path = json_path_compile(missing[i]);
+        ASSERT_TRUE(path);
+        ASSERT_TRUE(json_get_compiled(json, path) == NULL);
+        json_path_free(path);
+    }
+    json_free(json);
+}
+
+// 测试按编译后的路径在建立了哈希索引的大对象中查找
+TEST(json_path_compile, large_object)
+{
+    char key[32];
+    JSON *json = json_new(JSON_OBJ);
+    ASSERT_TRUE(json);
+    for (int i = 0; i < 100; i++)
+    {
+        sprintf(key, "key%d", i);
+        ASSERT_TRUE(json_add_member(json, key, json_new_num(i)));
+    }
+
+    json_path *path = json_path_compile("key77");
+    ASSERT_TRUE(path);
+    EXPECT_EQ(77, json_num(json_get_compiled(json, path), 0));
+    json_path_free(path);
+    json_free(json);
+}
+
+// 测试按编译后的路径修改、新建和追加成员
+TEST(json_path_compile, set)
+{
+    JSON *json = json_new(JSON_OBJ);
+    ASSERT_TRUE(json);
+
+    const char *paths[] = {"basic", "basic.enable", "basic.dns", "basic.dns[0]", "basic.dns[1]", "basic.dns[0]",
+                           "basic.dns[3]", "advance.enable"};
+    JSON *vals[] = {json_new(JSON_OBJ), json_new_bool(TRUE), json_new(JSON_ARR), json_new_str("192.168.1.1"),
+                    json_new_str("200.200.1.1"), json_new_str("200.200.3.254"), json_new_str("x"),
+                    json_new_bool(TRUE)};
+    int expect[] = {0, 0, 0, 0, 0, 0, -1, -1};
+    for (size_t i = 0; i < sizeof(paths) / sizeof(paths[0]); i++)
+    {
+        json_path *path = json_path_compile(paths[i]);
+        ASSERT_TRUE(path);
+        EXPECT_EQ(expect[i], json_set_compiled(json, path, vals[i]));
+        json_path_free(path);
+    }
+
+    const JSON *basic = json_get_member(json, "basic");
+    EXPECT_EQ(TRUE, json_obj_get_bool(basic, "enable"));
+    const JSON *dns = json_get_member(basic, "dns");
+    EXPECT_EQ(2, json_arr_count(dns));
+    ASSERT_STREQ("200.200.3.254", json_arr_get_str(dns, 0, NULL));
+    ASSERT_STREQ("200.200.1.1", json_arr_get_str(dns, 1, NULL));
+
+    // 空路径替换 JSON 值本身
+    json_path *self = json_path_compile("");
+    ASSERT_TRUE(self);
+    EXPECT_EQ(0, json_set_compiled(json, self, json_new_num(8080)));
+    EXPECT_EQ(JSON_NUM, json_type(json));
+    EXPECT_EQ(8080, json_num(json, 0));
+    // 标量替换为容器，再替换为另一种容器
+    JSON *obj = json_new(JSON_OBJ);
+    ASSERT_TRUE(json_add_member(obj, "port", json_new_num(53)));
+    EXPECT_EQ(0, json_set_compiled(json, self, obj));
+    EXPECT_EQ(53, json_obj_get_num(json, "port", 0));
+    JSON *arr = json_new(JSON_ARR);
+    ASSERT_TRUE(json_add_element(arr, json_new_str("200.200.0.1")));
+    EXPECT_EQ(0, json_set_compiled(json, self, arr));
+    ASSERT_STREQ("200.200.0.1", json_arr_get_str(json, 0, NULL));
+    json_path_free(self);
+    json_free(json);
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_snapshot
+//----------------------------------------------------------------------------------------------------
+
+// 测试快照修改后两个版本互不影响，未修改的子树仍然共享
+TEST(json_snapshot, set_compiled)
+{
+    buf_t expect, result;
+    JSON *json = json_load("json-test.json");
+    ASSERT_TRUE(json);
+    EXPECT_EQ(0, save_text(&expect, json));
+    JSON *snap = json_snapshot(json);
+    ASSERT_TRUE(snap);
+    ASSERT_TRUE(json_get_member(snap, "basic") == json_get_member(json, "basic"));
+
+    json_path *path = json_path_compile("basic.dns[1]");
+    ASSERT_TRUE(path);
+    EXPECT_EQ(0, json_set_compiled(snap, path, json_new_str("10.0.0.1")));
+    json_path_free(path);
+    ASSERT_STREQ("10.0.0.1", json_arr_get_str(json_get_member(json_get_member(snap, "basic"), "dns"), 1, NULL));
+    ASSERT_STREQ("200.0.0.254", json_arr_get_str(json_get_member(json_get_member(json, "basic"), "dns"), 1, NULL));
+    // 只有路径上的节点被拷贝
+    const JSON *old_basic = json_get_member(json, "basic"), *new_basic = json_get_member(snap, "basic");
+    ASSERT_TRUE(old_basic != new_basic);
+    ASSERT_TRUE(json_get_member(old_basic, "dns") != json_get_member(new_basic, "dns"));
+    ASSERT_TRUE(json_get_member(json, "advance") == json_get_member(snap, "advance"));
+    ASSERT_STREQ(json_obj_get_str(old_basic, "ip", NULL), json_obj_get_str(new_basic, "ip", NULL));
+
+    // 先释放原来的版本，快照仍然完整
+    json_free(json);
+    EXPECT_EQ(389, json_obj_get_num(json_get_member(snap, "basic"), "port", 0));
+    JSON *again = json_snapshot(snap);
+    ASSERT_TRUE(again);
+    json_free(snap);
+    EXPECT_EQ(0, save_text(&result, again));
+    ASSERT_TRUE(strcmp(expect.str, result.str) != 0);
+    free(expect.str);
+    free(result.str);
+    json_free(again);
+}
+
+// 测试直接对快照的根节点调用修改接口，以及共享的子成员不能就地修改
+TEST(json_snapshot, root_setters)
+{
+    const char *text = "{\"port\": 80, \"name\": \"a name longer than sso\", \"tags\": [1, 2], \"sub\": {\"on\": true}}";
+    JSON *json = json_parse(text, strlen(text));
+    ASSERT_TRUE(json);
+    JSON *snap = json_snapshot(json);
+    ASSERT_TRUE(snap);
+
+    EXPECT_EQ(0, json_obj_set_num(snap, "port", 8080));
+    EXPECT_EQ(0, json_obj_set_str(snap, "name", "x"));
+    ASSERT_TRUE(json_add_member(snap, "new", json_new_bool(TRUE)));
+    ASSERT_TRUE(json_add_member(snap, "sub", json_new_num(1)));
+    EXPECT_EQ(80, json_obj_get_num(json, "port", 0));
+    EXPECT_EQ(8080, json_obj_get_num(snap, "port", 0));
+    ASSERT_STREQ("a name longer than sso", json_obj_get_str(json, "name", NULL));
+    ASSERT_STREQ("x", json_obj_get_str(snap, "name", NULL));
+    EXPECT_EQ(TRUE, json_obj_get_bool(json_get_member(json, "sub"), "on"));
+    ASSERT_TRUE(json_get_member(json, "new") == NULL);
+
+    JSON *tags = (JSON *)json_get_member(json, "tags");
+    EXPECT_EQ(-1, json_arr_add_num(tags, 3));
+    ASSERT_TRUE(json_add_element(tags, json_new_num(3)) == NULL);
+    EXPECT_EQ(2, json_arr_count(tags));
+
+    json_free(snap);
+    EXPECT_EQ(1, json_arr_add_num(tags, 3));
+    json_free(json);
+}
+
+// 测试文档中的树也能建立快照
+TEST(json_snapshot, doc)
+{
+    json_doc *doc = json_doc_new();
+    ASSERT_TRUE(doc);
+    JSON *json = json_doc_load(doc, "json-test.json");
+    ASSERT_TRUE(json);
+    JSON *snap = json_snapshot(json);
+    ASSERT_TRUE(snap);
+    json_path *path = json_path_compile("basic.port");
+    ASSERT_TRUE(path);
+    EXPECT_EQ(0, json_set_compiled(snap, path, json_doc_new_num(doc, 80)));
+    json_path_free(path);
+    EXPECT_EQ(389, json_obj_get_num(json_get_member(json, "basic"), "port", 0));
+    EXPECT_EQ(80, json_obj_get_num(json_get_member(snap, "basic"), "port", 0));
+    json_doc_free(doc);
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_publish
+//----------------------------------------------------------------------------------------------------
+
+// 测试读区中取得的旧版本在换下之后仍然有效
+TEST(json_publish, single)
+{
+    JSON *v1 = json_new(JSON_OBJ);
+    ASSERT_TRUE(json_add_member(v1, "version", json_new_str("first version, heap string")));
+    json_slot *slot = json_slot_new(v1);
+    ASSERT_TRUE(slot);
+
+    const JSON *cur = json_acquire(slot);
+    ASSERT_TRUE(cur == v1);
+    JSON *v2 = json_snapshot(v1);
+    ASSERT_TRUE(v2);
+    EXPECT_EQ(0, json_obj_set_str(v2, "version", "second"));
+    json_publish(slot, v2);
+    ASSERT_STREQ("first version, heap string", json_obj_get_str(cur, "version", NULL));
+
+    // 嵌套的读区看到新版本，最外层离开之前旧版本都不会被释放
+    const JSON *inner = json_acquire(slot);
+    ASSERT_TRUE(inner == v2);
+    json_release();
+    json_publish(slot, json_snapshot(v2));
+    ASSERT_STREQ("first version, heap string", json_obj_get_str(cur, "version", NULL));
+    ASSERT_STREQ("second", json_obj_get_str(inner, "version", NULL));
+    json_release();
+
+    json_publish(slot, NULL);
+    ASSERT_TRUE(json_acquire(slot) == NULL);
+    json_release();
+    json_slot_free(slot);
+    json_slot_free(NULL);
+}
+
+typedef struct publish_reader
+{
+    json_slot *slot;
+    int reads;
+    int errors;
+} publish_reader;
+
+static void *publish_read(void *arg)
+{
+    publish_reader *pr = (publish_reader *)arg;
+    for (int i = 0; i < pr->reads; i++)
+    {
+        const JSON *cur = json_acquire(pr->slot);
+        const JSON *sub = json_get_member(cur, "sub");
+        // 同一个版本里两处数值总是相等
+        if (!cur || json_obj_get_int(cur, "seq", -1) != json_obj_get_int(sub, "seq", -2))
+            pr->errors++;
+        json_release();
+    }
+    return NULL;
+}
+
+// 测试多个读者线程与发布者并发
+TEST(json_publish, threads)
+{
+    const char *text = "{\"seq\": 0, \"sub\": {\"seq\": 0, \"name\": \"a name longer than sso\"}}";
+    JSON *json = json_parse(text, strlen(text));
+    ASSERT_TRUE(json);
+    json_slot *slot = json_slot_new(json);
+    ASSERT_TRUE(slot);
+    json_path *path = json_path_compile("sub.seq");
+    ASSERT_TRUE(path);
+
+    pthread_t tids[4];
+    publish_reader readers[4];
+    for (int i = 0; i < 4; i++)
+    {
+        readers[i].slot = slot;
+        readers[i].reads = 20000;
+        readers[i].errors = 0;
+        ASSERT_EQ(0, pthread_create(&tids[i], NULL, publish_read, &readers[i]));
+    }
+    for (int seq = 1; seq <= 2000; seq++)
+    {
+        // 只有发布者修改 json，读者看到的版本不会再被修改
+        JSON *next = json_snapshot(json);
+        ASSERT_TRUE(next);
+        EXPECT_EQ(0, json_set_compiled(next, path, json_new_int(seq)));
+        EXPECT_EQ(0, json_obj_set_num(next, "seq", seq));
+        json_publish(slot, next);
+        json = next;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        pthread_join(tids[i], NULL);
+        EXPECT_EQ(0, readers[i].errors);
+    }
+    const JSON *cur = json_acquire(slot);
+    EXPECT_EQ(2000, json_obj_get_int(json_get_member(cur, "sub"), "seq", 0));
+    json_release();
+    json_path_free(path);
+    json_slot_free(slot);
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_free_async
+//----------------------------------------------------------------------------------------------------
+
+// 测试各种值交给后台线程释放，超过队列长度时就地释放
+TEST(json_free_async, scene)
+{
+    json_free_async(NULL);
+    json_free_async(json_new_num(1));
+    json_free_async(json_load("json-test.json"));
+    JSON *json = json_load("json-test.json");
+    ASSERT_TRUE(json);
+    json_free_async(json_compact(json));
+    JSON *snap = json_snapshot(json);
+    ASSERT_TRUE(snap);
+    json_free_async(json);
+    for (int i = 0; i < 1000; i++)
+    {
+        JSON *arr = json_new(JSON_ARR);
+        ASSERT_TRUE(arr);
+        EXPECT_EQ(1, json_arr_add_str(arr, "a string longer than sso"));
+        json_free_async(arr);
+    }
+    json_free_drain();
+    // 快照持有的子成员不受原版本释放的影响
+    EXPECT_EQ(389, json_obj_get_num(json_get_member(snap, "basic"), "port", 0));
+    json_free_async(snap);
+    json_free_drain();
+    json_free_drain();
+}
+
+// 测试 fork 出的子进程中仍然可以使用后台释放
+TEST(json_free_async, fork)
+{
+    json_free_async(json_load("json-test.json"));
+    pid_t pid = fork();
+    ASSERT_TRUE(pid >= 0);
+    if (pid == 0)
+    {
+        JSON *json = json_load("json-test.json");
+        json_free_async(json);
+        json_free_drain();
+        _exit(json ? 0 : 1);
+    }
+    int status = -1;
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    EXPECT_EQ(0, status);
+    json_free_drain();
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_save_step
+//----------------------------------------------------------------------------------------------------
+
+// 用 budget 分多步保存 json，返回调用 json_save_step 的次数，失败返回 -1
+static int save_steps(buf_t *buf, const JSON *json, size_t budget)
+{
+    json_saver *s = json_save_begin(json, "test.yml");
+    int ret, steps = 0;
+    if (!s)
+        return -1;
+    do
+    {
+        ret = json_save_step(s, budget);
+        steps++;
+    } while (ret == 1);
+    if (json_save_end(s) != 0 || ret != 0)
+        return -1;
+    return read_file(buf, "test.yml") < 0 ? -1 : steps;
+}
+
+// 测试增量保存的结果与 json_save 相同
+TEST(json_save_step, same_as_save)
+{
+    const char *text = "[[1, 2.5, 3], {\"a\": [], \"b\": {}}, [[true, false], [{\"x\": null}]], \"s\", {\"k\": [-1]}]";
+    JSON *trees[4] = {json_load("json-test.json"), json_parse(text, strlen(text)), json_new_str("scalar root"),
+                      json_load_lazy("json-test.json")};
+    size_t budgets[4] = {1, 2, 7, (size_t)-1};
+
+    for (int t = 0; t < 4; t++)
+    {
+        ASSERT_TRUE(trees[t]);
+        buf_t expect;
+        ASSERT_EQ(0, save_text(&expect, trees[t]));
+        for (int b = 0; b < 4; b++)
+        {
+            buf_t result;
+            int steps = save_steps(&result, trees[t], budgets[b]);
+            ASSERT_TRUE(steps > 0);
+            if (budgets[b] == 1 && t != 2)
+                EXPECT_TRUE(steps > 10);
+            ASSERT_STREQ(expect.str, result.str);
+            free(result.str);
+        }
+        free(expect.str);
+        json_free(trees[t]);
+    }
+}
+
+// 测试大的打包数组按元素分步输出：数组作为根节点、数组元素和最后一个对象成员，结果与 json_save 相同
+TEST(json_save_step, packed)
+{
+    JSON *root = json_new(JSON_ARR), *obj = json_new(JSON_OBJ), *inner = json_new(JSON_ARR);
+    JSON *ints = json_new(JSON_ARR), *bools = json_new(JSON_ARR), *last = json_new(JSON_ARR);
+    ASSERT_TRUE(root && obj && inner && ints && bools && last);
+    for (int i = 0; i < 5000; i++)
+    {
+        ASSERT_TRUE(json_arr_add_num(root, i + 0.5) > 0);
+        ASSERT_TRUE(json_arr_add_int(ints, i) > 0);
+        ASSERT_TRUE(json_arr_add_bool(bools, i % 3 == 0) > 0);
+        ASSERT_TRUE(json_arr_add_num(last, -i) > 0);
+    }
+    ASSERT_TRUE(json_add_element(inner, ints) && json_add_element(inner, bools));
+    ASSERT_TRUE(json_add_member(obj, "inner", inner) && json_add_member(obj, "last", last));
+
+    JSON *trees[2] = {root, obj};
+    for (int t = 0; t < 2; t++)
+    {
+        buf_t expect, result;
+        ASSERT_EQ(0, save_text(&expect, trees[t]));
+        int steps = save_steps(&result, trees[t], 7);
+        // 每个元素都计入额度，打包数组不能一步输出完
+        EXPECT_TRUE(steps >= 5000 / 7);
+        ASSERT_STREQ(expect.str, result.str);
+        free(result.str);
+        ASSERT_TRUE(save_steps(&result, trees[t], 1) > 5000);
+        ASSERT_STREQ(expect.str, result.str);
+        free(result.str);
+        free(expect.str);
+        json_free(trees[t]);
+    }
+}
+
+// 测试提前结束和打不开文件
+TEST(json_save_step, abort)
+{
+    JSON *json = json_load("json-test.json");
+    ASSERT_TRUE(json);
+    json_saver *s = json_save_begin(json, "test.yml");
+    ASSERT_TRUE(s);
+    EXPECT_EQ(1, json_save_step(s, 3));
+    EXPECT_EQ(-1, json_save_end(s));
+    EXPECT_EQ(-1, json_save_end(NULL));
+    ASSERT_TRUE(json_save_begin(json, "nonexist/test.yml") == NULL);
+    json_free(json);
+}
+
+// 测试嵌套较深时增量保存：栈换到堆上之后暂停和继续，结果与 json_save 相同
+TEST(json_save_step, deep)
+{
+    JSON *root = json_new(JSON_ARR), *cur = root;
+    for (int i = 0; i < 1000; i++)
+    {
+        JSON *next = json_new(i % 2 ? JSON_ARR : JSON_OBJ);
+        ASSERT_TRUE(next);
+        if (json_type(cur) == JSON_ARR)
+            ASSERT_TRUE(json_arr_add_num(cur, i) > 0 && json_add_element(cur, next));
+        else
+            ASSERT_TRUE(json_add_member(cur, "n", json_new_num(i)) && json_add_member(cur, "k", next));
+        cur = next;
+    }
+    buf_t expect, result;
+    ASSERT_EQ(0, save_text(&expect, root));
+    ASSERT_TRUE(save_steps(&result, root, 3) > 600);
+    ASSERT_STREQ(expect.str, result.str);
+    free(expect.str);
+    free(result.str);
+    json_free(root);
+}
+
+//----------------------------------------------------------------------------------------------------
+//  json_walk
+//----------------------------------------------------------------------------------------------------
+
+typedef struct walk_log
+{
+    char text[256]; // 依次记录 enter 和 leave 的值
+    size_t len;
+    int enters;
+    U32 skip_depth; // 深度达到该值的数组和对象跳过子成员
+    int abort_at;   // 第几次 enter 时终止遍历
+} walk_log;
+
+static int log_enter(void *ctx, const JSON *json, json_walk_pos *pos)
+{
+    walk_log *log = (walk_log *)ctx;
+    if (++log->enters == log->abort_at)
+        return -3;
+    // 父节点在 enter 中设置的 data 在子成员中可见
+    if (pos->up && pos->up->data != (void *)pos->parent)
+        return -2;
+    pos->data = (void *)json;
+    if (pos->key)
+        log->len += snprintf(log->text + log->len, sizeof(log->text) - log->len, "%s=", pos->key->str);
+    if (json_type(json) == JSON_ARR || json_type(json) == JSON_OBJ)
+    {
+        log->len += snprintf(log->text + log->len, sizeof(log->text) - log->len, "%c%u ",
+                             json_type(json) == JSON_ARR ? '[' : '{', pos->depth);
+        return pos->depth >= log->skip_depth ? JSON_WALK_SKIP : 0;
+    }
+    log->len += snprintf(log->text + log->len, sizeof(log->text) - log->len, "%u.%u ", pos->depth, pos->index);
+    return 0;
+}
+static int log_leave(void *ctx, const JSON *json, const json_walk_pos *pos)
+{
+    walk_log *log = (walk_log *)ctx;
+    (void)pos;
+    log->len += snprintf(log->text + log->len, sizeof(log->text) - log->len, "%c ", json_type(json) == JSON_ARR ? ']' : '}');
+    return 0;
+}
+
+// 测试访问顺序、位置信息、跳过子成员和终止遍历
+TEST(json_walk, order)
+{
+    const char *text = "{\"a\": 1, \"b\": [true, {\"c\": \"x\"}], \"d\": [1, 2, 3], \"e\": {}}";
+    JSON *json = json_parse(text, strlen(text));
+    ASSERT_TRUE(json);
+    json_visitor v = {log_enter, log_leave};
+
+    walk_log log = {{0}, 0, 0, 100, 0};
+    EXPECT_EQ(0, json_walk(json, &v, &log));
+    ASSERT_STREQ("{0 a=1.0 b=[1 2.0 {2 c=3.0 } ] d=[1 ] e={1 } } ", log.text);
+    EXPECT_EQ(8, log.enters);
+
+    // 跳过的数组和对象不再调用 leave
+    memset(&log, 0, sizeof(log));
+    log.skip_depth = 1;
+    EXPECT_EQ(0, json_walk(json, &v, &log));
+    ASSERT_STREQ("{0 a=1.0 b=[1 d=[1 e={1 } ", log.text);
+    EXPECT_EQ(5, log.enters);
+
+    memset(&log, 0, sizeof(log));
+    log.skip_depth = 100;
+    log.abort_at = 4;
+    EXPECT_EQ(-3, json_walk(json, &v, &log));
+    EXPECT_EQ(4, log.enters);
+    ASSERT_STREQ("{0 a=1.0 b=[1 ", log.text);
+    json_free(json);
+}
+
+static int count_elements(void *ctx, const JSON *json, json_walk_pos *pos)
+{
+    (void)pos;
+    if (json_type(json) == JSON_ARR)
+        *(int *)ctx += json_arr_count(json);
+    return 0;
+}
+
+// 测试延迟加载的子树在 enter 之前已经展开
+TEST(json_walk, lazy)
+{
+    JSON *json = json_load_lazy("json-test.json");
+    JSON *full = json_load("json-test.json");
+    json_visitor v = {count_elements, NULL};
+    int lazy = 0, loaded = 0;
+    ASSERT_TRUE(json && full);
+    EXPECT_EQ(0, json_walk(json, &v, &lazy));
+    EXPECT_EQ(0, json_walk(full, &v, &loaded));
+    EXPECT_TRUE(loaded > 0);
+    EXPECT_EQ(loaded, lazy);
+    json_free(json);
+    json_free(full);
+}
+
+// 测试嵌套很深的树：释放、统计、紧凑拷贝和冻结都不递归
+TEST(json_walk, deep)
+{
+    const int depth = 200000;
+    JSON *root = json_new(JSON_ARR), *cur = root;
+    for (int i = 0; i < depth; i++)
+    {
+        JSON *next = json_new(i % 2 ? JSON_ARR : JSON_OBJ);
+        ASSERT_TRUE(next);
+        if (json_type(cur) == JSON_ARR)
+            ASSERT_TRUE(json_add_element(cur, next));
+        else
+            ASSERT_TRUE(json_add_member(cur, "k", next));
+        cur = next;
+    }
+    json_mem_stats st;
+    EXPECT_EQ(0, json_stats(root, &st));
+    EXPECT_EQ(depth, (int)st.max_depth);
+    EXPECT_EQ(depth + 1, (int)st.nodes);
+
+    JSON *copy = json_compact(root);
+    ASSERT_TRUE(copy);
+    EXPECT_EQ(0, json_stats(copy, &st));
+    EXPECT_EQ(depth, (int)st.max_depth);
+    json_free(copy);
+
+    ASSERT_EQ(0, json_freeze(root, "test.frz"));
+    JSON *frozen = json_open_frozen("test.frz");
+    ASSERT_TRUE(frozen);
+    EXPECT_EQ(0, json_stats(frozen, &st));
+    EXPECT_EQ(depth, (int)st.max_depth);
+    json_free(frozen);
+    remove("test.frz");
+    json_free(root);
+}
+
 //----------------------------------------------------------------------------------------------------
 //  json_get
 //----------------------------------------------------------------------------------------------------